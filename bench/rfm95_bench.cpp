@@ -0,0 +1,426 @@
+/**
+ * @file rfm95_bench.cpp
+ * @brief Latency and throughput benchmarks of the SPI backends and the RFM95 driver
+ *
+ * Every metric is reported per backend with its median, 99th percentile and
+ * mean, plus the heap allocations made per operation, as JSON or CSV.
+ * Throughput metrics are timed like the others and converted on output, so
+ * their p99 is the throughput at the p99 latency, the slow tail, and their
+ * mean is the total bytes over the total time:
+ *
+ * @code
+ * rfm95_bench --backend sim --backend sim-ch341 --format csv > results.csv
+ * rfm95_bench --backend ch341 --index 0 --iterations 500
+ * @endcode
+ *
+ * RX drain times need injected packets and are only measured on the
+ * simulator backends.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "RFM95.hpp"
+#include "SPIInterface.hpp"
+#include "SimulatedSX127x.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Every heap allocation of the process, operator new is replaced below
+static std::atomic<uint64_t> allocation_count(0);
+
+void *operator new(size_t size)
+{
+    allocation_count++;
+    void *pointer = std::malloc(size ? size : 1);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Samples of one metric
+ */
+struct Metric
+{
+    std::string name;
+    std::string unit;
+    std::vector<double> samples;  ///< Latencies in us, also for throughput metrics
+    double allocations_per_op;
+    double bytes_per_op = 0.0;    ///< Non-zero for throughput metrics, reported in bytes/s
+};
+
+/**
+ * @brief Figures reported for a metric
+ */
+struct Summary
+{
+    double p50;
+    double p99;
+    double mean;
+};
+
+struct BackendResult
+{
+    std::string backend;
+    bool available;
+    std::vector<Metric> metrics;
+};
+
+static double elapsedUs(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static double percentile(std::vector<double> samples, double fraction)
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    return samples[index];
+}
+
+static double mean(const std::vector<double> &samples)
+{
+    double sum = 0.0;
+    for (double sample : samples)
+    {
+        sum += sample;
+    }
+    return samples.empty() ? 0.0 : sum / samples.size();
+}
+
+static Summary summarize(const Metric &metric)
+{
+    Summary summary = {percentile(metric.samples, 0.50), percentile(metric.samples, 0.99), mean(metric.samples)};
+    if (metric.bytes_per_op > 0.0)
+    {
+        // Higher latency is lower throughput, so the p99 latency gives the slow tail
+        summary.p50 = summary.p50 > 0.0 ? metric.bytes_per_op * 1e6 / summary.p50 : 0.0;
+        summary.p99 = summary.p99 > 0.0 ? metric.bytes_per_op * 1e6 / summary.p99 : 0.0;
+        summary.mean = summary.mean > 0.0 ? metric.bytes_per_op * 1e6 / summary.mean : 0.0;
+    }
+    return summary;
+}
+
+/**
+ * @brief Time an operation, counting the allocations made inside it
+ */
+template <typename Operation>
+static Metric measure(const std::string &name, int iterations, Operation operation)
+{
+    Metric metric;
+    metric.name = name;
+    metric.unit = "us";
+    metric.samples.reserve(iterations);
+
+    uint64_t allocations = allocation_count;
+    for (int i = 0; i < iterations; i++)
+    {
+        Clock::time_point start = Clock::now();
+        operation();
+        metric.samples.push_back(elapsedUs(start, Clock::now()));
+    }
+    // The reserve above keeps push_back out of the count
+    metric.allocations_per_op = iterations ? static_cast<double>(allocation_count - allocations) / iterations : 0.0;
+    return metric;
+}
+
+static BackendResult runBackend(const std::string &backend, int device_index, int iterations)
+{
+    BackendResult result;
+    result.backend = backend;
+    result.available = false;
+
+    int slow_iterations = std::max(3, iterations / 20);
+
+    // begin() on a fresh instance each time, reopening the adapter on hardware
+    std::vector<double> begin_samples;
+    uint64_t begin_allocations = 0;
+    for (int i = 0; i < slow_iterations; i++)
+    {
+        std::unique_ptr<SPIInterface> spi = SPIFactory::createSPIInterface(backend, device_index);
+        if (!spi)
+        {
+            return result;
+        }
+        RFM95 radio(std::move(spi));
+        uint64_t allocations = allocation_count;
+        Clock::time_point start = Clock::now();
+        if (!radio.begin())
+        {
+            std::cerr << backend << ": begin() failed" << std::endl;
+            return result;
+        }
+        begin_samples.push_back(elapsedUs(start, Clock::now()));
+        begin_allocations += allocation_count - allocations;
+        radio.end();
+    }
+
+    std::unique_ptr<SPIInterface> spi = SPIFactory::createSPIInterface(backend, device_index);
+    SimulatedSX127x *sim = dynamic_cast<SimulatedSX127x *>(spi.get());
+    RFM95 radio(std::move(spi));
+    if (!radio.begin())
+    {
+        std::cerr << backend << ": begin() failed" << std::endl;
+        return result;
+    }
+    result.available = true;
+    result.metrics.push_back(Metric{"begin", "us", begin_samples,
+                                    static_cast<double>(begin_allocations) / slow_iterations});
+
+    radio.setFrequency(868.1);
+    radio.setSpreadingFactor(7);
+    radio.setBandwidth(125.0);
+
+    // Register accesses go to the bus, not the shadow copy. Writes are timed as the
+    // caller sees them, and the driver queues them on backends that can.
+    radio.setRegisterCache(false);
+    result.metrics.push_back(measure("register_read", iterations, [&radio]() {
+        radio.readRegister(RFM95::REG_VERSION);
+    }));
+    result.metrics.push_back(measure("register_write", iterations, [&radio]() {
+        radio.writeRegister(RFM95::REG_SYNC_WORD, 0x12);
+    }));
+
+    // Full FIFO bursts, reported as bytes per second; the read after a write waits for it to complete
+    uint8_t buffer[255];
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        buffer[i] = static_cast<uint8_t>(i);
+    }
+    Metric fifo_write = measure("fifo_write_throughput", iterations, [&radio, &buffer]() {
+        radio.writeRegister(RFM95::REG_FIFO_ADDR_PTR, 0);
+        radio.writeFifo(buffer, sizeof(buffer));
+        radio.readRegister(RFM95::REG_FIFO_ADDR_PTR);
+    });
+    Metric fifo_read = measure("fifo_read_throughput", iterations, [&radio, &buffer]() {
+        radio.writeRegister(RFM95::REG_FIFO_ADDR_PTR, 0);
+        radio.readFifo(buffer, sizeof(buffer));
+    });
+    for (Metric *metric : {&fifo_write, &fifo_read})
+    {
+        metric->unit = "bytes/s";
+        metric->bytes_per_op = sizeof(buffer);
+        result.metrics.push_back(*metric);
+    }
+    radio.setRegisterCache(true);
+    radio.refreshRegisterCache();
+
+    // From the send() call to the chip entering TX. The simulator knows the exact
+    // start; on hardware it is the whole send() minus the time on air, which also
+    // includes the TxDone detection latency.
+    std::vector<uint8_t> payload(buffer, buffer + 16);
+    uint32_t airtime_us = radio.getTimeOnAir(payload.size());
+    if (sim)
+    {
+        sim->setAirtimeScale(0.0);
+        sim->takeTransmissions();
+    }
+    Metric send_setup;
+    send_setup.name = "send_setup_to_tx_start";
+    send_setup.unit = "us";
+    uint64_t send_allocations = 0;
+    for (int i = 0; i < slow_iterations; i++)
+    {
+        uint64_t allocations = allocation_count;
+        Clock::time_point start = Clock::now();
+        bool sent = radio.send(payload);
+        Clock::time_point end = Clock::now();
+        send_allocations += allocation_count - allocations;
+        if (!sent)
+        {
+            std::cerr << backend << ": send() failed" << std::endl;
+            continue;
+        }
+
+        if (sim)
+        {
+            std::vector<SimulatedSX127x::Transmission> sent_packets = sim->takeTransmissions();
+            uint64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+            if (!sent_packets.empty())
+            {
+                send_setup.samples.push_back((sent_packets.back().start_ns - start_ns) / 1000.0);
+            }
+        }
+        else
+        {
+            send_setup.samples.push_back(std::max(0.0, elapsedUs(start, end) - airtime_us));
+        }
+    }
+    send_setup.allocations_per_op = static_cast<double>(send_allocations) / slow_iterations;
+    result.metrics.push_back(send_setup);
+
+    // Moving one waiting packet from the chip into the RX ring
+    if (sim)
+    {
+        radio.startRxEngine(false);
+        for (size_t size : {16, 64, 128, 255})
+        {
+            RFM95::RxPacket packet;
+            Metric drain;
+            drain.name = "rx_drain_" + std::to_string(size);
+            drain.unit = "us";
+            drain.samples.reserve(iterations);
+            uint64_t allocations = 0;
+            for (int i = 0; i < iterations; i++)
+            {
+                sim->injectPacket(buffer, size);
+                uint64_t before = allocation_count;
+                Clock::time_point start = Clock::now();
+                radio.serviceReceiver();
+                drain.samples.push_back(elapsedUs(start, Clock::now()));
+                allocations += allocation_count - before;
+                radio.readPacket(packet);
+            }
+            drain.allocations_per_op = static_cast<double>(allocations) / iterations;
+            result.metrics.push_back(drain);
+        }
+        radio.stopRxEngine();
+    }
+
+    radio.end();
+    return result;
+}
+
+static void printJson(const std::vector<BackendResult> &results, int iterations)
+{
+    std::ostringstream out;
+    out << "{\n  \"iterations\": " << iterations << ",\n  \"backends\": [";
+    for (size_t b = 0; b < results.size(); b++)
+    {
+        const BackendResult &result = results[b];
+        out << (b ? "," : "") << "\n    {\n      \"backend\": \"" << result.backend << "\",\n"
+            << "      \"available\": " << (result.available ? "true" : "false") << ",\n"
+            << "      \"metrics\": [";
+        for (size_t m = 0; m < result.metrics.size(); m++)
+        {
+            const Metric &metric = result.metrics[m];
+            Summary summary = summarize(metric);
+            out << (m ? "," : "") << "\n        {\"name\": \"" << metric.name << "\", \"unit\": \"" << metric.unit
+                << "\", \"samples\": " << metric.samples.size()
+                << ", \"p50\": " << summary.p50
+                << ", \"p99\": " << summary.p99
+                << ", \"mean\": " << summary.mean
+                << ", \"allocations_per_op\": " << metric.allocations_per_op << "}";
+        }
+        out << (result.metrics.empty() ? "" : "\n      ") << "]\n    }";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << out.str();
+}
+
+static void printCsv(const std::vector<BackendResult> &results)
+{
+    std::cout << "backend,metric,unit,samples,p50,p99,mean,allocations_per_op\n";
+    for (const BackendResult &result : results)
+    {
+        for (const Metric &metric : result.metrics)
+        {
+            Summary summary = summarize(metric);
+            std::cout << result.backend << "," << metric.name << "," << metric.unit << ","
+                      << metric.samples.size() << "," << summary.p50 << "," << summary.p99 << ","
+                      << summary.mean << "," << metric.allocations_per_op << "\n";
+        }
+    }
+}
+
+static void printUsage()
+{
+    std::cerr << "Usage: rfm95_bench [--backend TYPE]... [--index N] [--iterations N] [--format json|csv]" << std::endl;
+    std::cerr << "  TYPE: sim (default), sim-ch341, sim-spidev, ch341 or linux" << std::endl;
+    std::cerr << "  --index: CH341 device index, or the spidev chip select (/dev/spidev0.N)" << std::endl;
+    std::cerr << "  --iterations: samples per fast metric (default 1000)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> backends;
+    int device_index = 0;
+    int iterations = 1000;
+    std::string format = "json";
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            printUsage();
+            return 1;
+        }
+        if (arg == "--backend")
+        {
+            backends.push_back(argv[++i]);
+        }
+        else if (arg == "--index")
+        {
+            device_index = std::atoi(argv[++i]);
+        }
+        else if (arg == "--iterations")
+        {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--format")
+        {
+            format = argv[++i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (format != "json" && format != "csv")
+    {
+        printUsage();
+        return 1;
+    }
+    if (backends.empty())
+    {
+        backends.push_back("sim");
+    }
+
+    std::vector<BackendResult> results;
+    for (const std::string &backend : backends)
+    {
+        results.push_back(runBackend(backend, device_index, iterations));
+        if (!results.back().available)
+        {
+            std::cerr << backend << ": backend not available, skipped" << std::endl;
+        }
+    }
+
+    if (format == "csv")
+    {
+        printCsv(results);
+    }
+    else
+    {
+        printJson(results, iterations);
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "RFM95.hpp"
+#include "PacketCapture.hpp"
 #include <iostream>
 #include <string>
 #include <thread>
@@ -17,13 +18,14 @@ void signal_handler(int sig)
 
 void print_usage()
 {
-    std::cout << "Usage: rfm95_example [tx|rx] <device_index> [message]" << std::endl;
+    std::cout << "Usage: rfm95_example [tx|rx] <device_index> [message|capture.pcap]" << std::endl;
     std::cout << "  tx: Transmitter mode (message required)" << std::endl;
-    std::cout << "  rx: Receiver mode" << std::endl;
+    std::cout << "  rx: Receiver mode, optionally recording packets to a LoRaTap pcap file" << std::endl;
     std::cout << "  device_index: CH341 device index (0, 1, ...)" << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  rfm95_example tx 0 \"Hello world\"  # Send from first device" << std::endl;
     std::cout << "  rfm95_example rx 1                # Receive from second device" << std::endl;
+    std::cout << "  rfm95_example rx 0 rx.pcap        # Receive and capture for Wireshark" << std::endl;
     std::cout << "  rfm95_example test 0              # Test first device" << std::endl;
 }
 
@@ -102,18 +104,57 @@ int main(int argc, char **argv)
         // Receiver mode
         std::cout << "\nReceiver mode (device #" << device_index << "). Press Ctrl+C to exit." << std::endl;
 
-        while (!stop_flag)
+        // Stay in RX and let the engine queue packets while we print
+        radio.startRxEngine();
+
+        PacketCapture capture(PacketCapture::Options(argc >= 4 ? argv[3] : ""));
+        RadioProfile profile = radio.getProfile();
+        bool capturing = argc >= 4 && capture.start();
+        if (capturing)
         {
-            std::vector<uint8_t> data = radio.receive(3.0); // 3 second timeout
+            // Damaged frames belong in the capture as well
+            radio.setKeepCrcErrors(true);
+            std::cout << "Capturing to " << capture.getCurrentPath() << std::endl;
+        }
 
-            if (!data.empty())
+        RFM95::RxPacket packet;
+        while (!stop_flag)
+        {
+            if (!radio.readPacket(packet))
             {
-                std::string message(data.begin(), data.end());
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
 
-                std::cout << "Message received: \"" << message << "\"" << std::endl;
-                std::cout << "RSSI: " << radio.getRSSI() << " dBm" << std::endl;
-                std::cout << "SNR: " << radio.getSNR() << " dB" << std::endl;
+            if (capturing)
+            {
+                capture.capture(packet, profile);
+            }
+            if (packet.crc_error)
+            {
+                std::cout << "Packet with CRC error (" << static_cast<int>(packet.length) << " bytes)" << std::endl;
+                continue;
             }
+
+            std::string message(packet.data, packet.data + packet.length);
+
+            std::cout << "Message received: \"" << message << "\"" << std::endl;
+            std::cout << "RSSI: " << packet.rssi << " dBm" << std::endl;
+            std::cout << "SNR: " << packet.snr << " dB" << std::endl;
+            std::cout << "Frequency error: " << packet.freq_error << " Hz" << std::endl;
+            std::cout << "Received at: " << packet.timestamp_ns / 1000 << " us (+/- "
+                      << packet.timestamp_uncertainty_ns / 1000 << " us)" << std::endl;
+        }
+
+        radio.stopRxEngine();
+        if (capturing)
+        {
+            capture.stop();
+            std::cout << "Captured " << capture.getWritten() << " packets" << std::endl;
+        }
+        if (radio.getRxDropped() > 0 || radio.getRxCrcErrors() > 0)
+        {
+            std::cout << "Dropped: " << radio.getRxDropped() << ", CRC errors: " << radio.getRxCrcErrors() << std::endl;
         }
     }
     else if (mode == "test")
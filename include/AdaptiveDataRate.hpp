@@ -0,0 +1,254 @@
+/**
+ * @file AdaptiveDataRate.hpp
+ * @brief Per-link data rate selection from received signal quality
+ *
+ * Every packet from a peer adds one link budget sample: its SNR with the
+ * bandwidth and transmit power it was sent with taken out. From the rolling
+ * mean of those samples the engine predicts the SNR each candidate
+ * RadioProfile would see and picks the fastest one that stays a margin
+ * above its spreading factor's demodulation floor, at the lowest power that
+ * does. Profiles are precomputed register images, so switching a link costs
+ * one applyProfile() that only writes the registers that differ.
+ *
+ * Links are assumed to be symmetric: a packet received with a profile was
+ * sent by the peer with the same profile, and the peer hears us as well as
+ * we hear it.
+ *
+ * @code
+ * AdaptiveDataRate adr;
+ * adr.addLadder(868100000, 125000, 7, 12, 14);
+ * adr.addLadder(868100000, 125000, 7, 12, 2);
+ * ...
+ * adr.observe(peer, packet, current);     // From the RX path
+ * radio.applyProfile(adr.getProfile(peer)); // Before talking to the peer
+ * @endcode
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef ADAPTIVE_DATA_RATE_HPP
+#define ADAPTIVE_DATA_RATE_HPP
+
+#include "RFM95.hpp"
+#include "RadioProfile.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+/**
+ * @brief Adaptive data rate engine choosing among precomputed profiles
+ */
+class AdaptiveDataRate
+{
+public:
+    /**
+     * @brief Selection settings
+     */
+    struct Options
+    {
+        size_t window;          ///< Link budget samples averaged per peer
+        size_t min_samples;     ///< Samples needed before leaving the most robust profile
+        float margin_db;        ///< Required SNR above the demodulation floor
+        float hysteresis_db;    ///< Extra margin needed to switch to a faster or lower power profile
+        float noise_figure_db;  ///< Receiver noise figure, for the RSSI based SNR estimate of strong links
+
+        Options()
+            : window(16),
+              min_samples(4),
+              margin_db(5.0f),
+              hysteresis_db(2.0f),
+              noise_figure_db(6.0f)
+        {
+        }
+    };
+
+    /**
+     * @brief Link quality of one peer
+     */
+    struct LinkState
+    {
+        size_t samples;    ///< Samples in the window
+        float rssi_dbm;    ///< Mean packet RSSI
+        float snr_db;      ///< Mean packet SNR as reported by the module
+        float margin_db;   ///< Predicted SNR above the floor with the selected profile
+        size_t profile;    ///< Index of the selected profile
+    };
+
+    /**
+     * @brief Constructor
+     *
+     * @param options Selection settings
+     */
+    explicit AdaptiveDataRate(const Options &options = Options());
+
+    /**
+     * @brief SNR at which a spreading factor still demodulates (SX1276 datasheet, table 13)
+     *
+     * @param sf Spreading factor (6-12)
+     * @return Required SNR in dB
+     */
+    static float requiredSnr(int sf);
+
+    /**
+     * @brief Add a candidate profile
+     *
+     * @param profile The profile
+     * @return Index of the profile, as used by getProfileIndex() and observe()
+     */
+    size_t addProfile(const RadioProfile &profile);
+
+    /**
+     * @brief Add one profile per spreading factor
+     *
+     * @param frequency_hz Carrier frequency in Hz
+     * @param bandwidth_hz Bandwidth in Hz
+     * @param min_sf Fastest spreading factor (7-12)
+     * @param max_sf Slowest spreading factor
+     * @param power_dbm Output power on PA_BOOST
+     * @param sync_word Sync word
+     * @param crc Send and check a payload CRC
+     */
+    void addLadder(uint32_t frequency_hz, uint32_t bandwidth_hz = 125000, int min_sf = 7, int max_sf = 12,
+                   int power_dbm = 14, uint8_t sync_word = 0x12, bool crc = true);
+
+    /**
+     * @brief Get the number of candidate profiles
+     *
+     * @return Profile count
+     */
+    size_t getProfileCount();
+
+    /**
+     * @brief Get a candidate profile
+     *
+     * @param index Profile index
+     * @return The profile
+     */
+    RadioProfile getProfileAt(size_t index);
+
+    /**
+     * @brief Record a packet received from a peer and update its selection
+     *
+     * @param peer Application defined peer address
+     * @param rssi_dbm Packet RSSI
+     * @param snr_db Packet SNR
+     * @param profile Index of the profile the packet was sent with
+     * @return Index of the profile now selected for the peer
+     */
+    size_t observe(uint32_t peer, float rssi_dbm, float snr_db, size_t profile);
+
+    /**
+     * @brief Record a packet from the RX engine
+     *
+     * @param peer Application defined peer address
+     * @param packet Received packet
+     * @param profile Index of the profile the packet was sent with
+     * @return Index of the profile now selected for the peer
+     */
+    size_t observe(uint32_t peer, const RFM95::RxPacket &packet, size_t profile);
+
+    /**
+     * @brief Get the selected profile index of a peer
+     *
+     * @param peer Peer address
+     * @return Profile index; unknown peers get the most robust profile
+     */
+    size_t getProfileIndex(uint32_t peer);
+
+    /**
+     * @brief Get the selected profile of a peer
+     *
+     * @param peer Peer address
+     * @return The profile, to pass to RFM95::applyProfile()
+     */
+    RadioProfile getProfile(uint32_t peer);
+
+    /**
+     * @brief Get transmit options that switch the TX queue to a peer's profile
+     *
+     * @param peer Peer address
+     * @return Options for RFM95::enqueue()
+     */
+    RFM95::TxOptions getTxOptions(uint32_t peer);
+
+    /**
+     * @brief Get a peer's link quality
+     *
+     * @param peer Peer address
+     * @return Link state, all zero except profile for unknown peers
+     */
+    LinkState getLinkState(uint32_t peer);
+
+    /**
+     * @brief Forget a peer, it starts over on the most robust profile
+     *
+     * @param peer Peer address
+     */
+    void reset(uint32_t peer);
+
+private:
+    /**
+     * @brief A profile with the figures selection needs, computed once
+     */
+    struct Candidate
+    {
+        RadioProfile profile;
+        float required_snr_db;   ///< Demodulation floor of its spreading factor
+        float bandwidth_db;      ///< 10 log10(bandwidth / 125 kHz), the noise it lets in
+        float noise_floor_dbm;   ///< Thermal noise plus noise figure over the bandwidth
+        int power_dbm;
+        uint32_t airtime_us;     ///< Time on air of a reference packet, orders the candidates
+    };
+
+    /**
+     * @brief Rolling samples of one peer
+     */
+    struct Peer
+    {
+        std::vector<float> budget;  ///< SNR + bandwidth_db - power_dbm of each sample, options.window entries
+        std::vector<float> rssi;
+        std::vector<float> snr;
+        size_t next;                ///< Slot of the next sample
+        size_t samples;
+        size_t profile;             ///< Selected profile index
+    };
+
+    Options options;
+    std::mutex mutex;
+    std::vector<Candidate> candidates;
+    std::vector<size_t> order;  ///< Candidate indices, fastest first, lower power first at equal speed
+    std::unordered_map<uint32_t, Peer> peers;
+
+    /**
+     * @brief Most robust candidate: slowest, highest power, mutex held
+     *
+     * @return Candidate index
+     */
+    size_t fallback() const;
+
+    /**
+     * @brief Mean link budget of a peer, mutex held
+     */
+    static float mean(const std::vector<float> &values, size_t samples);
+
+    /**
+     * @brief Predicted margin of a candidate, mutex held
+     *
+     * @param budget Mean link budget
+     * @param candidate Candidate index
+     * @return SNR above the floor in dB
+     */
+    float marginOf(float budget, size_t candidate) const;
+
+    /**
+     * @brief Pick the profile for a peer from its samples, mutex held
+     *
+     * @param peer The peer
+     */
+    void select(Peer &peer);
+};
+
+#endif // ADAPTIVE_DATA_RATE_HPP
@@ -0,0 +1,87 @@
+/**
+ * @file BitReverse.hpp
+ * @brief Bit order reversal for LSB-first SPI devices
+ * 
+ * The CH341 always shifts the most significant bit first. For LSB-first
+ * devices every byte is mirrored on the host before it is sent and after it
+ * is received. These helpers work on whole buffers so the per-byte cost stays
+ * out of the USB packing loops.
+ * 
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef BIT_REVERSE_HPP
+#define BIT_REVERSE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace BitReverse
+{
+    /**
+     * @brief Mirror the bits of a byte (bit 0 becomes bit 7)
+     * 
+     * Usable in constant expressions; at run time prefer reverse().
+     * 
+     * @param byte Byte to mirror
+     * @return Mirrored byte
+     */
+    constexpr uint8_t reverseByte(uint8_t byte)
+    {
+        uint32_t b = byte;
+        b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+        b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+        b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+        return static_cast<uint8_t>(b);
+    }
+
+    /**
+     * @brief 256-entry lookup table built at compile time
+     */
+    struct Table
+    {
+        uint8_t value[256];
+
+        constexpr Table() : value()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                value[i] = reverseByte(static_cast<uint8_t>(i));
+            }
+        }
+    };
+
+    /**
+     * @brief Mirror the bits of a byte using the lookup table
+     * 
+     * @param byte Byte to mirror
+     * @return Mirrored byte
+     */
+    inline uint8_t reverse(uint8_t byte)
+    {
+        static constexpr Table table{};
+        return table.value[byte];
+    }
+
+    /**
+     * @brief Mirror the bits of every byte of a buffer in place
+     * 
+     * Uses NEON or SSE byte operations when the target supports them.
+     * 
+     * @param buffer Buffer to convert
+     * @param length Number of bytes
+     */
+    void reverseBits(uint8_t *buffer, size_t length);
+
+    /**
+     * @brief Copy a buffer, mirroring the bits of every byte
+     * 
+     * @param src Source bytes
+     * @param dst Destination (may equal src, must not otherwise overlap)
+     * @param length Number of bytes
+     */
+    void reverseBits(const uint8_t *src, uint8_t *dst, size_t length);
+}
+
+#endif // BIT_REVERSE_HPP
@@ -46,6 +46,12 @@ namespace CH341Config
     constexpr uint16_t MAX_PACKETS = 256;
     constexpr uint16_t MAX_PACKET_LEN = PACKET_LENGTH * MAX_PACKETS;
 
+    // Asynchronous pipeline
+    constexpr uint8_t ASYNC_MAX_SPI_PACKETS = 16; // SPI stream packets per queue slot (496 bytes)
+    constexpr uint8_t ASYNC_MAX_TRANSACTIONS = 16; // CS-framed transactions packed into one queue slot
+    constexpr uint8_t DEFAULT_QUEUE_DEPTH = 4;
+    constexpr unsigned int EVENT_LOOP_TIMEOUT_MS = 100;
+
     // Pin mapping for CH341F
     constexpr uint8_t PIN_MISO = 0x02;
     constexpr uint8_t PIN_MOSI = 0x04;
@@ -55,6 +61,7 @@ namespace CH341Config
     // Commands
     constexpr uint8_t CMD_SPI_STREAM = 0xA8;
     constexpr uint8_t CMD_UIO_STREAM = 0xAB;
+    constexpr uint8_t CMD_UIO_STM_IN = 0x00;  // Returns one byte with the D0-D7 levels
     constexpr uint8_t CMD_UIO_STM_OUT = 0x80;
     constexpr uint8_t CMD_UIO_STM_DIR = 0x40;
     constexpr uint8_t CMD_UIO_STM_END = 0x20;
@@ -62,8 +69,22 @@ namespace CH341Config
     constexpr uint8_t CMD_I2C_STM_SET = 0x60;
     constexpr uint8_t CMD_I2C_STM_END = 0x00;
 
+    // Stream rate codes for CMD_I2C_STM_SET (bits 1-0), the SPI clock follows them
+    constexpr uint8_t STM_SPEED_MASK = 0x03;
+    constexpr uint8_t STM_SPEED_20K = 0x00;
+    constexpr uint8_t STM_SPEED_100K = 0x01;
+    constexpr uint8_t STM_SPEED_400K = 0x02;
+    constexpr uint8_t STM_SPEED_750K = 0x03;
+
+    // INT# monitoring: bit of the UIO input byte watched by default, and the
+    // dedicated poll interval, which backs off while nothing happens
+    constexpr uint8_t DEFAULT_INT_PIN = 6;
+    constexpr unsigned int INT_POLL_MIN_MS = 1;
+    constexpr unsigned int INT_POLL_MAX_MS = 10;
+
     // Timeouts
     constexpr unsigned int USB_TIMEOUT = 1000;
+    constexpr unsigned int DRAIN_TIMEOUT = 10; // Stale IN data left behind by a failed stream
 }
 
 #endif // CH341_CONFIG_HPP
\ No newline at end of file
@@ -33,6 +33,13 @@
 #include <vector>
 #include <string>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class USBManager;
 
 /**
  * @class CH341SPI
@@ -40,12 +47,38 @@
  */
 class CH341SPI : public SPIInterface {
 public:
+    /**
+     * @brief Stream rate codes of the CH341, named by their nominal I2C rate.
+     */
+    enum class Speed : uint8_t {
+        Low = 0,      ///< 20 kHz
+        Standard = 1, ///< 100 kHz (default)
+        Fast = 2,     ///< 400 kHz
+        High = 3      ///< 750 kHz
+    };
+
+    /**
+     * @brief Test run at each rate by probeSpeed().
+     *
+     * Returns true if the attached device answered correctly at the current rate.
+     */
+    using SpeedProbe = std::function<bool(SPIInterface &spi)>;
+
     /**
      * @brief Constructor for CH341SPI.
      * @param device_index Index of the CH341 device to use (default is 0).
      * @param lsb_first Set to true if least significant bit should be sent first (default is false).
+     * @param speed Stream rate (default is Speed::Standard).
+     */
+    CH341SPI(int device_index = 0, bool lsb_first = false, Speed speed = Speed::Standard);
+
+    /**
+     * @brief Constructor for CH341SPI selecting the adapter by USB topology path or serial number.
+     * @param device_path Path as reported by USBManager::listDevices() (e.g. "1-1.4") or serial number.
+     * @param lsb_first Set to true if least significant bit should be sent first (default is false).
+     * @param speed Stream rate (default is Speed::Standard).
      */
-    CH341SPI(int device_index = 0, bool lsb_first = false);
+    CH341SPI(const std::string &device_path, bool lsb_first = false, Speed speed = Speed::Standard);
 
     /**
      * @brief Destructor for CH341SPI.
@@ -71,6 +104,161 @@ public:
      */
     std::vector<uint8_t> transfer(const std::vector<uint8_t>& write_data, size_t read_length = 0);
 
+    /**
+     * @brief Transfers data over SPI using caller-owned buffers.
+     * @param tx Bytes to clock out first.
+     * @param tx_len Number of bytes in tx.
+     * @param rx Destination for the bytes read after tx (may be null if rx_len is 0).
+     * @param rx_len Number of bytes to read after tx.
+     * @return True if the transfer succeeded, false otherwise.
+     */
+    bool transfer(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) override;
+
+    /**
+     * @brief Callback invoked when an asynchronous transaction completes.
+     * @param success True if every USB transfer of the transaction succeeded.
+     * @param data Bytes read after the write phase (valid only during the call).
+     * @param length Number of bytes in data.
+     */
+    using TransferCallback = std::function<void(bool success, const uint8_t *data, size_t length)>;
+
+    /**
+     * @brief Submits a CS-framed SPI transaction without waiting for it.
+     *
+     * Blocks only while all queue slots are in use. The callback runs on the
+     * libusb event thread, so it must not block.
+     *
+     * @param tx Bytes to clock out first (copied before returning).
+     * @param tx_len Number of bytes in tx.
+     * @param rx_len Number of bytes to read after tx.
+     * @param callback Completion callback (may be empty).
+     * @return True if the transaction was submitted, false otherwise.
+     */
+    bool transferAsync(const uint8_t *tx, size_t tx_len, size_t rx_len, TransferCallback callback);
+
+    /**
+     * @brief Executes several CS-framed transactions as one submission.
+     *
+     * The transactions are packed into as few queue slots as possible. Within
+     * a slot, chip select is toggled between transactions by UIO packets and
+     * every USB transfer is submitted back to back, so the whole batch costs
+     * about one USB round trip. Batches without read phases return as soon as
+     * they are submitted; errors are then reported by flush().
+     *
+     * @param transactions The transactions, executed in order.
+     * @param count Number of transactions.
+     * @return True if every transaction succeeded (or was submitted), false otherwise.
+     */
+    bool transferBatch(const Transaction *transactions, size_t count) override;
+
+    /**
+     * @brief Queues a write-only SPI transaction on the asynchronous pipeline.
+     * @param data The data to write (copied before returning).
+     * @param length The number of bytes to write.
+     * @return True if the transaction was submitted, false otherwise.
+     */
+    bool queueWrite(const uint8_t *data, size_t length) override;
+
+    /**
+     * @brief Waits until every queued transaction has completed.
+     * @return True if all transactions since the last flush succeeded, false otherwise.
+     */
+    bool flush() override;
+
+    /**
+     * @brief Sets how many transactions may be in flight at once.
+     *
+     * Waits for outstanding transactions before resizing the pool when the device is open.
+     *
+     * @param depth Number of queue slots (minimum 1).
+     */
+    void setQueueDepth(size_t depth);
+
+    /**
+     * @brief Get the number of transactions that may be in flight at once
+     *
+     * @return Queue depth
+     */
+    size_t getQueueDepth() const {
+        return queue_depth;
+    }
+
+    /**
+     * @brief Sets the stream rate.
+     *
+     * Takes effect immediately when the device is open, after queued
+     * transactions have completed, and on every later open().
+     *
+     * @param speed The rate.
+     * @return True if the rate was applied (or stored while closed), false otherwise.
+     */
+    bool setSpeed(Speed speed);
+
+    /**
+     * @brief Get the stream rate
+     *
+     * @return Current rate
+     */
+    Speed getSpeed() const {
+        return speed;
+    }
+
+    /**
+     * @brief Selects the fastest rate at which a probe keeps passing.
+     *
+     * Steps up from Speed::Low and stops at the first rate that fails, then
+     * settles on the last one that passed. When even Speed::Low fails the
+     * previous rate is restored.
+     *
+     * @param probe The test to run at each rate.
+     * @return True if a passing rate was found, false otherwise or if the device is closed.
+     */
+    bool probeSpeed(const SpeedProbe &probe);
+
+    /**
+     * @brief Sets a probe that open() runs through probeSpeed().
+     *
+     * A failing probe does not fail open(); the requested rate stays in use.
+     *
+     * @param probe The test (empty to open at the configured rate).
+     */
+    void setSpeedProbe(SpeedProbe probe) {
+        speed_probe = std::move(probe);
+    }
+
+    /**
+     * @brief Skips the settling delay after the pin setup in open() and close().
+     *
+     * The delay mirrors the original Python driver; the pin command has
+     * completed once its bulk transfer returns, so boards with a direct
+     * connection to the radio do not need it.
+     *
+     * @param enable True to skip the delay.
+     */
+    void setFastOpen(bool enable) {
+        fast_open = enable;
+    }
+
+    /**
+     * @brief Builds a probe that writes patterns to a register and reads them back.
+     *
+     * Uses the common convention of address bit 7 set for a write, as in the
+     * SX127x. The register's original value is restored afterwards.
+     *
+     * @param address A read/write register with no side effects (e.g. 0x39, the SX127x sync word).
+     * @param rounds Number of patterns written per rate.
+     * @return The probe.
+     */
+    static SpeedProbe registerEchoProbe(uint8_t address, int rounds = 8);
+
+    /**
+     * @brief Selects the fastest rate not above a frequency.
+     *
+     * @param hz Requested rate in Hz; anything below 100 kHz selects Speed::Low.
+     * @return The rate.
+     */
+    static Speed speedForFrequency(uint32_t hz);
+
     /**
      * @brief Writes a digital value to a specified pin.
      * @param pin The pin number.
@@ -97,14 +285,30 @@ public:
     /**
      * @brief Configure interrupt settings for a pin
      * 
-     * @param pin The pin number
+     * Equivalent to configureInterrupt(pin, InterruptEdge::Both) when enabling.
+     * 
+     * @param pin Bit of the UIO input byte (0-7, D0-D7)
      * @param enable True to enable the interrupt, false to disable it
      * @return True if the operation was successful, false otherwise
      */
-    bool configureInterrupt(uint8_t pin, bool enable) override {
-        // CH341 doesn't support native interrupts, would need external handling
-        return false;
-    }
+    bool configureInterrupt(uint8_t pin, bool enable) override;
+
+    /**
+     * @brief Selects the monitored input and its triggering edges
+     * 
+     * The CH341 has no interrupt endpoint, so the input is sampled: every
+     * transaction reads the pins in the UIO packet that releases chip select,
+     * and the monitoring thread issues a dedicated read only when the bus has
+     * been idle for the poll interval. That interval starts at
+     * CH341Config::INT_POLL_MIN_MS after an edge or bus activity and doubles
+     * up to CH341Config::INT_POLL_MAX_MS. Until this is called, falling edges
+     * of bit CH341Config::DEFAULT_INT_PIN (INT#) are reported.
+     * 
+     * @param pin Bit of the UIO input byte (0-7, D0-D7)
+     * @param edge The triggering edges, InterruptEdge::None to ignore the pin
+     * @return True if successful, false if the pin is out of range
+     */
+    bool configureInterrupt(uint8_t pin, InterruptEdge edge) override;
 
     /**
      * @brief Set interrupt callback
@@ -114,9 +318,23 @@ public:
      */
     bool setInterruptCallback(InterruptCallback callback) override;
 
+    /**
+     * @brief Set a callback receiving edge and timestamp of each interrupt
+     * 
+     * The timestamp is the middle of the interval between the two pin samples
+     * that bracket the edge, and the uncertainty is half that interval.
+     * 
+     * @param callback Function to call when interrupt occurs
+     * @return True if successful
+     */
+    bool setInterruptEventCallback(InterruptEventCallback callback) override;
+
     /**
      * @brief Enable or disable interrupts
      * 
+     * Callbacks run on the monitoring thread, never while the bus is held,
+     * so they may issue transfers.
+     * 
      * @param enable True to enable interrupts, false to disable them
      * @return True if successful, false otherwise
      */
@@ -141,16 +359,43 @@ public:
 
 private:
     libusb_device_handle *device; ///< Handle to the libusb device.
-    libusb_context *context; ///< Context for libusb.
+    std::shared_ptr<USBManager> usb; ///< Shared libusb context, event thread and device cache.
     int device_index; ///< Index of the CH341 device.
+    std::string device_path; ///< Path or serial of the CH341 device, empty to select by index.
     bool lsb_first; ///< Flag to indicate if LSB should be sent first.
+    Speed speed; ///< Stream rate programmed by configStream().
+    SpeedProbe speed_probe; ///< Probe run by open(), if set.
+    bool fast_open; ///< Flag to skip the pin settling delay.
     bool is_open; ///< Flag to indicate whether the device is open and active
     uint8_t _gpio_direction; ///< Direction of GPIO pins.
     uint8_t _gpio_output; ///< Output state of GPIO pins.
-    InterruptCallback interruptCallback; ///< Callback function for interrupts.
-    bool interruptEnabled; ///< Flag to indicate if interrupts are enabled.
+    InterruptCallback interruptCallback; ///< Callback function for interrupts, guarded by async_mutex.
+    InterruptEventCallback interrupt_event_callback; ///< Callback receiving edge details, guarded by async_mutex.
+    std::atomic<bool> interruptEnabled; ///< Flag to indicate if interrupts are enabled.
     std::thread interruptThread; ///< Thread for monitoring interrupts.
-    bool threadRunning; ///< Flag to indicate if the interrupt monitoring thread is running.
+    std::atomic<bool> threadRunning; ///< Flag to indicate if the interrupt monitoring thread is running.
+    std::vector<uint8_t> stream_buffer; ///< Scratch buffer holding the packed USB command stream.
+    std::vector<uint8_t> response_buffer; ///< Scratch buffer holding the raw SPI response.
+
+    struct AsyncSlot;
+    size_t queue_depth; ///< Number of transactions that may be in flight.
+    std::vector<std::unique_ptr<AsyncSlot>> slots; ///< Pre-allocated transaction slots.
+    std::vector<AsyncSlot *> free_slots; ///< Slots available for submission.
+    size_t active_slots; ///< Number of slots currently in flight.
+    bool async_error; ///< Set when a queued transaction failed since the last flush.
+    std::mutex async_mutex; ///< Protects the slot pool and submission order.
+    std::condition_variable async_cv; ///< Signalled whenever a slot completes.
+    std::atomic<bool> pipeline_running; ///< Flag to indicate that the slot pool accepts transactions.
+
+    // Pin sampling state, guarded by async_mutex
+    uint8_t interrupt_pin; ///< Monitored bit of the UIO input byte.
+    InterruptEdge interrupt_edge; ///< Edges reported on interrupt_pin.
+    bool pins_sampled; ///< pin_level holds a sample taken since monitoring (re)started.
+    bool pin_level; ///< Level of interrupt_pin in the last sample.
+    uint64_t pin_sample_start_ns; ///< When the last sample was requested, steady_clock nanoseconds.
+    uint64_t pin_sample_count; ///< Number of samples taken, piggybacked or dedicated.
+    uint64_t pin_edge_count; ///< Number of edges detected.
+    InterruptEvent pin_edge; ///< The last edge detected.
 
     /**
      * @brief Configures the SPI stream.
@@ -166,14 +411,205 @@ private:
     bool enablePins(bool enable);
 
     /**
-     * @brief Swaps the bits of a byte.
-     * @param byte The byte whose bits are to be swapped.
-     * @return The byte with swapped bits.
+     * @brief Appends one SPI stream packet to a command stream.
+     * @param buffer Command stream to append to.
+     * @param tx Bytes of the write phase.
+     * @param tx_len Number of bytes in tx.
+     * @param offset Position of the packet's first byte within the transaction.
+     * @param chunk Number of data bytes in the packet (at most PACKET_LENGTH - 1).
+     *
+     * Bytes past tx_len are 0xFF dummy clocks. In LSB-first mode the data run
+     * is mirrored as it is copied.
+     */
+    void appendStreamPacket(std::vector<uint8_t> &buffer, const uint8_t *tx, size_t tx_len,
+                            size_t offset, size_t chunk);
+
+    /**
+     * @brief Appends a UIO command packet that drives the chip select line.
+     * @param buffer Command stream to append to.
+     * @param cs_high True to deassert CS, false to assert it.
+     * @param sample_pins True to also read the pin levels, which answers with one byte.
+     *
+     * The packet is padded to CH341Config::PACKET_LENGTH so that any command
+     * following it in the same bulk write starts on a packet boundary.
+     */
+    static void appendChipSelect(std::vector<uint8_t> &buffer, bool cs_high, bool sample_pins = false);
+
+    /**
+     * @brief Appends a UIO command packet that releases CS and asserts it again.
+     * @param buffer Command stream to append to.
+     *
+     * Separates two transactions packed into the same slot. CS is held high for
+     * two output cycles, and the packet is padded like appendChipSelect().
+     */
+    static void appendChipSelectCycle(std::vector<uint8_t> &buffer);
+
+    /**
+     * @brief Number of SPI stream packets needed by a transaction.
+     * @param transaction The transaction.
+     * @return Packets carrying tx_len + rx_len bytes.
+     */
+    static size_t streamPackets(const Transaction &transaction);
+
+    /**
+     * @brief Runs one CS-framed SPI transaction as packed bulk transfers.
+     * @param tx Bytes to clock out first.
+     * @param tx_len Number of bytes in tx.
+     * @param rx Destination for the bytes clocked in after tx (may be null if rx_len is 0).
+     * @param rx_len Number of bytes to read after tx.
+     * @return True if every USB transfer succeeded, false otherwise.
+     */
+    bool streamTransfer(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+
+    /**
+     * @brief Cleans up after a failed streamTransfer(), on a best-effort basis.
+     *
+     * Raises CS so the radio sees the transaction end, then reads and throws
+     * away whatever the CH341 still answers so the next transfer starts aligned.
+     */
+    void abortStream();
+
+    /**
+     * @brief Writes a buffer to the bulk OUT endpoint.
+     * @param data Data to write.
+     * @param length Number of bytes to write.
+     * @return True if the whole buffer was written, false otherwise.
+     */
+    bool bulkWrite(uint8_t *data, size_t length);
+
+    /**
+     * @brief Counts a failed bulk transfer and reports it through the trace hook or std::cerr.
+     * @param ret libusb error code.
+     * @param message Description, printed followed by the libusb error name.
+     */
+    void reportUsbError(int ret, const char *message);
+
+    /**
+     * @brief Reads exactly length bytes from the bulk IN endpoint.
+     * @param data Destination buffer.
+     * @param length Number of bytes to read.
+     * @return True if all bytes were received, false otherwise.
+     *
+     * The CH341 answers each SPI stream packet with a short packet, so this
+     * keeps reading until the requested amount has arrived.
+     */
+    bool bulkRead(uint8_t *data, size_t length);
+
+    /**
+     * @brief Allocates the transaction slots and starts the libusb event thread.
+     * @return True if the pipeline is ready, false otherwise.
+     */
+    bool startPipeline();
+
+    /**
+     * @brief Waits for outstanding transactions, stops the event thread and frees the slots.
+     */
+    void stopPipeline();
+
+    /**
+     * @brief Takes a free slot, waiting while the queue is full.
+     * @param lock Lock held on async_mutex.
+     * @return The slot, or nullptr if the pipeline is not running.
+     */
+    AsyncSlot *acquireSlot(std::unique_lock<std::mutex> &lock);
+
+    /**
+     * @brief Builds the command stream of one or more transactions and submits its USB transfers.
+     * @param slot Slot to fill, owned by the caller.
+     * @param transactions Transactions to pack, which must fit the slot.
+     * @param count Number of transactions.
+     * @return True if all transfers were submitted, false otherwise.
+     *
+     * Must be called with async_mutex held so that transfers from different
+     * slots reach the endpoints in submission order. The read phase of each
+     * transaction is delivered to its rx pointer when the slot is waited on.
+     */
+    bool submitSlot(AsyncSlot *slot, const Transaction *transactions, size_t count);
+
+    /**
+     * @brief Cancels the transfers of a slot that were handed to libusb.
+     * @param slot The slot to cancel.
+     */
+    void cancelSlot(AsyncSlot *slot);
+
+    /**
+     * @brief Runs a transaction and waits for its result.
+     * @param tx Bytes to clock out first.
+     * @param tx_len Number of bytes in tx.
+     * @param rx Destination for the bytes read after tx (may be null if rx_len is 0).
+     * @param rx_len Number of bytes to read after tx.
+     * @return True if the transaction succeeded, false otherwise.
+     *
+     * Transactions that fit a queue slot go through the pipeline behind any
+     * queued writes; larger ones drain the pipeline and use streamTransfer().
+     */
+    bool runTransaction(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+
+    /**
+     * @brief Runs a batch, grouping the transactions into as few slots as possible.
+     * @param transactions Transactions to run in order.
+     * @param count Number of transactions.
+     * @return True if every transaction succeeded, false otherwise.
+     */
+    bool runBatch(const Transaction *transactions, size_t count);
+
+    /**
+     * @brief Adds transactions to the bus statistics.
+     * @param transactions Transactions that ran or were queued.
+     * @param count Number of transactions.
+     * @param success False to count them as failed.
+     */
+    void countTransactions(const Transaction *transactions, size_t count, bool success);
+
+    /**
+     * @brief Handles completion of one libusb transfer belonging to a slot.
+     * @param transfer The completed transfer.
+     */
+    void onTransferComplete(libusb_transfer *transfer);
+
+    /**
+     * @brief Finishes a slot once all of its transfers have completed.
+     * @param slot The completed slot.
+     * @param lock Lock held on async_mutex, released while the callback runs.
+     */
+    void finishSlot(AsyncSlot *slot, std::unique_lock<std::mutex> &lock);
+
+    /**
+     * @brief libusb completion trampoline.
+     * @param transfer The completed transfer.
+     */
+    static void LIBUSB_CALL transferCallback(libusb_transfer *transfer);
+
+    /**
+     * @brief Runs UIO commands with the bus to itself.
+     * @param lock Lock held on async_mutex.
+     * @param cmd Command stream (a single packet).
+     * @param cmd_len Number of bytes in cmd.
+     * @param in Destination for the response (may be null if in_len is 0).
+     * @param in_len Number of response bytes expected.
+     * @return True if the command was written and the response received, false otherwise.
+     *
+     * Waits for queued transactions first so the response cannot be mistaken
+     * for one of theirs.
+     */
+    bool commandTransfer(std::unique_lock<std::mutex> &lock, const uint8_t *cmd, size_t cmd_len,
+                         uint8_t *in = nullptr, size_t in_len = 0);
+
+    /**
+     * @brief Feeds one sample of the pin levels to the edge detector.
+     * @param pins The UIO input byte.
+     * @param start_ns When the sample was requested.
+     * @param end_ns When it was received.
+     *
+     * Must be called with async_mutex held.
      */
-    uint8_t swapBits(uint8_t byte);
+    void recordPinSample(uint8_t pins, uint64_t start_ns, uint64_t end_ns);
 
     /**
      * @brief Thread function for monitoring interrupts.
+     *
+     * Delivers the edges found in pin samples and polls the pins itself
+     * while no transaction does.
      */
     void interruptMonitoringThread();
 };
\ No newline at end of file
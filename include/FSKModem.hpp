@@ -0,0 +1,220 @@
+/**
+ * @file FSKModem.hpp
+ * @brief FSK/GFSK packet engine for RFM95
+ *
+ * Switches an RFM95 from LoRa to its FSK modem and drives the packet
+ * handler: bitrates from 1.2 to 300 kbps, frequency deviation, RX bandwidth,
+ * sync word, fixed or variable length frames, whitening or Manchester
+ * coding and the hardware CRC. The FSK FIFO only holds 64 bytes, so frames
+ * up to 2047 bytes are streamed through it, refilled while transmitting and
+ * drained while receiving whenever the fill level crosses the FIFO
+ * threshold.
+ *
+ * @code
+ * FSKModem::Config config;
+ * config.bitrate = 250000;
+ * config.deviation_hz = 125000;
+ * config.rx_bandwidth_hz = 250000;
+ * FSKModem fsk(radio);
+ * fsk.begin(config);
+ * fsk.send(image.data(), image.size());
+ * @endcode
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef FSK_MODEM_HPP
+#define FSK_MODEM_HPP
+
+#include "RFM95.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+/**
+ * @brief FSK packet mode layered on an RFM95
+ */
+class FSKModem
+{
+public:
+    // Size of the FSK FIFO
+    static constexpr size_t FIFO_SIZE = 64;
+
+    // Longest frame of the packet handler in fixed length mode
+    static constexpr size_t MAX_FIXED_LENGTH = 2047;
+
+    // Longest payload in variable length mode, bounded by its length byte
+    static constexpr size_t MAX_VARIABLE_LENGTH = 255;
+
+    // Longest sync word
+    static constexpr size_t MAX_SYNC_LENGTH = 8;
+
+    /**
+     * @brief Gaussian filter applied to the transmitted bits
+     */
+    enum class Shaping : uint8_t
+    {
+        None = 0,   ///< Plain FSK
+        BT_1_0 = 1, ///< GFSK, BT = 1.0
+        BT_0_5 = 2, ///< GFSK, BT = 0.5
+        BT_0_3 = 3  ///< GFSK, BT = 0.3
+    };
+
+    /**
+     * @brief Line coding of the payload
+     */
+    enum class DcFree : uint8_t
+    {
+        None = 0,       ///< Data sent as is
+        Manchester = 1, ///< Manchester coding, halves the net bitrate
+        Whitening = 2   ///< Whitening with the packet handler's LFSR
+    };
+
+    /**
+     * @brief Modem and packet handler settings
+     */
+    struct Config
+    {
+        float frequency_mhz;        ///< Carrier frequency in MHz
+        uint32_t bitrate;           ///< Bits per second (1200-300000)
+        uint32_t deviation_hz;      ///< Frequency deviation in Hz (600-200000)
+        uint32_t rx_bandwidth_hz;   ///< Single side RX filter bandwidth in Hz, rounded up (2600-250000)
+        Shaping shaping;
+        uint16_t preamble_length;   ///< Preamble bytes sent before the sync word
+        uint8_t sync_word[MAX_SYNC_LENGTH];
+        uint8_t sync_length;        ///< Sync word bytes used (1-8)
+        bool variable_length;       ///< Frames start with a length byte instead of having a fixed size
+        uint16_t payload_length;    ///< Frame size in fixed length mode, longest accepted payload in variable length mode
+        DcFree dc_free;
+        bool crc;                   ///< Append and check a CRC-16
+        uint8_t fifo_threshold;     ///< FIFO fill level that triggers a refill or a drain (1-62)
+        int tx_power;               ///< Transmit power in dBm, see RFM95::setTxPower()
+        bool use_pa_boost;
+
+        Config()
+            : frequency_mhz(868.1f),
+              bitrate(50000),
+              deviation_hz(25000),
+              rx_bandwidth_hz(83300),
+              shaping(Shaping::BT_0_5),
+              preamble_length(4),
+              sync_word{0x2D, 0xD4, 0, 0, 0, 0, 0, 0},
+              sync_length(2),
+              variable_length(true),
+              payload_length(MAX_VARIABLE_LENGTH),
+              dc_free(DcFree::Whitening),
+              crc(true),
+              fifo_threshold(32),
+              tx_power(17),
+              use_pa_boost(true)
+        {
+        }
+    };
+
+    /**
+     * @brief Constructor, the radio stays in LoRa mode until begin()
+     *
+     * @param radio Initialized radio
+     */
+    explicit FSKModem(RFM95 &radio);
+
+    FSKModem(const FSKModem &) = delete;
+    FSKModem &operator=(const FSKModem &) = delete;
+
+    /**
+     * @brief Switch the radio to FSK and apply a configuration
+     *
+     * The RX engine and TX queue of the radio must be stopped, they only
+     * understand LoRa.
+     *
+     * @param config Settings
+     * @return True if the module is in FSK standby with the settings applied
+     */
+    bool begin(const Config &config);
+
+    /**
+     * @brief Apply new settings to a modem already in FSK mode
+     *
+     * @param config Settings
+     * @return False if a value is out of range or a register access failed
+     */
+    bool configure(const Config &config);
+
+    /**
+     * @brief Switch the radio back to LoRa standby
+     *
+     * The LoRa page (0x0D-0x3F) is not restored; call RFM95::begin() or
+     * RFM95::applyProfile() before using LoRa again.
+     */
+    void end();
+
+    /**
+     * @brief Transmit one frame, streaming it through the FIFO
+     *
+     * @param data Payload
+     * @param length Payload size; exactly payload_length in fixed length mode
+     * @return True if PacketSent arrived in time
+     */
+    bool send(const uint8_t *data, size_t length);
+
+    /**
+     * @brief Receive one frame
+     *
+     * Returns after the first frame that passes the sync word match, even if
+     * its CRC fails, or at the timeout, leaving the modem in standby.
+     *
+     * @param buffer Destination of the payload
+     * @param capacity Size of buffer
+     * @param length Payload size on return
+     * @param timeout Longest time to wait for a frame
+     * @return True if a frame with a valid CRC (or any frame without CRC) was received
+     */
+    bool receive(uint8_t *buffer, size_t capacity, size_t &length,
+                 std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief Get the RSSI measured when the last frame's sync word matched
+     *
+     * @return RSSI in dBm
+     */
+    float getLastRssi() const;
+
+    /**
+     * @brief Get the time on air of a frame with the current settings
+     *
+     * @param length Payload size
+     * @return Time on air in microseconds
+     */
+    uint32_t getTimeOnAir(size_t length) const;
+
+    /**
+     * @brief Get the active settings
+     *
+     * @return Configuration passed to the last successful configure()
+     */
+    const Config &getConfig() const;
+
+    /**
+     * @brief Encode a bandwidth for RegRxBw or RegAfcBw
+     *
+     * @param bandwidth_hz Requested bandwidth
+     * @return Smallest supported bandwidth at or above the request, 250 kHz at most
+     */
+    static uint8_t bandwidthValue(uint32_t bandwidth_hz);
+
+private:
+    RFM95 &radio;
+    Config config;
+    float last_rssi;
+
+    /**
+     * @brief Time to move a number of bytes over the air
+     *
+     * @param bytes Byte count
+     * @return Duration in microseconds, at least 1
+     */
+    uint32_t byteTimeUs(size_t bytes) const;
+};
+
+#endif // FSK_MODEM_HPP
@@ -0,0 +1,311 @@
+/**
+ * @file Fragmenter.hpp
+ * @brief Fragmentation and reassembly of transfers larger than one packet
+ *
+ * A Fragmenter splits a buffer into fragments with a 5-byte header and
+ * hands them to the RFM95 TX queue a few at a time, so the worker sends
+ * them back to back without returning to the caller between packets. The
+ * receiving side stores fragments as they arrive, tracks the missing ones
+ * in a bitmap and, when the sender polls or the link goes quiet, asks for
+ * exactly those again. Every transfer buffer is allocated once by the
+ * constructor; nothing is allocated per fragment.
+ *
+ * Frames start with one of the FRAME_* bytes. The link is assumed to be
+ * point to point: there is no addressing, and other traffic on the channel
+ * must not start with those bytes.
+ *
+ * @code
+ * radio.startRxEngine();
+ * radio.startTxQueue();
+ * Fragmenter fragmenter(radio);
+ * fragmenter.setReceiveCallback([](const uint8_t *data, size_t length) { store(data, length); });
+ * fragmenter.send(image.data(), image.size(), [](bool success) { ... });
+ * while (running)
+ * {
+ *     fragmenter.service();
+ *     std::this_thread::sleep_for(std::chrono::milliseconds(5));
+ * }
+ * @endcode
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef FRAGMENTER_HPP
+#define FRAGMENTER_HPP
+
+#include "RFM95.hpp"
+#include "Stats.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <bitset>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief Fragmentation layer on the RFM95 TX queue and RX ring
+ */
+class Fragmenter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Frame header: type, transfer id, fragment index, last fragment index, fragment size
+    static constexpr size_t HEADER_SIZE = 5;
+    static constexpr size_t MAX_FRAGMENT_SIZE = 255 - HEADER_SIZE;
+    static constexpr size_t MAX_FRAGMENTS = 256;
+    static constexpr size_t MAX_TRANSFER_SIZE = MAX_FRAGMENTS * MAX_FRAGMENT_SIZE;
+
+    // Frame types, the first byte of every frame
+    static constexpr uint8_t FRAME_DATA = 0xF0;     ///< One fragment of a transfer
+    static constexpr uint8_t FRAME_REQUEST = 0xF1;  ///< Bitmap of the fragments the receiver is missing
+    static constexpr uint8_t FRAME_DONE = 0xF2;     ///< The receiver has the whole transfer
+    static constexpr uint8_t FRAME_POLL = 0x08;     ///< Flag on FRAME_DATA: answer with FRAME_REQUEST or FRAME_DONE
+
+    /**
+     * @brief Completion callback of send(), called from service() or poll()
+     */
+    using SendCallback = std::function<void(bool success)>;
+
+    /**
+     * @brief Called from service() with each reassembled transfer; data is only valid during the call
+     */
+    using ReceiveCallback = std::function<void(const uint8_t *data, size_t length)>;
+
+    /**
+     * @brief Called from service() with each received packet that is not a fragmentation frame
+     */
+    using PacketCallback = std::function<void(const RFM95::RxPacket &packet)>;
+
+    /**
+     * @brief Sizes, timeouts and transmit settings
+     */
+    struct Options
+    {
+        size_t fragment_size;                         ///< Payload bytes per fragment (1-MAX_FRAGMENT_SIZE)
+        size_t max_transfer_size;                     ///< Largest transfer in bytes, at most MAX_FRAGMENTS fragments
+        size_t tx_transfers;                          ///< Outgoing transfers in progress at once
+        size_t rx_transfers;                          ///< Incoming transfers reassembled at once
+        size_t window;                                ///< Fragments of one transfer in the TX queue at once
+        std::chrono::milliseconds response_timeout;   ///< Wait for an answer after the last fragment, on top of two packet airtimes
+        int retries;                                  ///< Polls without an answer (or requests without a fragment) before giving up
+        RFM95::TxOptions tx_options;                  ///< Settings of every frame sent
+
+        Options()
+            : fragment_size(MAX_FRAGMENT_SIZE),
+              max_transfer_size(MAX_TRANSFER_SIZE),
+              tx_transfers(2),
+              rx_transfers(2),
+              window(4),
+              response_timeout(500),
+              retries(5),
+              tx_options()
+        {
+        }
+    };
+
+    /**
+     * @brief Constructor, allocates every transfer buffer
+     *
+     * @param radio Radio whose TX queue and RX ring carry the frames; both must be started by the caller
+     * @param options Sizes and timeouts
+     */
+    Fragmenter(RFM95 &radio, const Options &options = Options());
+
+    /**
+     * @brief Destructor, waits until no fragment is left in the TX queue
+     */
+    ~Fragmenter();
+
+    Fragmenter(const Fragmenter &) = delete;
+    Fragmenter &operator=(const Fragmenter &) = delete;
+
+    /**
+     * @brief Start sending a transfer
+     *
+     * @param data Payload (copied before returning)
+     * @param length Payload length (1-max_transfer_size)
+     * @param callback Called once the receiver confirmed the transfer or the retries ran out
+     * @return False if the payload is too long or tx_transfers are already in progress
+     */
+    bool send(const uint8_t *data, size_t length, SendCallback callback = SendCallback());
+
+    /**
+     * @brief Install the callback receiving reassembled transfers
+     *
+     * @param callback The callback
+     */
+    void setReceiveCallback(ReceiveCallback callback);
+
+    /**
+     * @brief Install the callback receiving packets that are not fragmentation frames
+     *
+     * @param callback The callback
+     */
+    void setPacketCallback(PacketCallback callback);
+
+    /**
+     * @brief Drain the radio's RX ring and run the retransmit timers
+     *
+     * Call it regularly from the thread consuming the RX ring, every few
+     * milliseconds while transfers are in progress.
+     *
+     * @return Number of packets taken from the ring
+     */
+    size_t service();
+
+    /**
+     * @brief Handle one received packet, for applications that drain the ring themselves
+     *
+     * @param packet Received packet
+     * @return True if it was a fragmentation frame, false if it belongs to the application
+     */
+    bool handlePacket(const RFM95::RxPacket &packet);
+
+    /**
+     * @brief Run the retransmit timers without draining the ring
+     */
+    void poll();
+
+    /**
+     * @brief Get the number of outgoing transfers in progress
+     *
+     * @return Transfer count
+     */
+    size_t getPending();
+
+    /**
+     * @brief Access the fragment and transfer counters
+     *
+     * @return The statistics
+     */
+    FragmentStats &getStats();
+
+private:
+    /**
+     * @brief State of one outgoing transfer
+     */
+    struct TxTransfer
+    {
+        std::vector<uint8_t> buffer;      ///< max_transfer_size bytes, allocated once
+        bool active;
+        uint32_t generation;              ///< Tells TX callbacks of an earlier transfer in this slot apart
+        uint8_t id;
+        size_t length;
+        size_t count;                     ///< Number of fragments
+        size_t next;                      ///< First fragment not sent yet
+        std::bitset<MAX_FRAGMENTS> resend; ///< Fragments to send again
+        size_t queued;                    ///< Fragments in the TX queue
+        int retries;                      ///< Polls left without an answer
+        Clock::time_point deadline;       ///< Poll again if nothing is queued by then
+        SendCallback callback;
+    };
+
+    /**
+     * @brief State of one incoming transfer
+     */
+    struct RxTransfer
+    {
+        std::vector<uint8_t> buffer;      ///< max_transfer_size bytes, allocated once
+        bool active;
+        bool delivering;                  ///< Buffer is being handed to the receive callback
+        uint8_t id;
+        size_t count;
+        size_t fragment_size;
+        size_t length;                    ///< Known once the last fragment arrived
+        std::bitset<MAX_FRAGMENTS> received;
+        size_t received_count;
+        int requests;                     ///< Requests sent without a new fragment arriving
+        Clock::time_point deadline;       ///< Send a request if no fragment arrives by then
+    };
+
+    /**
+     * @brief A recently completed incoming transfer, whose FRAME_DONE may have been lost
+     */
+    struct Completed
+    {
+        bool valid;
+        uint8_t id;
+        uint8_t last;
+        Clock::time_point expires;
+    };
+
+    static constexpr size_t COMPLETED_HISTORY = 4;
+
+    RFM95 &radio;
+    Options options;
+    std::mutex mutex;                   ///< Protects everything below; never held while calling the radio's register API
+    std::condition_variable idle_cv;    ///< Signalled when a queued fragment completes
+    std::vector<TxTransfer> tx;
+    std::vector<RxTransfer> rx;
+    Completed completed[COMPLETED_HISTORY];
+    size_t completed_next;
+    size_t in_flight;                   ///< Fragments of any transfer in the TX queue
+    uint8_t next_id;
+    uint32_t frame_air_us;              ///< Time on air of a full frame, refreshed outside the lock
+    ReceiveCallback receive_callback;
+    std::shared_ptr<const PacketCallback> packet_callback; ///< Shared so service() can take it without copying the function
+    FragmentStats stats;
+
+    /**
+     * @brief Refresh frame_air_us from the radio's current settings
+     */
+    void refreshAirtime();
+
+    /**
+     * @brief Time to wait for the other side before acting
+     *
+     * @return response_timeout plus two frame airtimes
+     */
+    Clock::duration responseWindow() const;
+
+    /**
+     * @brief Queue as many fragments of a transfer as the window allows, mutex held
+     *
+     * @param slot Index into tx
+     */
+    void pump(size_t slot);
+
+    /**
+     * @brief Hand one fragment to the TX queue, mutex held
+     *
+     * @param slot Index into tx
+     * @param index Fragment index
+     * @param poll Ask the receiver to answer
+     * @return True if queued
+     */
+    bool enqueueFragment(size_t slot, size_t index, bool poll);
+
+    /**
+     * @brief TX queue callback of a fragment
+     *
+     * @param key Transfer generation in bits 32-63, slot in bits 8-31, fragment index in bits 0-7
+     * @param success Whether the fragment went on air
+     */
+    void fragmentDone(uint64_t key, bool success);
+
+    /**
+     * @brief Queue a FRAME_REQUEST or FRAME_DONE for an incoming transfer, mutex held
+     *
+     * @param id Transfer id
+     * @param last Index of its last fragment
+     * @param received Fragments received so far, nullptr for FRAME_DONE
+     */
+    void enqueueReply(uint8_t id, uint8_t last, const std::bitset<MAX_FRAGMENTS> *received);
+
+    /**
+     * @brief Handle a FRAME_DATA
+     */
+    bool handleData(const uint8_t *frame, size_t length);
+
+    /**
+     * @brief Handle a FRAME_REQUEST or FRAME_DONE for an outgoing transfer
+     */
+    void handleReply(const uint8_t *frame, size_t length);
+};
+
+#endif // FRAGMENTER_HPP
@@ -21,6 +21,8 @@
 #include <thread>
 #include <atomic>
 #include <map>
+#include <vector>
+#include <utility>
 #include <fstream>
 #include <fcntl.h>
 
@@ -30,6 +32,8 @@
 #include <unistd.h>
 #endif
 
+struct gpio_v2_line_config;
+
 /**
  * @class LinuxSPI
  * @brief A class to interface with SPI devices on Linux systems.
@@ -75,6 +79,33 @@ class LinuxSPI : public SPIInterface {
      * @return A vector containing the data read from the SPI device.
      */
     std::vector<uint8_t> transfer(const std::vector<uint8_t>& write_data, size_t read_length = 0);
+
+    /**
+     * @brief Transfers data over the SPI interface using caller-owned buffers.
+     * 
+     * The write and read phases are issued as two segments of a single
+     * SPI_IOC_MESSAGE, so chip select stays asserted across both.
+     * 
+     * @param tx The data to be written to the SPI device.
+     * @param tx_len The number of bytes to write.
+     * @param rx The buffer receiving the bytes read after the write phase.
+     * @param rx_len The number of bytes to read.
+     * @return true if the transfer succeeded, false otherwise.
+     */
+    bool transfer(const uint8_t* tx, size_t tx_len, uint8_t* rx, size_t rx_len) override;
+
+    /**
+     * @brief Executes several transactions with one SPI_IOC_MESSAGE.
+     * 
+     * Each transaction contributes one segment per phase, and cs_change on its
+     * last segment releases chip select before the next transaction. Batches
+     * longer than the per-message segment limit are split into several ioctls.
+     * 
+     * @param transactions The transactions, executed in order.
+     * @param count The number of transactions.
+     * @return true if every transaction succeeded, false otherwise.
+     */
+    bool transferBatch(const Transaction* transactions, size_t count) override;
     
     /**
      * @brief Sets the value of a GPIO pin.
@@ -101,41 +132,70 @@ class LinuxSPI : public SPIInterface {
      * @return true if the mode was successfully set, false otherwise.
      */
     bool pinMode(uint8_t pin, uint8_t mode);
+
+    /**
+     * @brief Selects the GPIO character device used for pins.
+     * 
+     * With a chip selected, pin numbers are line offsets on that chip instead
+     * of global sysfs numbers. Lines are requested once in pinMode() and their
+     * file descriptors stay open until close(), so reads and writes are single
+     * ioctls. INPUT_PULLUP enables the line's pull-up bias.
+     * Must be called before pinMode().
+     * 
+     * @param chip_path Chip device, e.g. "/dev/gpiochip0" (empty selects sysfs).
+     * @return true if the chip can be used, false otherwise.
+     */
+    bool setGPIOChip(const std::string& chip_path);
+
+    /**
+     * @brief Sets the mode of several GPIO pins as one group.
+     * 
+     * With the character device backend the pins share one line request, so
+     * digitalWriteGroup() drives them with a single ioctl. A pin can belong to
+     * one group only; pins previously configured on their own join the group.
+     * 
+     * @param pins The GPIO pin numbers.
+     * @param count The number of pins.
+     * @param mode The mode to set (e.g., input or output).
+     * @return true if every pin was configured, false otherwise.
+     */
+    bool pinModeGroup(const uint8_t* pins, size_t count, uint8_t mode);
+
+    /**
+     * @brief Sets the values of several GPIO pins.
+     * 
+     * Pins belonging to the same line request are written with one ioctl.
+     * 
+     * @param pins The GPIO pin numbers.
+     * @param values The values to set, one per pin.
+     * @param count The number of pins.
+     * @return true if every value was set, false otherwise.
+     */
+    bool digitalWriteGroup(const uint8_t* pins, const bool* values, size_t count);
     
     /**
      * @brief Configure interrupt settings for a GPIO pin
      * 
+     * Equivalent to configureInterrupt(pin, InterruptEdge::Both) when enabling.
+     * 
      * @param pin The pin number
      * @param enable True to enable the interrupt, false to disable it
      * @return True if the operation was successful, false otherwise
      */
-    bool configureInterrupt(uint8_t pin, bool enable) override {
-        // Basic implementation using sysfs
-        // In a real implementation, would use proper GPIO interrupts
-        std::string gpio_path = "/sys/class/gpio/gpio" + std::to_string(pin);
-        
-        // Check if GPIO exists
-        if (access(gpio_path.c_str(), F_OK) == -1) {
-            // Need to export
-            std::ofstream export_file("/sys/class/gpio/export");
-            if (!export_file.is_open()) {
-                return false;
-            }
-            export_file << pin;
-            export_file.close();
-        }
-        
-        // Configure edge for interrupt
-        std::string edge_path = gpio_path + "/edge";
-        std::ofstream edge_file(edge_path);
-        if (!edge_file.is_open()) {
-            return false;
-        }
-        edge_file << (enable ? "both" : "none");
-        edge_file.close();
-        
-        return true;
-    }
+    bool configureInterrupt(uint8_t pin, bool enable) override;
+
+    /**
+     * @brief Selects the interrupt pin and its triggering edges
+     * 
+     * The pin is configured as an input with edge detection, through the GPIO
+     * character device when one is selected and sysfs otherwise. If
+     * interrupts are already enabled, monitoring restarts on the new pin.
+     * 
+     * @param pin The pin number
+     * @param edge The triggering edges, InterruptEdge::None to stop using the pin
+     * @return True if the operation was successful, false otherwise
+     */
+    bool configureInterrupt(uint8_t pin, InterruptEdge edge) override;
     
     /**
      * @brief Set interrupt callback
@@ -144,6 +204,17 @@ class LinuxSPI : public SPIInterface {
      * @return True if successful, false otherwise
      */
     bool setInterruptCallback(InterruptCallback callback) override;
+
+    /**
+     * @brief Set a callback receiving edge and timestamp of each interrupt
+     * 
+     * The timestamp comes from the kernel with the character device backend,
+     * and is taken as soon as poll() wakes up with sysfs.
+     * 
+     * @param callback Function to call when interrupt occurs
+     * @return True if successful, false otherwise
+     */
+    bool setInterruptEventCallback(InterruptEventCallback callback) override;
     
     /**
      * @brief Enable or disable interrupts
@@ -172,14 +243,28 @@ private:
     std::string gpio_export_path;
     std::string gpio_unexport_path;
     std::map<uint8_t, std::string> gpio_pin_paths;
+    std::map<uint8_t, int> gpio_value_fds; // Open sysfs value files
+
+    // GPIO character device
+    struct GPIORequest {
+        int fd;                      // Line request file descriptor (-1 once released)
+        std::vector<uint8_t> pins;   // Line offsets, in request order
+        std::vector<uint64_t> flags; // GPIO_V2_LINE_FLAG_* of each line
+        uint64_t values;             // Last output values, one bit per line
+    };
+    std::string gpio_chip_path;
+    int gpio_chip_fd;
+    std::vector<GPIORequest> gpio_requests;
+    std::map<uint8_t, std::pair<size_t, unsigned int>> gpio_lines; // pin -> (request, line index)
     
     // Interrupt handling
     InterruptCallback interruptCallback;
     std::atomic<bool> interrupt_running;
     std::thread interrupt_thread;
     int interrupt_pin;
-    InterruptCallback interrupt_callback;
-    bool interrupt_enabled = false;
+    InterruptEdge interrupt_edge;
+    InterruptEventCallback interrupt_event_callback;
+    int interrupt_stop_pipe[2]; // Wakes the interrupt thread out of poll()
     
     /**
      * @brief Exports a GPIO pin for use.
@@ -223,7 +308,89 @@ private:
      */
     bool readGPIOValue(uint8_t pin);
 
-    void interruptThread();
+    /**
+     * @brief Returns the cached sysfs value file of a pin, opening it on first use.
+     * 
+     * @param pin The GPIO pin number.
+     * @return The file descriptor, or -1 on error.
+     */
+    int gpioValueFd(uint8_t pin);
+
+    /**
+     * @brief Requests lines from the GPIO chip, or reconfigures an existing request.
+     * 
+     * @param pins The line offsets.
+     * @param count The number of lines.
+     * @param mode The pin mode applied to every line.
+     * @return true if the lines are configured, false otherwise.
+     */
+    bool requestLines(const uint8_t* pins, size_t count, uint8_t mode);
+
+    /**
+     * @brief Closes a line request and forgets its pins.
+     * 
+     * @param index Index in gpio_requests.
+     */
+    void releaseRequest(size_t index);
+
+    /**
+     * @brief Builds the kernel line configuration of a request.
+     * 
+     * @param request The request.
+     * @param config Receives the configuration.
+     * @return true if the flags fit into the available attributes, false otherwise.
+     */
+    bool fillLineConfig(const GPIORequest& request, struct gpio_v2_line_config& config) const;
+
+    /**
+     * @brief Sets output values of a line request.
+     * 
+     * @param request The request.
+     * @param bits The values, one bit per line.
+     * @param mask The lines to set.
+     * @return true if the values were set, false otherwise.
+     */
+    bool writeLines(GPIORequest& request, uint64_t bits, uint64_t mask);
+
+    /**
+     * @brief Releases every line request and closes the GPIO chip.
+     */
+    void closeGPIOChip();
+
+    /**
+     * @brief Replaces the edge flags of a requested GPIO line.
+     * 
+     * @param pin The line offset.
+     * @param flags The GPIO_V2_LINE_FLAG_EDGE_* bits to set.
+     * @return true if the line was reconfigured, false otherwise.
+     */
+    bool setLineEdge(uint8_t pin, uint64_t flags);
+
+    /**
+     * @brief Starts the interrupt thread on the configured pin.
+     * 
+     * @return true if the thread is running, false otherwise.
+     */
+    bool startInterruptThread();
+
+    /**
+     * @brief Wakes up and joins the interrupt thread.
+     */
+    void stopInterruptThread();
+
+    /**
+     * @brief Delivers one interrupt to the registered callback.
+     * 
+     * @param event The interrupt.
+     */
+    void dispatchInterrupt(const InterruptEvent& event);
+
+    /**
+     * @brief Thread function blocking on edge events of the interrupt pin.
+     * 
+     * @param event_fd Line request fd (character device) or value file (sysfs).
+     */
+    void interruptThread(int event_fd);
 };
 
 
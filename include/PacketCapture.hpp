@@ -0,0 +1,214 @@
+/**
+ * @file PacketCapture.hpp
+ * @brief Streaming LoRaTap/pcap writer for received packets
+ *
+ * A PacketCapture records packets together with their channel, data rate
+ * and signal quality as LoRaTap-encapsulated pcap files (link type 270),
+ * which Wireshark decodes directly. capture() only copies the packet into a
+ * preallocated queue; encoding, file writes and rotation happen on the
+ * writer's own thread, so capturing adds no I/O to the receive path. When
+ * the writer falls behind, further packets are counted as dropped instead of
+ * slowing down the receivers.
+ *
+ * @code
+ * PacketCapture::Options options("gateway.pcap");
+ * options.max_file_bytes = 64 << 20;
+ * PacketCapture capture(options);
+ * capture.start();
+ * pool.setCapture(&capture);
+ * @endcode
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef PACKET_CAPTURE_HPP
+#define PACKET_CAPTURE_HPP
+
+#include "RFM95.hpp"
+#include "RadioProfile.hpp"
+#include "Stats.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief Buffered capture sink writing LoRaTap pcap files from a background thread
+ */
+class PacketCapture
+{
+public:
+    // pcap link type of LoRaTap
+    static constexpr uint32_t LINKTYPE_LORATAP = 270;
+
+    // Size of a LoRaTap version 1 header
+    static constexpr size_t LORATAP_HEADER_LENGTH = 35;
+
+    /**
+     * @brief Output file and rotation settings
+     */
+    struct Options
+    {
+        std::string path;                          ///< Capture file; with rotation a sequence number goes before the extension
+        uint64_t max_file_bytes;                   ///< Start a new file once this size is reached, 0 for no limit
+        std::chrono::seconds max_file_age;         ///< Start a new file once the current one is this old, 0 for no limit
+        size_t max_files;                          ///< Delete the oldest rotated files beyond this count, 0 to keep all
+        size_t queue_capacity;                     ///< Packets that may wait for the writer before new ones are dropped
+        std::chrono::milliseconds flush_interval;  ///< Longest time a packet waits before it is written out
+
+        Options(const std::string &path = "capture.pcap")
+            : path(path),
+              max_file_bytes(0),
+              max_file_age(0),
+              max_files(0),
+              queue_capacity(4096),
+              flush_interval(200)
+        {
+        }
+    };
+
+    /**
+     * @brief Constructor, nothing is opened until start()
+     *
+     * @param options Output settings
+     */
+    PacketCapture(const Options &options = Options());
+
+    /**
+     * @brief Destructor, writes out the queued packets and closes the file
+     */
+    ~PacketCapture();
+
+    PacketCapture(const PacketCapture &) = delete;
+    PacketCapture &operator=(const PacketCapture &) = delete;
+
+    /**
+     * @brief Open the first file and start the writer thread
+     *
+     * @return True if the file could be created
+     */
+    bool start();
+
+    /**
+     * @brief Write out the queued packets, close the file and stop the writer thread
+     */
+    void stop();
+
+    /**
+     * @brief Queue a received packet
+     *
+     * Never blocks on I/O: the packet is copied into the queue under a short
+     * lock, and dropped if the queue is full.
+     *
+     * @param packet Packet from the RX engine (RFM95::readPacket() or a RadioPool); its CRC fields set the CRC status
+     * @param profile Channel and data rate it was received with
+     * @param radio Radio the packet came from, stored as the LoRaTap RF chain
+     * @return True if queued, false if dropped or not running
+     */
+    bool capture(const RFM95::RxPacket &packet, const RadioProfile &profile, uint8_t radio = 0);
+
+    /**
+     * @brief Get the number of packets queued so far
+     *
+     * @return Packet count
+     */
+    uint64_t getCaptured() const;
+
+    /**
+     * @brief Get the number of packets dropped because the queue was full, capture was stopped or a write failed
+     *
+     * @return Packet count
+     */
+    uint64_t getDropped() const;
+
+    /**
+     * @brief Get the number of packets written to a file
+     *
+     * @return Packet count
+     */
+    uint64_t getWritten() const;
+
+    /**
+     * @brief Get the file currently written to
+     *
+     * @return Path, empty if no file is open
+     */
+    std::string getCurrentPath();
+
+private:
+    /**
+     * @brief One queued packet
+     */
+    struct Record
+    {
+        RFM95::RxPacket packet;
+        RadioProfile profile;
+        uint8_t radio;
+    };
+
+    Options options;
+    std::vector<Record> pending;     ///< Filled by capture(), capacity reserved at start()
+    std::vector<Record> writing;     ///< Swapped with pending by the writer
+    std::vector<uint8_t> buffer;     ///< Encoded records of one batch
+    size_t buffered;                 ///< Records in buffer
+    std::mutex mutex;                ///< Protects pending, running and current_path
+    std::condition_variable cv;      ///< Wakes the writer when the queue fills up or on stop()
+    std::thread writer;
+    bool running;
+    int64_t epoch_offset_ns;         ///< system_clock minus steady_clock, converts packet timestamps
+
+    std::ofstream file;              ///< Owned by the writer thread once started
+    std::string current_path;
+    uint64_t file_bytes;
+    std::chrono::steady_clock::time_point file_opened;
+    uint32_t file_sequence;
+    std::deque<std::string> rotated; ///< Files written so far, oldest first
+
+    StatsCounter captured;
+    StatsCounter dropped;
+    StatsCounter written;
+
+    /**
+     * @brief Open the next file and write the pcap global header
+     *
+     * @return True if the file is open
+     */
+    bool openFile();
+
+    /**
+     * @brief Check the rotation limits and move on to the next file if one is reached
+     */
+    void rotateIfNeeded();
+
+    /**
+     * @brief Encode and write a batch of records
+     *
+     * @param records Records to write
+     */
+    void writeRecords(const std::vector<Record> &records);
+
+    /**
+     * @brief Append the pcap record header, LoRaTap header and payload of one packet
+     *
+     * @param record The packet
+     */
+    void encode(const Record &record);
+
+    /**
+     * @brief Write the encoded buffer to the current file, which must be open
+     */
+    void flushBuffer();
+
+    /**
+     * @brief Writer thread function
+     */
+    void run();
+};
+
+#endif // PACKET_CAPTURE_HPP
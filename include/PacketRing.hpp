@@ -0,0 +1,150 @@
+/**
+ * @file PacketRing.hpp
+ * @brief Lock-free single-producer/single-consumer ring of fixed-size slots
+ * 
+ * The producer fills a slot in place and publishes it, the consumer reads it in
+ * place and releases it. Neither side locks or allocates, and each index is
+ * only written by one side, so one thread may produce while another consumes.
+ * 
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef PACKET_RING_HPP
+#define PACKET_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief SPSC ring buffer holding up to N elements of type T
+ * 
+ * @tparam T Slot type, default constructible and copy assignable
+ * @tparam N Number of slots, a power of two
+ */
+template <typename T, size_t N>
+class PacketRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "PacketRing capacity must be a power of two");
+
+public:
+    PacketRing() : head(0), tail(0) {}
+
+    PacketRing(const PacketRing &) = delete;
+    PacketRing &operator=(const PacketRing &) = delete;
+
+    /**
+     * @brief Get the next free slot (producer side)
+     * 
+     * @return Slot to fill, or nullptr if the ring is full
+     */
+    T *acquire()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+        {
+            return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    /**
+     * @brief Make the slot returned by acquire() visible to the consumer
+     */
+    void publish()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Get the oldest published slot (consumer side)
+     * 
+     * The consumer owns the slot, and may modify it, until release().
+     * 
+     * @return Slot to read, or nullptr if the ring is empty
+     */
+    T *peek()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &slots[t & (N - 1)];
+    }
+
+    /**
+     * @brief Hand the slot returned by peek() back to the producer
+     */
+    void release()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy out and release the oldest element
+     * 
+     * @param out Receives the element
+     * @return True if an element was available
+     */
+    bool pop(T &out)
+    {
+        const T *slot = peek();
+        if (!slot)
+        {
+            return false;
+        }
+        out = *slot;
+        release();
+        return true;
+    }
+
+    /**
+     * @brief Number of published elements not yet released
+     * 
+     * @return Element count (a snapshot when the other side is active)
+     */
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Check if no element is waiting
+     * 
+     * @return True if the ring is empty
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /**
+     * @brief Drop every element; only call while neither side is active
+     */
+    void clear()
+    {
+        tail.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    /**
+     * @brief Number of slots
+     * 
+     * @return N
+     */
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    // Indices run freely and are masked on access; padding keeps the producer
+    // and consumer indices on separate cache lines
+    std::atomic<size_t> head;
+    char head_pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char tail_pad[64 - sizeof(std::atomic<size_t>)];
+    T slots[N];
+};
+
+#endif // PACKET_RING_HPP
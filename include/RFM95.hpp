@@ -34,12 +34,19 @@
 
 #include "CH341SPI.hpp"
 #include "SPIInterface.hpp"
+#include "PacketRing.hpp"
+#include "RadioProfile.hpp"
 #include <cstdint>
 #include <vector>
 #include <string>
 #include <chrono>
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
 
 /**
  * @class RFM95
@@ -72,6 +79,7 @@ public:
     static constexpr uint8_t REG_RX_NB_BYTES = 0x13;
     static constexpr uint8_t REG_PKT_SNR_VALUE = 0x19;
     static constexpr uint8_t REG_PKT_RSSI_VALUE = 0x1A;
+    static constexpr uint8_t REG_HOP_CHANNEL = 0x1C;
     static constexpr uint8_t REG_MODEM_CONFIG_1 = 0x1D;
     static constexpr uint8_t REG_MODEM_CONFIG_2 = 0x1E;
     static constexpr uint8_t REG_PREAMBLE_MSB = 0x20;
@@ -92,35 +100,134 @@ public:
     static constexpr uint8_t REG_VERSION = 0x42;
     static constexpr uint8_t REG_PA_DAC = 0x4D;
 
+    // FSK/OOK mode registers, sharing addresses 0x0D-0x3F with the LoRa page
+    static constexpr uint8_t REG_FSK_BITRATE_MSB = 0x02;
+    static constexpr uint8_t REG_FSK_BITRATE_LSB = 0x03;
+    static constexpr uint8_t REG_FSK_FDEV_MSB = 0x04;
+    static constexpr uint8_t REG_FSK_FDEV_LSB = 0x05;
+    static constexpr uint8_t REG_FSK_RX_CONFIG = 0x0D;
+    static constexpr uint8_t REG_FSK_RSSI_CONFIG = 0x0E;
+    static constexpr uint8_t REG_FSK_RSSI_VALUE = 0x11;
+    static constexpr uint8_t REG_FSK_RX_BW = 0x12;
+    static constexpr uint8_t REG_FSK_AFC_BW = 0x13;
+    static constexpr uint8_t REG_FSK_PREAMBLE_DETECT = 0x1F;
+    static constexpr uint8_t REG_FSK_PREAMBLE_MSB = 0x25;
+    static constexpr uint8_t REG_FSK_PREAMBLE_LSB = 0x26;
+    static constexpr uint8_t REG_FSK_SYNC_CONFIG = 0x27;
+    static constexpr uint8_t REG_FSK_SYNC_VALUE_1 = 0x28;
+    static constexpr uint8_t REG_FSK_PACKET_CONFIG_1 = 0x30;
+    static constexpr uint8_t REG_FSK_PACKET_CONFIG_2 = 0x31;
+    static constexpr uint8_t REG_FSK_PAYLOAD_LENGTH = 0x32;
+    static constexpr uint8_t REG_FSK_FIFO_THRESH = 0x35;
+    static constexpr uint8_t REG_FSK_IMAGE_CAL = 0x3B;
+    static constexpr uint8_t REG_FSK_TEMP = 0x3C;
+    static constexpr uint8_t REG_FSK_IRQ_FLAGS_1 = 0x3E;
+    static constexpr uint8_t REG_FSK_IRQ_FLAGS_2 = 0x3F;
+    static constexpr uint8_t REG_FSK_BITRATE_FRAC = 0x5D;
+
     // RFM95 Operation Modes
     static constexpr uint8_t MODE_SLEEP = 0x00;
     static constexpr uint8_t MODE_STDBY = 0x01;
+    static constexpr uint8_t MODE_FSTX = 0x02;
     static constexpr uint8_t MODE_TX = 0x03;
+    static constexpr uint8_t MODE_FSRX = 0x04;
     static constexpr uint8_t MODE_RX_CONTINUOUS = 0x05;
     static constexpr uint8_t MODE_RX_SINGLE = 0x06;
+    static constexpr uint8_t MODE_CAD = 0x07;
 
     // PA Config
     static constexpr uint8_t PA_BOOST = 0x80;
 
+    // Lowest frequency served by the HF port, whose RSSI reference differs from the LF port's
+    static constexpr float HF_PORT_MIN_MHZ = 779.0f;
+
+    // FIFO
+    static constexpr size_t FIFO_SIZE = 256;
+
+    // RX engine
+    static constexpr size_t RX_RING_SIZE = 16;
+
+    // TX queue
+    static constexpr size_t TX_QUEUE_SIZE = 8;
+
+    // Slack on top of the time on air before a transmission counts as failed
+    static constexpr int TX_TIMEOUT_MARGIN_MS = 50;
+
+    // Slack on top of four symbols before a CAD cycle counts as failed
+    static constexpr int CAD_TIMEOUT_MARGIN_MS = 10;
+
+    // Listen before talk: CAD attempts and the longest random backoff between them
+    static constexpr int LBT_MAX_ATTEMPTS = 5;
+    static constexpr int LBT_MAX_BACKOFF_MS = 50;
+
     // IRQ Flags
-    static constexpr uint8_t IRQ_CAD_DONE_MASK = 0x01;
-    static constexpr uint8_t IRQ_CAD_DETECTED_MASK = 0x02;
-    static constexpr uint8_t IRQ_RX_TIMEOUT_MASK = 0x04;
+    static constexpr uint8_t IRQ_CAD_DETECTED_MASK = 0x01;
+    static constexpr uint8_t IRQ_FHSS_CHANGE_CHANNEL_MASK = 0x02;
+    static constexpr uint8_t IRQ_CAD_DONE_MASK = 0x04;
     static constexpr uint8_t IRQ_TX_DONE_MASK = 0x08;
     static constexpr uint8_t IRQ_VALID_HEADER_MASK = 0x10;
     static constexpr uint8_t IRQ_PAYLOAD_CRC_ERROR_MASK = 0x20;
     static constexpr uint8_t IRQ_RX_DONE_MASK = 0x40;
-    static constexpr uint8_t IRQ_TX_TIMEOUT_MASK = 0x80;
+    static constexpr uint8_t IRQ_RX_TIMEOUT_MASK = 0x80;
+    static constexpr uint8_t IRQ_TX_TIMEOUT_MASK = 0x80; // The SX127x has no TX timeout flag, kept for compatibility
+
+    // FSK IRQ flags (REG_FSK_IRQ_FLAGS_1 and REG_FSK_IRQ_FLAGS_2)
+    static constexpr uint8_t FSK_IRQ1_MODE_READY = 0x80;
+    static constexpr uint8_t FSK_IRQ1_SYNC_ADDRESS_MATCH = 0x01;
+    static constexpr uint8_t FSK_IRQ2_FIFO_FULL = 0x80;
+    static constexpr uint8_t FSK_IRQ2_FIFO_EMPTY = 0x40;
+    static constexpr uint8_t FSK_IRQ2_FIFO_LEVEL = 0x20;
+    static constexpr uint8_t FSK_IRQ2_FIFO_OVERRUN = 0x10;
+    static constexpr uint8_t FSK_IRQ2_PACKET_SENT = 0x08;
+    static constexpr uint8_t FSK_IRQ2_PAYLOAD_READY = 0x04;
+    static constexpr uint8_t FSK_IRQ2_CRC_OK = 0x02;
 
     // DIO Mapping
     static constexpr uint8_t DIO0_RX_DONE = 0x00;
     static constexpr uint8_t DIO0_TX_DONE = 0x40;
+    static constexpr uint8_t DIO0_CAD_DONE = 0x80;
     static constexpr uint8_t DIO1_RX_TIMEOUT = 0x00;
     static constexpr uint8_t DIO3_TX_DONE = 0x40; // 01 para DIO3
     static constexpr uint8_t DIO4_RX_DONE = 0x00; // 00 para DIO4
     static constexpr uint8_t DIO_TX_PIN = 0x03;
     static constexpr uint8_t DIO_RX_PIN = 0x04;
 
+    /**
+     * @brief Per-packet transmit settings for enqueue()
+     */
+    struct TxOptions
+    {
+        bool invert_iq;        ///< Transmit with inverted IQ
+        int tx_power;          ///< Output power in dBm (PA_BOOST), 0 to keep the current setting
+        int spreading_factor;  ///< Spreading factor, 0 to keep the current setting
+        bool use_profile;      ///< Apply profile before the packet, then tx_power and spreading_factor
+        RadioProfile profile;  ///< Channel and data rate for the packet if use_profile is set
+
+        TxOptions() : invert_iq(false), tx_power(0), spreading_factor(0), use_profile(false), profile() {}
+    };
+
+    /**
+     * @brief Completion callback for enqueue(), called from the TX worker thread
+     */
+    using TxCallback = std::function<void(bool success)>;
+
+    /**
+     * @brief One packet drained by the RX engine
+     */
+    struct RxPacket
+    {
+        uint8_t data[255];                 ///< Payload
+        uint8_t length;                    ///< Number of valid bytes in data
+        float rssi;                        ///< Packet RSSI in dBm
+        float snr;                         ///< Packet SNR in dB
+        int32_t freq_error;                ///< Estimated carrier frequency error in Hz
+        uint64_t timestamp_ns;             ///< When RxDone was raised (end of the packet), steady_clock nanoseconds
+        uint32_t timestamp_uncertainty_ns; ///< Half-width of the interval the timestamp is known to lie in
+        bool timestamp_from_edge;          ///< Timestamp came from the DIO0 edge rather than flag polling
+        bool crc_present;                  ///< The packet carried a payload CRC (from its header, or the profile in implicit header mode)
+        bool crc_error;                    ///< The payload CRC failed; such packets only reach the ring after setKeepCrcErrors(true)
+    };
+
     /**
      * @brief Constructor
      * 
@@ -143,9 +250,16 @@ public:
     /**
      * @brief Initialize RFM95 module
      * 
+     * The fast path replaces the fixed mode-change delays by OP_MODE readback
+     * polling and reads the whole configuration in one burst. A module that
+     * is already in LoRa mode skips the sleep/LoRa transition, and only the
+     * defaults that differ are written, so a module that still holds them
+     * costs no configuration writes at all.
+     * 
+     * @param fast Use the fast path
      * @return true if successful, false otherwise
      */
-    bool begin();
+    bool begin(bool fast = false);
 
     /**
      * @brief Close the connection
@@ -159,6 +273,51 @@ public:
      */
     void setFrequency(float freq_mhz);
 
+    /**
+     * @brief Set the carrier frequency from precomputed register bytes
+     * 
+     * One 3-byte burst, or nothing if the module is already on that frequency.
+     * Like setFrequency(), call it outside TX and RX.
+     * 
+     * @param frf Frequency register value
+     * @return True if successful
+     */
+    bool setFrf(const Frf &frf);
+
+    /**
+     * @brief Hop to a channel of a precomputed table
+     * 
+     * @param table Hop table
+     * @param channel Channel index
+     * @return True if successful, false if the channel is out of range
+     */
+    template <size_t N>
+    bool setChannel(const HopTable<N> &table, size_t channel)
+    {
+        return channel < N && setFrf(table[channel]);
+    }
+
+    /**
+     * @brief Apply a complete channel and data rate configuration
+     * 
+     * All registers of the profile go out in one register batch, as bursts
+     * where they are contiguous; registers that already hold their value
+     * are skipped. Like the individual setters, call it outside TX and RX.
+     * 
+     * @param profile Profile to apply
+     * @return True if successful
+     */
+    bool applyProfile(const RadioProfile &profile);
+
+    /**
+     * @brief Read back the current channel and data rate configuration
+     * 
+     * Registers held in the shadow cache cost no SPI traffic.
+     * 
+     * @return Profile that applyProfile() would restore this configuration with
+     */
+    RadioProfile getProfile();
+
     /**
      * @brief Get current frequency in MHz
      * 
@@ -184,6 +343,9 @@ public:
     /**
      * @brief Set spreading factor (6-12)
      * 
+     * Also updates the low data rate optimization. SF6 additionally needs
+     * implicit header mode, see setImplicitHeader().
+     * 
      * @param sf Spreading factor
      */
     void setSpreadingFactor(int sf);
@@ -198,6 +360,8 @@ public:
     /**
      * @brief Set bandwidth in kHz (7.8, 10.4, 15.6, 20.8, 31.25, 41.7, 62.5, 125, 250, 500)
      * 
+     * Also updates the low data rate optimization.
+     * 
      * @param bw_khz Bandwidth in kHz
      */
     void setBandwidth(float bw_khz);
@@ -205,7 +369,7 @@ public:
     /**
      * @brief Get current bandwidth in kHz
      * 
-     * @return Bandwidth in kHz
+     * @return Bandwidth in kHz, exact (7.8125 rather than the datasheet's 7.8)
      */
     float getBandwidth();
 
@@ -223,6 +387,70 @@ public:
      */
     int getCodingRate();
 
+    /**
+     * @brief Select implicit header mode for fixed-size frames
+     * 
+     * Without the header every frame saves its airtime, and SF6 requires
+     * it. Both ends must agree on the frame size, coding rate and CRC
+     * setting since nothing on air describes them: send() and the TX queue
+     * reject payloads of any other size, receive() and the RX engine return
+     * exactly payload_length bytes.
+     * 
+     * @param enable True for implicit header mode, false for explicit
+     * @param payload_length Frame size in bytes (1-255), written to RegPayloadLength
+     * @return False if enabling without a frame size or the write failed
+     */
+    bool setImplicitHeader(bool enable, uint8_t payload_length = 0);
+
+    /**
+     * @brief Check if implicit header mode is selected
+     * 
+     * @return True in implicit header mode
+     */
+    bool getImplicitHeader();
+
+    /**
+     * @brief Get the frame size of implicit header mode
+     * 
+     * @return Frame size in bytes, 0 in explicit header mode
+     */
+    uint8_t getImplicitLength();
+
+    /**
+     * @brief Enable or disable the payload CRC (RxPayloadCrcOn)
+     * 
+     * In explicit header mode the transmitter's setting travels in the header;
+     * in implicit header mode both ends must use the same one.
+     * 
+     * @param enable True to add and check a payload CRC
+     */
+    void setCRC(bool enable);
+
+    /**
+     * @brief Check if the payload CRC is enabled
+     * 
+     * @return True if enabled
+     */
+    bool getCRC();
+
+    /**
+     * @brief Set the low data rate optimization
+     * 
+     * setSpreadingFactor() and setBandwidth() enable it whenever a symbol
+     * lasts longer than 16 ms, as the datasheet mandates; this overrides that
+     * until the next call of either.
+     * 
+     * @param enable True to enable
+     */
+    void setLowDataRateOptimize(bool enable);
+
+    /**
+     * @brief Check if the low data rate optimization is enabled
+     * 
+     * @return True if enabled
+     */
+    bool getLowDataRateOptimize();
+
     /**
      * @brief Set preamble length (6-65535)
      * 
@@ -237,6 +465,19 @@ public:
      */
     int getPreambleLength();
 
+    /**
+     * @brief Get the time on air of a packet with the current modem settings
+     * 
+     * Uses spreading factor, bandwidth, coding rate, preamble length, CRC,
+     * header mode and low data rate optimization as currently programmed,
+     * served from the register cache when it is valid.
+     * See RadioProfile::timeOnAirUs() for the compile-time equivalent.
+     * 
+     * @param payload_length Payload length in bytes
+     * @return Time on air in microseconds
+     */
+    uint32_t getTimeOnAir(size_t payload_length);
+
     /**
      * @brief Set IQ inversion (used for LoRaWAN downlinks)
      * 
@@ -372,14 +613,68 @@ public:
      */
     void setLoRaMode(bool enable = true);
 
+    /**
+     * @brief Run one Channel Activity Detection cycle on the current channel
+     * 
+     * The module looks for a LoRa preamble at the current spreading factor
+     * and bandwidth for about two symbols, then returns to standby. The wait
+     * uses the DIO0 interrupt (mapped to CadDone) when setInterruptPin()
+     * succeeded and polls otherwise. If the RX engine is running, continuous
+     * receive is resumed afterwards.
+     * 
+     * @param detected Set to true if a preamble was detected
+     * @return True if the cycle completed
+     */
+    bool runCAD(bool &detected);
+
+    /**
+     * @brief Run a CAD cycle on each profile in turn
+     * 
+     * The radio is left on the last profile.
+     * 
+     * @param profiles Channels and data rates to check
+     * @return Indices of the profiles on which activity was detected
+     */
+    std::vector<size_t> scanChannels(const std::vector<RadioProfile> &profiles);
+
+    /**
+     * @brief Run a CAD cycle on each channel of a hop table at the current data rate
+     * 
+     * The radio is left on the last channel.
+     * 
+     * @param table Channels to check
+     * @return Indices of the channels on which activity was detected
+     */
+    template <size_t N>
+    std::vector<size_t> scanChannels(const HopTable<N> &table)
+    {
+        std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+        std::vector<size_t> active;
+        for (size_t i = 0; i < N; i++)
+        {
+            bool detected = false;
+            if (setFrf(table[i]) && cadCycle(detected) && detected)
+            {
+                active.push_back(i);
+            }
+        }
+        finishCAD();
+        return active;
+    }
+
     /**
      * @brief Send data packet
      * 
+     * With listen_before_talk, a CAD cycle runs first and the packet only
+     * goes out on a clear channel. A busy channel is retried after a random
+     * backoff, up to LBT_MAX_ATTEMPTS times.
+     * 
      * @param data Data to send (max 255 bytes)
      * @param invert_iq True to send with inverted IQ (LoRaWAN downlinks)
-     * @return True if send successful
+     * @param listen_before_talk True to check the channel with CAD before sending
+     * @return True if send successful, false on error or if the channel stayed busy
      */
-    bool send(const std::vector<uint8_t> &data, bool invert_iq = false);
+    bool send(const std::vector<uint8_t> &data, bool invert_iq = false, bool listen_before_talk = false);
 
     /**
      * @brief Receive data packet
@@ -390,10 +685,247 @@ public:
      */
     std::vector<uint8_t> receive(float timeout = 5.0, bool invert_iq = false);
 
+    /**
+     * @brief Receive data packet with its signal report and arrival time
+     * 
+     * The timestamp marks RxDone, the end of the packet; subtract
+     * getTimeOnAir(packet.length) for the start of the preamble. With
+     * setInterruptPin() it is the time of the DIO0 edge as reported by the
+     * SPI backend (the kernel edge timestamp on LinuxSPI with the GPIO
+     * character device, the bracketing pin samples on CH341SPI). Otherwise it is the middle of the interval between
+     * the last flag poll that did not see RxDone and the end of the one that
+     * did, and timestamp_uncertainty_ns is half that interval.
+     * 
+     * @param packet Filled with the packet on success
+     * @param timeout Maximum time to wait for packet in seconds
+     * @param invert_iq True to receive with inverted IQ
+     * @return True if a packet was received
+     */
+    bool receive(RxPacket &packet, float timeout = 5.0, bool invert_iq = false);
+
+    /**
+     * @brief Wait on the DIO0 line instead of polling REG_IRQ_FLAGS
+     * 
+     * Registers an interrupt callback on the host pin wired to DIO0. send()
+     * and receive() then sleep until the line rises and only read the IRQ
+     * flags once it did. If the SPI backend cannot deliver interrupts
+     * (configureInterrupt() returns false), polling stays in use.
+     * 
+     * @param pin Host pin connected to DIO0
+     * @return True if interrupts are in use, false if polling remains active
+     */
+    bool setInterruptPin(uint8_t pin);
+
+    /**
+     * @brief Stop using the DIO0 interrupt and go back to polling
+     */
+    void clearInterruptPin();
+
+    /**
+     * @brief Set a function called on every DIO0 edge
+     * 
+     * Lets code driving several radios from one thread, with
+     * startRxEngine(false), wait for all of them at once. It runs on the SPI
+     * backend's interrupt thread and must return quickly.
+     * 
+     * @param listener The function (empty to remove it)
+     */
+    void setInterruptListener(std::function<void()> listener);
+
+    /**
+     * @brief Check whether send() and receive() wait for DIO0 interrupts
+     * 
+     * @return True if interrupts are in use
+     */
+    bool getInterruptActive() const;
+
     /**
      * @brief Set continuous receive mode
+     * 
+     * @return True if the module is in RX_CONTINUOUS mode
      */
-    void setContinuousReceive();
+    bool setContinuousReceive();
+
+    /**
+     * @brief Start continuous reception into the packet ring
+     * 
+     * Calls setContinuousReceive() and, with background set, starts a thread
+     * that drains every packet with its RSSI, SNR and frequency error into a
+     * ring of RX_RING_SIZE pre-allocated slots. The module stays in RX between
+     * packets, so nothing is lost between two reads. The thread sleeps on the
+     * DIO0 interrupt when setInterruptPin() succeeded and polls otherwise.
+     * Packets with a CRC error and packets arriving while the ring is full are
+     * dropped and counted; see setKeepCrcErrors() to keep the former.
+     * 
+     * While the engine runs, receive() returns packets from the ring, and
+     * calls serviceReceiver() itself when the engine has no thread. Other
+     * register accesses stay safe, but anything that leaves RX mode stops the
+     * reception until the engine is restarted.
+     * 
+     * @param background False to drive the engine by calling serviceReceiver()
+     * @return True if successful, false if the module did not enter continuous RX
+     */
+    bool startRxEngine(bool background = true);
+
+    /**
+     * @brief Stop the RX engine and its thread, if any
+     * 
+     * The module stays in RX mode and packets already in the ring stay there.
+     */
+    void stopRxEngine();
+
+    /**
+     * @brief Check if the RX engine is running, with or without its thread
+     * 
+     * @return True if running
+     */
+    bool getRxEngineRunning() const;
+
+    /**
+     * @brief Move a received packet, if any, from the module into the ring
+     * 
+     * This is the step the engine thread runs; call it directly after
+     * startRxEngine(false). Costs one 4-byte burst read when nothing arrived.
+     * 
+     * @return True if a packet was handled (stored or dropped)
+     */
+    bool serviceReceiver();
+
+    /**
+     * @brief Copy the oldest packet out of the ring
+     * 
+     * Lock-free and allocation-free; call from one consumer thread only.
+     * 
+     * @param packet Receives the packet
+     * @return True if a packet was available
+     */
+    bool readPacket(RxPacket &packet);
+
+    /**
+     * @brief Access the oldest packet in place
+     * 
+     * @return The packet, or nullptr if the ring is empty; valid until releasePacket()
+     */
+    const RxPacket *peekPacket();
+
+    /**
+     * @brief Release the packet returned by peekPacket()
+     */
+    void releasePacket();
+
+    /**
+     * @brief Get the number of packets waiting in the ring
+     * 
+     * @return Packet count
+     */
+    size_t getRxPending() const;
+
+    /**
+     * @brief Get the number of packets dropped because the ring was full
+     * 
+     * @return Drop count since startRxEngine()
+     */
+    uint32_t getRxDropped() const;
+
+    /**
+     * @brief Get the number of packets dropped because of a CRC error
+     * 
+     * @return CRC error count since startRxEngine()
+     */
+    uint32_t getRxCrcErrors() const;
+
+    /**
+     * @brief Store packets with a CRC error in the ring instead of dropping them
+     * 
+     * They are still counted by getRxCrcErrors() and arrive with crc_error
+     * set, e.g. for a packet capture. Off by default.
+     * 
+     * @param keep True to keep them
+     */
+    void setKeepCrcErrors(bool keep);
+
+    /**
+     * @brief Check whether packets with a CRC error are kept
+     * 
+     * @return True if they reach the ring
+     */
+    bool getKeepCrcErrors() const;
+
+    /**
+     * @brief Access the receive, transmit and interrupt statistics
+     * 
+     * Unlike getRxDropped() and getRxCrcErrors() they are never reset by
+     * the driver. Installing a callback on the trace member routes the
+     * driver's timeout and error messages to it instead of std::cerr; the
+     * SPI backend has its own, see getBusStats().
+     * 
+     * @return The statistics
+     */
+    RadioStats &getStats();
+    const RadioStats &getStats() const;
+
+    /**
+     * @brief Access the statistics of the SPI backend
+     * 
+     * @return Transaction, byte and USB counters of the bus this module is on
+     */
+    BusStats &getBusStats();
+
+    /**
+     * @brief Start the TX queue worker
+     * 
+     * The worker transmits queued packets back to back: only the settings
+     * that differ from the previous packet are written, and the next payload
+     * is loaded and started in one submission as soon as TxDone is seen.
+     * When the RX engine is running, the module returns to continuous
+     * receive after the queue drains.
+     * 
+     * @return True if successful
+     */
+    bool startTxQueue();
+
+    /**
+     * @brief Stop the TX queue worker
+     * 
+     * The packet on air completes; packets still queued are reported as failed.
+     */
+    void stopTxQueue();
+
+    /**
+     * @brief Queue a packet for transmission without blocking
+     * 
+     * @param data Payload (copied before returning)
+     * @param length Payload length (max 255)
+     * @param options Transmit settings for this packet
+     * @param callback Called with the result once the packet is sent or has failed
+     * @return False if the worker is not running, the payload is too long or the queue is full
+     */
+    bool enqueue(const uint8_t *data, size_t length, const TxOptions &options = TxOptions(),
+                 TxCallback callback = TxCallback());
+
+    /**
+     * @brief Queue a packet for transmission without blocking
+     * 
+     * @param data Payload (max 255 bytes)
+     * @param options Transmit settings for this packet
+     * @return Future receiving the result; false immediately if the packet was not queued
+     */
+    std::future<bool> enqueue(const std::vector<uint8_t> &data, const TxOptions &options = TxOptions());
+
+    /**
+     * @brief Get the number of packets queued or on air
+     * 
+     * @return Packet count
+     */
+    size_t getTxPending() const;
+
+    /**
+     * @brief Wait until every queued packet has been sent or has failed
+     * 
+     * @param timeout Timeout in seconds
+     * @return True if the queue drained in time
+     */
+    bool waitTxIdle(float timeout);
 
     /**
      * @brief Set standby mode
@@ -431,6 +963,24 @@ public:
      */
     std::vector<uint8_t> readPayload();
 
+    /**
+     * @brief Read received data packet into a caller-owned buffer
+     * 
+     * @param buffer Destination buffer
+     * @param capacity Size of buffer in bytes
+     * @return Number of bytes read (0 if no packet or buffer too small)
+     */
+    size_t readPayload(uint8_t *buffer, size_t capacity);
+
+    /**
+     * @brief Read SNR and RSSI of the last packet in a single burst
+     * 
+     * @param rssi Receives RSSI in dBm
+     * @param snr Receives SNR in dB
+     * @return True if successful
+     */
+    bool getPacketStatus(float &rssi, float &snr);
+
     /**
      * @brief Get current RSSI in dBm
      * 
@@ -461,6 +1011,182 @@ public:
      */
     void writeRegister(uint8_t address, uint8_t value);
 
+    /**
+     * @brief Read consecutive registers in one SPI transaction
+     * 
+     * The address auto-increments after each byte.
+     * 
+     * @param address First register address
+     * @param buffer Destination buffer
+     * @param length Number of registers to read
+     * @return True if successful
+     */
+    bool readRegisters(uint8_t address, uint8_t *buffer, size_t length);
+
+    /**
+     * @brief Write consecutive registers in one SPI transaction
+     * 
+     * The address auto-increments after each byte.
+     * 
+     * @param address First register address
+     * @param data Values to write
+     * @param length Number of registers to write
+     */
+    void writeRegisters(uint8_t address, const uint8_t *data, size_t length);
+
+    /**
+     * @brief Read bytes from the FIFO at REG_FIFO_ADDR_PTR in one SPI transaction
+     * 
+     * @param buffer Destination buffer
+     * @param length Number of bytes to read
+     * @return True if successful
+     */
+    bool readFifo(uint8_t *buffer, size_t length);
+
+    /**
+     * @brief Write bytes to the FIFO at REG_FIFO_ADDR_PTR in one SPI transaction
+     * 
+     * @param data Bytes to write
+     * @param length Number of bytes to write
+     */
+    void writeFifo(const uint8_t *data, size_t length);
+
+    /**
+     * @brief Collects register accesses and submits them as one SPI batch
+     * 
+     * Each access is its own CS-framed transaction, but the whole list is
+     * handed to SPIInterface::transferBatch() at once, so a block of setup
+     * writes costs about one bus round trip. Writes go through the shadow
+     * cache like writeRegister(), so writes that change nothing are dropped.
+     * Reads always go to the bus and are complete once submit() returns.
+     * 
+     * Storage is fixed size; a batch that runs out of room submits what it
+     * holds and carries on. Anything not yet submitted is submitted by the
+     * destructor. Other threads cannot access the module while a batch exists.
+     */
+    class RegisterBatch
+    {
+    public:
+        /**
+         * @brief Start an empty batch
+         * 
+         * @param radio Module the accesses are for
+         */
+        explicit RegisterBatch(RFM95 &radio);
+
+        /**
+         * @brief Submit anything still pending
+         */
+        ~RegisterBatch();
+
+        RegisterBatch(const RegisterBatch &) = delete;
+        RegisterBatch &operator=(const RegisterBatch &) = delete;
+
+        /**
+         * @brief Queue a register write
+         * 
+         * @param address Register address
+         * @param value Value to write
+         */
+        void write(uint8_t address, uint8_t value);
+
+        /**
+         * @brief Queue a burst write to consecutive registers or the FIFO
+         * 
+         * @param address First register address (REG_FIFO for the FIFO)
+         * @param data Values to write (copied)
+         * @param length Number of bytes to write
+         */
+        void writeBurst(uint8_t address, const uint8_t *data, size_t length);
+
+        /**
+         * @brief Queue a burst read from consecutive registers or the FIFO
+         * 
+         * @param address First register address (REG_FIFO for the FIFO)
+         * @param buffer Destination, filled by submit()
+         * @param length Number of bytes to read
+         */
+        void read(uint8_t address, uint8_t *buffer, size_t length);
+
+        /**
+         * @brief Queue an operating mode change, keeping the upper bits of REG_OP_MODE
+         * 
+         * @param mode One of the MODE_* constants
+         */
+        void setMode(uint8_t mode);
+
+        /**
+         * @brief Submit the queued accesses
+         * 
+         * @return True if every access since the last submit succeeded
+         */
+        bool submit();
+
+    private:
+        static constexpr size_t ARENA_SIZE = FIFO_SIZE + 64;
+        static constexpr size_t MAX_TRANSACTIONS = 16;
+
+        RFM95 &radio;
+        std::unique_lock<std::recursive_mutex> lock; ///< Held on radio.bus_mutex for the batch's lifetime
+        uint8_t arena[ARENA_SIZE];   ///< Command bytes of the queued transactions
+        size_t arena_used;
+        SPIInterface::Transaction transactions[MAX_TRANSACTIONS];
+        size_t count;
+        bool ok;                     ///< No earlier partial submit failed
+
+        /**
+         * @brief Append a transaction, submitting first if the batch is full
+         * 
+         * @param tx_len Command bytes needed
+         * @return The transaction, with tx pointing into the arena
+         */
+        SPIInterface::Transaction &append(size_t tx_len);
+    };
+
+    /**
+     * @brief Enable or disable the register shadow cache
+     * 
+     * When enabled, configuration registers (0x01-0x4D) are mirrored on the host.
+     * Reads are served from the mirror and writes that would not change a value
+     * are skipped. Volatile registers (FIFO, FIFO pointers, IRQ flags, packet
+     * status, RSSI, frequency error) always go to the bus. Enabled by default.
+     * 
+     * @param enable True to enable, False to disable
+     */
+    void setRegisterCache(bool enable);
+
+    /**
+     * @brief Check if the register shadow cache is enabled
+     * 
+     * @return True if the cache is enabled
+     */
+    bool getRegisterCache() const;
+
+    /**
+     * @brief Reload the register shadow cache with one burst read
+     * 
+     * @return True if successful
+     */
+    bool refreshRegisterCache();
+
+    /**
+     * @brief Drop all cached register values
+     * 
+     * Call this if the module may have been changed behind the driver's back,
+     * e.g. after a hardware reset.
+     */
+    void invalidateRegisterCache();
+
+    /**
+     * @brief Wait until the writes queued by writeRegister() reached the module
+     * 
+     * Queued writes only report errors here. Reads that miss the cache call
+     * this first; if a queued write failed, the whole cache is dropped.
+     * 
+     * @return True if every queued write succeeded
+     */
+    bool flushWrites();
+
     /**
      * @brief Put the module in continuous receive mode
      */
@@ -477,6 +1203,9 @@ public:
     /**
      * @brief Calibrate temperature sensor with a reference temperature
      * 
+     * Takes one reading and keeps its difference to actual_temp as the
+     * offset readTemperature() applies.
+     * 
      * @param actual_temp Actual temperature measured with external sensor in Celsius
      * @return True if calibration successful
      */
@@ -485,7 +1214,10 @@ public:
     /**
      * @brief Read calibrated temperature
      * 
-     * @return Temperature in Celsius
+     * The sensor lives on the FSK page, so the module briefly leaves its
+     * current mode; an active receiver is restarted afterwards.
+     * 
+     * @return Temperature in Celsius, 0 on failure
      */
     float readTemperature();
 
@@ -533,7 +1265,307 @@ public:
     uint8_t readVersionRegister();
 
 private:
+    friend class FSKModem;           ///< Drives the FSK page with the bus lock and interrupt wait held here
+
+    // Register shadow cache covers REG_OP_MODE..REG_PA_DAC
+    static constexpr uint8_t SHADOW_FIRST = REG_OP_MODE;
+    static constexpr uint8_t SHADOW_LAST = REG_PA_DAC;
+
     std::unique_ptr<SPIInterface> spi; ///< Unique pointer to SPI interface implementation
+    std::atomic<bool> irq_active;      ///< DIO0 interrupts replace IRQ flag polling, read by the worker threads
+    uint64_t irq_count;                ///< Number of DIO0 edges seen, guarded by irq_mutex
+    uint64_t irq_edge_ns;              ///< Time of the last DIO0 edge in steady_clock nanoseconds, guarded by irq_mutex
+    uint32_t irq_edge_uncertainty_ns;  ///< Uncertainty of irq_edge_ns reported by the SPI backend
+    std::mutex irq_mutex;
+    std::condition_variable irq_cv;    ///< Signalled on every DIO0 edge
+    std::function<void()> irq_listener; ///< Called on every DIO0 edge, guarded by irq_mutex
+    std::recursive_mutex bus_mutex;    ///< Serializes register access and the shadow cache between threads
+    PacketRing<RxPacket, RX_RING_SIZE> rx_ring; ///< Packets drained by the RX engine
+    std::thread rx_thread;             ///< RX engine thread
+    std::atomic<bool> rx_running;      ///< RX engine is active (and its thread, if any, should keep running)
+    std::atomic<uint32_t> rx_dropped;  ///< Packets lost to a full ring
+    std::atomic<uint32_t> rx_crc_errors; ///< Packets lost to CRC errors
+    std::atomic<bool> rx_keep_crc_errors; ///< Store packets with a CRC error in the ring, flagged
+    RadioStats stats;                  ///< Lifetime counters, updated with relaxed atomics
+    uint64_t rx_clear_ns;              ///< Start of the last poll that found RxDone clear, owned by whoever drives the receiver
+
+    /**
+     * @brief One queued transmission
+     */
+    struct TxRequest
+    {
+        uint8_t data[255];
+        uint8_t length;
+        TxOptions options;
+        TxCallback callback;
+    };
+
+    PacketRing<TxRequest, TX_QUEUE_SIZE> tx_ring; ///< Packets waiting for the TX worker
+    std::mutex tx_mutex;               ///< Serializes producers and protects tx_busy
+    std::condition_variable tx_cv;     ///< Signalled when packets are queued or completed
+    std::thread tx_thread;             ///< TX worker thread
+    std::atomic<bool> tx_running;      ///< TX worker should keep running
+    bool tx_busy;                      ///< Worker is transmitting a burst
+    TxOptions tx_options;              ///< Settings applied for the previous packet
+    bool cache_enabled;                ///< Register shadow cache enabled
+    bool op_mode_stale;                ///< Mode bits may have changed on their own (TX, RX single, CAD)
+    bool writes_queued;                ///< writeRegister() queued writes not confirmed by SPIInterface::flush() yet
+    float temperature_offset;          ///< Correction added to the sensor reading, set by calibrateTemperature()
+    uint8_t shadow[SHADOW_LAST + 1];   ///< Shadow copy of configuration registers
+    bool shadow_valid[SHADOW_LAST + 1]; ///< Which shadow entries hold a known value
+
+    /**
+     * @brief Check whether a register never changes behind the host's back
+     * 
+     * @param address Register address
+     * @return True if the register can be served from the shadow cache
+     */
+    bool isCacheable(uint8_t address) const;
+
+    /**
+     * @brief Look up a register in the shadow cache
+     * 
+     * @param address Register address
+     * @param value Receives the cached value
+     * @return True on a cache hit
+     */
+    bool cachedValue(uint8_t address, uint8_t &value) const;
+
+    /**
+     * @brief Record a value read from the module
+     * 
+     * @param address Register address
+     * @param value Value read
+     */
+    void storeShadow(uint8_t address, uint8_t value);
+
+    /**
+     * @brief Record a value written to the module
+     * 
+     * @param address Register address
+     * @param value Value written
+     */
+    void applyShadowWrite(uint8_t address, uint8_t value);
+
+    /**
+     * @brief Drop cached values of the registers whose meaning depends on LoRa/FSK mode
+     */
+    void invalidatePagedRegisters();
+
+    /**
+     * @brief Change the operating mode keeping the LoRa and frequency bits of REG_OP_MODE
+     * 
+     * @param mode One of the MODE_* constants
+     */
+    void setMode(uint8_t mode);
+
+    /**
+     * @brief Switch between the LoRa and FSK/OOK register pages through sleep mode
+     * 
+     * LongRangeMode is only written in sleep mode, so this goes through
+     * sleep on the current page and sleep on the new one before entering mode.
+     * 
+     * @param lora True for the LoRa page, false for FSK/OOK
+     * @param mode One of the MODE_* constants to settle in
+     * @return True if the module reached the mode
+     */
+    bool switchModem(bool lora, uint8_t mode);
+
+    /**
+     * @brief Run the FSK temperature sensor once and restore the previous mode
+     * 
+     * @param raw Uncalibrated reading in degrees Celsius
+     * @return True if successful
+     */
+    bool measureTemperature(int &raw);
+
+    /**
+     * @brief Fast-path part of begin(): check the version and enter LoRa mode
+     * 
+     * @return True if successful
+     */
+    bool fastReset();
+
+    /**
+     * @brief Poll REG_OP_MODE until it reads back a value
+     * 
+     * Bypasses the register cache and stores the value on success.
+     * 
+     * @param op_mode Expected register value
+     * @param timeout_ms Timeout in milliseconds
+     * @return True if the value was read back in time
+     */
+    bool waitForOpMode(uint8_t op_mode, int timeout_ms);
+
+    /**
+     * @brief RX engine thread function
+     */
+    void rxEngineThread();
+
+    /**
+     * @brief TX worker thread function
+     */
+    void txWorkerThread();
+
+    /**
+     * @brief Transmit queued packets back to back until the queue is empty
+     */
+    void transmitBurst();
+
+    /**
+     * @brief Write the settings of a packet that differ from the previous one
+     * 
+     * @param options Settings for the next packet
+     */
+    void applyTxOptions(const TxOptions &options);
+
+    /**
+     * @brief Report the result of the oldest queued packet and free its slot
+     * 
+     * @param success Transmission result
+     */
+    void completeTx(bool success);
+
+    /**
+     * @brief Number of DIO0 edges seen so far
+     * 
+     * @return Edge counter, to be passed to waitForEvent()
+     */
+    uint64_t interruptCount();
+
+    /**
+     * @brief Wait until the IRQ flags are worth reading again
+     * 
+     * With interrupts, blocks until a DIO0 edge newer than seen or the deadline.
+     * Otherwise sleeps for one polling interval.
+     * 
+     * @param seen Edge counter of the last wake-up, updated on return
+     * @param deadline Time at which the caller gives up
+     * @param poll Polling interval without interrupts
+     */
+    void waitForEvent(uint64_t &seen, std::chrono::steady_clock::time_point deadline,
+                      std::chrono::microseconds poll = std::chrono::milliseconds(1));
+
+    /**
+     * @brief Wait for TxDone of a packet that was just started
+     * 
+     * The deadline is the time on air plus 25% and TX_TIMEOUT_MARGIN_MS for
+     * USB latency. Without interrupts the first poll happens when the packet
+     * should be done, then every 1/16 of the airtime (1-20 ms).
+     * 
+     * @param seen Edge counter from before TX was started
+     * @param time_on_air Expected time on air in microseconds
+     * @return True if TxDone was seen before the deadline
+     */
+    bool waitTxDone(uint64_t &seen, uint32_t time_on_air);
+
+    /**
+     * @brief Run one CAD cycle, leaving the module in standby
+     * 
+     * Waits up to four symbols plus CAD_TIMEOUT_MARGIN_MS. Callers hold
+     * bus_mutex and call finishCAD() once done.
+     * 
+     * @param detected Set to true if a preamble was detected
+     * @return True if the cycle completed
+     */
+    bool cadCycle(bool &detected);
+
+    /**
+     * @brief Resume continuous receive after CAD if the RX engine is running
+     */
+    void finishCAD();
+
+    /**
+     * @brief Wait for a clear channel using CAD and random backoff
+     * 
+     * @return True if the channel was found clear within LBT_MAX_ATTEMPTS
+     */
+    bool listenBeforeTalk();
+
+    /**
+     * @brief Record a DIO0 edge and wake waiters
+     * 
+     * @param timestamp_ns Time of the edge in steady_clock nanoseconds
+     * @param uncertainty_ns Half-width of the interval the edge lies in
+     */
+    void recordEdge(uint64_t timestamp_ns, uint32_t uncertainty_ns);
+
+    /**
+     * @brief Timestamp a packet whose RxDone flag was just seen
+     * 
+     * Uses the last DIO0 edge if it came after the last poll that found the
+     * flag clear, the polling interval otherwise.
+     * 
+     * @param packet Packet to stamp
+     * @param clear_ns Start of the last poll that found RxDone clear
+     * @param seen_ns End of the poll that saw RxDone
+     */
+    void stampPacket(RxPacket &packet, uint64_t clear_ns, uint64_t seen_ns);
+
+    /**
+     * @brief Decode the signal report read along with a packet
+     * 
+     * @param packet Packet to fill
+     * @param signal REG_PKT_SNR_VALUE..REG_HOP_CHANNEL
+     * @param freq_error REG_FREQ_ERROR_MSB..LSB
+     */
+    void decodeSignal(RxPacket &packet, const uint8_t *signal, const uint8_t *freq_error);
+
+    /**
+     * @brief Convert RegPktRssiValue to dBm for the band the module is tuned to
+     * 
+     * @param value RegPktRssiValue
+     * @param snr Packet SNR in dB
+     * @return Packet RSSI in dBm
+     */
+    float packetRssi(uint8_t value, float snr);
+
+    /**
+     * @brief Compute the REG_OP_MODE value selecting a mode
+     * 
+     * @param mode One of the MODE_* constants
+     * @return Current upper bits of REG_OP_MODE combined with mode
+     */
+    uint8_t modeValue(uint8_t mode);
+
+    /**
+     * @brief Check whether a register write would change what the module holds
+     * 
+     * @param address Register address
+     * @param value Value to write
+     * @return False if the shadow cache proves the write is a no-op
+     */
+    bool writeNeeded(uint8_t address, uint8_t value) const;
+
+    /**
+     * @brief Set the low data rate optimization for the programmed spreading factor and bandwidth
+     */
+    void updateLowDataRateOptimize();
+
+    /**
+     * @brief Check that a payload can be sent with the current header mode
+     * 
+     * @param length Payload length
+     * @return False, with a message, for SF6 in explicit header mode or a size other than the implicit frame size
+     */
+    bool checkFrameLength(size_t length);
+
+    /**
+     * @brief Queue the IQ inversion registers
+     * 
+     * @param batch Batch to append to
+     * @param invert True to invert IQ
+     */
+    void queueInvertIQ(RegisterBatch &batch, bool invert);
+
+    /**
+     * @brief Queue the DIO mapping registers and unmask all interrupts
+     * 
+     * @param batch Batch to append to
+     * @param _dio3 DIO3 mapping
+     * @param _dio4 DIO4 mapping
+     */
+    void queueDIOMapping(RegisterBatch &batch, uint8_t _dio3, uint8_t _dio4);
 };
 
 #endif // RFM95_HPP
\ No newline at end of file
@@ -0,0 +1,231 @@
+/**
+ * @file RadioPool.hpp
+ * @brief Gateway front end receiving on many RFM95 modules at once
+ *
+ * A RadioPool owns any number of RFM95 instances, each on its own SPI backend
+ * (CH341 adapters and Linux spidev can be mixed), and runs their RX engines
+ * from a small fixed set of worker threads instead of one thread per radio.
+ * Received packets from all radios are merged into a single stream ordered
+ * by their RxDone timestamps.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef RADIO_POOL_HPP
+#define RADIO_POOL_HPP
+
+#include "RFM95.hpp"
+#include "RadioProfile.hpp"
+#include "SPIInterface.hpp"
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class PacketCapture;
+
+/**
+ * @brief Several receivers driven by a fixed pool of worker threads
+ */
+class RadioPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Time between two checks of a radio without a working DIO0 interrupt
+    static constexpr int POLL_INTERVAL_MS = 2;
+
+    // Safety check of interrupt-driven radios, bounds the latency of a missed edge
+    static constexpr int IDLE_CHECK_MS = 100;
+
+    /**
+     * @brief Packet tagged with the radio it came from
+     */
+    struct Packet
+    {
+        size_t radio;        ///< Index returned by addRadio()
+        RFM95::RxPacket rx;  ///< The packet, timestamp_ns orders the stream
+    };
+
+    /**
+     * @brief Constructor
+     *
+     * @param worker_count Number of worker threads (at least 1); radios are spread over them round-robin
+     * @param cpus Cores to pin the workers to, worker i going to cpus[i % size]; empty leaves them unpinned
+     */
+    RadioPool(size_t worker_count = 1, const std::vector<int> &cpus = std::vector<int>());
+
+    /**
+     * @brief Destructor, stops the workers and releases the radios
+     */
+    ~RadioPool();
+
+    RadioPool(const RadioPool &) = delete;
+    RadioPool &operator=(const RadioPool &) = delete;
+
+    /**
+     * @brief Initialize a module on an SPI backend and add it
+     *
+     * @param spi SPI backend the module is on
+     * @param profile Channel and data rate to receive on
+     * @param interrupt_pin Host pin connected to DIO0, -1 to poll the module
+     * @return Radio index, or -1 if the module did not initialize or the pool is running
+     */
+    int addRadio(std::unique_ptr<SPIInterface> spi, const RadioProfile &profile, int interrupt_pin = -1);
+
+    /**
+     * @brief Add a module that is already initialized and configured
+     *
+     * @param radio The module; the pool owns it from now on
+     * @return Radio index, or -1 if the pool is running
+     */
+    int addRadio(std::unique_ptr<RFM95> radio);
+
+    /**
+     * @brief Access a radio, e.g. to transmit or read its counters
+     *
+     * Packets must only be read through the pool while it runs.
+     *
+     * @param index Radio index
+     * @return The radio
+     */
+    RFM95 &getRadio(size_t index);
+
+    /**
+     * @brief Get the number of radios
+     *
+     * @return Radio count
+     */
+    size_t getRadioCount() const;
+
+    /**
+     * @brief Set how long a packet is held back for packets of other radios that are older
+     *
+     * Packets reach the pool some time after their RxDone edge, more so for
+     * polled radios. The output is in timestamp order as long as every radio
+     * delivers within this window. Zero hands packets out as they arrive.
+     *
+     * @param window Reorder window (default 20 ms)
+     */
+    void setReorderWindow(std::chrono::microseconds window);
+
+    /**
+     * @brief Set how many packets of one radio may wait in the merged output
+     *
+     * When a radio reaches the limit its packets stay in its own ring, and
+     * once that fills up too the radio drops and counts further packets
+     * (RFM95::getRxDropped()), without slowing down the other radios.
+     * Packets held back this way may come out after newer packets of other
+     * radios.
+     *
+     * @param limit Packets per radio (default RFM95::RX_RING_SIZE)
+     */
+    void setMaxPendingPerRadio(size_t limit);
+
+    /**
+     * @brief Record every packet in a capture as it is taken from its radio
+     *
+     * Packets are tagged with the radio index and the channel and data rate
+     * the radio had when the pool started. Capturing only copies the packet,
+     * the capture writes it out on its own thread.
+     *
+     * @param capture A started capture, which must outlive the pool's use of it; nullptr to stop capturing
+     */
+    void setCapture(PacketCapture *capture);
+
+    /**
+     * @brief Start the RX engines of all radios and the worker threads
+     *
+     * @return True if successful
+     */
+    bool start();
+
+    /**
+     * @brief Stop the workers; radios stay in RX and keep their rings
+     */
+    void stop();
+
+    /**
+     * @brief Take the oldest packet of the merged stream
+     *
+     * @param packet Receives the packet
+     * @param timeout Timeout in seconds
+     * @return True if a packet was available in time
+     */
+    bool readPacket(Packet &packet, float timeout = 5.0);
+
+    /**
+     * @brief Get the number of packets in the merged output
+     *
+     * @return Packet count
+     */
+    size_t getPending();
+
+private:
+    /**
+     * @brief Per-radio state
+     */
+    struct Member
+    {
+        std::unique_ptr<RFM95> radio;
+        size_t index;
+        size_t worker;                  ///< Worker servicing the radio
+        size_t queued;                  ///< Packets in the output, guarded by output_mutex
+        std::atomic<bool> signalled;    ///< Set by the DIO0 listener
+        RadioProfile profile;           ///< Read back at start(), describes captured packets
+        Clock::time_point next_check;   ///< Worker-local
+    };
+
+    /**
+     * @brief Per-worker state
+     */
+    struct Worker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;     ///< Signalled on edges of its radios and when output space frees up
+        bool wake;                      ///< Guarded by mutex
+        std::vector<Member *> members;
+    };
+
+    std::vector<std::unique_ptr<Member>> members;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<int> cpus;
+
+    std::vector<Packet> output;         ///< Min-heap on timestamp_ns, capacity reserved at start()
+    std::mutex output_mutex;            ///< Protects output, Member::queued and the settings below
+    std::condition_variable output_cv;  ///< Signalled when packets are added
+    std::chrono::nanoseconds reorder_window;
+    size_t max_pending;
+    PacketCapture *capture;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Wake a worker
+     *
+     * @param worker Worker to wake
+     */
+    void wakeWorker(Worker &worker);
+
+    /**
+     * @brief Move a radio's packets from its ring into the output, up to its limit
+     *
+     * @param member Radio
+     */
+    void drain(Member &member);
+
+    /**
+     * @brief Worker thread function
+     *
+     * @param worker Worker state
+     * @param cpu Core to pin to, -1 for none
+     */
+    void run(Worker &worker, int cpu);
+};
+
+#endif // RADIO_POOL_HPP
@@ -0,0 +1,345 @@
+/**
+ * @file RadioProfile.hpp
+ * @brief Precomputed SX127x LoRa register images and frequency hop tables
+ *
+ * A RadioProfile holds the exact register values for one channel and data
+ * rate, so switching to it costs a single register batch with no float math
+ * or read-modify-write cycles. Profiles and hop tables can be built at
+ * compile time:
+ *
+ * @code
+ * constexpr RadioProfile uplink = RadioProfile::make(868100000, 7, 125000, 5, 14);
+ * constexpr HopTable<8> channels = HopTable<8>::uniform(867100000, 200000);
+ * @endcode
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef RADIO_PROFILE_HPP
+#define RADIO_PROFILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Carrier frequency as the three RegFrf bytes (MSB first)
+ */
+struct Frf
+{
+    uint8_t bytes[3];
+
+    /**
+     * @brief Convert a frequency, rounding to the nearest 61.035 Hz step
+     *
+     * @param hz Carrier frequency in Hz
+     * @return Register value, Frf = hz * 2^19 / 32 MHz
+     */
+    static constexpr Frf fromHz(uint32_t hz)
+    {
+        uint32_t frf = static_cast<uint32_t>(((static_cast<uint64_t>(hz) << 19) + 16000000) / 32000000);
+        return Frf{{static_cast<uint8_t>(frf >> 16), static_cast<uint8_t>(frf >> 8), static_cast<uint8_t>(frf)}};
+    }
+
+    /**
+     * @brief Convert back to a frequency
+     *
+     * @return Carrier frequency in Hz
+     */
+    constexpr uint32_t toHz() const
+    {
+        return static_cast<uint32_t>(
+            (((static_cast<uint64_t>(bytes[0]) << 16) | (static_cast<uint64_t>(bytes[1]) << 8) | bytes[2]) *
+                 32000000 + (1 << 18)) >> 19);
+    }
+};
+
+/**
+ * @brief Register image of one LoRa channel and data rate
+ */
+struct RadioProfile
+{
+    Frf frf;                     ///< RegFrfMsb..Lsb (0x06-0x08)
+    uint8_t pa_config;           ///< RegPaConfig (0x09), contiguous with RegFrf
+    uint8_t modem_config_1;      ///< RegModemConfig1 (0x1D): bandwidth, coding rate, implicit header
+    uint8_t modem_config_2;      ///< RegModemConfig2 (0x1E): spreading factor, RX CRC
+    uint8_t modem_config_3;      ///< RegModemConfig3 (0x26): low data rate optimize, AGC
+    uint8_t detection_optimize;  ///< RegDetectOptimize (0x31)
+    uint8_t detection_threshold; ///< RegDetectionThreshold (0x37)
+    uint8_t sync_word;           ///< RegSyncWord (0x39)
+    uint8_t pa_dac;              ///< RegPaDac (0x4D)
+    uint8_t payload_length;      ///< RegPayloadLength (0x22): frame size in implicit header mode, unused otherwise
+
+    /**
+     * @brief Divisor of 500 kHz giving the bandwidth of a RegModemConfig1 code
+     *
+     * The bandwidths are 500 kHz / 64, 48, 32, 24, 16, 12, 8, 4, 2 and 1; the
+     * datasheet rounds the narrow ones, 7.8 kHz is 7812.5 Hz and 41.7 kHz is
+     * 41666.67 Hz.
+     *
+     * @param code Bandwidth code
+     * @return The divisor
+     */
+    static constexpr uint32_t bandwidthDivisor(uint8_t code)
+    {
+        const uint32_t divisors[] = {64, 48, 32, 24, 16, 12, 8, 4, 2, 1};
+        return divisors[code < 10 ? code : 9];
+    }
+
+    /**
+     * @brief Bandwidth code for RegModemConfig1, as RFM95::setBandwidth() picks it
+     *
+     * @param hz Bandwidth in Hz, rounded up to the next supported value; the
+     *           datasheet's rounded figures (e.g. 41700) select their own code
+     * @return Code 0 (7.8 kHz) to 9 (500 kHz)
+     */
+    static constexpr uint8_t bandwidthCode(uint32_t hz)
+    {
+        uint8_t code = 9;
+        for (uint8_t i = 0; i < 10; i++)
+        {
+            // hz <= 500 kHz / divisor, with 0.1% slack for the rounded figures
+            if (static_cast<uint64_t>(hz) * bandwidthDivisor(i) <= 500500)
+            {
+                code = i;
+                break;
+            }
+        }
+        return code;
+    }
+
+    /**
+     * @brief Bandwidth of a RegModemConfig1 code
+     *
+     * @param code Bandwidth code
+     * @return Bandwidth in Hz, rounded to the nearest Hz; timing uses symbolUs() instead
+     */
+    static constexpr uint32_t bandwidthHz(uint8_t code)
+    {
+        return (500000 + bandwidthDivisor(code) / 2) / bandwidthDivisor(code);
+    }
+
+    /**
+     * @brief Duration of one LoRa symbol, 2^SF / BW
+     *
+     * @param sf Spreading factor (6-12)
+     * @param code Bandwidth code
+     * @return Symbol time in microseconds, exact for every supported bandwidth
+     */
+    static constexpr uint32_t symbolUs(int sf, uint8_t code)
+    {
+        return (static_cast<uint32_t>(1) << sf) * bandwidthDivisor(code) * 2;
+    }
+
+    /**
+     * @brief Whether the low data rate optimization is mandated, for symbols longer than 16 ms
+     *
+     * @param sf Spreading factor (6-12)
+     * @param code Bandwidth code
+     * @return True if it must be enabled
+     */
+    static constexpr bool lowDataRateOptimize(int sf, uint8_t code)
+    {
+        return symbolUs(sf, code) > 16000;
+    }
+
+    /**
+     * @brief Build a profile
+     *
+     * Values are clamped like the individual RFM95 setters. The low data rate
+     * optimization is enabled when a symbol lasts longer than 16 ms, and
+     * output powers above 17 dBm select the high-power PA_BOOST mode.
+     * SF6 only works in implicit header mode, so it needs an implicit_length.
+     *
+     * @param frequency_hz Carrier frequency in Hz
+     * @param sf Spreading factor (6-12)
+     * @param bandwidth_hz Bandwidth in Hz
+     * @param coding_rate Coding rate denominator (5-8)
+     * @param power_dbm Output power on PA_BOOST (2-20 dBm)
+     * @param sync_word Sync word (0x12 private, 0x34 public networks)
+     * @param crc Send a payload CRC, and check it on reception
+     * @param implicit_length Frame size for implicit header mode (1-255), 0 for explicit header
+     * @return The profile
+     */
+    static constexpr RadioProfile make(uint32_t frequency_hz, int sf, uint32_t bandwidth_hz,
+                                       int coding_rate = 5, int power_dbm = 17,
+                                       uint8_t sync_word = 0x12, bool crc = false,
+                                       uint8_t implicit_length = 0)
+    {
+        sf = sf < 6 ? 6 : (sf > 12 ? 12 : sf);
+        coding_rate = coding_rate < 5 ? 5 : (coding_rate > 8 ? 8 : coding_rate);
+        power_dbm = power_dbm < 2 ? 2 : (power_dbm > 20 ? 20 : power_dbm);
+
+        uint8_t bw = bandwidthCode(bandwidth_hz);
+        bool ldro = lowDataRateOptimize(sf, bw);
+        bool high_power = power_dbm > 17;
+
+        return RadioProfile{
+            Frf::fromHz(frequency_hz),
+            static_cast<uint8_t>(0x80 | (high_power ? power_dbm - 5 : power_dbm - 2)),
+            static_cast<uint8_t>((bw << 4) | ((coding_rate - 4) << 1) | (implicit_length > 0 ? 0x01 : 0x00)),
+            static_cast<uint8_t>((sf << 4) | (crc ? 0x04 : 0x00)),
+            static_cast<uint8_t>((ldro ? 0x08 : 0x00) | 0x04),
+            static_cast<uint8_t>(sf == 6 ? 0xC5 : 0xC3),
+            static_cast<uint8_t>(sf == 6 ? 0x0C : 0x0A),
+            sync_word,
+            static_cast<uint8_t>(high_power ? 0x87 : 0x84),
+            implicit_length};
+    }
+
+    /**
+     * @brief LoRa time on air, following the SX1276 datasheet (section 4.1.1.7)
+     *
+     * Tsym = 2^SF / BW, the preamble lasts preamble_length + 4.25 symbols and
+     * the payload 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * (CR + 4), 0)
+     * symbols.
+     *
+     * @param sf Spreading factor (6-12)
+     * @param bandwidth_hz Bandwidth in Hz
+     * @param coding_rate Coding rate denominator (5-8)
+     * @param preamble_length Programmed preamble length in symbols
+     * @param payload_length Payload length in bytes
+     * @param crc Payload CRC enabled
+     * @param implicit_header Implicit header mode
+     * @param ldro Low data rate optimization enabled
+     * @return Time on air in microseconds, rounded up
+     */
+    static constexpr uint32_t timeOnAirUs(int sf, uint32_t bandwidth_hz, int coding_rate,
+                                          uint16_t preamble_length, size_t payload_length,
+                                          bool crc, bool implicit_header, bool ldro)
+    {
+        uint64_t quarters = timeOnAirQuarters(sf, coding_rate, preamble_length, payload_length, crc, implicit_header, ldro);
+        uint64_t scale = static_cast<uint64_t>(4) * bandwidth_hz;
+        return static_cast<uint32_t>((quarters * (static_cast<uint64_t>(1) << sf) * 1000000 + scale - 1) / scale);
+    }
+
+    /**
+     * @brief Length of a LoRa packet in quarter symbols
+     *
+     * Quarters keep the 4.25-symbol preamble tail exact. Parameters as for timeOnAirUs().
+     *
+     * @return Quarter symbols from the start of the preamble to the end of the payload
+     */
+    static constexpr uint64_t timeOnAirQuarters(int sf, int coding_rate, uint16_t preamble_length,
+                                                size_t payload_length, bool crc, bool implicit_header, bool ldro)
+    {
+        int64_t numerator = 8 * static_cast<int64_t>(payload_length) - 4 * sf + 28 +
+                            (crc ? 16 : 0) - (implicit_header ? 20 : 0);
+        int64_t denominator = 4 * (sf - (ldro ? 2 : 0));
+        int64_t blocks = numerator > 0 ? (numerator + denominator - 1) / denominator : 0;
+        int64_t payload_symbols = 8 + blocks * coding_rate;
+        return (static_cast<uint64_t>(preamble_length) * 4 + 17) + static_cast<uint64_t>(payload_symbols) * 4;
+    }
+
+    /**
+     * @brief LoRa time on air for raw modem register values
+     *
+     * @param modem_config_1 RegModemConfig1
+     * @param modem_config_2 RegModemConfig2
+     * @param modem_config_3 RegModemConfig3
+     * @param preamble_length Programmed preamble length in symbols
+     * @param payload_length Payload length in bytes
+     * @return Time on air in microseconds
+     */
+    static constexpr uint32_t timeOnAirUs(uint8_t modem_config_1, uint8_t modem_config_2, uint8_t modem_config_3,
+                                          uint16_t preamble_length, size_t payload_length)
+    {
+        // With the exact symbol time of the bandwidth code
+        return static_cast<uint32_t>(
+            (timeOnAirQuarters((modem_config_2 >> 4) & 0x0F, 4 + ((modem_config_1 >> 1) & 0x07), preamble_length,
+                               payload_length, (modem_config_2 & 0x04) != 0, (modem_config_1 & 0x01) != 0,
+                               (modem_config_3 & 0x08) != 0) *
+                 symbolUs((modem_config_2 >> 4) & 0x0F, (modem_config_1 >> 4) & 0x0F) + 3) / 4);
+    }
+
+    /**
+     * @brief Time on air of a packet sent with this profile
+     *
+     * @param payload_length Payload length in bytes
+     * @param preamble_length Programmed preamble length in symbols (the module default is 8)
+     * @return Time on air in microseconds
+     */
+    constexpr uint32_t timeOnAirUs(size_t payload_length, uint16_t preamble_length = 8) const
+    {
+        return timeOnAirUs(modem_config_1, modem_config_2, modem_config_3, preamble_length, payload_length);
+    }
+
+    /**
+     * @brief Output power this profile transmits with
+     *
+     * @return Power in dBm, decoded like RFM95::getTxPower() plus the high-power PA_BOOST mode
+     */
+    constexpr int powerDbm() const
+    {
+        return !(pa_config & 0x80) ? (pa_config & 0x0F) : (pa_config & 0x0F) + (pa_dac == 0x87 ? 5 : 2);
+    }
+
+    /**
+     * @brief The same data rate on another carrier frequency
+     *
+     * @param frequency_hz Carrier frequency in Hz
+     * @return The profile
+     */
+    constexpr RadioProfile withFrequency(uint32_t frequency_hz) const
+    {
+        return RadioProfile{Frf::fromHz(frequency_hz), pa_config, modem_config_1, modem_config_2,
+                            modem_config_3, detection_optimize, detection_threshold, sync_word, pa_dac,
+                            payload_length};
+    }
+};
+
+/**
+ * @brief Precomputed carrier frequencies for channel hopping
+ *
+ * @tparam N Number of channels
+ */
+template <size_t N>
+struct HopTable
+{
+    Frf channels[N];
+
+    /**
+     * @brief Build a table of equally spaced channels
+     *
+     * @param first_hz Frequency of channel 0 in Hz
+     * @param spacing_hz Distance between neighbouring channels in Hz
+     * @return The table
+     */
+    static constexpr HopTable uniform(uint32_t first_hz, uint32_t spacing_hz)
+    {
+        HopTable table{};
+        for (size_t i = 0; i < N; i++)
+        {
+            table.channels[i] = Frf::fromHz(static_cast<uint32_t>(first_hz + i * spacing_hz));
+        }
+        return table;
+    }
+
+    /**
+     * @brief Build a table from a list of frequencies
+     *
+     * @param hz Channel frequencies in Hz
+     * @return The table
+     */
+    static constexpr HopTable fromList(const uint32_t (&hz)[N])
+    {
+        HopTable table{};
+        for (size_t i = 0; i < N; i++)
+        {
+            table.channels[i] = Frf::fromHz(hz[i]);
+        }
+        return table;
+    }
+
+    constexpr const Frf &operator[](size_t channel) const
+    {
+        return channels[channel];
+    }
+
+    static constexpr size_t size()
+    {
+        return N;
+    }
+};
+
+#endif // RADIO_PROFILE_HPP
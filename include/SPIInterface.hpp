@@ -11,6 +11,10 @@
 #include <memory>
 #include <functional>
 #include <string>
+#include <algorithm>
+#include "Stats.hpp"
+
+class USBManager;
 
 /**
  * @brief   Abstract interface for SPI communication
@@ -51,7 +55,80 @@ public:
      * @return A vector containing the data read from the SPI device.
      */
     virtual std::vector<uint8_t> transfer(const std::vector<uint8_t>& write_data, size_t read_length = 0) = 0;
-    
+
+    /***
+     * Transfers data over SPI using caller-owned buffers.
+     * Clocks out tx_len bytes, then clocks in rx_len more bytes into rx, all
+     * within one chip-select frame. Implementations that override this do not
+     * allocate memory.
+     * @param tx The data to write to the SPI device.
+     * @param tx_len The number of bytes to write.
+     * @param rx The buffer receiving the bytes read after the write phase (may be null if rx_len is 0).
+     * @param rx_len The number of bytes to read.
+     * @return True if the transfer succeeded, false otherwise.
+     */
+    virtual bool transfer(const uint8_t* tx, size_t tx_len, uint8_t* rx, size_t rx_len) {
+        std::vector<uint8_t> response = transfer(std::vector<uint8_t>(tx, tx + tx_len), rx_len);
+        if (response.size() < rx_len) {
+            return false;
+        }
+        std::copy(response.begin(), response.begin() + rx_len, rx);
+        return true;
+    }
+
+    /***
+     * One CS-framed transaction of a batch, see transferBatch().
+     */
+    struct Transaction {
+        const uint8_t* tx;  ///< Bytes to clock out first
+        size_t tx_len;      ///< Number of bytes in tx
+        uint8_t* rx;        ///< Receives the bytes clocked in after tx (may be null if rx_len is 0)
+        size_t rx_len;      ///< Number of bytes to read after tx
+    };
+
+    /***
+     * Executes several independent transactions as one bus submission.
+     * Chip select is asserted around each transaction and released between
+     * them, exactly as if transfer() had been called once per entry, but
+     * implementations may hand the whole list to the hardware at once.
+     * A batch without read phases may return before the data is on the bus,
+     * with the same ordering guarantees as queueWrite(). The tx buffers may be
+     * reused as soon as the call returns.
+     * @param transactions The transactions, executed in order.
+     * @param count The number of transactions.
+     * @return True if every transaction succeeded (or was accepted), false otherwise.
+     */
+    virtual bool transferBatch(const Transaction* transactions, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const Transaction& t = transactions[i];
+            if (!transfer(t.tx, t.tx_len, t.rx, t.rx_len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /***
+     * Queues a write-only SPI transaction.
+     * Implementations with an asynchronous transport may return before the data
+     * is on the bus. Transactions are always executed in the order they were
+     * queued, and before any later transfer().
+     * @param data The data to write to the SPI device (copied before returning).
+     * @param length The number of bytes to write.
+     * @return True if the transaction was accepted, false otherwise.
+     */
+    virtual bool queueWrite(const uint8_t* data, size_t length) {
+        return transfer(data, length, nullptr, 0);
+    }
+
+    /***
+     * Waits until every queued transaction has completed.
+     * @return True if all queued transactions succeeded since the last flush, false otherwise.
+     */
+    virtual bool flush() {
+        return true;
+    }
+
     /***
      * Writes a digital value to a specified pin.
      * @param pin The pin number.
@@ -89,6 +166,52 @@ public:
     using InterruptCallback = std::function<void(void)>;
     virtual bool setInterruptCallback(InterruptCallback callback) = 0;
 
+    /***
+     * Signal edges that can trigger an interrupt.
+     */
+    enum class InterruptEdge {
+        None,
+        Rising,
+        Falling,
+        Both
+    };
+
+    /***
+     * One interrupt as reported by the edge detector.
+     */
+    struct InterruptEvent {
+        uint8_t pin;             ///< Pin that triggered
+        bool rising;             ///< True for a rising edge, false for a falling edge
+        uint64_t timestamp_ns;   ///< Time of the edge on the std::chrono::steady_clock timeline
+        uint32_t uncertainty_ns; ///< Half-width of the interval the edge lies in, 0 if timestamped by the edge detector
+    };
+
+    /***
+     * Callback function receiving interrupt details.
+     */
+    using InterruptEventCallback = std::function<void(const InterruptEvent&)>;
+
+    /***
+     * Selects the interrupt pin and the edges that trigger it.
+     * @param pin The pin number.
+     * @param edge The triggering edges, InterruptEdge::None to disable the pin.
+     * @return True if the operation was successful, false otherwise.
+     */
+    virtual bool configureInterrupt(uint8_t pin, InterruptEdge edge) {
+        return configureInterrupt(pin, edge != InterruptEdge::None);
+    }
+
+    /***
+     * Sets a callback receiving the edge and timestamp of every interrupt.
+     * When set, it is called instead of the InterruptCallback.
+     * @param callback The callback (empty to remove it).
+     * @return True if the implementation reports interrupt events, false otherwise.
+     */
+    virtual bool setInterruptEventCallback(InterruptEventCallback callback) {
+        (void)callback;
+        return false;
+    }
+
     /***
      * Enables or disables interrupts.
      * @param enable True to enable interrupts, false to disable them.
@@ -101,6 +224,22 @@ public:
      * @return True if the device is active, false otherwise.
      */
     virtual bool isActive() const = 0;
+
+    /***
+     * Counters, latency histograms and the error trace hook of this interface.
+     * Updated with relaxed atomics, so they may be read from any thread at any time.
+     * @return The statistics.
+     */
+    BusStats& getStats() {
+        return stats;
+    }
+
+    const BusStats& getStats() const {
+        return stats;
+    }
+
+protected:
+    BusStats stats;
 };
 
 /**
@@ -111,21 +250,49 @@ public:
  */
 class SPIFactory {
 public:
-    static std::unique_ptr<SPIInterface> createCH341SPI(int device_index = 0, bool lsb_first = false);
+    /***
+     * Creates a CH341 interface.
+     * @param device_index Index of the adapter, in USB topology order.
+     * @param lsb_first Set LSB first mode.
+     * @param speed Stream rate in Hz, rounded down to the nearest CH341 rate (20k, 100k, 400k or 750k).
+     * @return A unique pointer to an SPIInterface.
+     */
+    static std::unique_ptr<SPIInterface> createCH341SPI(int device_index = 0, bool lsb_first = false,
+                                                        uint32_t speed = 100000);
+
+    /***
+     * Creates a CH341 interface for the adapter at a USB topology path or with a serial number.
+     * @param device_path Path such as "1-1.4" (see USBManager::listDevices()) or serial number.
+     * @param lsb_first Set LSB first mode.
+     * @param speed Stream rate in Hz, rounded down to the nearest CH341 rate.
+     * @return A unique pointer to an SPIInterface.
+     */
+    static std::unique_ptr<SPIInterface> createCH341SPI(const std::string& device_path, bool lsb_first = false,
+                                                        uint32_t speed = 100000);
     static std::unique_ptr<SPIInterface> createLinuxSPI(const std::string& device = std::string("/dev/spidev0.0"), 
                                                       uint32_t speed = 1000000,
                                                       uint8_t mode = 0);
     /***
      * Creates an SPI interface for a specific device type.
-     * @param device_type The type of SPI device to create (e.g., "CH341", "Linux").
-     * @param device_index Optional parameter for device index.
+     * @param device_type The type of SPI device to create, case-insensitive: "CH341", "Linux" (or "spidev"),
+     *                    or "sim" for a simulated SX127x ("sim-ch341" and "sim-spidev" add their transfer latency).
+     * @param device_index Optional parameter for device index (the spidev chip select for "Linux").
      * @param lsb_first Optional parameter to set LSB first mode for CH341 devices.
      * @return A unique pointer to an SPIInterface, or nullptr if the type is unsupported.
      */
     static std::unique_ptr<SPIInterface> createSPIInterface(const std::string& device_type, int device_index = 0, bool lsb_first = false);
     
+    /***
+     * Returns the process-wide USB manager shared by all CH341 interfaces,
+     * creating it on first use.
+     * @return The manager; never null, but its context is null if libusb failed to initialize.
+     */
+    static std::shared_ptr<USBManager> getUSBManager();
+
     /***
      * Releases any resources used by the factory.
+     * Drops the factory's reference to the USB manager; the libusb context is
+     * released once no CH341 interface uses it any more.
      */
     static void cleanupResources();
     
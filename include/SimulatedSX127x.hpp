@@ -0,0 +1,337 @@
+/**
+ * @file SimulatedSX127x.hpp
+ * @brief SPIInterface backend emulating an SX127x LoRa transceiver
+ *
+ * Lets RFM95 run without hardware: the simulator decodes the SPI register
+ * protocol against a 128-register file and the 256-byte FIFO, runs the LoRa
+ * operating modes in real time (TX, continuous and single RX, CAD) using the
+ * datasheet time on air, and raises DIO0 as the chip would. Packets are
+ * injected with the signal quality the receiver should report, and an
+ * optional latency model makes every transfer cost what it would on a CH341
+ * adapter or on spidev, so driver overhead can be measured on its own.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#pragma once
+
+#include "SPIInterface.hpp"
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <random>
+
+/**
+ * @class SimulatedSX127x
+ * @brief A simulated SX1276/77/78/79 behind an SPIInterface.
+ */
+class SimulatedSX127x : public SPIInterface {
+public:
+    /**
+     * @brief Time charged for every SPI transaction
+     */
+    struct LatencyModel {
+        uint32_t transfer_ns; ///< Fixed cost of one transaction (or one batch)
+        uint32_t byte_ns;     ///< Additional cost per byte clocked
+
+        constexpr LatencyModel(uint32_t transfer_ns = 0, uint32_t byte_ns = 0)
+            : transfer_ns(transfer_ns), byte_ns(byte_ns) {}
+
+        /**
+         * @brief No latency, transfers cost only the simulation itself
+         */
+        static constexpr LatencyModel none() { return LatencyModel(0, 0); }
+
+        /**
+         * @brief A CH341 at its default stream rate: one USB round trip per transaction
+         */
+        static constexpr LatencyModel ch341() { return LatencyModel(1000000, 10000); }
+
+        /**
+         * @brief Linux spidev: one ioctl per transaction
+         *
+         * @param speed_hz SPI clock in Hz
+         */
+        static constexpr LatencyModel spidev(uint32_t speed_hz = 1000000)
+        {
+            return LatencyModel(20000, static_cast<uint32_t>(8000000000ull / speed_hz));
+        }
+    };
+
+    /**
+     * @brief How an injected packet is received
+     */
+    struct InjectOptions {
+        std::chrono::microseconds delay; ///< Time from now to the start of the preamble
+        uint64_t start_ns;               ///< Absolute preamble start on the steady_clock timeline, overrides delay if non-zero
+        uint32_t frequency_hz;           ///< Carrier frequency, 0 to be received on any channel
+        float rssi;                      ///< Packet RSSI in dBm
+        float snr;                       ///< Packet SNR in dB
+        int32_t freq_error_hz;           ///< Carrier offset reported in RegFei
+        bool crc_on_payload;             ///< The sender added a payload CRC, reported in RegHopChannel with an explicit header
+        bool crc_error;                  ///< Flag a payload CRC error
+
+        InjectOptions()
+            : delay(0), start_ns(0), frequency_hz(0), rssi(-60.0f), snr(9.0f), freq_error_hz(0), crc_on_payload(true),
+              crc_error(false) {}
+    };
+
+    /**
+     * @brief A packet transmitted by the simulated chip
+     */
+    struct Transmission {
+        std::vector<uint8_t> data;       ///< Payload
+        uint32_t frequency_hz;           ///< Carrier frequency
+        uint8_t modem_config[3];         ///< RegModemConfig1, 2 and 3 during the transmission
+        bool invert_iq;                  ///< RegInvertIQ InvertIQ-TX bit
+        uint64_t start_ns;               ///< Start of the preamble on the steady_clock timeline
+        uint64_t end_ns;                 ///< TxDone
+    };
+
+    using TransmitCallback = std::function<void(const Transmission&)>;
+
+    /**
+     * @brief Constructor, the chip starts in its power-on reset state
+     *
+     * @param latency Cost of every SPI transaction
+     */
+    SimulatedSX127x(const LatencyModel& latency = LatencyModel());
+
+    /**
+     * @brief Destructor, stops the interrupt thread
+     */
+    ~SimulatedSX127x();
+
+    SimulatedSX127x(const SimulatedSX127x&) = delete;
+    SimulatedSX127x& operator=(const SimulatedSX127x&) = delete;
+
+    bool open() override;
+    void close() override;
+    std::vector<uint8_t> transfer(const std::vector<uint8_t>& write_data, size_t read_length = 0) override;
+    bool transfer(const uint8_t* tx, size_t tx_len, uint8_t* rx, size_t rx_len) override;
+    bool transferBatch(const Transaction* transactions, size_t count) override;
+
+    /**
+     * @brief Pins are plain latches, except the interrupt pin which reads DIO0
+     */
+    bool digitalWrite(uint8_t pin, bool value) override;
+    bool digitalRead(uint8_t pin) override;
+    bool pinMode(uint8_t pin, uint8_t mode) override;
+
+    /**
+     * @brief Wire DIO0 to a pin and trigger on its rising edge
+     */
+    bool configureInterrupt(uint8_t pin, bool enable) override;
+    bool configureInterrupt(uint8_t pin, InterruptEdge edge) override;
+    bool setInterruptCallback(InterruptCallback callback) override;
+
+    /**
+     * @brief Edges are reported with the exact simulated time and zero uncertainty
+     */
+    bool setInterruptEventCallback(InterruptEventCallback callback) override;
+    bool enableInterrupt(bool enable) override;
+    bool isActive() const override;
+
+    /**
+     * @brief Change the cost of SPI transactions
+     *
+     * @param latency The new model
+     */
+    void setLatencyModel(const LatencyModel& latency);
+
+    /**
+     * @brief Scale every on-air duration (TX, RX, CAD, RX timeouts)
+     *
+     * @param scale 1.0 for real time, 0 to complete them at the next access
+     */
+    void setAirtimeScale(double scale);
+
+    /**
+     * @brief Put a packet on the air for the receiver
+     *
+     * It is received if the chip is in RX on its frequency from the start of
+     * the preamble until the end of the packet, which is computed from the
+     * modem configuration at that moment.
+     *
+     * @param data Payload
+     * @param length Payload length (max 255)
+     * @param options Timing and signal quality
+     * @return False if the payload is too long
+     */
+    bool injectPacket(const uint8_t* data, size_t length, const InjectOptions& options = InjectOptions());
+
+    /**
+     * @brief Report activity on every channel to CAD and RegRssiValue
+     *
+     * @param busy True to make CAD detect a preamble even without an injected packet
+     */
+    void setChannelBusy(bool busy);
+
+    /**
+     * @brief Set a function called after each completed transmission
+     *
+     * Handing the transmission to another simulator's injectPacket() with
+     * start_ns set links two radios.
+     *
+     * @param callback The function (empty to remove it)
+     */
+    void setTransmitCallback(TransmitCallback callback);
+
+    /**
+     * @brief Take the transmissions completed so far
+     *
+     * @return Transmissions, oldest first
+     */
+    std::vector<Transmission> takeTransmissions();
+
+    /**
+     * @brief Return every register, the FIFO and the mode to the power-on reset state
+     */
+    void reset();
+
+    /**
+     * @brief Read a register without SPI side effects or latency
+     *
+     * @param address Register address
+     * @return Register value
+     */
+    uint8_t peekRegister(uint8_t address);
+
+    /**
+     * @brief Get the number of SPI transactions so far, same as getStats().transactions
+     *
+     * @return Transaction count
+     */
+    uint64_t getTransferCount() const;
+
+    /**
+     * @brief Get the number of bytes clocked so far, both directions
+     *
+     * @return Byte count
+     */
+    uint64_t getByteCount() const;
+
+private:
+    /**
+     * @brief An injected packet waiting for its end of reception
+     */
+    struct OnAir {
+        std::vector<uint8_t> data;
+        InjectOptions options;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    uint8_t regs[128];
+    uint8_t fifo[256];
+    uint8_t rx_write;                  ///< Where the next received packet is written
+    uint64_t mode_event_ns;            ///< TxDone, CadDone or RxTimeout of the current mode, 0 if none
+    uint64_t mode_start_ns;            ///< When the current mode was entered
+    std::deque<OnAir> on_air;          ///< Injected packets ordered by end_ns
+    std::vector<Transmission> transmissions;
+    bool channel_busy;
+    bool dio0;                         ///< Current DIO0 level
+    std::minstd_rand noise;            ///< RegRssiWideband source
+    double airtime_scale;
+    LatencyModel latency;
+    bool opened;
+
+    uint8_t pin_state;                 ///< Latched digitalWrite() values
+    int interrupt_pin;                 ///< Pin wired to DIO0, -1 if none
+    InterruptEdge interrupt_edge;
+    InterruptCallback interrupt_callback;
+    InterruptEventCallback interrupt_event_callback;
+    TransmitCallback transmit_callback;
+    std::vector<InterruptEvent> edges; ///< Edges waiting for the interrupt thread
+
+    mutable std::mutex mutex;          ///< Protects all of the above
+    std::condition_variable cv;        ///< Wakes the interrupt thread on mode changes and edges
+    std::thread interrupt_thread;
+    std::atomic<bool> interrupt_running;
+
+    /**
+     * @brief Burn the time one submission (a transaction or a whole batch) costs
+     *
+     * @param bytes Bytes clocked in both directions
+     */
+    void chargeLatency(size_t bytes);
+
+    /**
+     * @brief Run one CS-framed transaction against the register file, with the lock held
+     *
+     * @param tx Bytes clocked out, the first one is the address byte
+     * @param tx_len Number of bytes in tx
+     * @param rx Bytes clocked in after tx
+     * @param rx_len Number of bytes to read
+     * @param delivered Receives transmissions completed meanwhile
+     */
+    void execute(const uint8_t* tx, size_t tx_len, uint8_t* rx, size_t rx_len, std::vector<Transmission>& delivered);
+
+    uint8_t readRegister(uint8_t address, uint64_t now);
+    void writeRegister(uint8_t address, uint8_t value, uint64_t now);
+
+    /**
+     * @brief Handle a write to RegOpMode
+     *
+     * @param value Value written
+     * @param now Current time
+     */
+    void setOpMode(uint8_t value, uint64_t now);
+
+    /**
+     * @brief Complete every mode event and packet that is due
+     *
+     * @param now Current time
+     * @param delivered Receives completed transmissions
+     */
+    void advance(uint64_t now, std::vector<Transmission>& delivered);
+
+    /**
+     * @brief Store a packet in the FIFO as the modem does at RxDone
+     *
+     * @param packet The packet
+     */
+    void receivePacket(const OnAir& packet);
+
+    /**
+     * @brief Recompute DIO0 and queue an edge for the interrupt thread
+     *
+     * @param when Time of the change
+     */
+    void updateDio0(uint64_t when);
+
+    /**
+     * @brief Check whether a packet is on the air on the current channel
+     *
+     * @param now Current time
+     * @return The packet, or nullptr
+     */
+    const OnAir* activePacket(uint64_t now) const;
+
+    bool loraMode() const;
+    uint8_t mode() const;
+    uint32_t frequencyHz() const;
+    uint64_t scaled(uint64_t duration_ns) const;
+    uint64_t symbolNs() const;
+    uint64_t timeOnAirNs(size_t payload_length) const;
+
+    /**
+     * @brief Hand completed transmissions to the callback, without the lock
+     *
+     * @param lock Lock on mutex, released while calling out
+     * @param delivered Transmissions to report
+     */
+    void deliver(std::unique_lock<std::mutex>& lock, std::vector<Transmission>& delivered);
+
+    /**
+     * @brief Interrupt thread function
+     */
+    void interruptThread();
+};
@@ -0,0 +1,386 @@
+/**
+ * @file Stats.hpp
+ * @brief Counters, latency histograms and the trace hook of the bus and radio drivers
+ *
+ * Everything here is updated with relaxed atomic operations from the hot
+ * paths, so it stays enabled in production: recording a latency costs a
+ * handful of instructions and no locks. Readers see each value exactly,
+ * but not a consistent snapshot across values.
+ *
+ * Errors the drivers used to print on std::cerr also go through a
+ * TraceHook. Once a callback is installed the messages are handed to it
+ * instead of being printed.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+
+/**
+ * @brief Event counter
+ */
+class StatsCounter
+{
+public:
+    StatsCounter() : value(0) {}
+
+    StatsCounter(const StatsCounter &) = delete;
+    StatsCounter &operator=(const StatsCounter &) = delete;
+
+    void add(uint64_t amount = 1)
+    {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        value.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value;
+};
+
+/**
+ * @brief Latency histogram with power-of-two microsecond buckets
+ *
+ * Bucket 0 counts samples below 1 us, bucket i samples from 2^(i-1) up to
+ * 2^i us, and the last bucket everything from about 4 s up.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS = 24;
+
+    LatencyHistogram()
+        : total_ns(0),
+          max_ns(0)
+    {
+        reset();
+    }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    /**
+     * @brief Record one sample
+     *
+     * @param ns Latency in nanoseconds
+     */
+    void record(uint64_t ns)
+    {
+        buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t seen = max_ns.load(std::memory_order_relaxed);
+        while (ns > seen && !max_ns.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Record the time since a start point
+     *
+     * @param start Start of the measured operation
+     */
+    void recordSince(std::chrono::steady_clock::time_point start)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    /**
+     * @brief Get the number of samples in one bucket
+     *
+     * @param bucket Bucket index
+     * @return Sample count
+     */
+    uint64_t getBucket(size_t bucket) const
+    {
+        return bucket < BUCKETS ? buckets[bucket].load(std::memory_order_relaxed) : 0;
+    }
+
+    /**
+     * @brief Upper edge of a bucket
+     *
+     * @param bucket Bucket index
+     * @return Bound in nanoseconds, UINT64_MAX for the last bucket
+     */
+    static uint64_t bucketLimitNs(size_t bucket)
+    {
+        return bucket + 1 >= BUCKETS ? UINT64_MAX : (static_cast<uint64_t>(1) << bucket) * 1000;
+    }
+
+    uint64_t getCount() const
+    {
+        uint64_t count = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            count += buckets[i].load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    uint64_t getTotalNs() const
+    {
+        return total_ns.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMaxNs() const
+    {
+        return max_ns.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Estimate a percentile
+     *
+     * @param fraction Percentile as a fraction (0.99 for p99)
+     * @return Upper edge of the bucket holding the percentile, the maximum for the last bucket, 0 without samples
+     */
+    uint64_t getPercentileNs(double fraction) const
+    {
+        uint64_t count = getCount();
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(fraction * count);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+            {
+                return i + 1 >= BUCKETS ? getMaxNs() : std::min(bucketLimitNs(i), getMaxNs());
+            }
+        }
+        return getMaxNs();
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+        total_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+
+    static size_t bucketFor(uint64_t ns)
+    {
+        uint64_t us = ns / 1000;
+        if (us == 0)
+        {
+            return 0;
+        }
+#if defined(__GNUC__)
+        size_t bucket = 64 - __builtin_clzll(us);
+#else
+        size_t bucket = 0;
+        while (us)
+        {
+            us >>= 1;
+            bucket++;
+        }
+#endif
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+};
+
+/**
+ * @brief Events reported through a TraceHook
+ */
+enum class TraceEvent
+{
+    UsbError,       ///< A USB transfer failed (code: libusb error or transfer status)
+    UsbTimeout,     ///< A USB transfer timed out
+    SpiError,       ///< An SPI transaction failed (code: errno where there is one)
+    OpModeTimeout,  ///< The module did not reach the requested operating mode
+    TxTimeout,      ///< TxDone did not arrive in time
+    CadTimeout,     ///< CadDone did not arrive in time
+    ChannelBusy,    ///< Listen before talk gave up
+    RxCrcError,     ///< A received packet failed its payload CRC
+    RxDropped,      ///< A received packet was dropped because the ring was full
+    RxModeError,    ///< The module could not be put in continuous RX
+    InvalidFrame    ///< The header mode, spreading factor and frame length do not fit together (code: frame length or SF)
+};
+
+/**
+ * @brief One traced event
+ */
+struct TraceRecord
+{
+    TraceEvent event;
+    int code;               ///< Event specific detail, 0 if none
+    uint64_t timestamp_ns;  ///< std::chrono::steady_clock time of the event
+    const char *message;    ///< Static description
+};
+
+/**
+ * @brief Optional callback receiving the errors of a driver
+ */
+class TraceHook
+{
+public:
+    using Callback = std::function<void(const TraceRecord &)>;
+
+    TraceHook() : enabled(false) {}
+
+    TraceHook(const TraceHook &) = delete;
+    TraceHook &operator=(const TraceHook &) = delete;
+
+    /**
+     * @brief Install the callback
+     *
+     * It runs on whichever driver thread hit the event, possibly the USB
+     * event thread, and must not call back into the driver.
+     *
+     * @param callback The callback (empty to go back to std::cerr)
+     */
+    void setCallback(Callback callback)
+    {
+        std::shared_ptr<Callback> next = callback ? std::make_shared<Callback>(std::move(callback)) : nullptr;
+        std::atomic_store(&current, next);
+        enabled.store(next != nullptr, std::memory_order_release);
+    }
+
+    /**
+     * @brief Report an event
+     *
+     * @param event The event
+     * @param code Event specific detail
+     * @param message Static description
+     * @return True if a callback took it, false if the caller should log it itself
+     */
+    bool emit(TraceEvent event, int code, const char *message) const
+    {
+        if (!enabled.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        std::shared_ptr<Callback> callback = std::atomic_load(&current);
+        if (!callback)
+        {
+            return false;
+        }
+
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        (*callback)(TraceRecord{event, code, now, message});
+        return true;
+    }
+
+private:
+    std::atomic<bool> enabled;
+    std::shared_ptr<Callback> current;
+};
+
+/**
+ * @brief Statistics of one SPI interface
+ */
+struct BusStats
+{
+    StatsCounter transactions;             ///< CS-framed SPI transactions
+    StatsCounter bytes_out;                ///< Bytes written, address bytes included
+    StatsCounter bytes_in;                 ///< Bytes clocked in and kept
+    StatsCounter errors;                   ///< Failed transactions
+    StatsCounter usb_transfers;            ///< USB bulk transfers (CH341 only)
+    StatsCounter usb_errors;               ///< Failed USB bulk transfers, timeouts included
+    StatsCounter usb_timeouts;             ///< USB bulk transfers that timed out
+    LatencyHistogram transaction_latency;  ///< transfer() and transferBatch() calls, queueing included
+    LatencyHistogram usb_latency;          ///< Synchronous bulk transfers and asynchronous slot round trips
+    TraceHook trace;
+
+    void reset()
+    {
+        transactions.reset();
+        bytes_out.reset();
+        bytes_in.reset();
+        errors.reset();
+        usb_transfers.reset();
+        usb_errors.reset();
+        usb_timeouts.reset();
+        transaction_latency.reset();
+        usb_latency.reset();
+    }
+};
+
+/**
+ * @brief Statistics of one RFM95
+ */
+struct RadioStats
+{
+    StatsCounter packets_received;         ///< Packets stored in the ring or returned by receive()
+    StatsCounter crc_errors;               ///< Packets with IRQ_PAYLOAD_CRC_ERROR_MASK set
+    StatsCounter rx_dropped;               ///< Packets lost to a full ring
+    StatsCounter packets_sent;             ///< Transmissions that reached TxDone
+    StatsCounter tx_timeouts;              ///< Transmissions without TxDone in time
+    StatsCounter cad_timeouts;             ///< CAD cycles without CadDone in time
+    StatsCounter interrupts;               ///< DIO0 edges reported by the SPI backend
+    LatencyHistogram irq_service_latency;  ///< RxDone (edge or estimate) to the packet being stored
+    TraceHook trace;
+
+    void reset()
+    {
+        packets_received.reset();
+        crc_errors.reset();
+        rx_dropped.reset();
+        packets_sent.reset();
+        tx_timeouts.reset();
+        cad_timeouts.reset();
+        interrupts.reset();
+        irq_service_latency.reset();
+    }
+};
+
+/**
+ * @brief Statistics of one Fragmenter
+ */
+struct FragmentStats
+{
+    StatsCounter fragments_sent;           ///< Data fragments that reached TxDone, retransmissions included
+    StatsCounter retransmissions;          ///< Fragments sent again after a loss or a retransmit request
+    StatsCounter requests_sent;            ///< Retransmit requests sent by the receiving side
+    StatsCounter duplicates;               ///< Fragments received again, already stored
+    StatsCounter transfers_sent;           ///< Outgoing transfers confirmed by the receiver
+    StatsCounter transfers_failed;         ///< Outgoing transfers given up after the retries
+    StatsCounter transfers_received;       ///< Incoming transfers reassembled and delivered
+    StatsCounter transfers_abandoned;      ///< Incoming transfers given up after the retries
+
+    void reset()
+    {
+        fragments_sent.reset();
+        retransmissions.reset();
+        requests_sent.reset();
+        duplicates.reset();
+        transfers_sent.reset();
+        transfers_failed.reset();
+        transfers_received.reset();
+        transfers_abandoned.reset();
+    }
+};
+
+#endif // STATS_HPP
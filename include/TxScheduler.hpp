@@ -0,0 +1,231 @@
+/**
+ * @file TxScheduler.hpp
+ * @brief Duty-cycle aware transmission scheduler for RFM95
+ *
+ * Tracks the airtime spent in each regulatory sub-band over a sliding window
+ * and hands every queued packet to the RFM95 TX queue on the channel that
+ * allows it to go out first, without exceeding any sub-band's duty cycle.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#ifndef TX_SCHEDULER_HPP
+#define TX_SCHEDULER_HPP
+
+#include "RFM95.hpp"
+#include "RadioProfile.hpp"
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * @brief Duty-cycle scheduler layered on the RFM95 TX queue
+ */
+class TxScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Pending packets held by the scheduler
+    static constexpr size_t QUEUE_SIZE = 32;
+
+    // Channels are selected by a 32-bit mask
+    static constexpr size_t MAX_CHANNELS = 32;
+    static constexpr uint32_t ALL_CHANNELS = 0xFFFFFFFF;
+
+    /**
+     * @brief Frequency range sharing one duty-cycle budget
+     */
+    struct SubBand
+    {
+        uint32_t low_hz;   ///< Lowest carrier frequency in the band
+        uint32_t high_hz;  ///< Highest carrier frequency in the band
+        float duty_cycle;  ///< Allowed fraction of the window spent transmitting (0.01 = 1%)
+    };
+
+    /**
+     * @brief Constructor
+     *
+     * @param radio Radio to transmit on; its TX queue is started by start()
+     * @param window Length of the sliding duty-cycle window
+     */
+    TxScheduler(RFM95 &radio, std::chrono::seconds window = std::chrono::seconds(3600));
+
+    /**
+     * @brief Destructor, stops the scheduler
+     */
+    ~TxScheduler();
+
+    TxScheduler(const TxScheduler &) = delete;
+    TxScheduler &operator=(const TxScheduler &) = delete;
+
+    /**
+     * @brief Add a sub-band
+     *
+     * @param low_hz Lowest frequency in Hz
+     * @param high_hz Highest frequency in Hz
+     * @param duty_cycle Allowed duty cycle (0.01 = 1%)
+     * @return Index of the sub-band
+     */
+    size_t addSubBand(uint32_t low_hz, uint32_t high_hz, float duty_cycle);
+
+    /**
+     * @brief Add the ETSI EN 300 220 sub-bands of the 863-870 MHz band
+     *
+     * 863-865 MHz 0.1%, 865-868 MHz 1%, 868.0-868.6 MHz 1%,
+     * 868.7-869.2 MHz 0.1%, 869.4-869.65 MHz 10% and 869.7-870 MHz 1%.
+     */
+    void addEU868SubBands();
+
+    /**
+     * @brief Add a channel
+     *
+     * @param profile Frequency and data rate of the channel
+     * @return Channel index, or -1 if no sub-band contains the frequency or MAX_CHANNELS is reached
+     */
+    int addChannel(const RadioProfile &profile);
+
+    /**
+     * @brief Set the preamble length used to compute airtime
+     *
+     * @param length Programmed preamble length in symbols (default 8)
+     */
+    void setPreambleLength(uint16_t length);
+
+    /**
+     * @brief Start dispatching, starting the radio's TX queue if needed
+     *
+     * @return True if successful
+     */
+    bool start();
+
+    /**
+     * @brief Stop dispatching; packets not yet dispatched are reported as failed
+     */
+    void stop();
+
+    /**
+     * @brief Queue a packet
+     *
+     * @param data Payload (copied before returning)
+     * @param length Payload length (max 255)
+     * @param callback Called with the result once sent, failed, or dropped because no channel can ever carry it
+     * @param channels Mask of channels the packet may use
+     * @param options Transmit options; the channel's profile replaces any profile set here
+     * @return False if the payload is too long, no channel is allowed or the queue is full
+     */
+    bool schedule(const uint8_t *data, size_t length, RFM95::TxCallback callback = RFM95::TxCallback(),
+                  uint32_t channels = ALL_CHANNELS, const RFM95::TxOptions &options = RFM95::TxOptions());
+
+    /**
+     * @brief Earliest time a packet may start on a channel
+     *
+     * @param channel Channel index
+     * @param length Payload length in bytes
+     * @return Start time, Clock::time_point::max() if the packet never fits the budget
+     */
+    Clock::time_point nextAvailable(int channel, size_t length);
+
+    /**
+     * @brief Get the fraction of a sub-band's budget currently in use
+     *
+     * @param sub_band Sub-band index
+     * @return Used airtime over allowed airtime in the window (0-1)
+     */
+    float getUtilization(size_t sub_band);
+
+    /**
+     * @brief Get the number of packets waiting for a slot
+     *
+     * @return Packet count
+     */
+    size_t getPending();
+
+private:
+    /**
+     * @brief One transmission accounted against a sub-band
+     */
+    struct Usage
+    {
+        Clock::time_point start;
+        uint32_t airtime_us;
+    };
+
+    /**
+     * @brief Budget bookkeeping of one sub-band
+     */
+    struct Band
+    {
+        SubBand limits;
+        std::deque<Usage> usage; ///< Transmissions inside the window, oldest first
+        uint64_t used_us;        ///< Sum of usage airtime
+    };
+
+    struct Channel
+    {
+        RadioProfile profile;
+        size_t band;
+    };
+
+    /**
+     * @brief One packet waiting for a slot
+     */
+    struct Pending
+    {
+        uint8_t data[255];
+        uint8_t length;
+        uint32_t channels;
+        RFM95::TxOptions options;
+        RFM95::TxCallback callback;
+    };
+
+    RFM95 &radio;
+    std::chrono::microseconds window;
+    uint16_t preamble_length;
+    std::vector<Band> bands;
+    std::vector<Channel> channels;
+    std::vector<Pending> pending;   ///< Waiting packets in arrival order, capacity QUEUE_SIZE
+    std::mutex mutex;               ///< Protects all of the above
+    std::condition_variable cv;     ///< Signalled when packets are queued or the scheduler stops
+    std::thread worker;
+    std::atomic<bool> running;
+
+    /**
+     * @brief Drop usage that has left the window
+     *
+     * @param band Sub-band
+     * @param now Current time
+     */
+    void prune(Band &band, Clock::time_point now);
+
+    /**
+     * @brief Earliest start of some airtime in a sub-band
+     *
+     * @param band Sub-band, pruned to now
+     * @param airtime_us Airtime in microseconds
+     * @param now Current time
+     * @return Start time, Clock::time_point::max() if the airtime exceeds the whole budget
+     */
+    Clock::time_point earliest(const Band &band, uint32_t airtime_us, Clock::time_point now) const;
+
+    /**
+     * @brief Airtime budget of a sub-band per window
+     *
+     * @param band Sub-band
+     * @return Budget in microseconds
+     */
+    uint64_t budget(const Band &band) const;
+
+    /**
+     * @brief Worker thread function
+     */
+    void run();
+};
+
+#endif // TX_SCHEDULER_HPP
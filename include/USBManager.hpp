@@ -0,0 +1,174 @@
+/**
+ * @file USBManager.hpp
+ * @brief Process-wide libusb context, event thread and CH341 device cache.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ *
+ * @license MIT License
+ * Copyright (c) 2025 Sergio Pérez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <libusb.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/**
+ * @brief Shared libusb state for every CH341SPI instance.
+ *
+ * One libusb context and one event-handling thread serve all adapters in the
+ * process. CH341 devices are enumerated once and the cache is kept current by
+ * hotplug callbacks where libusb supports them; elsewhere a lookup that misses
+ * re-enumerates. Obtain the instance through SPIFactory::getUSBManager(); it
+ * lives as long as the factory or any adapter holds a reference.
+ */
+class USBManager {
+public:
+    /**
+     * @brief Description of one attached CH341 adapter.
+     */
+    struct DeviceInfo {
+        std::string path;   ///< Stable topology path, e.g. "1-1.4" (bus-port.port...)
+        std::string serial; ///< Serial number string, empty if the adapter has none or it was never read
+        uint8_t bus;        ///< USB bus number
+        uint8_t address;    ///< Device address on the bus
+    };
+
+    /**
+     * @brief Initializes libusb, fills the device cache and starts the event thread.
+     */
+    USBManager();
+
+    /**
+     * @brief Stops the event thread and releases the context.
+     */
+    ~USBManager();
+
+    USBManager(const USBManager &) = delete;
+    USBManager &operator=(const USBManager &) = delete;
+
+    /**
+     * @brief Get the shared libusb context.
+     * @return The context, or nullptr if libusb failed to initialize.
+     */
+    libusb_context *getContext() const {
+        return context;
+    }
+
+    /**
+     * @brief Check whether the cache is maintained by hotplug events.
+     * @return True if hotplug callbacks are registered.
+     */
+    bool hasHotplug() const {
+        return hotplug_registered;
+    }
+
+    /**
+     * @brief List the attached CH341 adapters, ordered by path.
+     * @return One entry per adapter; the index in this list is the device index.
+     */
+    std::vector<DeviceInfo> listDevices();
+
+    /**
+     * @brief Opens the Nth CH341 adapter, in path order.
+     * @param index Device index.
+     * @return Open handle, or nullptr on failure.
+     */
+    libusb_device_handle *openDevice(int index);
+
+    /**
+     * @brief Opens a CH341 adapter by topology path or serial number.
+     * @param id Path as reported by listDevices() (e.g. "1-1.4") or serial number.
+     * @return Open handle, or nullptr on failure.
+     */
+    libusb_device_handle *openDevice(const std::string &id);
+
+    /**
+     * @brief Rebuilds the device cache from a full enumeration.
+     * @return True if the enumeration succeeded.
+     */
+    bool refresh();
+
+private:
+    /**
+     * @brief One cached adapter; the device is referenced while cached.
+     */
+    struct Entry {
+        libusb_device *device;
+        DeviceInfo info;
+        std::vector<uint8_t> ports; ///< Port chain from the root hub, for ordering
+        bool serial_read; ///< The serial descriptor was already fetched
+    };
+
+    libusb_context *context; ///< Shared libusb context.
+    libusb_hotplug_callback_handle hotplug_handle; ///< Registration of hotplugCallback.
+    bool hotplug_registered; ///< Flag to indicate if hotplug events keep the cache current.
+    std::vector<Entry> devices; ///< Cached adapters, ordered by path.
+    std::mutex devices_mutex; ///< Protects devices.
+    std::thread event_thread; ///< Thread running the libusb event loop.
+    std::atomic<bool> event_running; ///< Flag to keep the event loop running.
+
+    /**
+     * @brief Adds a device to the cache unless it is already there.
+     * @param device The device (referenced by the cache on success).
+     */
+    void addDevice(libusb_device *device);
+
+    /**
+     * @brief Removes a device from the cache.
+     * @param device The device.
+     */
+    void removeDevice(libusb_device *device);
+
+    /**
+     * @brief Drops every cached device.
+     */
+    void clearDevices();
+
+    /**
+     * @brief Opens a cached device, reporting errors.
+     * @param device The device.
+     * @return Open handle, or nullptr on failure.
+     */
+    libusb_device_handle *openCached(libusb_device *device);
+
+    /**
+     * @brief Builds the topology path of a device.
+     * @param device The device.
+     * @return Path such as "1-1.4".
+     */
+    static std::string devicePath(libusb_device *device);
+
+    /**
+     * @brief Thread function running the libusb event loop.
+     */
+    void eventLoop();
+
+    /**
+     * @brief libusb hotplug trampoline.
+     */
+    static int LIBUSB_CALL hotplugCallback(libusb_context *ctx, libusb_device *device,
+                                           libusb_hotplug_event event, void *user_data);
+};
@@ -0,0 +1,243 @@
+/**
+ * @file AdaptiveDataRate.cpp
+ * @brief Implementation of the adaptive data rate engine
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "AdaptiveDataRate.hpp"
+#include <algorithm>
+#include <cmath>
+
+// The SX127x packet SNR stops growing around +10 dB, above this RSSI tells more
+static const float SNR_SATURATION_DB = 8.0f;
+
+// Reference packet ordering the candidates by speed
+static const size_t REFERENCE_PAYLOAD = 32;
+
+AdaptiveDataRate::AdaptiveDataRate(const Options &options)
+    : options(options)
+{
+    this->options.window = std::max<size_t>(1, options.window);
+    this->options.min_samples = std::max<size_t>(1, std::min(options.min_samples, this->options.window));
+}
+
+float AdaptiveDataRate::requiredSnr(int sf)
+{
+    // -5 dB at SF6, 2.5 dB lower for every step up to -20 dB at SF12
+    sf = std::max(6, std::min(sf, 12));
+    return -5.0f - 2.5f * (sf - 6);
+}
+
+size_t AdaptiveDataRate::addProfile(const RadioProfile &profile)
+{
+    Candidate candidate;
+    candidate.profile = profile;
+
+    int sf = (profile.modem_config_2 >> 4) & 0x0F;
+    float bandwidth_hz = 500000.0f / RadioProfile::bandwidthDivisor((profile.modem_config_1 >> 4) & 0x0F);
+    candidate.required_snr_db = requiredSnr(sf);
+    candidate.bandwidth_db = 10.0f * std::log10(bandwidth_hz / 125000.0f);
+    candidate.noise_floor_dbm = -174.0f + 10.0f * std::log10(bandwidth_hz) + options.noise_figure_db;
+    candidate.power_dbm = profile.powerDbm();
+    candidate.airtime_us = profile.timeOnAirUs(REFERENCE_PAYLOAD);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t index = candidates.size();
+    candidates.push_back(candidate);
+
+    auto position = std::upper_bound(order.begin(), order.end(), index, [this](size_t a, size_t b) {
+        const Candidate &x = candidates[a];
+        const Candidate &y = candidates[b];
+        return x.airtime_us != y.airtime_us ? x.airtime_us < y.airtime_us : x.power_dbm < y.power_dbm;
+    });
+    order.insert(position, index);
+
+    // Peers still without enough samples follow the most robust candidate
+    for (auto &entry : peers)
+    {
+        select(entry.second);
+    }
+    return index;
+}
+
+void AdaptiveDataRate::addLadder(uint32_t frequency_hz, uint32_t bandwidth_hz, int min_sf, int max_sf,
+                                 int power_dbm, uint8_t sync_word, bool crc)
+{
+    for (int sf = std::max(7, min_sf); sf <= std::min(12, max_sf); sf++)
+    {
+        addProfile(RadioProfile::make(frequency_hz, sf, bandwidth_hz, 5, power_dbm, sync_word, crc));
+    }
+}
+
+size_t AdaptiveDataRate::getProfileCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return candidates.size();
+}
+
+RadioProfile AdaptiveDataRate::getProfileAt(size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return index < candidates.size() ? candidates[index].profile : RadioProfile();
+}
+
+size_t AdaptiveDataRate::observe(uint32_t peer, float rssi_dbm, float snr_db, size_t profile)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (profile >= candidates.size())
+    {
+        return fallback();
+    }
+
+    auto found = peers.find(peer);
+    if (found == peers.end())
+    {
+        Peer fresh;
+        fresh.budget.assign(options.window, 0.0f);
+        fresh.rssi.assign(options.window, 0.0f);
+        fresh.snr.assign(options.window, 0.0f);
+        fresh.next = 0;
+        fresh.samples = 0;
+        fresh.profile = fallback();
+        found = peers.emplace(peer, std::move(fresh)).first;
+    }
+    Peer &state = found->second;
+
+    // Strong links saturate the packet SNR, estimate it from the RSSI instead. The
+    // packet RSSI measures signal plus noise, so the noise comes out first.
+    const Candidate &received = candidates[profile];
+    float snr = snr_db;
+    float excess_db = rssi_dbm - received.noise_floor_dbm;
+    if (snr_db >= SNR_SATURATION_DB && excess_db > 0.0f)
+    {
+        snr = std::max(snr_db, 10.0f * std::log10(std::pow(10.0f, excess_db / 10.0f) - 1.0f));
+    }
+
+    state.budget[state.next] = snr + received.bandwidth_db - received.power_dbm;
+    state.rssi[state.next] = rssi_dbm;
+    state.snr[state.next] = snr_db;
+    state.next = (state.next + 1) % options.window;
+    state.samples = std::min(state.samples + 1, options.window);
+
+    select(state);
+    return state.profile;
+}
+
+size_t AdaptiveDataRate::observe(uint32_t peer, const RFM95::RxPacket &packet, size_t profile)
+{
+    return observe(peer, packet.rssi, packet.snr, profile);
+}
+
+size_t AdaptiveDataRate::getProfileIndex(uint32_t peer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = peers.find(peer);
+    return found != peers.end() ? found->second.profile : fallback();
+}
+
+RadioProfile AdaptiveDataRate::getProfile(uint32_t peer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (candidates.empty())
+    {
+        return RadioProfile();
+    }
+    auto found = peers.find(peer);
+    return candidates[found != peers.end() ? found->second.profile : fallback()].profile;
+}
+
+RFM95::TxOptions AdaptiveDataRate::getTxOptions(uint32_t peer)
+{
+    RFM95::TxOptions tx_options;
+    tx_options.use_profile = getProfileCount() > 0;
+    tx_options.profile = getProfile(peer);
+    return tx_options;
+}
+
+AdaptiveDataRate::LinkState AdaptiveDataRate::getLinkState(uint32_t peer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    LinkState state = {0, 0.0f, 0.0f, 0.0f, fallback()};
+
+    auto found = peers.find(peer);
+    if (found == peers.end() || found->second.samples == 0)
+    {
+        return state;
+    }
+
+    const Peer &link = found->second;
+    state.samples = link.samples;
+    state.rssi_dbm = mean(link.rssi, link.samples);
+    state.snr_db = mean(link.snr, link.samples);
+    state.margin_db = marginOf(mean(link.budget, link.samples), link.profile);
+    state.profile = link.profile;
+    return state;
+}
+
+void AdaptiveDataRate::reset(uint32_t peer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    peers.erase(peer);
+}
+
+size_t AdaptiveDataRate::fallback() const
+{
+    return order.empty() ? 0 : order.back();
+}
+
+float AdaptiveDataRate::mean(const std::vector<float> &values, size_t samples)
+{
+    // The window fills from slot 0, so the first samples entries are the valid ones
+    float sum = 0.0f;
+    for (size_t i = 0; i < samples; i++)
+    {
+        sum += values[i];
+    }
+    return samples > 0 ? sum / samples : 0.0f;
+}
+
+float AdaptiveDataRate::marginOf(float budget, size_t candidate) const
+{
+    const Candidate &target = candidates[candidate];
+    return budget - target.bandwidth_db + target.power_dbm - target.required_snr_db;
+}
+
+void AdaptiveDataRate::select(Peer &peer)
+{
+    if (candidates.empty())
+    {
+        return;
+    }
+    if (peer.samples < options.min_samples)
+    {
+        peer.profile = fallback();
+        return;
+    }
+
+    float budget = mean(peer.budget, peer.samples);
+    size_t current = std::find(order.begin(), order.end(), peer.profile) - order.begin();
+
+    // Candidates ahead of the current one in the order need the hysteresis on top
+    size_t best = order.size();
+    float best_margin = 0.0f;
+    for (size_t rank = 0; rank < order.size(); rank++)
+    {
+        float margin = marginOf(budget, order[rank]);
+        float needed = options.margin_db + (rank < current ? options.hysteresis_db : 0.0f);
+        if (margin >= needed)
+        {
+            peer.profile = order[rank];
+            return;
+        }
+        if (best == order.size() || margin > best_margin)
+        {
+            best = rank;
+            best_margin = margin;
+        }
+    }
+
+    // Nothing meets the margin: the candidate with the most headroom
+    peer.profile = order[best];
+}
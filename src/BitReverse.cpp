@@ -0,0 +1,100 @@
+/**
+ * @file BitReverse.cpp
+ * @brief Buffer kernels for bit order reversal.
+ * 
+ * AArch64 has a native per-byte bit reverse (RBIT). ARMv7 NEON and SSSE3 use
+ * two 16-entry nibble tables with a byte shuffle, and plain SSE2 mirrors the
+ * bits with masked shifts. Tails shorter than a vector use the lookup table.
+ * 
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "BitReverse.hpp"
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static_assert(BitReverse::reverseByte(0x01) == 0x80, "reverseByte is broken");
+static_assert(BitReverse::reverseByte(0xA8) == 0x15, "reverseByte is broken");
+static_assert(BitReverse::Table().value[0x0F] == 0xF0, "lookup table is broken");
+
+namespace
+{
+#if (defined(__ARM_NEON) && !defined(__aarch64__)) || defined(__SSSE3__)
+    // Mirrored low nibble moved to the high nibble, and mirrored high nibble moved to the low nibble
+    constexpr uint8_t NIBBLE_LO[16] = {0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0,
+                                       0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0};
+    constexpr uint8_t NIBBLE_HI[16] = {0x00, 0x08, 0x04, 0x0C, 0x02, 0x0A, 0x06, 0x0E,
+                                       0x01, 0x09, 0x05, 0x0D, 0x03, 0x0B, 0x07, 0x0F};
+#endif
+
+    size_t reverseVector(const uint8_t *src, uint8_t *dst, size_t length)
+    {
+        size_t i = 0;
+#if defined(__aarch64__)
+        for (; i + 16 <= length; i += 16)
+        {
+            vst1q_u8(dst + i, vrbitq_u8(vld1q_u8(src + i)));
+        }
+#elif defined(__ARM_NEON)
+        const uint8x8x2_t lo = {{vld1_u8(NIBBLE_LO), vld1_u8(NIBBLE_LO + 8)}};
+        const uint8x8x2_t hi = {{vld1_u8(NIBBLE_HI), vld1_u8(NIBBLE_HI + 8)}};
+        const uint8x8_t mask = vdup_n_u8(0x0F);
+        for (; i + 8 <= length; i += 8)
+        {
+            uint8x8_t v = vld1_u8(src + i);
+            uint8x8_t r = vorr_u8(vtbl2_u8(lo, vand_u8(v, mask)), vtbl2_u8(hi, vshr_n_u8(v, 4)));
+            vst1_u8(dst + i, r);
+        }
+#elif defined(__SSSE3__)
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(NIBBLE_LO));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(NIBBLE_HI));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i r = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, mask)),
+                                     _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), mask)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);
+        }
+#elif defined(__SSE2__)
+        // Same steps as reverseByte(); the masks drop the bits shifted across byte lanes
+        const __m128i m4 = _mm_set1_epi8(0x0F);
+        const __m128i m2 = _mm_set1_epi8(0x33);
+        const __m128i m1 = _mm_set1_epi8(0x55);
+        for (; i + 16 <= length; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), m4), _mm_slli_epi16(_mm_and_si128(v, m4), 4));
+            v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 2), m2), _mm_slli_epi16(_mm_and_si128(v, m2), 2));
+            v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), m1), _mm_slli_epi16(_mm_and_si128(v, m1), 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+        }
+#else
+        (void)src;
+        (void)dst;
+        (void)length;
+#endif
+        return i;
+    }
+}
+
+void BitReverse::reverseBits(uint8_t *buffer, size_t length)
+{
+    reverseBits(buffer, buffer, length);
+}
+
+void BitReverse::reverseBits(const uint8_t *src, uint8_t *dst, size_t length)
+{
+    size_t i = reverseVector(src, dst, length);
+    for (; i < length; i++)
+    {
+        dst[i] = reverse(src[i]);
+    }
+}
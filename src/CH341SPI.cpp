@@ -12,53 +12,102 @@
 
 #include "CH341SPI.hpp"
 #include "CH341Config.hpp"
+#include "BitReverse.hpp"
+#include "USBManager.hpp"
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 
-CH341SPI::CH341SPI(int device_index, bool lsb_first)
+// Same timeline as SPIInterface::InterruptEvent::timestamp_ns
+static uint64_t steadyNowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief One queue slot: a group of CS-framed SPI transactions and the libusb transfers that carry them.
+ */
+struct CH341SPI::AsyncSlot
+{
+    /**
+     * @brief Where the read phase of one packed transaction lands in in_buffer.
+     */
+    struct Target
+    {
+        size_t offset;
+        size_t length;
+        uint8_t *dest;
+    };
+
+    CH341SPI *owner;
+    std::vector<libusb_transfer *> out; ///< One OUT transfer per bulk segment
+    std::vector<libusb_transfer *> in;  ///< One IN transfer per SPI stream packet
+    std::vector<uint8_t> out_buffer;    ///< UIO and SPI stream packets of every transaction
+    std::vector<size_t> segment_ends;   ///< End offset in out_buffer of each OUT transfer
+    std::vector<size_t> packet_sizes;   ///< Data bytes of each SPI stream packet
+    std::vector<uint8_t> in_buffer;
+    std::vector<Target> targets;        ///< One entry per packed transaction
+    int pending;                        ///< Transfers still owned by libusb
+    bool sample_pins;                   ///< The final UIO packet also reads the pins
+    uint8_t pin_sample;                 ///< Pin levels read by the final UIO packet
+    uint64_t submit_ns;                 ///< When the slot was submitted, steady_clock nanoseconds
+    size_t out_submitted;
+    size_t in_submitted;
+    bool success;
+    bool done;
+    bool waited;                        ///< A synchronous caller releases the slot itself
+    TransferCallback callback;
+};
+
+CH341SPI::CH341SPI(int device_index, bool lsb_first, Speed speed)
     : device(nullptr),
-      context(nullptr),
+      usb(SPIFactory::getUSBManager()),
       device_index(device_index),
       lsb_first(lsb_first),
+      speed(speed),
+      fast_open(false),
+      is_open(false),
+      _gpio_direction(0),
+      _gpio_output(0),
       interruptEnabled(false),
-      threadRunning(false)
+      threadRunning(false),
+      queue_depth(CH341Config::DEFAULT_QUEUE_DEPTH),
+      active_slots(0),
+      async_error(false),
+      pipeline_running(false),
+      interrupt_pin(CH341Config::DEFAULT_INT_PIN),
+      interrupt_edge(InterruptEdge::Falling),
+      pins_sampled(false),
+      pin_level(false),
+      pin_sample_start_ns(0),
+      pin_sample_count(0),
+      pin_edge_count(0),
+      pin_edge()
 {
-    // Initialize libusb context
-    int ret = libusb_init(&context);
-    if (ret != 0)
-    {
-        std::cerr << "Failed to initialize libusb: " << libusb_error_name(ret) << std::endl;
-    }
+}
+
+CH341SPI::CH341SPI(const std::string &device_path, bool lsb_first, Speed speed)
+    : CH341SPI(0, lsb_first, speed)
+{
+    this->device_path = device_path;
 }
 
 CH341SPI::~CH341SPI()
 {
     // Stop interrupt thread if running
-    if (threadRunning)
-    {
-        threadRunning = false;
-        if (interruptThread.joinable())
-        {
-            interruptThread.join();
-        }
-    }
+    enableInterrupt(false);
 
-    // Ensure device is closed
+    // Ensure device is closed; the USB manager goes when its last user does
     close();
-
-    // Free libusb context
-    if (context)
-    {
-        libusb_exit(context);
-        context = nullptr;
-    }
 }
 
 bool CH341SPI::open()
 {
-    if (!context)
+    if (!usb || !usb->getContext())
     {
         std::cerr << "LibUSB not initialized" << std::endl;
         return false;
@@ -66,60 +115,15 @@ bool CH341SPI::open()
 
     try
     {
-        // Get list of devices
-        libusb_device **device_list;
-        ssize_t count = libusb_get_device_list(context, &device_list);
-        if (count < 0)
-        {
-            std::cerr << "Failed to get device list: " << libusb_error_name(count) << std::endl;
-            return false;
-        }
-
-        // Find CH341 devices
-        std::vector<libusb_device *> ch341_devices;
-        for (ssize_t i = 0; i < count; i++)
-        {
-            libusb_device *dev = device_list[i];
-            libusb_device_descriptor desc;
-
-            int ret = libusb_get_device_descriptor(dev, &desc);
-            if (ret < 0)
-                continue;
-
-            if (desc.idVendor == CH341Config::VENDOR_ID &&
-                desc.idProduct == CH341Config::PRODUCT_ID)
-            {
-                ch341_devices.push_back(dev);
-            }
-        }
-
-        if (ch341_devices.empty())
-        {
-            std::cerr << "No CH341 devices found" << std::endl;
-            libusb_free_device_list(device_list, 1);
-            return false;
-        }
-
-        if (device_index >= static_cast<int>(ch341_devices.size()))
-        {
-            std::cerr << "Device index " << device_index << " out of range, only "
-                      << ch341_devices.size() << " devices found" << std::endl;
-            libusb_free_device_list(device_list, 1);
-            return false;
-        }
-
-        // Open selected device
-        int ret = libusb_open(ch341_devices[device_index], &device);
-        libusb_free_device_list(device_list, 1);
-
-        if (ret != 0)
+        // The manager keeps the device list, no enumeration here
+        device = device_path.empty() ? usb->openDevice(device_index) : usb->openDevice(device_path);
+        if (!device)
         {
-            std::cerr << "Failed to open device: " << libusb_error_name(ret) << std::endl;
             return false;
         }
 
         // Set configuration
-        ret = libusb_set_configuration(device, 1);
+        int ret = libusb_set_configuration(device, 1);
         if (ret != 0)
         {
             std::cerr << "Failed to set configuration: " << libusb_error_name(ret) << std::endl;
@@ -151,6 +155,18 @@ bool CH341SPI::open()
             return false;
         }
 
+        if (!startPipeline())
+        {
+            close();
+            return false;
+        }
+
+        is_open = true;
+
+        if (speed_probe && !probeSpeed(speed_probe))
+        {
+            std::cerr << "Speed probe failed at every rate, keeping the configured rate" << std::endl;
+        }
         return true;
     }
     catch (const std::exception &e)
@@ -171,6 +187,7 @@ void CH341SPI::close()
     {
         try
         {
+            stopPipeline();
             enablePins(false);
             libusb_release_interface(device, 0);
             libusb_close(device);
@@ -181,6 +198,7 @@ void CH341SPI::close()
         }
         device = nullptr;
     }
+    is_open = false;
 }
 
 bool CH341SPI::configStream()
@@ -190,20 +208,17 @@ bool CH341SPI::configStream()
 
     try
     {
-        // Configure for 100KHz (slower for stability)
+        // Program the stream rate, 100KHz unless configured otherwise
         uint8_t cmd[3] = {
             CH341Config::CMD_I2C_STREAM,
-            CH341Config::CMD_I2C_STM_SET | 0x01, // 100KHz
+            static_cast<uint8_t>(CH341Config::CMD_I2C_STM_SET |
+                                 (static_cast<uint8_t>(speed) & CH341Config::STM_SPEED_MASK)),
             CH341Config::CMD_I2C_STM_END};
 
-        int transferred = 0;
-        int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                       cmd, sizeof(cmd), &transferred,
-                                       CH341Config::USB_TIMEOUT);
-
-        if (ret != 0 || transferred != sizeof(cmd))
+        std::unique_lock<std::mutex> lock(async_mutex);
+        if (!commandTransfer(lock, cmd, sizeof(cmd)))
         {
-            std::cerr << "Error configuring stream: " << libusb_error_name(ret) << std::endl;
+            std::cerr << "Error configuring stream" << std::endl;
             return false;
         }
 
@@ -216,6 +231,90 @@ bool CH341SPI::configStream()
     }
 }
 
+bool CH341SPI::setSpeed(Speed speed)
+{
+    this->speed = speed;
+    if (!device)
+    {
+        return true;
+    }
+
+    // The rate command must not overtake transactions already queued
+    flush();
+    return configStream();
+}
+
+bool CH341SPI::probeSpeed(const SpeedProbe &probe)
+{
+    if (!device || !probe)
+    {
+        return false;
+    }
+
+    Speed previous = speed;
+    Speed best = Speed::Low;
+    bool found = false;
+    for (uint8_t code = CH341Config::STM_SPEED_20K; code <= CH341Config::STM_SPEED_750K; code++)
+    {
+        if (!setSpeed(static_cast<Speed>(code)) || !probe(*this))
+        {
+            break;
+        }
+        best = static_cast<Speed>(code);
+        found = true;
+    }
+
+    setSpeed(found ? best : previous);
+    return found;
+}
+
+CH341SPI::SpeedProbe CH341SPI::registerEchoProbe(uint8_t address, int rounds)
+{
+    return [address, rounds](SPIInterface &spi) {
+        // Alternating, complementary and walking patterns toggle every data line
+        static const uint8_t patterns[] = {0x55, 0xAA, 0x00, 0xFF, 0x01, 0x80, 0x0F, 0xF0};
+
+        uint8_t read_cmd = address & 0x7F;
+        uint8_t original = 0;
+        if (!spi.transfer(&read_cmd, 1, &original, 1))
+        {
+            return false;
+        }
+
+        bool ok = true;
+        for (int i = 0; ok && i < rounds; i++)
+        {
+            uint8_t pattern = patterns[i % sizeof(patterns)];
+            uint8_t write_cmd[2] = {static_cast<uint8_t>(address | 0x80), pattern};
+            uint8_t readback = static_cast<uint8_t>(~pattern);
+            ok = spi.transfer(write_cmd, sizeof(write_cmd), nullptr, 0) &&
+                 spi.transfer(&read_cmd, 1, &readback, 1) &&
+                 readback == pattern;
+        }
+
+        uint8_t restore_cmd[2] = {static_cast<uint8_t>(address | 0x80), original};
+        spi.transfer(restore_cmd, sizeof(restore_cmd), nullptr, 0);
+        return ok;
+    };
+}
+
+CH341SPI::Speed CH341SPI::speedForFrequency(uint32_t hz)
+{
+    if (hz >= 750000)
+    {
+        return Speed::High;
+    }
+    if (hz >= 400000)
+    {
+        return Speed::Fast;
+    }
+    if (hz >= 100000)
+    {
+        return Speed::Standard;
+    }
+    return Speed::Low;
+}
+
 bool CH341SPI::enablePins(bool enable)
 {
     if (!device)
@@ -233,19 +332,19 @@ bool CH341SPI::enablePins(bool enable)
             CH341Config::CMD_UIO_STM_END                           // End stream
         };
 
-        int transferred = 0;
-        int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                       cmd, sizeof(cmd), &transferred,
-                                       CH341Config::USB_TIMEOUT);
-
-        if (ret != 0 || transferred != sizeof(cmd))
+        std::unique_lock<std::mutex> lock(async_mutex);
+        if (!commandTransfer(lock, cmd, sizeof(cmd)))
         {
-            std::cerr << "Error setting pins: " << libusb_error_name(ret) << std::endl;
+            std::cerr << "Error setting pins" << std::endl;
             return false;
         }
+        lock.unlock();
 
         // Add delay similar to Python implementation
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (!fast_open)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
 
         return true;
     }
@@ -256,229 +355,917 @@ bool CH341SPI::enablePins(bool enable)
     }
 }
 
-uint8_t CH341SPI::swapBits(uint8_t byte)
+void CH341SPI::appendChipSelect(std::vector<uint8_t> &buffer, bool cs_high, bool sample_pins)
 {
-    // Bit swapping algorithm implementation
-    uint8_t result = 0;
-    for (int i = 0; i < 8; i++)
+    buffer.push_back(CH341Config::CMD_UIO_STREAM);
+    buffer.push_back(CH341Config::CMD_UIO_STM_OUT | (cs_high ? 0x37 : 0x36));
+    if (sample_pins)
     {
-        if (byte & (1 << i))
-        {
-            result |= (1 << (7 - i));
-        }
+        buffer.push_back(CH341Config::CMD_UIO_STM_IN);
+    }
+    buffer.push_back(CH341Config::CMD_UIO_STM_END);
+
+    // Everything after STM_END is ignored, pad so the next command starts a new packet
+    while (buffer.size() % CH341Config::PACKET_LENGTH != 0)
+    {
+        buffer.push_back(0x00);
     }
-    return result;
 }
 
-std::vector<uint8_t> CH341SPI::transfer(const std::vector<uint8_t> &write_data, size_t read_length)
+void CH341SPI::appendChipSelectCycle(std::vector<uint8_t> &buffer)
 {
-    std::vector<uint8_t> result;
+    buffer.push_back(CH341Config::CMD_UIO_STREAM);
+    buffer.push_back(CH341Config::CMD_UIO_STM_OUT | 0x37);
+    buffer.push_back(CH341Config::CMD_UIO_STM_OUT | 0x37);
+    buffer.push_back(CH341Config::CMD_UIO_STM_OUT | 0x36);
+    buffer.push_back(CH341Config::CMD_UIO_STM_END);
 
-    if (!device)
+    while (buffer.size() % CH341Config::PACKET_LENGTH != 0)
     {
-        return result; // Empty result indicates error
+        buffer.push_back(0x00);
     }
+}
 
-    try
+void CH341SPI::appendStreamPacket(std::vector<uint8_t> &buffer, const uint8_t *tx, size_t tx_len,
+                                  size_t offset, size_t chunk)
+{
+    buffer.push_back(CH341Config::CMD_SPI_STREAM);
+
+    // Bytes past the write phase are dummy clocks for the read phase; 0xFF is
+    // its own mirror image, so only the copied run needs converting
+    size_t start = buffer.size();
+    size_t from_tx = offset < tx_len ? std::min(chunk, tx_len - offset) : 0;
+    buffer.resize(start + chunk, 0xFF);
+
+    if (lsb_first)
     {
-        // CS low
-        uint8_t cs_low[3] = {
-            CH341Config::CMD_UIO_STREAM,
-            CH341Config::CMD_UIO_STM_OUT | 0x36,
-            CH341Config::CMD_UIO_STM_END};
+        BitReverse::reverseBits(tx + offset, buffer.data() + start, from_tx);
+    }
+    else if (from_tx > 0)
+    {
+        std::memcpy(buffer.data() + start, tx + offset, from_tx);
+    }
+}
 
-        int transferred = 0;
-        int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                       cs_low, sizeof(cs_low), &transferred,
-                                       CH341Config::USB_TIMEOUT);
+size_t CH341SPI::streamPackets(const Transaction &transaction)
+{
+    const size_t data_per_packet = CH341Config::PACKET_LENGTH - 1;
+    return (transaction.tx_len + transaction.rx_len + data_per_packet - 1) / data_per_packet;
+}
 
-        if (ret != 0)
-        {
-            std::cerr << "Error setting CS low: " << libusb_error_name(ret) << std::endl;
-            return result;
-        }
+void CH341SPI::reportUsbError(int ret, const char *message)
+{
+    bool timeout = ret == LIBUSB_ERROR_TIMEOUT;
 
-        // Transfer byte by byte, as in the Python implementation
-        for (size_t i = 0; i < write_data.size(); i++)
-        {
-            // Send one byte at a time
-            uint8_t cmd[2] = {CH341Config::CMD_SPI_STREAM, lsb_first ? swapBits(write_data[i]) : write_data[i]};
+    stats.usb_errors.add();
+    if (timeout)
+    {
+        stats.usb_timeouts.add();
+    }
 
-            ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                       cmd, sizeof(cmd), &transferred,
-                                       CH341Config::USB_TIMEOUT);
+    if (!stats.trace.emit(timeout ? TraceEvent::UsbTimeout : TraceEvent::UsbError, ret, message))
+    {
+        std::cerr << message << ": " << libusb_error_name(ret) << std::endl;
+    }
+}
 
-            if (ret != 0)
-            {
-                std::cerr << "Error in SPI write: " << libusb_error_name(ret) << std::endl;
-                return result;
-            }
+bool CH341SPI::bulkWrite(uint8_t *data, size_t length)
+{
+    int transferred = 0;
+    auto start = std::chrono::steady_clock::now();
+    int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
+                                   data, static_cast<int>(length), &transferred,
+                                   CH341Config::USB_TIMEOUT);
+    stats.usb_latency.recordSince(start);
+    stats.usb_transfers.add();
 
-            // Read the response for this byte
-            uint8_t response_byte;
-            ret = libusb_bulk_transfer(device, CH341Config::BULK_READ_EP,
-                                       &response_byte, 1, &transferred,
-                                       CH341Config::USB_TIMEOUT);
+    if (ret != 0 || transferred != static_cast<int>(length))
+    {
+        reportUsbError(ret, "Error in SPI write");
+        return false;
+    }
+    return true;
+}
 
-            if (ret != 0)
-            {
-                std::cerr << "Error in SPI read: " << libusb_error_name(ret) << std::endl;
-                return result;
-            }
+bool CH341SPI::bulkRead(uint8_t *data, size_t length)
+{
+    size_t received = 0;
+    while (received < length)
+    {
+        int transferred = 0;
+        auto start = std::chrono::steady_clock::now();
+        int ret = libusb_bulk_transfer(device, CH341Config::BULK_READ_EP,
+                                       data + received, static_cast<int>(length - received), &transferred,
+                                       CH341Config::USB_TIMEOUT);
+        stats.usb_latency.recordSince(start);
+        stats.usb_transfers.add();
 
-            // Discard this response byte (echo of command byte)
-            // This is a workaround for the CH341 SPI adapter
+        if (ret != 0 || transferred <= 0)
+        {
+            reportUsbError(ret, "Error in SPI read");
+            return false;
         }
+        received += transferred;
+    }
+    return true;
+}
 
-        // Now read the requested bytes
-        for (size_t i = 0; i < read_length; i++)
-        {
-            // Send dummy byte (0xFF)
-            uint8_t cmd[2] = {CH341Config::CMD_SPI_STREAM, 0xFF};
+bool CH341SPI::streamTransfer(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    // Each SPI stream packet is the command byte followed by up to 31 data bytes,
+    // and the CH341 answers with one byte per data byte clocked.
+    const size_t data_per_packet = CH341Config::PACKET_LENGTH - 1;
+    const size_t packets_per_write = CH341Config::MAX_PACKET_LEN / CH341Config::PACKET_LENGTH;
+    const size_t total = tx_len + rx_len;
 
-            ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                       cmd, sizeof(cmd), &transferred,
-                                       CH341Config::USB_TIMEOUT);
+    response_buffer.resize(total);
 
-            if (ret != 0)
-            {
-                std::cerr << "Error in SPI read byte: " << libusb_error_name(ret) << std::endl;
-                return result;
-            }
+    size_t offset = 0;
+    bool first = true;
+    bool cs_released = false;
 
-            // Leer la respuesta
-            uint8_t response_byte;
-            ret = libusb_bulk_transfer(device, CH341Config::BULK_READ_EP,
-                                       &response_byte, 1, &transferred,
-                                       CH341Config::USB_TIMEOUT);
+    // The pins are read along with CS high, the cheapest INT# sample there is
+    bool sample_pins = interruptEnabled;
+    uint64_t start_ns = steadyNowNs();
 
-            if (ret != 0)
-            {
-                std::cerr << "Error in SPI read byte: " << libusb_error_name(ret) << std::endl;
-                return result;
-            }
+    while (first || offset < total)
+    {
+        stream_buffer.clear();
 
-            // Process and send the response byte
-            result.push_back(lsb_first ? swapBits(response_byte) : response_byte);
+        size_t packets = packets_per_write;
+        if (first)
+        {
+            // CS low goes in the same bulk write as the first SPI packets
+            appendChipSelect(stream_buffer, false);
+            packets--;
         }
 
-        // CS high
-        uint8_t cs_high[3] = {
-            CH341Config::CMD_UIO_STREAM,
-            CH341Config::CMD_UIO_STM_OUT | 0x37,
-            CH341Config::CMD_UIO_STM_END};
+        size_t round_start = offset;
+        size_t round_end = std::min(total, offset + packets * data_per_packet);
 
-        ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                   cs_high, sizeof(cs_high), &transferred,
-                                   CH341Config::USB_TIMEOUT);
+        while (offset < round_end)
+        {
+            size_t chunk = std::min(data_per_packet, round_end - offset);
+            appendStreamPacket(stream_buffer, tx, tx_len, offset, chunk);
+            offset += chunk;
+        }
 
-        if (ret != 0)
+        // A short SPI packet terminates the bulk transfer, so CS high can only be
+        // packed behind the payload when the last SPI packet is completely full.
+        if (offset == total && stream_buffer.size() % CH341Config::PACKET_LENGTH == 0 &&
+            stream_buffer.size() + CH341Config::PACKET_LENGTH <= CH341Config::MAX_PACKET_LEN)
+        {
+            appendChipSelect(stream_buffer, true, sample_pins);
+            cs_released = true;
+        }
+
+        if (!bulkWrite(stream_buffer.data(), stream_buffer.size()) ||
+            !bulkRead(response_buffer.data() + round_start, round_end - round_start))
         {
-            std::cerr << "Error setting CS high: " << libusb_error_name(ret) << std::endl;
+            abortStream();
+            return false;
         }
 
-        return result;
+        first = false;
     }
-    catch (const std::exception &e)
+
+    if (!cs_released)
     {
-        std::cerr << "Exception in spiTransfer: " << e.what() << std::endl;
-        return std::vector<uint8_t>();
+        stream_buffer.clear();
+        appendChipSelect(stream_buffer, true, sample_pins);
+        if (!bulkWrite(stream_buffer.data(), stream_buffer.size()))
+        {
+            std::cerr << "Error setting CS high" << std::endl;
+            abortStream();
+            return false;
+        }
     }
-}
 
-bool CH341SPI::digitalWrite(uint8_t pin, bool value)
-{
-    if (!device)
-        return false;
-
-    // Ensure the pin is configured as output
-    _gpio_direction |= pin;
+    // The pin byte is answered after every SPI packet of the transaction. CS is
+    // already high and the data is complete, so a lost sample only costs the sample.
+    uint8_t pins = 0;
+    if (sample_pins)
+    {
+        if (bulkRead(&pins, 1))
+        {
+            recordPinSample(pins, start_ns, steadyNowNs());
+        }
+        else
+        {
+            abortStream();
+        }
+    }
 
-    if (value)
+    // The bytes clocked in during the write phase are discarded
+    if (lsb_first)
     {
-        _gpio_output |= pin; // Set the pin high
+        BitReverse::reverseBits(response_buffer.data() + tx_len, rx, rx_len);
     }
-    else
+    else if (rx_len > 0)
     {
-        _gpio_output &= ~pin; // Set the pin low
+        std::memcpy(rx, response_buffer.data() + tx_len, rx_len);
     }
 
-    // Send the GPIO command to the CH341
-    uint8_t cmd[4] = {
-        CH341Config::CMD_UIO_STREAM,
-        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_OUT | _gpio_output),
-        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_DIR | _gpio_direction),
-        CH341Config::CMD_UIO_STM_END};
-
-    int transferred = 0;
-    int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                   cmd, sizeof(cmd), &transferred,
-                                   CH341Config::USB_TIMEOUT);
-
-    return (ret == 0);
+    return true;
 }
 
-bool CH341SPI::digitalRead(uint8_t pin)
+void CH341SPI::abortStream()
 {
-    if (!device)
-        return false;
-
-    // Ensure the pin is configured as input
-    _gpio_direction &= ~pin;
-
-    // Send the command to configure the direction
-    uint8_t dir_cmd[3] = {
-        CH341Config::CMD_UIO_STREAM,
-        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_DIR | _gpio_direction),
-        CH341Config::CMD_UIO_STM_END
-    };
+    stream_buffer.clear();
+    appendChipSelect(stream_buffer, true);
+    bulkWrite(stream_buffer.data(), stream_buffer.size());
 
+    // Errors are expected here, the read ends once nothing more arrives
+    stream_buffer.resize(CH341Config::MAX_PACKET_LEN);
     int transferred = 0;
-    int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                   dir_cmd, sizeof(dir_cmd), &transferred,
-                                   CH341Config::USB_TIMEOUT);
+    do
+    {
+        transferred = 0;
+        int ret = libusb_bulk_transfer(device, CH341Config::BULK_READ_EP, stream_buffer.data(),
+                                       static_cast<int>(stream_buffer.size()), &transferred,
+                                       CH341Config::DRAIN_TIMEOUT);
+        stats.usb_transfers.add();
+        if (ret != 0)
+        {
+            break;
+        }
+    } while (transferred > 0);
+}
 
-    if (ret != 0)
-        return false;
+bool CH341SPI::runTransaction(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    const Transaction transaction = {tx, tx_len, rx, rx_len};
 
-    // Command to read the state of the pins
-    uint8_t read_cmd[2] = {
-        CH341Config::CMD_UIO_STREAM | 0x80, // Command for reading
-        CH341Config::CMD_UIO_STM_END
-    };
+    std::unique_lock<std::mutex> lock(async_mutex);
 
-    ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                               read_cmd, sizeof(read_cmd), &transferred,
-                               CH341Config::USB_TIMEOUT);
+    if (!pipeline_running || streamPackets(transaction) > CH341Config::ASYNC_MAX_SPI_PACKETS)
+    {
+        // Too large for a queue slot: drain the pipeline and stream it in rounds
+        async_cv.wait(lock, [this]() { return active_slots == 0; });
+        return streamTransfer(tx, tx_len, rx, rx_len);
+    }
 
-    if (ret != 0)
+    AsyncSlot *slot = acquireSlot(lock);
+    if (!slot)
+    {
         return false;
+    }
 
-    // Read the response
-    uint8_t gpio_value;
-    ret = libusb_bulk_transfer(device, CH341Config::BULK_READ_EP,
-                               &gpio_value, 1, &transferred,
-                               CH341Config::USB_TIMEOUT);
+    slot->waited = true;
+    submitSlot(slot, &transaction, 1);
 
-    if (ret != 0 || transferred != 1)
-        return false;
+    async_cv.wait(lock, [slot]() { return slot->done; });
 
-    // Verify if the specific pin is high
-    return (gpio_value & pin) != 0;
+    bool success = slot->success;
+    free_slots.push_back(slot);
+    active_slots--;
+    async_cv.notify_all();
+    return success;
 }
 
-bool CH341SPI::pinMode(uint8_t pin, uint8_t mode)
+bool CH341SPI::transfer(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
 {
     if (!device)
+    {
         return false;
+    }
 
-    if (mode == OUTPUT)
+    const Transaction transaction = {tx, tx_len, rx, rx_len};
+    auto start = std::chrono::steady_clock::now();
+    bool success = false;
+
+    try
     {
-        _gpio_direction |= pin; // Configure as output
+        success = runTransaction(tx, tx_len, rx, rx_len);
     }
-    else
+    catch (const std::exception &e)
     {
-        _gpio_direction &= ~pin; // Configure as input
+        std::cerr << "Exception in spiTransfer: " << e.what() << std::endl;
+    }
+
+    stats.transaction_latency.recordSince(start);
+    countTransactions(&transaction, 1, success);
+    return success;
+}
+
+std::vector<uint8_t> CH341SPI::transfer(const std::vector<uint8_t> &write_data, size_t read_length)
+{
+    std::vector<uint8_t> result(read_length);
+
+    if (!transfer(write_data.data(), write_data.size(), result.data(), read_length))
+    {
+        return std::vector<uint8_t>(); // Empty result indicates error
+    }
+
+    return result;
+}
+
+bool CH341SPI::transferAsync(const uint8_t *tx, size_t tx_len, size_t rx_len, TransferCallback callback)
+{
+    const Transaction transaction = {tx, tx_len, nullptr, rx_len};
+
+    if (!device || streamPackets(transaction) > CH341Config::ASYNC_MAX_SPI_PACKETS)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    AsyncSlot *slot = acquireSlot(lock);
+    if (!slot)
+    {
+        return false;
+    }
+
+    slot->waited = false;
+    slot->callback = std::move(callback);
+    bool submitted = submitSlot(slot, &transaction, 1);
+    countTransactions(&transaction, 1, submitted);
+    return submitted;
+}
+
+bool CH341SPI::transferBatch(const Transaction *transactions, size_t count)
+{
+    if (!device)
+    {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool success = runBatch(transactions, count);
+    stats.transaction_latency.recordSince(start);
+    countTransactions(transactions, count, success);
+    return success;
+}
+
+bool CH341SPI::runBatch(const Transaction *transactions, size_t count)
+{
+    bool has_reads = false;
+    for (size_t i = 0; i < count; i++)
+    {
+        has_reads = has_reads || transactions[i].rx_len > 0;
+    }
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    size_t first = 0;
+    while (first < count)
+    {
+        if (!pipeline_running || streamPackets(transactions[first]) > CH341Config::ASYNC_MAX_SPI_PACKETS)
+        {
+            // Same fallback as runTransaction() for a transaction no slot can hold
+            const Transaction &t = transactions[first];
+            async_cv.wait(lock, [this]() { return active_slots == 0; });
+            if (!streamTransfer(t.tx, t.tx_len, t.rx, t.rx_len))
+            {
+                return false;
+            }
+            first++;
+            continue;
+        }
+
+        // Greedily pack the following transactions into one slot
+        size_t last = first;
+        size_t packets = 0;
+        while (last < count && last - first < CH341Config::ASYNC_MAX_TRANSACTIONS &&
+               packets + streamPackets(transactions[last]) <= CH341Config::ASYNC_MAX_SPI_PACKETS)
+        {
+            packets += streamPackets(transactions[last]);
+            last++;
+        }
+
+        AsyncSlot *slot = acquireSlot(lock);
+        if (!slot)
+        {
+            return false;
+        }
+
+        slot->waited = has_reads;
+        bool submitted = submitSlot(slot, transactions + first, last - first);
+
+        if (has_reads)
+        {
+            // Wait before the next group so a long batch never holds more than one slot
+            async_cv.wait(lock, [slot]() { return slot->done; });
+            bool success = slot->success;
+            free_slots.push_back(slot);
+            active_slots--;
+            async_cv.notify_all();
+            if (!success)
+            {
+                return false;
+            }
+        }
+        else if (!submitted)
+        {
+            return false;
+        }
+
+        first = last;
+    }
+
+    return true;
+}
+
+bool CH341SPI::queueWrite(const uint8_t *data, size_t length)
+{
+    const size_t slot_capacity = CH341Config::ASYNC_MAX_SPI_PACKETS * (CH341Config::PACKET_LENGTH - 1);
+
+    if (length > slot_capacity)
+    {
+        return transfer(data, length, nullptr, 0);
+    }
+
+    return transferAsync(data, length, 0, TransferCallback());
+}
+
+void CH341SPI::countTransactions(const Transaction *transactions, size_t count, bool success)
+{
+    size_t bytes_out = 0;
+    size_t bytes_in = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        bytes_out += transactions[i].tx_len;
+        bytes_in += transactions[i].rx_len;
+    }
+
+    stats.transactions.add(count);
+    stats.bytes_out.add(bytes_out);
+    stats.bytes_in.add(bytes_in);
+    if (!success)
+    {
+        stats.errors.add();
+    }
+}
+
+bool CH341SPI::flush()
+{
+    std::unique_lock<std::mutex> lock(async_mutex);
+    async_cv.wait(lock, [this]() { return active_slots == 0; });
+
+    bool failed = async_error;
+    async_error = false;
+    return !failed;
+}
+
+void CH341SPI::setQueueDepth(size_t depth)
+{
+    depth = std::max<size_t>(1, depth);
+
+    if (!pipeline_running)
+    {
+        queue_depth = depth;
+        return;
+    }
+
+    // Resize the pool in place once nothing is in flight
+    stopPipeline();
+    queue_depth = depth;
+    startPipeline();
+}
+
+bool CH341SPI::startPipeline()
+{
+    const size_t max_in = CH341Config::ASYNC_MAX_SPI_PACKETS;
+    const size_t max_transactions = CH341Config::ASYNC_MAX_TRANSACTIONS;
+    // Every transaction adds at most one UIO packet and may end a segment, plus the final CS high
+    const size_t buffer_size = (max_in + max_transactions + 1) * CH341Config::PACKET_LENGTH;
+
+    std::lock_guard<std::mutex> lock(async_mutex);
+
+    for (size_t i = 0; i < queue_depth; i++)
+    {
+        std::unique_ptr<AsyncSlot> slot(new AsyncSlot());
+        slot->owner = this;
+        for (size_t j = 0; j < max_transactions + 1; j++)
+        {
+            slot->out.push_back(libusb_alloc_transfer(0));
+        }
+        // One IN transfer per SPI stream packet, plus one for the pin sample
+        for (size_t j = 0; j < max_in + 1; j++)
+        {
+            slot->in.push_back(libusb_alloc_transfer(0));
+        }
+        slot->out_buffer.reserve(buffer_size);
+        slot->segment_ends.reserve(max_transactions + 1);
+        slot->packet_sizes.reserve(max_in);
+        slot->in_buffer.resize(max_in * (CH341Config::PACKET_LENGTH - 1));
+        slot->targets.reserve(max_transactions);
+
+        bool allocated = true;
+        for (libusb_transfer *t : slot->out)
+        {
+            allocated = allocated && t;
+        }
+        for (libusb_transfer *t : slot->in)
+        {
+            allocated = allocated && t;
+        }
+
+        free_slots.push_back(slot.get());
+        slots.push_back(std::move(slot));
+
+        if (!allocated)
+        {
+            std::cerr << "Failed to allocate USB transfers" << std::endl;
+            return false; // stopPipeline() from close() frees what was allocated
+        }
+    }
+
+    active_slots = 0;
+    async_error = false;
+    pipeline_running = true;
+    return true;
+}
+
+void CH341SPI::stopPipeline()
+{
+    std::unique_lock<std::mutex> lock(async_mutex);
+    async_cv.wait_for(lock, std::chrono::milliseconds(CH341Config::USB_TIMEOUT * 2),
+                      [this]() { return active_slots == 0; });
+
+    // The shared event thread keeps running, so stragglers can still be reaped
+    if (active_slots > 0)
+    {
+        for (std::unique_ptr<AsyncSlot> &slot : slots)
+        {
+            if (slot->pending > 0)
+            {
+                cancelSlot(slot.get());
+            }
+        }
+        async_cv.wait_for(lock, std::chrono::milliseconds(CH341Config::USB_TIMEOUT),
+                          [this]() { return active_slots == 0; });
+    }
+
+    pipeline_running = false;
+    async_cv.notify_all();
+
+    for (std::unique_ptr<AsyncSlot> &slot : slots)
+    {
+        for (libusb_transfer *t : slot->out)
+        {
+            libusb_free_transfer(t);
+        }
+        for (libusb_transfer *t : slot->in)
+        {
+            libusb_free_transfer(t);
+        }
+    }
+    slots.clear();
+    free_slots.clear();
+    active_slots = 0;
+}
+
+CH341SPI::AsyncSlot *CH341SPI::acquireSlot(std::unique_lock<std::mutex> &lock)
+{
+    async_cv.wait(lock, [this]() { return !free_slots.empty() || !pipeline_running; });
+    if (!pipeline_running)
+    {
+        return nullptr;
+    }
+
+    AsyncSlot *slot = free_slots.back();
+    free_slots.pop_back();
+    active_slots++;
+
+    slot->success = true;
+    slot->done = false;
+    slot->pending = 0;
+    slot->callback = TransferCallback();
+    return slot;
+}
+
+bool CH341SPI::submitSlot(AsyncSlot *slot, const Transaction *transactions, size_t count)
+{
+    const size_t data_per_packet = CH341Config::PACKET_LENGTH - 1;
+
+    std::vector<uint8_t> &out = slot->out_buffer;
+    out.clear();
+    slot->segment_ends.clear();
+    slot->packet_sizes.clear();
+    slot->targets.clear();
+
+    // Same layout as streamTransfer() for each transaction: CS low, SPI stream
+    // packets, CS high. Between two transactions the CS high and the next CS
+    // low share one UIO packet.
+    size_t in_offset = 0;
+    for (size_t n = 0; n < count; n++)
+    {
+        const Transaction &t = transactions[n];
+        const size_t total = t.tx_len + t.rx_len;
+
+        if (n == 0)
+        {
+            appendChipSelect(out, false);
+        }
+        else
+        {
+            // A short SPI packet ends the bulk transfer, anything behind it needs a new one
+            if (out.size() % CH341Config::PACKET_LENGTH != 0)
+            {
+                slot->segment_ends.push_back(out.size());
+            }
+            appendChipSelectCycle(out);
+        }
+
+        for (size_t offset = 0; offset < total; offset += data_per_packet)
+        {
+            size_t chunk = std::min(data_per_packet, total - offset);
+            appendStreamPacket(out, t.tx, t.tx_len, offset, chunk);
+            slot->packet_sizes.push_back(chunk);
+        }
+
+        // The bytes clocked in during the write phase are discarded
+        slot->targets.push_back({in_offset + t.tx_len, t.rx_len, t.rx});
+        in_offset += total;
+    }
+
+    if (out.size() % CH341Config::PACKET_LENGTH != 0)
+    {
+        slot->segment_ends.push_back(out.size());
+    }
+
+    // While INT# is monitored, releasing CS also samples the pins, so busy
+    // buses need no dedicated polls
+    slot->sample_pins = interruptEnabled;
+    slot->submit_ns = steadyNowNs();
+    appendChipSelect(out, true, slot->sample_pins);
+    slot->segment_ends.push_back(out.size());
+
+    // All transfers of the slot are submitted back to back, so the OUT and IN
+    // endpoints see them in the same order as every other queued slot.
+    slot->out_submitted = 0;
+    slot->in_submitted = 0;
+
+    int submitted = 0;
+    int ret = 0;
+    size_t segment_start = 0;
+    for (size_t i = 0; ret == 0 && i < slot->segment_ends.size(); i++)
+    {
+        size_t segment_end = slot->segment_ends[i];
+        libusb_fill_bulk_transfer(slot->out[i], device, CH341Config::BULK_WRITE_EP,
+                                  out.data() + segment_start, static_cast<int>(segment_end - segment_start),
+                                  &CH341SPI::transferCallback, slot, CH341Config::USB_TIMEOUT);
+        ret = libusb_submit_transfer(slot->out[i]);
+        if (ret == 0)
+        {
+            slot->out_submitted++;
+            submitted++;
+        }
+        segment_start = segment_end;
+    }
+
+    // The CH341 answers every SPI stream packet with its own short packet,
+    // so each IN transfer is sized to exactly one packet's response.
+    size_t offset = 0;
+    for (size_t i = 0; ret == 0 && i < slot->packet_sizes.size(); i++)
+    {
+        size_t chunk = slot->packet_sizes[i];
+        libusb_fill_bulk_transfer(slot->in[i], device, CH341Config::BULK_READ_EP,
+                                  slot->in_buffer.data() + offset, static_cast<int>(chunk),
+                                  &CH341SPI::transferCallback, slot, CH341Config::USB_TIMEOUT);
+        ret = libusb_submit_transfer(slot->in[i]);
+        if (ret == 0)
+        {
+            slot->in_submitted++;
+            submitted++;
+        }
+        offset += chunk;
+    }
+
+    // The pin byte is answered after the last SPI stream packet
+    if (ret == 0 && slot->sample_pins)
+    {
+        libusb_transfer *transfer = slot->in[slot->packet_sizes.size()];
+        libusb_fill_bulk_transfer(transfer, device, CH341Config::BULK_READ_EP,
+                                  &slot->pin_sample, 1,
+                                  &CH341SPI::transferCallback, slot, CH341Config::USB_TIMEOUT);
+        ret = libusb_submit_transfer(transfer);
+        if (ret == 0)
+        {
+            slot->in_submitted++;
+            submitted++;
+        }
+    }
+
+    slot->pending = submitted;
+
+    if (ret != 0)
+    {
+        reportUsbError(ret, "Error submitting SPI transfer");
+        slot->success = false;
+        async_error = true;
+
+        // Whatever was already submitted can no longer be matched to a response
+        cancelSlot(slot);
+
+        if (submitted == 0)
+        {
+            slot->done = true;
+            if (!slot->waited)
+            {
+                free_slots.push_back(slot);
+                active_slots--;
+            }
+            async_cv.notify_all();
+        }
+        return false;
+    }
+
+    return true;
+}
+
+void CH341SPI::cancelSlot(AsyncSlot *slot)
+{
+    // Cancelling a transfer that already completed is harmless (LIBUSB_ERROR_NOT_FOUND)
+    for (size_t i = 0; i < slot->out_submitted; i++)
+    {
+        libusb_cancel_transfer(slot->out[i]);
+    }
+    for (size_t i = 0; i < slot->in_submitted; i++)
+    {
+        libusb_cancel_transfer(slot->in[i]);
+    }
+}
+
+void LIBUSB_CALL CH341SPI::transferCallback(libusb_transfer *transfer)
+{
+    AsyncSlot *slot = static_cast<AsyncSlot *>(transfer->user_data);
+    slot->owner->onTransferComplete(transfer);
+}
+
+void CH341SPI::onTransferComplete(libusb_transfer *transfer)
+{
+    AsyncSlot *slot = static_cast<AsyncSlot *>(transfer->user_data);
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    stats.usb_transfers.add();
+
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED || transfer->actual_length != transfer->length)
+    {
+        if (slot->success && transfer->status != LIBUSB_TRANSFER_CANCELLED)
+        {
+            bool timeout = transfer->status == LIBUSB_TRANSFER_TIMED_OUT;
+
+            stats.usb_errors.add();
+            if (timeout)
+            {
+                stats.usb_timeouts.add();
+            }
+
+            if (!stats.trace.emit(timeout ? TraceEvent::UsbTimeout : TraceEvent::UsbError, transfer->status,
+                                  "Error in SPI transfer"))
+            {
+                std::cerr << "Error in SPI transfer: status " << transfer->status << std::endl;
+            }
+        }
+        slot->success = false;
+        async_error = true;
+
+        // Responses of later transactions would be misaligned, cancel everything in flight
+        for (std::unique_ptr<AsyncSlot> &other : slots)
+        {
+            if (other->pending > 0)
+            {
+                cancelSlot(other.get());
+            }
+        }
+    }
+
+    if (--slot->pending == 0)
+    {
+        finishSlot(slot, lock);
+    }
+}
+
+void CH341SPI::finishSlot(AsyncSlot *slot, std::unique_lock<std::mutex> &lock)
+{
+    stats.usb_latency.record(steadyNowNs() - slot->submit_ns);
+
+    if (slot->sample_pins && slot->success)
+    {
+        recordPinSample(slot->pin_sample, slot->submit_ns, steadyNowNs());
+    }
+
+    if (lsb_first && slot->success)
+    {
+        for (const AsyncSlot::Target &target : slot->targets)
+        {
+            BitReverse::reverseBits(slot->in_buffer.data() + target.offset, target.length);
+        }
+    }
+
+    if (slot->waited)
+    {
+        if (slot->success)
+        {
+            for (const AsyncSlot::Target &target : slot->targets)
+            {
+                if (target.length > 0)
+                {
+                    std::memcpy(target.dest, slot->in_buffer.data() + target.offset, target.length);
+                }
+            }
+        }
+        slot->done = true;
+        async_cv.notify_all();
+        return;
+    }
+
+    TransferCallback callback;
+    callback.swap(slot->callback);
+    bool success = slot->success;
+
+    if (callback)
+    {
+        // Only transferAsync() installs a callback, and it packs a single transaction
+        const AsyncSlot::Target &target = slot->targets.front();
+        lock.unlock();
+        callback(success, slot->in_buffer.data() + target.offset, target.length);
+        lock.lock();
+    }
+
+    slot->done = true;
+    free_slots.push_back(slot);
+    active_slots--;
+    async_cv.notify_all();
+}
+
+bool CH341SPI::digitalWrite(uint8_t pin, bool value)
+{
+    if (!device)
+        return false;
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    // Ensure the pin is configured as output
+    _gpio_direction |= pin;
+
+    if (value)
+    {
+        _gpio_output |= pin; // Set the pin high
+    }
+    else
+    {
+        _gpio_output &= ~pin; // Set the pin low
+    }
+
+    // Send the GPIO command to the CH341
+    uint8_t cmd[4] = {
+        CH341Config::CMD_UIO_STREAM,
+        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_OUT | _gpio_output),
+        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_DIR | _gpio_direction),
+        CH341Config::CMD_UIO_STM_END};
+
+    return commandTransfer(lock, cmd, sizeof(cmd));
+}
+
+bool CH341SPI::digitalRead(uint8_t pin)
+{
+    if (!device)
+        return false;
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    // Ensure the pin is configured as input
+    _gpio_direction &= ~pin;
+
+    // Set the direction and read the levels in one command
+    uint8_t cmd[4] = {
+        CH341Config::CMD_UIO_STREAM,
+        static_cast<uint8_t>(CH341Config::CMD_UIO_STM_DIR | _gpio_direction),
+        CH341Config::CMD_UIO_STM_IN,
+        CH341Config::CMD_UIO_STM_END
+    };
+
+    uint8_t gpio_value = 0;
+    uint64_t start_ns = steadyNowNs();
+    if (!commandTransfer(lock, cmd, sizeof(cmd), &gpio_value, 1))
+        return false;
+
+    // Also a sample for the interrupt monitor
+    recordPinSample(gpio_value, start_ns, steadyNowNs());
+
+    // Verify if the specific pin is high
+    return (gpio_value & pin) != 0;
+}
+
+bool CH341SPI::pinMode(uint8_t pin, uint8_t mode)
+{
+    if (!device)
+        return false;
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+
+    if (mode == OUTPUT)
+    {
+        _gpio_direction |= pin; // Configure as output
+    }
+    else
+    {
+        _gpio_direction &= ~pin; // Configure as input
     }
 
     // Send the command to configure the direction
@@ -487,24 +1274,67 @@ bool CH341SPI::pinMode(uint8_t pin, uint8_t mode)
         static_cast<uint8_t>(CH341Config::CMD_UIO_STM_DIR | _gpio_direction),
         CH341Config::CMD_UIO_STM_END};
 
-    int transferred = 0;
-    int ret = libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                   cmd, sizeof(cmd), &transferred,
-                                   CH341Config::USB_TIMEOUT);
+    return commandTransfer(lock, cmd, sizeof(cmd));
+}
 
-    return (ret == 0);
+bool CH341SPI::commandTransfer(std::unique_lock<std::mutex> &lock, const uint8_t *cmd, size_t cmd_len,
+                               uint8_t *in, size_t in_len)
+{
+    // Responses arrive in request order, so nothing else may be in flight
+    async_cv.wait(lock, [this]() { return active_slots == 0; });
+    if (!device)
+    {
+        return false;
+    }
+
+    uint8_t buffer[CH341Config::PACKET_LENGTH];
+    std::memcpy(buffer, cmd, std::min<size_t>(cmd_len, sizeof(buffer)));
+    return bulkWrite(buffer, std::min<size_t>(cmd_len, sizeof(buffer))) &&
+           (in_len == 0 || bulkRead(in, in_len));
+}
+
+bool CH341SPI::configureInterrupt(uint8_t pin, bool enable)
+{
+    return configureInterrupt(pin, enable ? InterruptEdge::Both : InterruptEdge::None);
+}
+
+bool CH341SPI::configureInterrupt(uint8_t pin, InterruptEdge edge)
+{
+    if (pin > 7)
+    {
+        std::cerr << "Error: CH341 interrupt pin must be 0-7" << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(async_mutex);
+    interrupt_pin = pin;
+    interrupt_edge = edge;
+    pins_sampled = false;
+    return true;
 }
 
 bool CH341SPI::setInterruptCallback(InterruptCallback callback)
 {
+    std::lock_guard<std::mutex> lock(async_mutex);
     interruptCallback = callback;
     return true;
 }
 
+bool CH341SPI::setInterruptEventCallback(InterruptEventCallback callback)
+{
+    std::lock_guard<std::mutex> lock(async_mutex);
+    interrupt_event_callback = callback;
+    return true;
+}
+
 bool CH341SPI::enableInterrupt(bool enable)
 {
     if (enable && !interruptEnabled)
     {
+        {
+            std::lock_guard<std::mutex> lock(async_mutex);
+            pins_sampled = false;
+        }
         interruptEnabled = true;
         threadRunning = true;
         // Create a new thread to monitor the INT# pin
@@ -514,7 +1344,11 @@ bool CH341SPI::enableInterrupt(bool enable)
     else if (!enable && interruptEnabled)
     {
         interruptEnabled = false;
-        threadRunning = false;
+        {
+            std::lock_guard<std::mutex> lock(async_mutex);
+            threadRunning = false;
+        }
+        async_cv.notify_all();
         if (interruptThread.joinable())
         {
             interruptThread.join();
@@ -524,49 +1358,101 @@ bool CH341SPI::enableInterrupt(bool enable)
     return false;
 }
 
+void CH341SPI::recordPinSample(uint8_t pins, uint64_t start_ns, uint64_t end_ns)
+{
+    bool level = (pins >> interrupt_pin) & 0x01;
+    uint64_t previous_start_ns = pin_sample_start_ns;
+    bool had_sample = pins_sampled;
+
+    pin_sample_count++;
+    pin_sample_start_ns = start_ns;
+    pins_sampled = true;
+
+    if (!had_sample || level == pin_level)
+    {
+        pin_level = level;
+        return;
+    }
+    pin_level = level;
+
+    bool wanted = interrupt_edge == InterruptEdge::Both ||
+                  (interrupt_edge == InterruptEdge::Rising && level) ||
+                  (interrupt_edge == InterruptEdge::Falling && !level);
+    if (!wanted)
+    {
+        return;
+    }
+
+    // The edge lies between the request of the previous sample and the arrival of this one
+    uint64_t half_width = (end_ns - std::min(previous_start_ns, end_ns)) / 2;
+    pin_edge.pin = interrupt_pin;
+    pin_edge.rising = level;
+    pin_edge.timestamp_ns = end_ns - half_width;
+    pin_edge.uncertainty_ns = static_cast<uint32_t>(std::min<uint64_t>(half_width, UINT32_MAX));
+    pin_edge_count++;
+    async_cv.notify_all();
+}
+
 void CH341SPI::interruptMonitoringThread()
 {
-    // Vector to store the state of the interrupt register
-    uint8_t cmd[2] = {CH341Config::CMD_UIO_STREAM | 0x80, CH341Config::CMD_UIO_STM_END};
+    // Dedicated pin read, answered with one byte
+    const uint8_t cmd[3] = {CH341Config::CMD_UIO_STREAM, CH341Config::CMD_UIO_STM_IN, CH341Config::CMD_UIO_STM_END};
+
+    std::unique_lock<std::mutex> lock(async_mutex);
+    uint64_t delivered = pin_edge_count;
+    uint64_t samples = pin_sample_count;
+    auto interval = std::chrono::milliseconds(CH341Config::INT_POLL_MIN_MS);
 
     while (threadRunning)
     {
-        if (device)
+        async_cv.wait_for(lock, interval, [this, &delivered]() {
+            return !threadRunning || pin_edge_count != delivered;
+        });
+        if (!threadRunning)
         {
-            // Read the state of the INT# pin (pin 7)
-            int transferred = 0;
-
-            // Send command to read the pins
-            libusb_bulk_transfer(device, CH341Config::BULK_WRITE_EP,
-                                 cmd, sizeof(cmd), &transferred,
-                                 CH341Config::USB_TIMEOUT);
+            break;
+        }
 
-            // Read the response
-            uint8_t pinState;
-            if (libusb_bulk_transfer(device, CH341Config::BULK_READ_EP,
-                                     &pinState, 1, &transferred,
-                                     CH341Config::USB_TIMEOUT) == 0)
+        if (pin_edge_count != delivered)
+        {
+            // Edges are coalesced if several arrived since the last delivery
+            delivered = pin_edge_count;
+            InterruptEvent event = pin_edge;
+            InterruptEventCallback event_callback = interrupt_event_callback;
+            InterruptCallback callback = interruptCallback;
+            lock.unlock();
+            if (event_callback)
+            {
+                event_callback(event);
+            }
+            else if (callback)
             {
+                callback();
+            }
+            lock.lock();
+            interval = std::chrono::milliseconds(CH341Config::INT_POLL_MIN_MS);
+            continue;
+        }
 
-                // Check if the corresponding bit for INT# is active (pin 7 = bit 6)
-                // Note: You may need to adjust this logic based on how it's connected
-                bool interruptTriggered = ((pinState & 0x40) == 0); // Active low
+        // Transactions kept the pins sampled, no need to poll yet
+        if (pin_sample_count != samples)
+        {
+            samples = pin_sample_count;
+            interval = std::chrono::milliseconds(CH341Config::INT_POLL_MIN_MS);
+            continue;
+        }
 
-                static bool lastState = false;
-                // Detect state change (falling edge)
-                if (interruptTriggered && !lastState)
-                {
-                    // Call the callback if set
-                    if (interruptCallback)
-                    {
-                        interruptCallback();
-                    }
-                }
-                lastState = interruptTriggered;
+        // Poll only an idle bus; queued transactions sample the pins themselves
+        if (pipeline_running && active_slots == 0)
+        {
+            uint8_t pins = 0;
+            uint64_t start_ns = steadyNowNs();
+            if (commandTransfer(lock, cmd, sizeof(cmd), &pins, 1))
+            {
+                recordPinSample(pins, start_ns, steadyNowNs());
             }
+            samples = pin_sample_count;
         }
-
-        // Sleep for a short time to avoid saturating the bus
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        interval = std::min(interval * 2, std::chrono::milliseconds(CH341Config::INT_POLL_MAX_MS));
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,449 @@
+/**
+ * @file FSKModem.cpp
+ * @brief Implementation of the FSK/GFSK packet engine
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "FSKModem.hpp"
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+constexpr size_t FSKModem::FIFO_SIZE;
+constexpr size_t FSKModem::MAX_FIXED_LENGTH;
+constexpr size_t FSKModem::MAX_VARIABLE_LENGTH;
+constexpr size_t FSKModem::MAX_SYNC_LENGTH;
+
+// Crystal frequency, the base of every rate and deviation register
+static const uint32_t FXOSC = 32000000;
+
+FSKModem::FSKModem(RFM95 &radio)
+    : radio(radio),
+      last_rssi(0.0f)
+{
+}
+
+bool FSKModem::begin(const Config &config)
+{
+    if (radio.getRxEngineRunning())
+    {
+        std::cerr << "Error: Stop the RX engine before switching to FSK" << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(radio.bus_mutex);
+
+    if (!radio.switchModem(false, RFM95::MODE_STDBY))
+    {
+        return false;
+    }
+
+    return configure(config);
+}
+
+bool FSKModem::configure(const Config &next)
+{
+    if (next.bitrate < 1200 || next.bitrate > 300000)
+    {
+        std::cerr << "Error: FSK bitrate must be 1200-300000 bps" << std::endl;
+        return false;
+    }
+    if (next.deviation_hz < 600 || next.deviation_hz + next.bitrate / 2 > 250000)
+    {
+        std::cerr << "Error: FSK deviation must be at least 600 Hz and deviation + bitrate / 2 at most 250 kHz" << std::endl;
+        return false;
+    }
+    if (next.sync_length < 1 || next.sync_length > MAX_SYNC_LENGTH)
+    {
+        std::cerr << "Error: FSK sync word must be 1-8 bytes" << std::endl;
+        return false;
+    }
+    if (next.fifo_threshold < 1 || next.fifo_threshold > FIFO_SIZE - 2)
+    {
+        std::cerr << "Error: FSK FIFO threshold must be 1-62" << std::endl;
+        return false;
+    }
+    size_t max_length = next.variable_length ? MAX_VARIABLE_LENGTH : MAX_FIXED_LENGTH;
+    if (next.payload_length < 1 || next.payload_length > max_length)
+    {
+        std::cerr << "Error: FSK payload length must be 1-" << max_length << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(radio.bus_mutex);
+
+    radio.setFrequency(next.frequency_mhz);
+    radio.setTxPower(next.tx_power, next.use_pa_boost);
+
+    RFM95::RegisterBatch batch(radio);
+
+    // BitRate = FXOSC / (RegBitrate + RegBitrateFrac / 16)
+    uint32_t bitrate16 = (FXOSC * 16ull + next.bitrate / 2) / next.bitrate;
+    uint8_t bitrate[2] = {static_cast<uint8_t>(bitrate16 >> 12), static_cast<uint8_t>(bitrate16 >> 4)};
+    batch.writeBurst(RFM95::REG_FSK_BITRATE_MSB, bitrate, sizeof(bitrate));
+    batch.write(RFM95::REG_FSK_BITRATE_FRAC, static_cast<uint8_t>(bitrate16 & 0x0F));
+
+    // Fdev = Fstep * RegFdev with Fstep = FXOSC / 2^19
+    uint32_t fdev = static_cast<uint32_t>((static_cast<uint64_t>(next.deviation_hz) << 19) / FXOSC);
+    uint8_t deviation[2] = {static_cast<uint8_t>((fdev >> 8) & 0x3F), static_cast<uint8_t>(fdev)};
+    batch.writeBurst(RFM95::REG_FSK_FDEV_MSB, deviation, sizeof(deviation));
+
+    // Gaussian filter in bits 6-5, default 40 us ramp
+    batch.write(RFM95::REG_PA_RAMP, static_cast<uint8_t>((static_cast<uint8_t>(next.shaping) << 5) | 0x09));
+
+    // AFC, AGC and an RX start on preamble detection
+    batch.write(RFM95::REG_FSK_RX_CONFIG, 0x1E);
+    uint8_t bandwidth[2] = {bandwidthValue(next.rx_bandwidth_hz), bandwidthValue(next.rx_bandwidth_hz)};
+    batch.writeBurst(RFM95::REG_FSK_RX_BW, bandwidth, sizeof(bandwidth));
+
+    // Detector on, 2 preamble bytes, 10 chips of tolerance
+    batch.write(RFM95::REG_FSK_PREAMBLE_DETECT, 0xAA);
+
+    // Preamble length, sync configuration and sync word are contiguous
+    uint8_t framing[3 + MAX_SYNC_LENGTH];
+    framing[0] = static_cast<uint8_t>(next.preamble_length >> 8);
+    framing[1] = static_cast<uint8_t>(next.preamble_length);
+    framing[2] = static_cast<uint8_t>(0x10 | (next.sync_length - 1)); // SyncOn, no automatic RX restart
+    std::copy(next.sync_word, next.sync_word + next.sync_length, framing + 3);
+    batch.writeBurst(RFM95::REG_FSK_PREAMBLE_MSB, framing, 3 + next.sync_length);
+
+    // PacketConfig1, PacketConfig2 and PayloadLength are contiguous too. The CRC
+    // is checked but a failing frame stays in the FIFO, so it can be counted.
+    uint8_t packet[3];
+    packet[0] = static_cast<uint8_t>((next.variable_length ? 0x80 : 0x00) |
+                                     (static_cast<uint8_t>(next.dc_free) << 5) |
+                                     (next.crc ? 0x10 : 0x00) | 0x08);
+    packet[1] = static_cast<uint8_t>(0x40 | ((next.payload_length >> 8) & 0x07)); // Packet mode
+    packet[2] = static_cast<uint8_t>(next.payload_length);
+    batch.writeBurst(RFM95::REG_FSK_PACKET_CONFIG_1, packet, sizeof(packet));
+
+    // Start transmitting as soon as the FIFO holds a byte
+    batch.write(RFM95::REG_FSK_FIFO_THRESH, static_cast<uint8_t>(0x80 | next.fifo_threshold));
+
+    // DIO0 = 00: PacketSent in TX, PayloadReady in RX
+    uint8_t dio_mapping = radio.readRegister(RFM95::REG_DIO_MAPPING_1);
+    batch.write(RFM95::REG_DIO_MAPPING_1, dio_mapping & 0x3F);
+
+    if (!batch.submit())
+    {
+        return false;
+    }
+
+    config = next;
+    return true;
+}
+
+void FSKModem::end()
+{
+    std::lock_guard<std::recursive_mutex> lock(radio.bus_mutex);
+
+    radio.switchModem(true, RFM95::MODE_STDBY);
+}
+
+bool FSKModem::send(const uint8_t *data, size_t length)
+{
+    if (config.variable_length ? length > config.payload_length : length != config.payload_length)
+    {
+        if (!radio.stats.trace.emit(TraceEvent::InvalidFrame, static_cast<int>(length),
+                                    "FSK frame does not match the payload length"))
+        {
+            std::cerr << "Error: FSK frame of " << length << " bytes does not match the payload length" << std::endl;
+        }
+        return false;
+    }
+    if (radio.getRxEngineRunning())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(radio.bus_mutex);
+
+    uint32_t time_on_air = getTimeOnAir(length);
+    auto start = std::chrono::steady_clock::now();
+    auto air = std::chrono::microseconds(time_on_air);
+    auto deadline = start + air + air / 4 + std::chrono::milliseconds(RFM95::TX_TIMEOUT_MARGIN_MS);
+    uint64_t seen = radio.interruptCount();
+
+    // FifoOverrun clears the FIFO, then prefill it completely before TX starts
+    RFM95::RegisterBatch batch(radio);
+    batch.write(RFM95::REG_FSK_IRQ_FLAGS_2, RFM95::FSK_IRQ2_FIFO_OVERRUN);
+
+    uint8_t first[FIFO_SIZE];
+    size_t used = 0;
+    if (config.variable_length)
+    {
+        first[used++] = static_cast<uint8_t>(length);
+    }
+    size_t sent = std::min(length, FIFO_SIZE - used);
+    std::copy(data, data + sent, first + used);
+    batch.writeBurst(RFM95::REG_FIFO, first, used + sent);
+    batch.setMode(RFM95::MODE_TX);
+    if (!batch.submit())
+    {
+        radio.setMode(RFM95::MODE_STDBY);
+        return false;
+    }
+
+    // Each refill covers what the FIFO has room for once it drops to the threshold
+    size_t refill = FIFO_SIZE - config.fifo_threshold;
+    auto poll = std::chrono::microseconds(byteTimeUs(std::max<size_t>(config.fifo_threshold / 2, 1)));
+    while (sent < length)
+    {
+        uint8_t flags = 0;
+        batch.read(RFM95::REG_FSK_IRQ_FLAGS_2, &flags, 1);
+        if (!batch.submit())
+        {
+            break;
+        }
+
+        if (!(flags & RFM95::FSK_IRQ2_FIFO_LEVEL))
+        {
+            size_t chunk = std::min(refill, length - sent);
+            batch.writeBurst(RFM95::REG_FIFO, data + sent, chunk);
+            if (!batch.submit())
+            {
+                break;
+            }
+            sent += chunk;
+            continue;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(poll);
+    }
+
+    bool done = false;
+    while (sent == length)
+    {
+        uint8_t flags = 0;
+        batch.read(RFM95::REG_FSK_IRQ_FLAGS_2, &flags, 1);
+        if (batch.submit() && (flags & RFM95::FSK_IRQ2_PACKET_SENT))
+        {
+            done = true;
+            break;
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+        radio.waitForEvent(seen, deadline, poll);
+    }
+
+    batch.setMode(RFM95::MODE_STDBY);
+    batch.submit();
+
+    if (done)
+    {
+        radio.stats.packets_sent.add();
+        return true;
+    }
+
+    radio.stats.tx_timeouts.add();
+    if (!radio.stats.trace.emit(TraceEvent::TxTimeout, static_cast<int>(time_on_air), "FSK TX timeout"))
+    {
+        std::cerr << "FSK TX timeout after " << sent << " of " << length << " bytes" << std::endl;
+    }
+    return false;
+}
+
+bool FSKModem::receive(uint8_t *buffer, size_t capacity, size_t &length, std::chrono::milliseconds timeout)
+{
+    length = 0;
+    if (!config.variable_length && capacity < config.payload_length)
+    {
+        return false;
+    }
+    if (radio.getRxEngineRunning())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(radio.bus_mutex);
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    uint64_t seen = radio.interruptCount();
+
+    RFM95::RegisterBatch batch(radio);
+    batch.write(RFM95::REG_FSK_IRQ_FLAGS_2, RFM95::FSK_IRQ2_FIFO_OVERRUN);
+    batch.setMode(RFM95::MODE_RX_CONTINUOUS);
+    if (!batch.submit())
+    {
+        return false;
+    }
+
+    // PayloadReady on DIO0 is the only edge, so interrupts only help once a
+    // frame that fits the FIFO has started
+    size_t frame_bytes = config.payload_length + (config.variable_length ? 1 : 0);
+    bool wait_for_edge = radio.irq_active && frame_bytes <= FIFO_SIZE;
+    auto poll = std::chrono::microseconds(byteTimeUs(std::max<size_t>(config.fifo_threshold / 2, 1)));
+
+    size_t expected = config.variable_length ? 0 : config.payload_length;
+    bool synced = false;
+    bool have_length = !config.variable_length;
+    bool ok = false;
+    bool done = false;
+    while (!done)
+    {
+        uint8_t rssi = 0;
+        uint8_t flags[2] = {0, 0};
+        batch.read(RFM95::REG_FSK_RSSI_VALUE, &rssi, 1);
+        batch.read(RFM95::REG_FSK_IRQ_FLAGS_1, flags, sizeof(flags));
+        if (!batch.submit())
+        {
+            break;
+        }
+
+        if (!synced && (flags[0] & RFM95::FSK_IRQ1_SYNC_ADDRESS_MATCH))
+        {
+            synced = true;
+            last_rssi = -rssi / 2.0f;
+        }
+
+        if (flags[1] & RFM95::FSK_IRQ2_FIFO_OVERRUN)
+        {
+            // The FIFO was lost with the frame, listen for the next one
+            batch.write(RFM95::REG_FSK_IRQ_FLAGS_2, RFM95::FSK_IRQ2_FIFO_OVERRUN);
+            batch.submit();
+            synced = false;
+            have_length = !config.variable_length;
+            expected = config.variable_length ? 0 : config.payload_length;
+            length = 0;
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                break;
+            }
+            continue;
+        }
+
+        bool payload_ready = (flags[1] & RFM95::FSK_IRQ2_PAYLOAD_READY) != 0;
+        if (!have_length && !(flags[1] & RFM95::FSK_IRQ2_FIFO_EMPTY))
+        {
+            uint8_t frame_length = 0;
+            batch.read(RFM95::REG_FIFO, &frame_length, 1);
+            if (!batch.submit())
+            {
+                break;
+            }
+            if (frame_length > capacity)
+            {
+                if (!radio.stats.trace.emit(TraceEvent::InvalidFrame, frame_length, "FSK frame does not fit the buffer"))
+                {
+                    std::cerr << "Error: FSK frame of " << static_cast<int>(frame_length)
+                              << " bytes does not fit the buffer" << std::endl;
+                }
+                break;
+            }
+            expected = frame_length;
+            have_length = true;
+        }
+
+        // FifoLevel guarantees more than threshold bytes, PayloadReady the whole rest
+        size_t chunk = 0;
+        if (have_length && payload_ready)
+        {
+            chunk = expected - length;
+        }
+        else if (have_length && (flags[1] & RFM95::FSK_IRQ2_FIFO_LEVEL))
+        {
+            chunk = std::min<size_t>(config.fifo_threshold, expected - length);
+        }
+        if (chunk > 0)
+        {
+            batch.read(RFM95::REG_FIFO, buffer + length, chunk);
+            if (!batch.submit())
+            {
+                break;
+            }
+            length += chunk;
+        }
+
+        if (have_length && payload_ready && length == expected)
+        {
+            ok = !config.crc || (flags[1] & RFM95::FSK_IRQ2_CRC_OK);
+            done = true;
+            continue;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+        if (chunk == 0)
+        {
+            if (synced && wait_for_edge)
+            {
+                radio.waitForEvent(seen, deadline, poll);
+            }
+            else
+            {
+                std::this_thread::sleep_until(std::min(deadline, std::chrono::steady_clock::now() + poll));
+            }
+        }
+    }
+
+    batch.setMode(RFM95::MODE_STDBY);
+    batch.submit();
+
+    if (done && ok)
+    {
+        radio.stats.packets_received.add();
+        return true;
+    }
+    if (done)
+    {
+        radio.stats.crc_errors.add();
+        radio.stats.trace.emit(TraceEvent::RxCrcError, 0, "FSK CRC error");
+    }
+    return false;
+}
+
+float FSKModem::getLastRssi() const
+{
+    return last_rssi;
+}
+
+uint32_t FSKModem::getTimeOnAir(size_t length) const
+{
+    size_t bytes = config.preamble_length + config.sync_length + (config.variable_length ? 1 : 0) +
+                   length + (config.crc ? 2 : 0);
+    return byteTimeUs(bytes);
+}
+
+const FSKModem::Config &FSKModem::getConfig() const
+{
+    return config;
+}
+
+uint8_t FSKModem::bandwidthValue(uint32_t bandwidth_hz)
+{
+    // RxBw = FXOSC / (RxBwMant * 2^(RxBwExp + 2)), searched from the narrowest setting up
+    static const uint32_t mantissas[3] = {24, 20, 16};
+    for (int exponent = 7; exponent >= 1; exponent--)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t hz = FXOSC / (mantissas[i] << (exponent + 2));
+            if (hz >= bandwidth_hz)
+            {
+                return static_cast<uint8_t>(((2 - i) << 3) | exponent);
+            }
+        }
+    }
+    return 0x01; // 250 kHz
+}
+
+uint32_t FSKModem::byteTimeUs(size_t bytes) const
+{
+    uint64_t bits = static_cast<uint64_t>(bytes) * 8;
+    if (config.dc_free == DcFree::Manchester)
+    {
+        bits *= 2;
+    }
+    return static_cast<uint32_t>(std::max<uint64_t>(1, bits * 1000000 / config.bitrate));
+}
@@ -0,0 +1,591 @@
+/**
+ * @file Fragmenter.cpp
+ * @brief Implementation of the fragmentation and reassembly layer
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "Fragmenter.hpp"
+#include <algorithm>
+#include <cstring>
+
+constexpr size_t Fragmenter::HEADER_SIZE;
+constexpr size_t Fragmenter::MAX_FRAGMENT_SIZE;
+constexpr size_t Fragmenter::MAX_FRAGMENTS;
+constexpr size_t Fragmenter::MAX_TRANSFER_SIZE;
+constexpr uint8_t Fragmenter::FRAME_DATA;
+constexpr uint8_t Fragmenter::FRAME_REQUEST;
+constexpr uint8_t Fragmenter::FRAME_DONE;
+constexpr uint8_t Fragmenter::FRAME_POLL;
+constexpr size_t Fragmenter::COMPLETED_HISTORY;
+
+Fragmenter::Fragmenter(RFM95 &radio, const Options &options)
+    : radio(radio),
+      options(options),
+      completed(),
+      completed_next(0),
+      in_flight(0),
+      next_id(static_cast<uint8_t>(Clock::now().time_since_epoch().count())),
+      frame_air_us(0)
+{
+    // next_id starts from the clock so a restarted sender does not reuse the ids the receiver just completed
+    this->options.fragment_size = std::max<size_t>(1, std::min(options.fragment_size, MAX_FRAGMENT_SIZE));
+    this->options.max_transfer_size = std::max<size_t>(1, std::min(options.max_transfer_size,
+                                                                   MAX_FRAGMENTS * this->options.fragment_size));
+    this->options.window = std::max<size_t>(1, std::min(options.window, static_cast<size_t>(RFM95::TX_QUEUE_SIZE)));
+
+    tx.resize(std::max<size_t>(1, options.tx_transfers));
+    for (TxTransfer &transfer : tx)
+    {
+        transfer.buffer.resize(this->options.max_transfer_size);
+        transfer.active = false;
+        transfer.generation = 0;
+        transfer.queued = 0;
+    }
+
+    rx.resize(std::max<size_t>(1, options.rx_transfers));
+    for (RxTransfer &transfer : rx)
+    {
+        transfer.buffer.resize(this->options.max_transfer_size);
+        transfer.active = false;
+        transfer.delivering = false;
+    }
+
+    refreshAirtime();
+}
+
+Fragmenter::~Fragmenter()
+{
+    // Fragments still queued call back into this object
+    std::unique_lock<std::mutex> lock(mutex);
+    for (TxTransfer &transfer : tx)
+    {
+        transfer.active = false;
+    }
+    idle_cv.wait(lock, [this]() { return in_flight == 0; });
+}
+
+bool Fragmenter::send(const uint8_t *data, size_t length, SendCallback callback)
+{
+    if (length == 0 || length > options.max_transfer_size)
+    {
+        return false;
+    }
+
+    // The radio's bus is busy for as long as a burst of fragments is on air
+    bool idle = getPending() == 0;
+    if (idle)
+    {
+        refreshAirtime();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = 0;
+    while (slot < tx.size() && tx[slot].active)
+    {
+        slot++;
+    }
+    if (slot == tx.size())
+    {
+        return false;
+    }
+
+    TxTransfer &transfer = tx[slot];
+    transfer.active = true;
+    transfer.generation++;
+    transfer.id = next_id++;
+    transfer.length = length;
+    transfer.count = (length + options.fragment_size - 1) / options.fragment_size;
+    transfer.next = 0;
+    transfer.resend.reset();
+    transfer.queued = 0;
+    transfer.retries = options.retries;
+    transfer.deadline = Clock::now() + responseWindow();
+    transfer.callback = std::move(callback);
+    std::memcpy(transfer.buffer.data(), data, length);
+
+    pump(slot);
+    return true;
+}
+
+void Fragmenter::setReceiveCallback(ReceiveCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    receive_callback = std::move(callback);
+}
+
+void Fragmenter::setPacketCallback(PacketCallback callback)
+{
+    std::shared_ptr<const PacketCallback> installed;
+    if (callback)
+    {
+        installed = std::make_shared<PacketCallback>(std::move(callback));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    packet_callback = std::move(installed);
+}
+
+size_t Fragmenter::service()
+{
+    // Packets are handled in place in the ring; the application callback is only
+    // looked up once a packet needs it, and sharing it costs no allocation
+    std::shared_ptr<const PacketCallback> forward;
+    bool looked_up = false;
+    size_t handled = 0;
+    while (const RFM95::RxPacket *packet = radio.peekPacket())
+    {
+        if (!handlePacket(*packet))
+        {
+            if (!looked_up)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                forward = packet_callback;
+                looked_up = true;
+            }
+            if (forward)
+            {
+                (*forward)(*packet);
+            }
+        }
+        radio.releasePacket();
+        handled++;
+    }
+
+    poll();
+    return handled;
+}
+
+bool Fragmenter::handlePacket(const RFM95::RxPacket &packet)
+{
+    if (packet.crc_error || packet.length < HEADER_SIZE)
+    {
+        return false;
+    }
+
+    uint8_t type = packet.data[0];
+    if ((type & ~FRAME_POLL) == FRAME_DATA)
+    {
+        return handleData(packet.data, packet.length);
+    }
+    if (type == FRAME_REQUEST || type == FRAME_DONE)
+    {
+        handleReply(packet.data, packet.length);
+        return true;
+    }
+    return false;
+}
+
+void Fragmenter::poll()
+{
+    // Failed transfers are reported one at a time, outside the lock
+    while (true)
+    {
+        SendCallback failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Clock::time_point now = Clock::now();
+
+            for (RxTransfer &transfer : rx)
+            {
+                if (!transfer.active || transfer.delivering || now < transfer.deadline)
+                {
+                    continue;
+                }
+                if (transfer.requests >= options.retries)
+                {
+                    transfer.active = false;
+                    stats.transfers_abandoned.add();
+                    continue;
+                }
+
+                // The sender's poll or the fragments after a gap were lost
+                enqueueReply(transfer.id, static_cast<uint8_t>(transfer.count - 1), &transfer.received);
+                transfer.requests++;
+                transfer.deadline = now + responseWindow();
+            }
+
+            size_t slot = 0;
+            for (; slot < tx.size(); slot++)
+            {
+                TxTransfer &transfer = tx[slot];
+                if (!transfer.active || transfer.queued > 0 || now < transfer.deadline)
+                {
+                    continue;
+                }
+                if (transfer.retries <= 0)
+                {
+                    break;
+                }
+
+                transfer.retries--;
+                transfer.deadline = now + responseWindow();
+                if (transfer.next < transfer.count || transfer.resend.any())
+                {
+                    // Earlier enqueues failed, the TX queue may have room again
+                    pump(slot);
+                }
+                else
+                {
+                    // The poll or its answer was lost: the last fragment asks again
+                    enqueueFragment(slot, transfer.count - 1, true);
+                }
+            }
+
+            if (slot == tx.size())
+            {
+                return;
+            }
+
+            tx[slot].active = false;
+            failed.swap(tx[slot].callback);
+            stats.transfers_failed.add();
+        }
+
+        if (failed)
+        {
+            failed(false);
+        }
+    }
+}
+
+size_t Fragmenter::getPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t pending = 0;
+    for (const TxTransfer &transfer : tx)
+    {
+        pending += transfer.active ? 1 : 0;
+    }
+    return pending;
+}
+
+FragmentStats &Fragmenter::getStats()
+{
+    return stats;
+}
+
+void Fragmenter::refreshAirtime()
+{
+    // Reads the radio's registers, so it must not run under the lock
+    uint32_t air = radio.getTimeOnAir(255);
+    std::lock_guard<std::mutex> lock(mutex);
+    frame_air_us = air;
+}
+
+Fragmenter::Clock::duration Fragmenter::responseWindow() const
+{
+    return options.response_timeout + std::chrono::microseconds(2 * static_cast<uint64_t>(frame_air_us));
+}
+
+void Fragmenter::pump(size_t slot)
+{
+    TxTransfer &transfer = tx[slot];
+    while (transfer.active && transfer.queued < options.window)
+    {
+        size_t index = 0;
+        bool first_pass = transfer.next < transfer.count;
+        if (first_pass)
+        {
+            index = transfer.next++;
+        }
+        else if (transfer.resend.any())
+        {
+            while (!transfer.resend.test(index))
+            {
+                index++;
+            }
+            transfer.resend.reset(index);
+        }
+        else
+        {
+            break;
+        }
+
+        // The last fragment of each pass asks the receiver what is still missing
+        bool last = transfer.next == transfer.count && transfer.resend.none();
+        if (!enqueueFragment(slot, index, last))
+        {
+            if (first_pass)
+            {
+                transfer.next--;
+            }
+            else
+            {
+                transfer.resend.set(index);
+            }
+            break;
+        }
+        if (!first_pass)
+        {
+            stats.retransmissions.add();
+        }
+    }
+}
+
+bool Fragmenter::enqueueFragment(size_t slot, size_t index, bool poll)
+{
+    TxTransfer &transfer = tx[slot];
+    size_t offset = index * options.fragment_size;
+    size_t size = std::min(options.fragment_size, transfer.length - offset);
+
+    uint8_t frame[HEADER_SIZE + MAX_FRAGMENT_SIZE];
+    frame[0] = poll ? (FRAME_DATA | FRAME_POLL) : FRAME_DATA;
+    frame[1] = transfer.id;
+    frame[2] = static_cast<uint8_t>(index);
+    frame[3] = static_cast<uint8_t>(transfer.count - 1);
+    frame[4] = static_cast<uint8_t>(options.fragment_size);
+    std::memcpy(frame + HEADER_SIZE, transfer.buffer.data() + offset, size);
+
+    // Generation, slot and index packed into one word keep the capture within
+    // std::function's inline storage, so queueing a fragment does not allocate
+    uint64_t key = (static_cast<uint64_t>(transfer.generation) << 32) | (static_cast<uint64_t>(slot) << 8) | index;
+    if (!radio.enqueue(frame, HEADER_SIZE + size, options.tx_options,
+                       [this, key](bool success) { fragmentDone(key, success); }))
+    {
+        return false;
+    }
+
+    transfer.queued++;
+    in_flight++;
+    return true;
+}
+
+void Fragmenter::fragmentDone(uint64_t key, bool success)
+{
+    size_t slot = static_cast<size_t>((key >> 8) & 0xFFFFFF);
+    size_t index = static_cast<size_t>(key & 0xFF);
+    uint32_t generation = static_cast<uint32_t>(key >> 32);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    in_flight--;
+    idle_cv.notify_all();
+
+    TxTransfer &transfer = tx[slot];
+    if (transfer.generation != generation)
+    {
+        return;
+    }
+    transfer.queued--;
+
+    if (success)
+    {
+        stats.fragments_sent.add();
+    }
+    else if (transfer.active)
+    {
+        transfer.resend.set(index);
+    }
+
+    // The answer to a poll can only come once it is on air
+    transfer.deadline = Clock::now() + responseWindow();
+    pump(slot);
+}
+
+void Fragmenter::enqueueReply(uint8_t id, uint8_t last, const std::bitset<MAX_FRAGMENTS> *received)
+{
+    uint8_t frame[HEADER_SIZE + MAX_FRAGMENTS / 8];
+    frame[0] = received ? FRAME_REQUEST : FRAME_DONE;
+    frame[1] = id;
+    frame[2] = 0;
+    frame[3] = last;
+    frame[4] = 0;
+
+    // Missing fragments as a bitmap, fragment 0 in bit 0 of the first byte
+    size_t length = HEADER_SIZE;
+    if (received)
+    {
+        size_t count = static_cast<size_t>(last) + 1;
+        std::memset(frame + HEADER_SIZE, 0, (count + 7) / 8);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!received->test(i))
+            {
+                frame[HEADER_SIZE + i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+        }
+        length += (count + 7) / 8;
+        stats.requests_sent.add();
+    }
+
+    // A lost answer is recovered by the sender's next poll
+    radio.enqueue(frame, length, options.tx_options);
+}
+
+bool Fragmenter::handleData(const uint8_t *frame, size_t length)
+{
+    bool poll = (frame[0] & FRAME_POLL) != 0;
+    uint8_t id = frame[1];
+    size_t index = frame[2];
+    uint8_t last = frame[3];
+    size_t fragment_size = frame[4];
+    size_t size = length - HEADER_SIZE;
+
+    // Anything inconsistent is not ours
+    if (index > last || fragment_size == 0 || fragment_size > MAX_FRAGMENT_SIZE || size == 0 ||
+        size > fragment_size || (index < last && size != fragment_size))
+    {
+        return false;
+    }
+    size_t offset = index * fragment_size;
+
+    RxTransfer *deliver = nullptr;
+    ReceiveCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+
+        // Fragments of a transfer we already delivered: our FRAME_DONE was lost
+        for (const Completed &entry : completed)
+        {
+            if (entry.valid && entry.id == id && entry.last == last && now < entry.expires)
+            {
+                stats.duplicates.add();
+                if (poll)
+                {
+                    enqueueReply(id, last, nullptr);
+                }
+                return true;
+            }
+        }
+
+        RxTransfer *transfer = nullptr;
+        RxTransfer *free_slot = nullptr;
+        for (RxTransfer &candidate : rx)
+        {
+            if (candidate.active && candidate.id == id && candidate.count == static_cast<size_t>(last) + 1)
+            {
+                transfer = &candidate;
+                break;
+            }
+            if (!candidate.active && !candidate.delivering && !free_slot)
+            {
+                free_slot = &candidate;
+            }
+        }
+
+        if (!transfer)
+        {
+            if (!free_slot)
+            {
+                return true; // Every slot busy, the sender will retry
+            }
+            transfer = free_slot;
+            transfer->active = true;
+            transfer->id = id;
+            transfer->count = static_cast<size_t>(last) + 1;
+            transfer->fragment_size = fragment_size;
+            transfer->length = 0;
+            transfer->received.reset();
+            transfer->received_count = 0;
+        }
+
+        if (fragment_size != transfer->fragment_size || offset + size > transfer->buffer.size())
+        {
+            return true;
+        }
+
+        if (transfer->received.test(index))
+        {
+            stats.duplicates.add();
+        }
+        else
+        {
+            std::memcpy(transfer->buffer.data() + offset, frame + HEADER_SIZE, size);
+            transfer->received.set(index);
+            transfer->received_count++;
+            if (index == last)
+            {
+                transfer->length = offset + size;
+            }
+        }
+        transfer->requests = 0;
+        transfer->deadline = now + responseWindow();
+
+        if (transfer->received_count == transfer->count)
+        {
+            enqueueReply(id, last, nullptr);
+
+            Completed &entry = completed[completed_next];
+            completed_next = (completed_next + 1) % COMPLETED_HISTORY;
+            entry.valid = true;
+            entry.id = id;
+            entry.last = last;
+            entry.expires = now + responseWindow() * (options.retries + 1);
+
+            transfer->active = false;
+            transfer->delivering = true;
+            deliver = transfer;
+            callback = receive_callback;
+        }
+        else if (poll)
+        {
+            enqueueReply(id, last, &transfer->received);
+        }
+    }
+
+    if (deliver)
+    {
+        stats.transfers_received.add();
+        if (callback)
+        {
+            callback(deliver->buffer.data(), deliver->length);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        deliver->delivering = false;
+    }
+    return true;
+}
+
+void Fragmenter::handleReply(const uint8_t *frame, size_t length)
+{
+    uint8_t id = frame[1];
+    size_t count = static_cast<size_t>(frame[3]) + 1;
+
+    SendCallback done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t slot = 0;
+        while (slot < tx.size() && !(tx[slot].active && tx[slot].id == id && tx[slot].count == count))
+        {
+            slot++;
+        }
+        if (slot == tx.size())
+        {
+            return; // An answer to a transfer that already finished
+        }
+
+        TxTransfer &transfer = tx[slot];
+        transfer.retries = options.retries;
+        transfer.deadline = Clock::now() + responseWindow();
+
+        if (frame[0] == FRAME_DONE)
+        {
+            transfer.active = false;
+            done.swap(transfer.callback);
+            stats.transfers_sent.add();
+        }
+        else if (transfer.queued == 0)
+        {
+            // While fragments are queued the pass's own poll will ask again with a fresher bitmap.
+            // Fragments not sent yet show up as missing too, skip those.
+            size_t bitmap = std::min(length - HEADER_SIZE, (count + 7) / 8);
+            for (size_t i = 0; i < bitmap * 8 && i < transfer.next; i++)
+            {
+                if (frame[HEADER_SIZE + i / 8] & (1 << (i % 8)))
+                {
+                    transfer.resend.set(i);
+                }
+            }
+            pump(slot);
+        }
+    }
+
+    if (done)
+    {
+        done(true);
+    }
+}
@@ -5,6 +5,7 @@
 #include <linux/spi/spidev.h>
 #include <linux/gpio.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #endif
 #include <fstream>
 #include <iostream>
@@ -12,15 +13,28 @@
 #include <cstring>
 #include <map>
 #include <algorithm>
+#include <chrono>
+#include <cerrno>
+
+// The v2 line uAPI first shipped with Linux 5.10
+#if defined(__linux__) && defined(GPIO_V2_LINES_MAX)
+#define LINUXSPI_GPIO_CDEV 1
+#else
+#define LINUXSPI_GPIO_CDEV 0
+#endif
 
 LinuxSPI::LinuxSPI(const std::string& device, uint32_t speed, uint8_t mode)
     : device_path(device),
       speed_hz(speed),
       spi_mode(mode),
       fd(-1),
+      gpio_chip_fd(-1),
       interrupt_running(false),
-      interrupt_pin(-1)
+      interrupt_pin(-1),
+      interrupt_edge(InterruptEdge::None)
 {
+    interrupt_stop_pipe[0] = -1;
+    interrupt_stop_pipe[1] = -1;
 #ifdef __linux__
     gpio_export_path = "/sys/class/gpio/export";
     gpio_unexport_path = "/sys/class/gpio/unexport";
@@ -86,10 +100,11 @@ void LinuxSPI::close() {
     }
 
     // Unexport all used GPIO pins
-    for (const auto& pin_entry : gpio_pin_paths) {
-        unexportGPIO(pin_entry.first);
+    while (!gpio_pin_paths.empty()) {
+        unexportGPIO(gpio_pin_paths.begin()->first);
     }
-    gpio_pin_paths.clear();
+
+    closeGPIOChip();
 #endif
 }
 
@@ -126,11 +141,22 @@ std::vector<uint8_t> LinuxSPI::transfer(const std::vector<uint8_t>& write_data,
     };
 
     // Execute SPI transfer
-    if (ioctl(fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
-        std::cerr << "Error: SPI transfer failed" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    int result = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
+    stats.transaction_latency.recordSince(start);
+    stats.transactions.add();
+
+    if (result < 0) {
+        stats.errors.add();
+        if (!stats.trace.emit(TraceEvent::SpiError, errno, "SPI transfer failed")) {
+            std::cerr << "Error: SPI transfer failed" << std::endl;
+        }
         return {};
     }
 
+    stats.bytes_out.add(write_data.size());
+    stats.bytes_in.add(read_length);
+
     // Return received data
     return rx_buffer;
 #else
@@ -140,30 +166,165 @@ std::vector<uint8_t> LinuxSPI::transfer(const std::vector<uint8_t>& write_data,
 #endif
 }
 
-bool LinuxSPI::exportGPIO(uint8_t pin) {
+bool LinuxSPI::transfer(const uint8_t* tx, size_t tx_len, uint8_t* rx, size_t rx_len) {
 #ifdef __linux__
-    std::ofstream exportFile(gpio_export_path);
-    if (!exportFile.is_open()) {
-        std::cerr << "Error: Unable to open GPIO export file" << std::endl;
+    if (fd < 0) {
         return false;
     }
 
-    exportFile << pin;
-    exportFile.close();
+    // One segment per phase, chip select stays asserted between them
+    struct spi_ioc_transfer tr[2];
+    std::memset(tr, 0, sizeof(tr));
+    unsigned int segments = 0;
+
+    if (tx_len > 0) {
+        tr[segments].tx_buf = (unsigned long)tx;
+        tr[segments].len = static_cast<uint32_t>(tx_len);
+        tr[segments].speed_hz = speed_hz;
+        tr[segments].bits_per_word = 8;
+        segments++;
+    }
+
+    if (rx_len > 0) {
+        tr[segments].rx_buf = (unsigned long)rx;
+        tr[segments].len = static_cast<uint32_t>(rx_len);
+        tr[segments].speed_hz = speed_hz;
+        tr[segments].bits_per_word = 8;
+        segments++;
+    }
+
+    if (segments == 0) {
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int result = ioctl(fd, SPI_IOC_MESSAGE(segments), tr);
+    stats.transaction_latency.recordSince(start);
+    stats.transactions.add();
+
+    if (result < 0) {
+        stats.errors.add();
+        if (!stats.trace.emit(TraceEvent::SpiError, errno, "SPI transfer failed")) {
+            std::cerr << "Error: SPI transfer failed" << std::endl;
+        }
+        return false;
+    }
+
+    stats.bytes_out.add(tx_len);
+    stats.bytes_in.add(rx_len);
+    return true;
+#else
+    std::cerr << "Error: Linux SPI not supported on this platform" << std::endl;
+    return false;
+#endif
+}
+
+bool LinuxSPI::transferBatch(const Transaction* transactions, size_t count) {
+#ifdef __linux__
+    if (fd < 0) {
+        return false;
+    }
+
+    // Bounded so the message lives on the stack; longer batches are split
+    // into several messages, which release chip select between them anyway.
+    const size_t max_segments = 32;
+    struct spi_ioc_transfer tr[max_segments];
+    size_t next = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (next < count) {
+        std::memset(tr, 0, sizeof(tr));
+        unsigned int segments = 0;
+
+        size_t message_first = next;
+
+        while (next < count && segments + 2 <= max_segments) {
+            const Transaction& t = transactions[next++];
+            unsigned int first_segment = segments;
+
+            if (t.tx_len > 0) {
+                tr[segments].tx_buf = (unsigned long)t.tx;
+                tr[segments].len = static_cast<uint32_t>(t.tx_len);
+                tr[segments].speed_hz = speed_hz;
+                tr[segments].bits_per_word = 8;
+                segments++;
+            }
+
+            if (t.rx_len > 0) {
+                tr[segments].rx_buf = (unsigned long)t.rx;
+                tr[segments].len = static_cast<uint32_t>(t.rx_len);
+                tr[segments].speed_hz = speed_hz;
+                tr[segments].bits_per_word = 8;
+                segments++;
+            }
+
+            // Deselect after the last segment of each transaction; on the last
+            // segment of the message the driver releases chip select by itself
+            if (segments > first_segment) {
+                tr[segments - 1].cs_change = 1;
+            }
+        }
 
-    // Wait a moment for the system to create the files
-    usleep(100000); // 100ms
+        if (segments == 0) {
+            continue;
+        }
 
-    exportFile << pin;
-    exportFile.close();
+        // cs_change on the final segment would keep the device selected
+        tr[segments - 1].cs_change = 0;
 
+        if (ioctl(fd, SPI_IOC_MESSAGE(segments), tr) < 0) {
+            stats.errors.add();
+            if (!stats.trace.emit(TraceEvent::SpiError, errno, "SPI batch transfer failed")) {
+                std::cerr << "Error: SPI batch transfer failed" << std::endl;
+            }
+            return false;
+        }
 
-    usleep(100000); // 100ms
+        for (size_t i = message_first; i < next; i++) {
+            stats.bytes_out.add(transactions[i].tx_len);
+            stats.bytes_in.add(transactions[i].rx_len);
+        }
+        stats.transactions.add(next - message_first);
+    }
 
+    stats.transaction_latency.recordSince(start);
+    return true;
+#else
+    std::cerr << "Error: Linux SPI not supported on this platform" << std::endl;
+    return false;
+#endif
+}
 
+bool LinuxSPI::exportGPIO(uint8_t pin) {
+#ifdef __linux__
     std::stringstream ss;
     ss << "/sys/class/gpio/gpio" << static_cast<int>(pin);
-    gpio_pin_paths[pin] = ss.str();
+    std::string pin_path = ss.str();
+
+    // Nothing to do if the pin was left exported
+    if (access(pin_path.c_str(), F_OK) != 0) {
+        std::ofstream exportFile(gpio_export_path);
+        if (!exportFile.is_open()) {
+            std::cerr << "Error: Unable to open GPIO export file" << std::endl;
+            return false;
+        }
+
+        exportFile << static_cast<int>(pin);
+        exportFile.close();
+    }
+
+    // udev fixes the permissions of the new files asynchronously, wait until
+    // they are writable instead of sleeping for a fixed time
+    std::string direction_path = pin_path + "/direction";
+    for (int i = 0; i < 200 && access(direction_path.c_str(), W_OK) != 0; i++) {
+        usleep(1000); // 1ms
+    }
+    if (access(direction_path.c_str(), W_OK) != 0) {
+        std::cerr << "Error: GPIO " << static_cast<int>(pin) << " did not appear" << std::endl;
+        return false;
+    }
+
+    gpio_pin_paths[pin] = pin_path;
 
     return true;
 #else
@@ -173,18 +334,24 @@ bool LinuxSPI::exportGPIO(uint8_t pin) {
 
 bool LinuxSPI::unexportGPIO(uint8_t pin) {
 #ifdef __linux__
+    auto value_fd = gpio_value_fds.find(pin);
+    if (value_fd != gpio_value_fds.end()) {
+        ::close(value_fd->second);
+        gpio_value_fds.erase(value_fd);
+    }
+
+    // Remove pin's path from the map
+    gpio_pin_paths.erase(pin);
+
     std::ofstream unexportFile(gpio_unexport_path);
     if (!unexportFile.is_open()) {
         std::cerr << "Error: Unable to open GPIO unexport file" << std::endl;
         return false;
     }
 
-    unexportFile << pin;
+    unexportFile << static_cast<int>(pin);
     unexportFile.close();
 
-    // Remove pin's path from the map
-    gpio_pin_paths.erase(pin);
-
     return true;
 #else
     return false;
@@ -218,24 +385,49 @@ bool LinuxSPI::setGPIODirection(uint8_t pin, const std::string& direction) {
 #endif
 }
 
-bool LinuxSPI::writeGPIOValue(uint8_t pin, bool value) {
+int LinuxSPI::gpioValueFd(uint8_t pin) {
 #ifdef __linux__
+    auto cached = gpio_value_fds.find(pin);
+    if (cached != gpio_value_fds.end()) {
+        return cached->second;
+    }
+
     // Verify if pin is exported
-    if (gpio_pin_paths.find(pin) == gpio_pin_paths.end()) {
+    auto path = gpio_pin_paths.find(pin);
+    if (path == gpio_pin_paths.end()) {
         std::cerr << "Error: Pin " << static_cast<int>(pin) << " not exported" << std::endl;
-        return false;
+        return -1;
     }
 
-    // Open value file
-    std::string value_path = gpio_pin_paths[pin] + "/value";
-    std::ofstream valueFile(value_path);
-    if (!valueFile.is_open()) {
+    // Kept open so later accesses are a single pread()/pwrite()
+    std::string value_path = path->second + "/value";
+    int value_fd = ::open(value_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (value_fd < 0) {
+        value_fd = ::open(value_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (value_fd < 0) {
         std::cerr << "Error: Unable to open GPIO value file for pin " << static_cast<int>(pin) << std::endl;
+        return -1;
+    }
+
+    gpio_value_fds[pin] = value_fd;
+    return value_fd;
+#else
+    return -1;
+#endif
+}
+
+bool LinuxSPI::writeGPIOValue(uint8_t pin, bool value) {
+#ifdef __linux__
+    int value_fd = gpioValueFd(pin);
+    if (value_fd < 0) {
         return false;
     }
 
-    valueFile << (value ? "1" : "0");
-    valueFile.close();
+    if (pwrite(value_fd, value ? "1" : "0", 1, 0) != 1) {
+        std::cerr << "Error: Unable to write GPIO value for pin " << static_cast<int>(pin) << std::endl;
+        return false;
+    }
 
     return true;
 #else
@@ -245,39 +437,342 @@ bool LinuxSPI::writeGPIOValue(uint8_t pin, bool value) {
 
 bool LinuxSPI::readGPIOValue(uint8_t pin) {
 #ifdef __linux__
-    // Verify if pin is exported
-    if (gpio_pin_paths.find(pin) == gpio_pin_paths.end()) {
-        std::cerr << "Error: Pin " << static_cast<int>(pin) << " not exported" << std::endl;
+    int value_fd = gpioValueFd(pin);
+    if (value_fd < 0) {
         return false;
     }
 
-    // Open value file
-    std::string value_path = gpio_pin_paths[pin] + "/value";
-    std::ifstream valueFile(value_path);
-    if (!valueFile.is_open()) {
-        std::cerr << "Error: Unable to open GPIO value file for pin " << static_cast<int>(pin) << std::endl;
+    char value = '0';
+    if (pread(value_fd, &value, 1, 0) != 1) {
+        std::cerr << "Error: Unable to read GPIO value for pin " << static_cast<int>(pin) << std::endl;
         return false;
     }
 
-    char value;
-    valueFile >> value;
-    valueFile.close();
-
     return (value == '1');
 #else
     return false;
 #endif
 }
 
+#if LINUXSPI_GPIO_CDEV
+static uint64_t lineFlags(uint8_t mode) {
+    switch (mode) {
+        case SPIInterface::OUTPUT:
+            return GPIO_V2_LINE_FLAG_OUTPUT;
+        case SPIInterface::INPUT_PULLUP:
+            return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+        default:
+            return GPIO_V2_LINE_FLAG_INPUT;
+    }
+}
+#endif
+
+bool LinuxSPI::setGPIOChip(const std::string& chip_path) {
+#if LINUXSPI_GPIO_CDEV
+    closeGPIOChip();
+    gpio_chip_path = chip_path;
+
+    if (chip_path.empty()) {
+        return true;
+    }
+
+    gpio_chip_fd = ::open(chip_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (gpio_chip_fd < 0) {
+        std::cerr << "Error: Could not open GPIO chip: " << chip_path << std::endl;
+        gpio_chip_path.clear();
+        return false;
+    }
+
+    return true;
+#else
+    std::cerr << "Error: GPIO character device not supported on this platform" << std::endl;
+    return chip_path.empty();
+#endif
+}
+
+void LinuxSPI::closeGPIOChip() {
+#if LINUXSPI_GPIO_CDEV
+    for (size_t i = 0; i < gpio_requests.size(); i++) {
+        releaseRequest(i);
+    }
+    gpio_requests.clear();
+    gpio_lines.clear();
+
+    if (gpio_chip_fd >= 0) {
+        ::close(gpio_chip_fd);
+        gpio_chip_fd = -1;
+    }
+#endif
+}
+
+void LinuxSPI::releaseRequest(size_t index) {
+#if LINUXSPI_GPIO_CDEV
+    // Entries are never erased so the indices in gpio_lines stay valid
+    GPIORequest& request = gpio_requests[index];
+    if (request.fd >= 0) {
+        ::close(request.fd);
+        request.fd = -1;
+    }
+    for (uint8_t pin : request.pins) {
+        gpio_lines.erase(pin);
+    }
+    request.pins.clear();
+    request.flags.clear();
+#else
+    (void)index;
+#endif
+}
+
+bool LinuxSPI::fillLineConfig(const GPIORequest& request, struct gpio_v2_line_config& config) const {
+#if LINUXSPI_GPIO_CDEV
+    std::memset(&config, 0, sizeof(config));
+    config.flags = request.flags[0];
+
+    // Lines whose flags differ from the first one get a flags attribute,
+    // lines sharing the same flags share the attribute
+    uint64_t output_mask = 0;
+    for (size_t i = 0; i < request.flags.size(); i++) {
+        if (request.flags[i] & GPIO_V2_LINE_FLAG_OUTPUT) {
+            output_mask |= 1ULL << i;
+        }
+        if (request.flags[i] == config.flags) {
+            continue;
+        }
+
+        unsigned int attr = 0;
+        while (attr < config.num_attrs && config.attrs[attr].attr.flags != request.flags[i]) {
+            attr++;
+        }
+        if (attr == config.num_attrs) {
+            // One attribute stays reserved for the output values
+            if (config.num_attrs + 1 >= GPIO_V2_LINE_NUM_ATTRS_MAX) {
+                return false;
+            }
+            config.attrs[attr].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+            config.attrs[attr].attr.flags = request.flags[i];
+            config.num_attrs++;
+        }
+        config.attrs[attr].mask |= 1ULL << i;
+    }
+
+    // Outputs keep their last value when the request is reconfigured
+    if (output_mask) {
+        unsigned int attr = config.num_attrs++;
+        config.attrs[attr].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        config.attrs[attr].attr.values = request.values & output_mask;
+        config.attrs[attr].mask = output_mask;
+    }
+
+    return true;
+#else
+    (void)request;
+    (void)config;
+    return false;
+#endif
+}
+
+bool LinuxSPI::requestLines(const uint8_t* pins, size_t count, uint8_t mode) {
+#if LINUXSPI_GPIO_CDEV
+    if (count == 0 || count > GPIO_V2_LINES_MAX || gpio_chip_fd < 0) {
+        return false;
+    }
+
+    uint64_t flags = lineFlags(mode);
+
+    // Reconfigure in place when the pins are already requested together
+    auto first = gpio_lines.find(pins[0]);
+    if (first != gpio_lines.end()) {
+        size_t index = first->second.first;
+        GPIORequest& request = gpio_requests[index];
+
+        bool in_place = count == 1;
+        if (!in_place && request.pins.size() == count) {
+            in_place = true;
+            for (size_t i = 0; i < count; i++) {
+                auto line = gpio_lines.find(pins[i]);
+                in_place = in_place && line != gpio_lines.end() && line->second.first == index;
+            }
+        }
+
+        if (in_place) {
+            for (size_t i = 0; i < count; i++) {
+                // An input keeps its edge detection, see configureInterrupt()
+                uint64_t& line_flags = request.flags[gpio_lines[pins[i]].second];
+                uint64_t edges = line_flags & (GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING);
+                line_flags = (flags & GPIO_V2_LINE_FLAG_INPUT) ? (flags | edges) : flags;
+            }
+
+            struct gpio_v2_line_config config;
+            if (!fillLineConfig(request, config) ||
+                ioctl(request.fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+                std::cerr << "Error: Could not reconfigure GPIO line " << static_cast<int>(pins[0]) << std::endl;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    // Pins may only move out of requests of their own
+    for (size_t i = 0; i < count; i++) {
+        auto line = gpio_lines.find(pins[i]);
+        if (line != gpio_lines.end() && gpio_requests[line->second.first].pins.size() > 1) {
+            std::cerr << "Error: GPIO line " << static_cast<int>(pins[i]) << " already belongs to a group" << std::endl;
+            return false;
+        }
+    }
+
+    GPIORequest request;
+    request.fd = -1;
+    request.pins.assign(pins, pins + count);
+    request.flags.assign(count, flags);
+    request.values = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        auto line = gpio_lines.find(pins[i]);
+        if (line != gpio_lines.end()) {
+            GPIORequest& old = gpio_requests[line->second.first];
+            request.values |= (old.values & 1ULL) << i;
+            releaseRequest(line->second.first);
+        }
+    }
+
+    struct gpio_v2_line_request line_request;
+    std::memset(&line_request, 0, sizeof(line_request));
+    for (size_t i = 0; i < count; i++) {
+        line_request.offsets[i] = pins[i];
+    }
+    line_request.num_lines = static_cast<uint32_t>(count);
+    std::strncpy(line_request.consumer, "LinuxSPI", sizeof(line_request.consumer) - 1);
+
+    if (!fillLineConfig(request, line_request.config) ||
+        ioctl(gpio_chip_fd, GPIO_V2_GET_LINE_IOCTL, &line_request) < 0) {
+        std::cerr << "Error: Could not request GPIO line " << static_cast<int>(pins[0]) << std::endl;
+        return false;
+    }
+    request.fd = line_request.fd;
+
+    gpio_requests.push_back(request);
+    for (size_t i = 0; i < count; i++) {
+        gpio_lines[pins[i]] = std::make_pair(gpio_requests.size() - 1, static_cast<unsigned int>(i));
+    }
+
+    return true;
+#else
+    (void)pins;
+    (void)count;
+    (void)mode;
+    return false;
+#endif
+}
+
+bool LinuxSPI::writeLines(GPIORequest& request, uint64_t bits, uint64_t mask) {
+#if LINUXSPI_GPIO_CDEV
+    struct gpio_v2_line_values values;
+    values.bits = bits;
+    values.mask = mask;
+
+    if (ioctl(request.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+        std::cerr << "Error: Unable to set GPIO line values" << std::endl;
+        return false;
+    }
+
+    request.values = (request.values & ~mask) | (bits & mask);
+    return true;
+#else
+    (void)request;
+    (void)bits;
+    (void)mask;
+    return false;
+#endif
+}
+
 bool LinuxSPI::digitalWrite(uint8_t pin, bool value) {
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        auto line = gpio_lines.find(pin);
+        if (line == gpio_lines.end()) {
+            std::cerr << "Error: GPIO line " << static_cast<int>(pin) << " not requested" << std::endl;
+            return false;
+        }
+        uint64_t bit = 1ULL << line->second.second;
+        return writeLines(gpio_requests[line->second.first], value ? bit : 0, bit);
+    }
+#endif
     return writeGPIOValue(pin, value);
 }
 
+bool LinuxSPI::digitalWriteGroup(const uint8_t* pins, const bool* values, size_t count) {
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        bool success = true;
+        for (size_t i = 0; i < count; i++) {
+            auto line = gpio_lines.find(pins[i]);
+            if (line == gpio_lines.end()) {
+                std::cerr << "Error: GPIO line " << static_cast<int>(pins[i]) << " not requested" << std::endl;
+                success = false;
+                continue;
+            }
+
+            // Each request is written once, when its first pin in the list is reached
+            size_t index = line->second.first;
+            bool seen = false;
+            for (size_t j = 0; j < i && !seen; j++) {
+                auto other = gpio_lines.find(pins[j]);
+                seen = other != gpio_lines.end() && other->second.first == index;
+            }
+            if (seen) {
+                continue;
+            }
+
+            uint64_t bits = 0;
+            uint64_t mask = 0;
+            for (size_t j = i; j < count; j++) {
+                auto other = gpio_lines.find(pins[j]);
+                if (other != gpio_lines.end() && other->second.first == index) {
+                    uint64_t bit = 1ULL << other->second.second;
+                    mask |= bit;
+                    bits = values[j] ? (bits | bit) : (bits & ~bit);
+                }
+            }
+            success = writeLines(gpio_requests[index], bits, mask) && success;
+        }
+        return success;
+    }
+#endif
+    bool success = true;
+    for (size_t i = 0; i < count; i++) {
+        success = writeGPIOValue(pins[i], values[i]) && success;
+    }
+    return success;
+}
+
 bool LinuxSPI::digitalRead(uint8_t pin) {
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        auto line = gpio_lines.find(pin);
+        if (line == gpio_lines.end()) {
+            std::cerr << "Error: GPIO line " << static_cast<int>(pin) << " not requested" << std::endl;
+            return false;
+        }
+
+        struct gpio_v2_line_values values;
+        values.bits = 0;
+        values.mask = 1ULL << line->second.second;
+        if (ioctl(gpio_requests[line->second.first].fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            std::cerr << "Error: Unable to read GPIO line " << static_cast<int>(pin) << std::endl;
+            return false;
+        }
+        return (values.bits & values.mask) != 0;
+    }
+#endif
     return readGPIOValue(pin);
 }
 
 bool LinuxSPI::pinMode(uint8_t pin, uint8_t mode) {
+    return pinModeGroup(&pin, 1, mode);
+}
+
+bool LinuxSPI::pinModeGroup(const uint8_t* pins, size_t count, uint8_t mode) {
     std::string direction;
     switch (mode) {
         case INPUT:
@@ -287,8 +782,8 @@ bool LinuxSPI::pinMode(uint8_t pin, uint8_t mode) {
             direction = "out";
             break;
         case INPUT_PULLUP:
-            // In Linux, pull-ups are configured differently
-            // here we simulate configuring as a normal input
+            // sysfs cannot set a bias, here we simulate configuring as a
+            // normal input; the character device enables the pull-up
             direction = "in";
             break;
         default:
@@ -296,11 +791,140 @@ bool LinuxSPI::pinMode(uint8_t pin, uint8_t mode) {
             return false;
     }
 
-    return setGPIODirection(pin, direction);
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        return requestLines(pins, count, mode);
+    }
+#endif
+
+    bool success = true;
+    for (size_t i = 0; i < count; i++) {
+        success = setGPIODirection(pins[i], direction) && success;
+    }
+    return success;
+}
+
+bool LinuxSPI::setLineEdge(uint8_t pin, uint64_t flags) {
+#if LINUXSPI_GPIO_CDEV
+    auto line = gpio_lines.find(pin);
+    if (line == gpio_lines.end()) {
+        return false;
+    }
+
+    GPIORequest& request = gpio_requests[line->second.first];
+    uint64_t& line_flags = request.flags[line->second.second];
+    line_flags &= ~(GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING |
+                    GPIO_V2_LINE_FLAG_OUTPUT);
+    line_flags |= GPIO_V2_LINE_FLAG_INPUT | flags;
+
+    struct gpio_v2_line_config config;
+    if (!fillLineConfig(request, config) ||
+        ioctl(request.fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+        std::cerr << "Error: Could not configure edge detection on GPIO line " << static_cast<int>(pin) << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void)pin;
+    (void)flags;
+    return false;
+#endif
+}
+
+bool LinuxSPI::configureInterrupt(uint8_t pin, bool enable) {
+    return configureInterrupt(pin, enable ? InterruptEdge::Both : InterruptEdge::None);
+}
+
+bool LinuxSPI::configureInterrupt(uint8_t pin, InterruptEdge edge) {
+#ifdef __linux__
+    bool running = interrupt_running;
+    if (running) {
+        stopInterruptThread();
+    }
+
+    bool success = false;
+
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        uint64_t flags = 0;
+        if (edge == InterruptEdge::Rising || edge == InterruptEdge::Both) {
+            flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+        }
+        if (edge == InterruptEdge::Falling || edge == InterruptEdge::Both) {
+            flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+        }
+
+        success = (gpio_lines.count(pin) || requestLines(&pin, 1, INPUT)) && setLineEdge(pin, flags);
+    } else
+#endif
+    {
+        const char* edge_name = "none";
+        switch (edge) {
+            case InterruptEdge::Rising:
+                edge_name = "rising";
+                break;
+            case InterruptEdge::Falling:
+                edge_name = "falling";
+                break;
+            case InterruptEdge::Both:
+                edge_name = "both";
+                break;
+            case InterruptEdge::None:
+                break;
+        }
+
+        // Edge detection needs an input
+        if (setGPIODirection(pin, "in")) {
+            std::ofstream edgeFile(gpio_pin_paths[pin] + "/edge");
+            if (edgeFile.is_open()) {
+                edgeFile << edge_name;
+                edgeFile.close();
+                success = edgeFile.good();
+            }
+        }
+        if (!success) {
+            std::cerr << "Error: Unable to configure edge for interrupts" << std::endl;
+        }
+    }
+
+    if (success) {
+        interrupt_pin = edge == InterruptEdge::None ? -1 : pin;
+        interrupt_edge = edge;
+    }
+
+    if (running && interrupt_pin >= 0) {
+        startInterruptThread();
+    }
+    return success;
+#else
+    (void)pin;
+    (void)edge;
+    return false;
+#endif
 }
 
 bool LinuxSPI::setInterruptCallback(InterruptCallback callback) {
+    // The thread reads the callbacks without locking, swap them while it is stopped
+    bool running = interrupt_running;
+    if (running) {
+        stopInterruptThread();
+    }
     interruptCallback = callback;
+    if (running) {
+        startInterruptThread();
+    }
+    return true;
+}
+
+bool LinuxSPI::setInterruptEventCallback(InterruptEventCallback callback) {
+    bool running = interrupt_running;
+    if (running) {
+        stopInterruptThread();
+    }
+    interrupt_event_callback = callback;
+    if (running) {
+        startInterruptThread();
+    }
     return true;
 }
 
@@ -308,37 +932,14 @@ bool LinuxSPI::enableInterrupt(bool enable) {
 #ifdef __linux__
     if (enable && !interrupt_running) {
         // Verify that we have a callback and a pin configured
-        if (!interruptCallback || interrupt_pin < 0) {
+        if ((!interruptCallback && !interrupt_event_callback) || interrupt_pin < 0) {
             std::cerr << "Error: Callback or interrupt pin not configured" << std::endl;
             return false;
         }
 
-        // Verify that the pin is configured as input
-        if (gpio_pin_paths.find(interrupt_pin) == gpio_pin_paths.end()) {
-            std::cerr << "Error: Interrupt pin not configured as GPIO" << std::endl;
-            return false;
-        }
-
-        // Configure edge for interrupts
-        std::string edge_path = gpio_pin_paths[interrupt_pin] + "/edge";
-        std::ofstream edgeFile(edge_path);
-        if (!edgeFile.is_open()) {
-            std::cerr << "Error: Unable to configure edge for interrupts" << std::endl;
-            return false;
-        }
-        edgeFile << "rising";  // Could be configurable
-        edgeFile.close();
-
-        // Start monitoring thread
-        interrupt_running = true;
-        interrupt_thread = std::thread(&LinuxSPI::interruptThread, this);
-        return true;
-    } else if (!enable && interrupt_running) {
-        // Stop monitoring thread
-        interrupt_running = false;
-        if (interrupt_thread.joinable()) {
-            interrupt_thread.join();
-        }
+        return startInterruptThread();
+    } else if (!enable && (interrupt_running || interrupt_thread.joinable())) {
+        stopInterruptThread();
         return true;
     }
     
@@ -348,26 +949,161 @@ bool LinuxSPI::enableInterrupt(bool enable) {
 #endif
 }
 
-void LinuxSPI::interruptThread() {
+bool LinuxSPI::startInterruptThread() {
 #ifdef __linux__
-    std::string value_path = gpio_pin_paths[interrupt_pin] + "/value";
-    
+    // Reap a thread that gave up on an error
+    stopInterruptThread();
+
+    // Resolved here so the thread never touches the GPIO maps
+    int event_fd = -1;
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        auto line = gpio_lines.find(static_cast<uint8_t>(interrupt_pin));
+        if (line != gpio_lines.end()) {
+            event_fd = gpio_requests[line->second.first].fd;
+        }
+    } else
+#endif
+    {
+        event_fd = gpioValueFd(static_cast<uint8_t>(interrupt_pin));
+    }
+    if (event_fd < 0) {
+        std::cerr << "Error: Interrupt pin not configured as GPIO" << std::endl;
+        return false;
+    }
+
+    if (pipe(interrupt_stop_pipe) < 0) {
+        std::cerr << "Error: Unable to create interrupt wake-up pipe" << std::endl;
+        return false;
+    }
+
+    // Start monitoring thread
+    interrupt_running = true;
+    interrupt_thread = std::thread(&LinuxSPI::interruptThread, this, event_fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LinuxSPI::stopInterruptThread() {
+#ifdef __linux__
+    interrupt_running = false;
+    if (interrupt_stop_pipe[1] >= 0) {
+        char wake = 0;
+        (void)!write(interrupt_stop_pipe[1], &wake, 1);
+    }
+    if (interrupt_thread.joinable()) {
+        interrupt_thread.join();
+    }
+
+    for (int& pipe_fd : interrupt_stop_pipe) {
+        if (pipe_fd >= 0) {
+            ::close(pipe_fd);
+            pipe_fd = -1;
+        }
+    }
+#endif
+}
+
+void LinuxSPI::dispatchInterrupt(const InterruptEvent& event) {
+    if (interrupt_event_callback) {
+        interrupt_event_callback(event);
+    } else if (interruptCallback) {
+        interruptCallback();
+    }
+}
+
+void LinuxSPI::interruptThread(int event_fd) {
+#ifdef __linux__
+    const uint8_t pin = static_cast<uint8_t>(interrupt_pin);
+
+    // Both backends block in poll() until an edge arrives or the stop pipe is written
+    struct pollfd fds[2];
+    fds[0].fd = event_fd;
+    fds[1].fd = interrupt_stop_pipe[0];
+    fds[1].events = POLLIN;
+
+#if LINUXSPI_GPIO_CDEV
+    if (gpio_chip_fd >= 0) {
+        fds[0].events = POLLIN;
+
+        // The kernel queues events with their timestamps, nothing is lost between reads
+        struct gpio_v2_line_event events[16];
+        while (interrupt_running) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error: poll() on GPIO line failed" << std::endl;
+                break;
+            }
+            if (fds[1].revents) {
+                break;
+            }
+            if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                std::cerr << "Error: GPIO line request closed" << std::endl;
+                break;
+            }
+            if (!(fds[0].revents & POLLIN)) {
+                continue;
+            }
+
+            ssize_t length = read(fds[0].fd, events, sizeof(events));
+            for (ssize_t i = 0; length > 0 && i < length / static_cast<ssize_t>(sizeof(events[0])); i++) {
+                if (events[i].offset != pin) {
+                    continue; // Another line of the same group
+                }
+                InterruptEvent event;
+                event.pin = pin;
+                event.rising = events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+                event.timestamp_ns = events[i].timestamp_ns;
+                event.uncertainty_ns = 0;
+                dispatchInterrupt(event);
+            }
+        }
+        return;
+    }
+#endif
+
+    // sysfs signals an edge as POLLPRI on the value file; reading the value
+    // from offset 0 re-arms it
+    fds[0].events = POLLPRI | POLLERR;
+
+    char value = '0';
+    (void)!pread(fds[0].fd, &value, 1, 0);
+
     while (interrupt_running) {
-        // Ideally, we would use poll() or epoll() to wait for interrupts
-        // efficiently, but for simplicity, we use polling
-        
-        if (readGPIOValue(interrupt_pin)) {
-            // Call the callback
-            if (interruptCallback) {
-                interruptCallback();
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            
-            // Wait a bit to avoid bouncing
-            usleep(50000);  // 50ms
+            std::cerr << "Error: poll() on GPIO value failed" << std::endl;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (!(fds[0].revents & (POLLPRI | POLLERR))) {
+            continue;
         }
-        
-        // Wait a short time before checking again
-        usleep(10000);  // 10ms
+
+        InterruptEvent event;
+        event.pin = pin;
+        event.timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        event.uncertainty_ns = 0;
+
+        if (pread(fds[0].fd, &value, 1, 0) != 1) {
+            continue;
+        }
+
+        // sysfs does not report which edge fired, infer it from the level
+        event.rising = interrupt_edge == InterruptEdge::Rising ? true :
+                       interrupt_edge == InterruptEdge::Falling ? false : value == '1';
+        dispatchInterrupt(event);
     }
+#else
+    (void)event_fd;
 #endif
 }
@@ -0,0 +1,361 @@
+/**
+ * @file PacketCapture.cpp
+ * @brief Implementation of the LoRaTap/pcap capture writer
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "PacketCapture.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+constexpr uint32_t PacketCapture::LINKTYPE_LORATAP;
+constexpr size_t PacketCapture::LORATAP_HEADER_LENGTH;
+
+// pcap with nanosecond timestamps, written in host byte order
+static const uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+static const uint32_t PCAP_SNAPLEN = 65535;
+
+// LoRaTap version 1 flags
+static const uint8_t LORATAP_FLAG_IMPLICIT_HEADER = 0x04;
+static const uint8_t LORATAP_FLAG_CRC_OK = 0x08;
+static const uint8_t LORATAP_FLAG_BAD_CRC = 0x10;
+static const uint8_t LORATAP_FLAG_NO_CRC = 0x20;
+
+static int64_t nowNs(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+static void appendHost32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(bytes));
+}
+
+static void appendBig16(std::vector<uint8_t> &buffer, uint16_t value)
+{
+    buffer.push_back(static_cast<uint8_t>(value >> 8));
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+static void appendBig32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+    appendBig16(buffer, static_cast<uint16_t>(value >> 16));
+    appendBig16(buffer, static_cast<uint16_t>(value));
+}
+
+static uint8_t clampByte(float value)
+{
+    return static_cast<uint8_t>(std::max(0.0f, std::min(255.0f, value + 0.5f)));
+}
+
+PacketCapture::PacketCapture(const Options &options)
+    : options(options),
+      buffered(0),
+      running(false),
+      epoch_offset_ns(0),
+      file_bytes(0),
+      file_sequence(0)
+{
+}
+
+PacketCapture::~PacketCapture()
+{
+    stop();
+}
+
+bool PacketCapture::start()
+{
+    stop();
+
+    // Allocate every buffer up front so capture() and the writer never do
+    size_t capacity = std::max<size_t>(options.queue_capacity, 1);
+    pending.reserve(capacity);
+    writing.reserve(capacity);
+    buffer.reserve(capacity * (16 + LORATAP_HEADER_LENGTH + 255));
+
+    epoch_offset_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count() -
+                      nowNs(std::chrono::steady_clock::now());
+
+    if (!openFile())
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = true;
+    }
+    writer = std::thread(&PacketCapture::run, this);
+    return true;
+}
+
+void PacketCapture::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+
+    if (file.is_open())
+    {
+        file.close();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    current_path.clear();
+}
+
+bool PacketCapture::capture(const RFM95::RxPacket &packet, const RadioProfile &profile, uint8_t radio)
+{
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || pending.size() >= pending.capacity())
+        {
+            dropped.add();
+            return false;
+        }
+
+        pending.emplace_back();
+        Record &record = pending.back();
+        record.packet = packet;
+        record.profile = profile;
+        record.radio = radio;
+
+        // Only a filling queue wakes the writer early, otherwise it flushes on its interval
+        wake = pending.size() == pending.capacity() / 2 + 1;
+    }
+    captured.add();
+
+    if (wake)
+    {
+        cv.notify_one();
+    }
+    return true;
+}
+
+uint64_t PacketCapture::getCaptured() const
+{
+    return captured.get();
+}
+
+uint64_t PacketCapture::getDropped() const
+{
+    return dropped.get();
+}
+
+uint64_t PacketCapture::getWritten() const
+{
+    return written.get();
+}
+
+std::string PacketCapture::getCurrentPath()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_path;
+}
+
+bool PacketCapture::openFile()
+{
+    if (file.is_open())
+    {
+        file.close();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_path.clear();
+    }
+
+    std::string path = options.path;
+    bool rotating = options.max_file_bytes > 0 || options.max_file_age.count() > 0;
+    if (rotating)
+    {
+        // capture.pcap becomes capture-000001.pcap, capture-000002.pcap, ...
+        char sequence[16];
+        std::snprintf(sequence, sizeof(sequence), "-%06u", static_cast<unsigned>(++file_sequence));
+        size_t slash = path.find_last_of('/');
+        size_t dot = path.find_last_of('.');
+        size_t split = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : path.size();
+        path.insert(split, sequence);
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not create capture file: " << path << std::endl;
+        return false;
+    }
+
+    uint8_t header[24];
+    uint32_t magic = PCAP_MAGIC_NS;
+    uint16_t version[2] = {2, 4};
+    uint32_t zero[2] = {0, 0};
+    uint32_t snaplen = PCAP_SNAPLEN;
+    uint32_t linktype = LINKTYPE_LORATAP;
+    std::memcpy(header, &magic, 4);
+    std::memcpy(header + 4, version, 4);
+    std::memcpy(header + 8, zero, 8);
+    std::memcpy(header + 16, &snaplen, 4);
+    std::memcpy(header + 20, &linktype, 4);
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.flush();
+
+    file_bytes = sizeof(header);
+    file_opened = std::chrono::steady_clock::now();
+
+    if (rotating)
+    {
+        rotated.push_back(path);
+        while (options.max_files > 0 && rotated.size() > options.max_files)
+        {
+            std::remove(rotated.front().c_str());
+            rotated.pop_front();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current_path = path;
+    return true;
+}
+
+void PacketCapture::rotateIfNeeded()
+{
+    bool full = options.max_file_bytes > 0 && file_bytes + buffer.size() >= options.max_file_bytes;
+    bool old = options.max_file_age.count() > 0 &&
+               std::chrono::steady_clock::now() - file_opened >= options.max_file_age;
+    if (full || old)
+    {
+        flushBuffer();
+        openFile();
+    }
+}
+
+void PacketCapture::writeRecords(const std::vector<Record> &records)
+{
+    // A file that could not be created is retried once per batch
+    if (!file.is_open() && !records.empty() && !openFile())
+    {
+        dropped.add(records.size());
+        return;
+    }
+
+    for (const Record &record : records)
+    {
+        rotateIfNeeded();
+        encode(record);
+    }
+    flushBuffer();
+}
+
+void PacketCapture::encode(const Record &record)
+{
+    const RFM95::RxPacket &packet = record.packet;
+    const RadioProfile &profile = record.profile;
+
+    int sf = (profile.modem_config_2 >> 4) & 0x0F;
+    uint32_t divisor = RadioProfile::bandwidthDivisor((profile.modem_config_1 >> 4) & 0x0F);
+    int coding_rate = 4 + ((profile.modem_config_1 >> 1) & 0x07);
+    bool implicit_header = (profile.modem_config_1 & 0x01) != 0;
+
+    // pcap record header
+    int64_t wall_ns = static_cast<int64_t>(packet.timestamp_ns) + epoch_offset_ns;
+    uint32_t captured_length = static_cast<uint32_t>(LORATAP_HEADER_LENGTH + packet.length);
+    appendHost32(buffer, static_cast<uint32_t>(wall_ns / 1000000000));
+    appendHost32(buffer, static_cast<uint32_t>(wall_ns % 1000000000));
+    appendHost32(buffer, captured_length);
+    appendHost32(buffer, captured_length);
+
+    // LoRaTap version 1, multi-byte fields in network byte order
+    buffer.push_back(1);
+    buffer.push_back(0);
+    appendBig16(buffer, static_cast<uint16_t>(LORATAP_HEADER_LENGTH));
+    appendBig32(buffer, profile.frf.toHz());
+    buffer.push_back(static_cast<uint8_t>(4 / divisor)); // In 125 kHz steps, 0 for anything narrower
+    buffer.push_back(static_cast<uint8_t>(sf));
+
+    // LoRaTap's own scale, not the chip's: -139 + value dBm, in quarter steps below 0 dB SNR
+    float rssi = packet.rssi + 139.0f;
+    buffer.push_back(clampByte(packet.snr < 0 ? rssi * 4.0f : rssi));
+    buffer.push_back(0); // Max RSSI, not measured
+    buffer.push_back(0); // Current RSSI, not measured
+    buffer.push_back(static_cast<uint8_t>(static_cast<int8_t>(std::max(-128.0f, std::min(127.0f, packet.snr * 4.0f)))));
+
+    buffer.push_back(profile.sync_word);
+    buffer.insert(buffer.end(), 8, 0); // Gateway EUI
+    appendBig32(buffer, static_cast<uint32_t>(packet.timestamp_ns / 1000));
+
+    uint8_t flags = packet.crc_error ? LORATAP_FLAG_BAD_CRC : packet.crc_present ? LORATAP_FLAG_CRC_OK : LORATAP_FLAG_NO_CRC;
+    if (implicit_header)
+    {
+        flags |= LORATAP_FLAG_IMPLICIT_HEADER;
+    }
+    buffer.push_back(flags);
+    buffer.push_back(static_cast<uint8_t>(coding_rate));
+    appendBig16(buffer, 0); // FSK data rate
+    buffer.push_back(0);    // IF channel
+    buffer.push_back(record.radio);
+    appendBig16(buffer, 0); // Tag
+
+    buffer.insert(buffer.end(), packet.data, packet.data + packet.length);
+    buffered++;
+}
+
+void PacketCapture::flushBuffer()
+{
+    if (buffer.empty())
+    {
+        return;
+    }
+
+    file.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    file.flush();
+    if (file)
+    {
+        written.add(buffered);
+        file_bytes += buffer.size();
+    }
+    else
+    {
+        // Keep the file: a full disk may recover, reopening would truncate it
+        std::cerr << "Error: Could not write capture file: " << current_path << std::endl;
+        dropped.add(buffered);
+        file.clear();
+    }
+    buffer.clear();
+    buffered = 0;
+}
+
+void PacketCapture::run()
+{
+    while (true)
+    {
+        bool last = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, options.flush_interval,
+                        [this]() { return !running || pending.size() > pending.capacity() / 2; });
+            writing.swap(pending);
+            last = !running;
+        }
+
+        writeRecords(writing);
+        writing.clear();
+
+        if (last)
+        {
+            return;
+        }
+    }
+}
@@ -24,73 +24,209 @@
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <cstring>
+#include <random>
+
+// Bound to references by std::chrono, so they need a definition before C++17
+constexpr int RFM95::TX_TIMEOUT_MARGIN_MS;
+constexpr int RFM95::CAD_TIMEOUT_MARGIN_MS;
+
+// Same timeline as SPIInterface::InterruptEvent::timestamp_ns
+static uint64_t steadyNowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
 RFM95::RFM95(std::unique_ptr<SPIInterface> spi_interface)
-    : spi(std::move(spi_interface))
+    : spi(std::move(spi_interface)),
+      irq_active(false),
+      irq_count(0),
+      irq_edge_ns(0),
+      irq_edge_uncertainty_ns(0),
+      rx_running(false),
+      rx_dropped(0),
+      rx_crc_errors(0),
+      rx_keep_crc_errors(false),
+      rx_clear_ns(0),
+      tx_running(false),
+      tx_busy(false),
+      cache_enabled(true),
+      op_mode_stale(false),
+      writes_queued(false),
+      temperature_offset(0.0f)
 {
-    // ...initialization code...
+    invalidateRegisterCache();
 }
 
 RFM95::RFM95(int device_index)
-    : spi(SPIFactory::createCH341SPI(device_index))
+    : spi(SPIFactory::createCH341SPI(device_index)),
+      irq_active(false),
+      irq_count(0),
+      irq_edge_ns(0),
+      irq_edge_uncertainty_ns(0),
+      rx_running(false),
+      rx_dropped(0),
+      rx_crc_errors(0),
+      rx_keep_crc_errors(false),
+      rx_clear_ns(0),
+      tx_running(false),
+      tx_busy(false),
+      cache_enabled(true),
+      op_mode_stale(false),
+      writes_queued(false),
+      temperature_offset(0.0f)
 {
-    // ...initialization code...
+    invalidateRegisterCache();
 }
 
 RFM95::~RFM95()
 {
+    stopTxQueue();
+    stopRxEngine();
+    clearInterruptPin();
     end();
 }
 
-bool RFM95::begin()
+bool RFM95::begin(bool fast)
 {
     if (!spi->open())
     {
         return false;
     }
 
-    // Reset device to initial state
-    sleepMode();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-
-    // Read VERSION register
-    uint8_t version = readVersionRegister();
+    // Nothing is known about the module until it has been read back
+    invalidateRegisterCache();
 
-    if (version != 0x12)
+    if (fast)
     {
-        return false;
+        if (!fastReset())
+        {
+            return false;
+        }
     }
+    else
+    {
+        // Reset device to initial state
+        sleepMode();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
-    // Set sleep mode and LoRa mode
-    writeRegister(REG_OP_MODE, 0x80); // LoRa mode
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        // Read VERSION register
+        uint8_t version = readVersionRegister();
+
+        if (version != 0x12)
+        {
+            return false;
+        }
+
+        // Set sleep mode and LoRa mode
+        writeRegister(REG_OP_MODE, 0x80); // LoRa mode
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        // Mirror the configuration registers so the writes below only touch what differs
+        refreshRegisterCache();
+    }
+
+    RegisterBatch config(*this);
 
     // Set base addresses
-    writeRegister(REG_FIFO_TX_BASE_ADDR, 0);
-    writeRegister(REG_FIFO_RX_BASE_ADDR, 0);
+    config.write(REG_FIFO_TX_BASE_ADDR, 0);
+    config.write(REG_FIFO_RX_BASE_ADDR, 0);
 
     // Set modem config
-    writeRegister(REG_MODEM_CONFIG_1, 0x72);
-    writeRegister(REG_MODEM_CONFIG_2, 0x70);
-    writeRegister(REG_MODEM_CONFIG_3, 0x04);
+    config.write(REG_MODEM_CONFIG_1, 0x72);
+    config.write(REG_MODEM_CONFIG_2, 0x70);
+    config.write(REG_MODEM_CONFIG_3, 0x04);
 
     // Set transmit power
-    writeRegister(REG_PA_CONFIG, 0x8F);
-    writeRegister(REG_PA_DAC, 0x87);
+    config.write(REG_PA_CONFIG, 0x8F);
+    config.write(REG_PA_DAC, 0x87);
 
     // Set LNA
-    writeRegister(REG_LNA, 0x23);
+    config.write(REG_LNA, 0x23);
 
     // Set up FIFO
-    writeRegister(REG_FIFO_ADDR_PTR, 0);
+    config.write(REG_FIFO_ADDR_PTR, 0);
 
     // Go to standby
-    standbyMode();
+    config.setMode(MODE_STDBY);
+    if (!config.submit())
+    {
+        return false;
+    }
+
+    if (fast)
+    {
+        return waitForOpMode(modeValue(MODE_STDBY), 10);
+    }
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
     return true;
 }
 
+bool RFM95::fastReset()
+{
+    // One burst mirrors every configuration register, the version and OP_MODE included
+    refreshRegisterCache();
+
+    if (readVersionRegister() != 0x12)
+    {
+        return false;
+    }
+
+    // A module already in LoRa mode keeps its configuration; begin() then only writes what differs
+    uint8_t op_mode = readRegister(REG_OP_MODE);
+    if (op_mode & 0x80)
+    {
+        return true;
+    }
+
+    // LongRangeMode can only be changed in sleep mode
+    setMode(MODE_SLEEP);
+    if (!waitForOpMode(op_mode & 0xF8, 10))
+    {
+        return false;
+    }
+    writeRegister(REG_OP_MODE, 0x80);
+    if (!waitForOpMode(0x80, 10))
+    {
+        return false;
+    }
+
+    // The paged registers now read the LoRa page
+    refreshRegisterCache();
+    return true;
+}
+
+bool RFM95::waitForOpMode(uint8_t op_mode, int timeout_ms)
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    // Queued writes are ordered before the read, so the first readback usually matches
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    uint8_t cmd = REG_OP_MODE;
+    while (true)
+    {
+        uint8_t value = 0;
+        if (spi->transfer(&cmd, 1, &value, 1) && value == op_mode)
+        {
+            storeShadow(REG_OP_MODE, value);
+            return true;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            if (!stats.trace.emit(TraceEvent::OpModeTimeout, op_mode, "Timeout waiting for OP_MODE"))
+            {
+                std::cerr << "Timeout waiting for OP_MODE 0x" << std::hex << static_cast<int>(op_mode)
+                          << ", read 0x" << static_cast<int>(value) << std::dec << std::endl;
+            }
+            return false;
+        }
+        std::this_thread::yield();
+    }
+}
+
 void RFM95::end()
 {
     spi->close();
@@ -100,21 +236,77 @@ void RFM95::setFrequency(float freq_mhz)
 {
     uint32_t frf = static_cast<uint32_t>((freq_mhz * 524288.0) / 32.0);
 
-    // Write the three bytes
-    writeRegister(REG_FRF_MSB, (frf >> 16) & 0xFF);
-    writeRegister(REG_FRF_MID, (frf >> 8) & 0xFF);
-    writeRegister(REG_FRF_LSB, frf & 0xFF);
+    // Write the three bytes in one burst
+    uint8_t frf_bytes[3] = {
+        static_cast<uint8_t>((frf >> 16) & 0xFF),
+        static_cast<uint8_t>((frf >> 8) & 0xFF),
+        static_cast<uint8_t>(frf & 0xFF)};
+    writeRegisters(REG_FRF_MSB, frf_bytes, sizeof(frf_bytes));
+}
+
+bool RFM95::setFrf(const Frf &frf)
+{
+    RegisterBatch batch(*this);
+    batch.writeBurst(REG_FRF_MSB, frf.bytes, sizeof(frf.bytes));
+    return batch.submit();
+}
+
+bool RFM95::applyProfile(const RadioProfile &profile)
+{
+    RegisterBatch batch(*this);
+
+    // RegFrf and RegPaConfig are contiguous, as are both modem config registers
+    uint8_t frf_pa[4] = {profile.frf.bytes[0], profile.frf.bytes[1], profile.frf.bytes[2], profile.pa_config};
+    batch.writeBurst(REG_FRF_MSB, frf_pa, sizeof(frf_pa));
+
+    uint8_t modem_config[2] = {profile.modem_config_1, profile.modem_config_2};
+    batch.writeBurst(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+
+    batch.write(REG_MODEM_CONFIG_3, profile.modem_config_3);
+    batch.write(REG_DETECTION_OPTIMIZE, profile.detection_optimize);
+    batch.write(REG_DETECTION_THRESHOLD, profile.detection_threshold);
+    batch.write(REG_SYNC_WORD, profile.sync_word);
+    batch.write(REG_PA_DAC, profile.pa_dac);
+    if (profile.modem_config_1 & 0x01)
+    {
+        batch.write(REG_PAYLOAD_LENGTH, profile.payload_length);
+    }
+    return batch.submit();
+}
+
+RadioProfile RFM95::getProfile()
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    uint8_t frf_pa[4] = {0, 0, 0, 0};
+    readRegisters(REG_FRF_MSB, frf_pa, sizeof(frf_pa));
+    uint8_t modem_config[2] = {0, 0};
+    readRegisters(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+
+    RadioProfile profile;
+    profile.frf = Frf{{frf_pa[0], frf_pa[1], frf_pa[2]}};
+    profile.pa_config = frf_pa[3];
+    profile.modem_config_1 = modem_config[0];
+    profile.modem_config_2 = modem_config[1];
+    profile.modem_config_3 = readRegister(REG_MODEM_CONFIG_3);
+    profile.detection_optimize = readRegister(REG_DETECTION_OPTIMIZE);
+    profile.detection_threshold = readRegister(REG_DETECTION_THRESHOLD);
+    profile.sync_word = readRegister(REG_SYNC_WORD);
+    profile.pa_dac = readRegister(REG_PA_DAC);
+    profile.payload_length = readRegister(REG_PAYLOAD_LENGTH);
+    return profile;
 }
 
 float RFM95::getFrequency()
 {
-    // Read the three bytes from the registers
-    uint32_t msb = static_cast<uint32_t>(readRegister(REG_FRF_MSB));
-    uint32_t mid = static_cast<uint32_t>(readRegister(REG_FRF_MID));
-    uint32_t lsb = static_cast<uint32_t>(readRegister(REG_FRF_LSB));
+    // Read the three bytes from the registers in one burst
+    uint8_t frf_bytes[3] = {0, 0, 0};
+    readRegisters(REG_FRF_MSB, frf_bytes, sizeof(frf_bytes));
 
     // Combine the bytes to form the FRF value
-    uint32_t frf = (msb << 16) | (mid << 8) | lsb;
+    uint32_t frf = (static_cast<uint32_t>(frf_bytes[0]) << 16) |
+                   (static_cast<uint32_t>(frf_bytes[1]) << 8) |
+                   static_cast<uint32_t>(frf_bytes[2]);
 
     // Calculate the frequency using the formula from the datasheet
     float freq_mhz = (frf * 32.0) / 524288.0;
@@ -164,6 +356,13 @@ void RFM95::setSpreadingFactor(int sf)
     uint8_t reg2 = readRegister(REG_MODEM_CONFIG_2);
     reg2 = (reg2 & 0x0F) | ((sf << 4) & 0xF0);
     writeRegister(REG_MODEM_CONFIG_2, reg2);
+    updateLowDataRateOptimize();
+
+    if (sf == 6 && !getImplicitHeader() &&
+        !stats.trace.emit(TraceEvent::InvalidFrame, sf, "SF6 only works in implicit header mode"))
+    {
+        std::cerr << "Warning: SF6 only works in implicit header mode, see setImplicitHeader()" << std::endl;
+    }
 }
 
 int RFM95::getSpreadingFactor()
@@ -174,29 +373,20 @@ int RFM95::getSpreadingFactor()
 
 void RFM95::setBandwidth(float bw_khz)
 {
-    const float bws[] = {7.8, 10.4, 15.6, 20.8, 31.25, 41.7, 62.5, 125, 250, 500};
-    uint8_t bw_value = 9; // Default to 500kHz
-
-    for (int i = 0; i < 10; i++)
-    {
-        if (bw_khz <= bws[i])
-        {
-            bw_value = i;
-            break;
-        }
-    }
+    // Rounded up to the next supported bandwidth, 500 kHz above that
+    float bw_hz = std::max(0.0f, std::min(bw_khz, 1000.0f)) * 1000.0f;
+    uint8_t bw_value = RadioProfile::bandwidthCode(static_cast<uint32_t>(bw_hz + 0.5f));
 
     uint8_t reg1 = readRegister(REG_MODEM_CONFIG_1);
     reg1 = (reg1 & 0x0F) | (bw_value << 4);
     writeRegister(REG_MODEM_CONFIG_1, reg1);
+    updateLowDataRateOptimize();
 }
 
 float RFM95::getBandwidth()
 {
-    const float bws[] = {7.8, 10.4, 15.6, 20.8, 31.25, 41.7, 62.5, 125, 250, 500};
     uint8_t reg1 = readRegister(REG_MODEM_CONFIG_1);
-    uint8_t bw_value = (reg1 >> 4) & 0x0F;
-    return bws[bw_value < 10 ? bw_value : 9];
+    return 500.0f / RadioProfile::bandwidthDivisor((reg1 >> 4) & 0x0F);
 }
 
 void RFM95::setCodingRate(int denominator)
@@ -216,32 +406,130 @@ int RFM95::getCodingRate()
     return cr + 4;
 }
 
+bool RFM95::setImplicitHeader(bool enable, uint8_t payload_length)
+{
+    if (enable && payload_length == 0)
+    {
+        return false;
+    }
+
+    RegisterBatch batch(*this);
+    uint8_t reg1 = readRegister(REG_MODEM_CONFIG_1);
+    batch.write(REG_MODEM_CONFIG_1, enable ? (reg1 | 0x01) : (reg1 & 0xFE));
+    if (enable)
+    {
+        batch.write(REG_PAYLOAD_LENGTH, payload_length);
+    }
+    return batch.submit();
+}
+
+bool RFM95::getImplicitHeader()
+{
+    return (readRegister(REG_MODEM_CONFIG_1) & 0x01) != 0;
+}
+
+uint8_t RFM95::getImplicitLength()
+{
+    return getImplicitHeader() ? readRegister(REG_PAYLOAD_LENGTH) : 0;
+}
+
+void RFM95::setCRC(bool enable)
+{
+    uint8_t reg2 = readRegister(REG_MODEM_CONFIG_2);
+    writeRegister(REG_MODEM_CONFIG_2, enable ? (reg2 | 0x04) : (reg2 & ~0x04));
+}
+
+bool RFM95::getCRC()
+{
+    return (readRegister(REG_MODEM_CONFIG_2) & 0x04) != 0;
+}
+
+void RFM95::setLowDataRateOptimize(bool enable)
+{
+    uint8_t reg3 = readRegister(REG_MODEM_CONFIG_3);
+    writeRegister(REG_MODEM_CONFIG_3, enable ? (reg3 | 0x08) : (reg3 & ~0x08));
+}
+
+bool RFM95::getLowDataRateOptimize()
+{
+    return (readRegister(REG_MODEM_CONFIG_3) & 0x08) != 0;
+}
+
+void RFM95::updateLowDataRateOptimize()
+{
+    // Mandated when a symbol lasts longer than 16 ms, same rule as RadioProfile::make()
+    uint8_t modem_config[2] = {0, 0};
+    readRegisters(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+    int sf = (modem_config[1] >> 4) & 0x0F;
+    setLowDataRateOptimize(RadioProfile::lowDataRateOptimize(sf, (modem_config[0] >> 4) & 0x0F));
+}
+
+bool RFM95::checkFrameLength(size_t length)
+{
+    uint8_t modem_config[2] = {0, 0};
+    readRegisters(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+
+    if (!(modem_config[0] & 0x01))
+    {
+        if (((modem_config[1] >> 4) & 0x0F) == 6)
+        {
+            if (!stats.trace.emit(TraceEvent::InvalidFrame, 6, "SF6 requires implicit header mode"))
+            {
+                std::cerr << "Error: SF6 requires implicit header mode" << std::endl;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // The receiver only knows the length from RegPayloadLength, which TX also uses
+    uint8_t fixed = readRegister(REG_PAYLOAD_LENGTH);
+    if (length != fixed)
+    {
+        if (!stats.trace.emit(TraceEvent::InvalidFrame, static_cast<int>(length), "Frame length differs from the implicit header length"))
+        {
+            std::cerr << "Error: Implicit header frames are " << static_cast<int>(fixed) << " bytes, got " << length << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
 void RFM95::setPreambleLength(int length)
 {
-    writeRegister(REG_PREAMBLE_MSB, (length >> 8) & 0xFF);
-    writeRegister(REG_PREAMBLE_LSB, length & 0xFF);
+    uint8_t preamble[2] = {
+        static_cast<uint8_t>((length >> 8) & 0xFF),
+        static_cast<uint8_t>(length & 0xFF)};
+    writeRegisters(REG_PREAMBLE_MSB, preamble, sizeof(preamble));
 }
 
 int RFM95::getPreambleLength()
 {
-    uint16_t msb = readRegister(REG_PREAMBLE_MSB);
-    uint16_t lsb = readRegister(REG_PREAMBLE_LSB);
-    return (msb << 8) | lsb;
+    uint8_t preamble[2] = {0, 0};
+    readRegisters(REG_PREAMBLE_MSB, preamble, sizeof(preamble));
+    return (preamble[0] << 8) | preamble[1];
 }
 
 void RFM95::setInvertIQ(bool invert)
+{
+    RegisterBatch batch(*this);
+    queueInvertIQ(batch, invert);
+    batch.submit();
+}
+
+void RFM95::queueInvertIQ(RegisterBatch &batch, bool invert)
 {
     if (invert)
     {
         // Setup for inverted IQ
-        writeRegister(REG_INVERTIQ, 0x66);
-        writeRegister(REG_INVERTIQ2, 0x19);
+        batch.write(REG_INVERTIQ, 0x66);
+        batch.write(REG_INVERTIQ2, 0x19);
     }
     else
     {
         // Setup for normal IQ
-        writeRegister(REG_INVERTIQ, 0x27);
-        writeRegister(REG_INVERTIQ2, 0x1D);
+        batch.write(REG_INVERTIQ, 0x27);
+        batch.write(REG_INVERTIQ2, 0x1D);
     }
 }
 
@@ -373,254 +661,1530 @@ void RFM95::setLoRaMode(bool enable)
     std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Wait for mode change
 }
 
-bool RFM95::send(const std::vector<uint8_t> &data, bool invert_iq)
+bool RFM95::send(const std::vector<uint8_t> &data, bool invert_iq, bool listen_before_talk)
 {
     if (data.size() > 255)
     {
         return false;
     }
 
+    // Keep the RX engine off the bus for the whole transmission
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    if (!checkFrameLength(data.size()) || (listen_before_talk && !listenBeforeTalk()))
+    {
+        return false;
+    }
+
+    // The oscillator only needs time to start when leaving sleep
+    uint8_t op_mode = 0;
+    bool from_sleep = !cachedValue(REG_OP_MODE, op_mode) || (op_mode & 0x07) == MODE_SLEEP;
+
+    RegisterBatch setup(*this);
+
     // Configure IQ mode
-    setInvertIQ(invert_iq);
+    queueInvertIQ(setup, invert_iq);
 
-    setDIOMapping(0x40, 0x40); // DIO3=01, DIO4=01 (TxDone)
+    queueDIOMapping(setup, 0x40, 0x40); // DIO0=01 (TxDone)
 
     // Enter standby mode
-    standbyMode();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-
-    // Configure DIO3 for TxDone
-    uint8_t current = readRegister(REG_DIO_MAPPING_1);
-    writeRegister(REG_DIO_MAPPING_1, (current & 0x3F) | 0x40); // 01 for DIO3
+    setup.setMode(MODE_STDBY);
+    bool submitted = true;
+    if (from_sleep)
+    {
+        submitted = setup.submit();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
 
     // Clear IRQ flags
-    writeRegister(REG_IRQ_FLAGS, 0xFF);
+    setup.write(REG_IRQ_FLAGS, 0xFF);
 
     // Write data
-    writeRegister(REG_FIFO_ADDR_PTR, 0);
-    for (uint8_t byte : data)
+    setup.write(REG_FIFO_ADDR_PTR, 0);
+    setup.writeBurst(REG_FIFO, data.data(), data.size());
+    setup.write(REG_PAYLOAD_LENGTH, data.size());
+
+    // Start TX; edges from before the flags were cleared only cause one extra read
+    uint32_t time_on_air = getTimeOnAir(data.size());
+    uint64_t seen = interruptCount();
+    setup.setMode(MODE_TX);
+    if (!setup.submit() || !submitted)
+    {
+        if (invert_iq)
+        {
+            setInvertIQ(false);
+        }
+        return false;
+    }
+
+    // Wait for TX done
+    bool sent = waitTxDone(seen, time_on_air);
+    if (sent)
+    {
+        writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
+    }
+    standbyMode();
+
+    // Restore normal IQ mode if it was inverted
+    if (invert_iq)
     {
-        writeRegister(REG_FIFO, byte);
+        setInvertIQ(false);
     }
-    writeRegister(REG_PAYLOAD_LENGTH, data.size());
+    return sent;
+}
 
-    // Start TX
-    writeRegister(REG_OP_MODE, MODE_TX);
+uint32_t RFM95::getTimeOnAir(size_t payload_length)
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
 
-    // Wait for TX done
+    uint8_t modem_config[2] = {0, 0};
+    readRegisters(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+    uint8_t modem_config_3 = readRegister(REG_MODEM_CONFIG_3);
+    return RadioProfile::timeOnAirUs(modem_config[0], modem_config[1], modem_config_3,
+                                     static_cast<uint16_t>(getPreambleLength()), payload_length);
+}
+
+bool RFM95::waitTxDone(uint64_t &seen, uint32_t time_on_air)
+{
     auto start = std::chrono::steady_clock::now();
+    auto air = std::chrono::microseconds(time_on_air);
+    auto deadline = start + air + air / 4 + std::chrono::milliseconds(TX_TIMEOUT_MARGIN_MS);
+
+    // Without interrupts nothing can happen before the packet is on air, and
+    // long packets do not need millisecond polling once it should be done
+    auto poll = std::max<std::chrono::microseconds>(std::chrono::milliseconds(1),
+                                                    std::min<std::chrono::microseconds>(air / 16, std::chrono::milliseconds(20)));
+    if (!irq_active)
+    {
+        std::this_thread::sleep_until(start + air);
+    }
+
     while (true)
     {
-        uint8_t flags = readRegister(REG_IRQ_FLAGS);
-        if (flags & IRQ_TX_DONE_MASK)
+        if (readRegister(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK)
         {
-            writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
-            standbyMode();
-            // Restore normal IQ mode if it was inverted
-            if (invert_iq)
-            {
-                setInvertIQ(false);
-            }
+            stats.packets_sent.add();
             return true;
         }
 
-        auto now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > 2000)
+        if (std::chrono::steady_clock::now() >= deadline)
         {
-            // Timeout after 2 seconds
-            // Restore normal IQ mode if it was inverted
-            if (invert_iq)
+            stats.tx_timeouts.add();
+            if (!stats.trace.emit(TraceEvent::TxTimeout, static_cast<int>(time_on_air), "TX timeout"))
             {
-                setInvertIQ(false);
+                std::cerr << "TX timeout after " << (time_on_air / 1000) << " ms time on air" << std::endl;
             }
             return false;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        waitForEvent(seen, deadline, poll);
     }
 }
 
-std::vector<uint8_t> RFM95::receive(float timeout, bool invert_iq)
+bool RFM95::runCAD(bool &detected)
 {
-    // Configure IQ mode
-    setInvertIQ(invert_iq);
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+    bool done = cadCycle(detected);
+    finishCAD();
+    return done;
+}
 
-    // Enter receive mode
-    writeRegister(REG_OP_MODE, MODE_RX_CONTINUOUS);
-    setDIOMapping(0x40, 0xC0); // DIO3=01, DIO4=11
+std::vector<size_t> RFM95::scanChannels(const std::vector<RadioProfile> &profiles)
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+    std::vector<size_t> active;
+    for (size_t i = 0; i < profiles.size(); i++)
+    {
+        bool detected = false;
+        if (applyProfile(profiles[i]) && cadCycle(detected) && detected)
+        {
+            active.push_back(i);
+        }
+    }
+    finishCAD();
+    return active;
+}
 
-    // Clear IRQ flags
-    writeRegister(REG_IRQ_FLAGS, 0xFF);
+bool RFM95::cadCycle(bool &detected)
+{
+    detected = false;
+
+    // CAD lasts about two symbols of the current data rate
+    uint8_t modem_config[2] = {0, 0};
+    readRegisters(REG_MODEM_CONFIG_1, modem_config, sizeof(modem_config));
+    int sf = (modem_config[1] >> 4) & 0x0F;
+    auto symbol = std::chrono::microseconds(RadioProfile::symbolUs(sf, (modem_config[0] >> 4) & 0x0F));
+
+    uint8_t op_mode = 0;
+    bool from_sleep = !cachedValue(REG_OP_MODE, op_mode) || (op_mode & 0x07) == MODE_SLEEP;
+    uint8_t dio_mapping = (readRegister(REG_DIO_MAPPING_1) & 0x3F) | DIO0_CAD_DONE;
+
+    RegisterBatch setup(*this);
+    setup.setMode(MODE_STDBY);
+    bool submitted = true;
+    if (from_sleep)
+    {
+        submitted = setup.submit();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    setup.write(REG_DIO_MAPPING_1, dio_mapping);
+    setup.write(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t seen = interruptCount();
+    setup.setMode(MODE_CAD);
+    if (!setup.submit() || !submitted)
+    {
+        return false;
+    }
 
+    auto deadline = start + symbol * 4 + std::chrono::milliseconds(CAD_TIMEOUT_MARGIN_MS);
+    auto poll = std::max<std::chrono::microseconds>(std::chrono::microseconds(100), symbol / 4);
+    if (!irq_active)
+    {
+        std::this_thread::sleep_until(start + symbol * 2);
+    }
 
-    // Wait for RX done or timeout
-    auto start_time = std::chrono::steady_clock::now();
     while (true)
     {
         uint8_t irq_flags = readRegister(REG_IRQ_FLAGS);
-
-        if (irq_flags != 0)
+        if (irq_flags & IRQ_CAD_DONE_MASK)
         {
-
-            // Decode flags
-            if (irq_flags & IRQ_RX_DONE_MASK)
+            detected = (irq_flags & IRQ_CAD_DETECTED_MASK) != 0;
+            writeRegister(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+            if (cachedValue(REG_OP_MODE, op_mode))
             {
-
-                // Check for CRC error
-                if (irq_flags & IRQ_PAYLOAD_CRC_ERROR_MASK)
-                {
-                    writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
-                    continue;                           // Try again
-                }
-
-                // Read packet
-                uint8_t length = readRegister(REG_RX_NB_BYTES);
-
-                if (length > 0)
-                {
-                    uint8_t current_addr = readRegister(REG_FIFO_RX_CURRENT_ADDR);
-                    writeRegister(REG_FIFO_ADDR_PTR, current_addr);
-
-                    std::vector<uint8_t> data;
-                    data.reserve(length);
-                    for (int i = 0; i < length; i++)
-                    {
-                        data.push_back(readRegister(REG_FIFO));
-                    }
-
-                    writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
-
-                    // Restore normal IQ mode if it was inverted
-                    if (invert_iq)
-                    {
-                        setInvertIQ(false);
-                    }
-
-                    return data;
-                }
+                // The module fell back to standby by itself
+                storeShadow(REG_OP_MODE, (op_mode & 0xF8) | MODE_STDBY);
             }
+            return true;
         }
 
-        auto now = std::chrono::steady_clock::now();
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count() > timeout * 1000)
+        if (std::chrono::steady_clock::now() >= deadline)
         {
-            writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
-
-            // Restore normal IQ mode if it was inverted
-            if (invert_iq)
+            stats.cad_timeouts.add();
+            if (!stats.trace.emit(TraceEvent::CadTimeout, 0, "CAD timeout"))
             {
-                setInvertIQ(false);
+                std::cerr << "CAD timeout" << std::endl;
             }
-
-            return std::vector<uint8_t>(); // Return empty vector on timeout
+            standbyMode();
+            return false;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        waitForEvent(seen, deadline, poll);
     }
 }
 
-void RFM95::setContinuousReceive()
+void RFM95::finishCAD()
 {
-    // Put the module in standby mode first
-    standbyMode();
-    
-    // Configure FIFO RX
-    writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_BASE_ADDR));
-    
-    // Configure DIO for reception
-    uint8_t dio_mapping = readRegister(REG_DIO_MAPPING_1);
-    dio_mapping &= 0x3F;  // Clear DIO0 bits (bits 6-7)
-    dio_mapping |= DIO0_RX_DONE;  // DIO0 = 0 (RX_DONE)
-    writeRegister(REG_DIO_MAPPING_1, dio_mapping);
-    
-    // Clear interrupt flags
-    clearIRQFlags();
-    
-    // Change to RX_CONTINUOUS mode
-    uint8_t opmode = readRegister(REG_OP_MODE);
-    opmode = (opmode & 0xF8) | MODE_RX_CONTINUOUS;  // Modes: 1=STDBY, 5=RXCONT, 3=TX
-    writeRegister(REG_OP_MODE, opmode);
-    
-    // Debug: verify that the mode was changed correctly
-    opmode = readRegister(REG_OP_MODE);
-    if ((opmode & 0x07) != MODE_RX_CONTINUOUS) {
-        std::cerr << "Error: Could not change to RX_CONTINUOUS mode" << std::endl;
+    if (rx_running)
+    {
+        setContinuousReceive();
     }
 }
 
-void RFM95::standbyMode()
+bool RFM95::listenBeforeTalk()
 {
-    writeRegister(REG_OP_MODE, MODE_STDBY);
-}
+    // Random backoff keeps nodes that found the channel busy together from colliding again
+    static thread_local std::minstd_rand backoff(std::random_device{}());
+    std::uniform_int_distribution<int> backoff_ms(1, LBT_MAX_BACKOFF_MS);
 
-void RFM95::sleepMode()
-{
-    uint8_t current = readRegister(REG_OP_MODE);
-    writeRegister(REG_OP_MODE, (current & 0xF8) | MODE_SLEEP);
+    for (int attempt = 0; attempt < LBT_MAX_ATTEMPTS; attempt++)
+    {
+        bool detected = false;
+        if (!cadCycle(detected))
+        {
+            return false;
+        }
+        if (!detected)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms(backoff)));
+    }
+
+    if (!stats.trace.emit(TraceEvent::ChannelBusy, LBT_MAX_ATTEMPTS, "Channel busy"))
+    {
+        std::cerr << "Channel busy after " << LBT_MAX_ATTEMPTS << " CAD attempts" << std::endl;
+    }
+    return false;
+}
+
+std::vector<uint8_t> RFM95::receive(float timeout, bool invert_iq)
+{
+    RxPacket packet;
+    if (!receive(packet, timeout, invert_iq))
+    {
+        return std::vector<uint8_t>();
+    }
+    return std::vector<uint8_t>(packet.data, packet.data + packet.length);
+}
+
+bool RFM95::receive(RxPacket &packet, float timeout, bool invert_iq)
+{
+    if (rx_running)
+    {
+        // The engine owns the receiver, hand out its packets instead
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::microseconds(static_cast<int64_t>(timeout * 1e6f));
+        while (true)
+        {
+            // Without the engine thread nothing else moves packets into the ring
+            if (!rx_thread.joinable())
+            {
+                serviceReceiver();
+            }
+
+            // Packets kept with setKeepCrcErrors() are skipped, receive() only returns intact ones
+            if (readPacket(packet))
+            {
+                if (!packet.crc_error)
+                {
+                    return true;
+                }
+                continue;
+            }
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    RegisterBatch setup(*this);
+
+    // Configure IQ mode
+    queueInvertIQ(setup, invert_iq);
+
+    // Enter receive mode
+    setup.setMode(MODE_RX_CONTINUOUS);
+    queueDIOMapping(setup, DIO0_RX_DONE, 0xC0); // DIO0=00 (RxDone), DIO4=11
+
+    // Clear IRQ flags
+    uint64_t seen = interruptCount();
+    setup.write(REG_IRQ_FLAGS, 0xFF);
+    setup.submit();
+    rx_clear_ns = steadyNowNs();
+
+    // Wait for RX done or timeout
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(static_cast<int64_t>(timeout * 1e6f));
+    while (true)
+    {
+        uint64_t poll_ns = steadyNowNs();
+        uint8_t irq_flags = readRegister(REG_IRQ_FLAGS);
+
+        if (irq_flags & IRQ_RX_DONE_MASK)
+        {
+            uint64_t seen_ns = steadyNowNs();
+
+            // Check for CRC error
+            if (irq_flags & IRQ_PAYLOAD_CRC_ERROR_MASK)
+            {
+                stats.crc_errors.add();
+                stats.trace.emit(TraceEvent::RxCrcError, 0, "Payload CRC error");
+                writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
+                rx_clear_ns = seen_ns;
+                continue;                           // Try again
+            }
+
+            // Read packet: RX_CURRENT_ADDR (0x10) through RX_NB_BYTES (0x13) in one burst
+            uint8_t status[4] = {0, 0, 0, 0};
+            readRegisters(REG_FIFO_RX_CURRENT_ADDR, status, sizeof(status));
+            uint8_t current_addr = status[0];
+            uint8_t length = status[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR];
+
+            if (length > 0)
+            {
+                uint8_t signal[4] = {0, 0, 0, 0};
+                uint8_t freq_error[3] = {0, 0, 0};
+
+                RegisterBatch drain(*this);
+                drain.write(REG_FIFO_ADDR_PTR, current_addr);
+                drain.read(REG_FIFO, packet.data, length);
+                drain.read(REG_PKT_SNR_VALUE, signal, sizeof(signal));
+                drain.read(REG_FREQ_ERROR_MSB, freq_error, sizeof(freq_error));
+                drain.write(REG_IRQ_FLAGS, 0xFF); // Clear flags
+                bool drained = drain.submit();
+
+                // Restore normal IQ mode if it was inverted
+                if (invert_iq)
+                {
+                    setInvertIQ(false);
+                }
+
+                if (!drained)
+                {
+                    return false;
+                }
+                packet.length = length;
+                packet.crc_error = false;
+                decodeSignal(packet, signal, freq_error);
+                stampPacket(packet, rx_clear_ns, seen_ns);
+                uint64_t stored_ns = steadyNowNs();
+                stats.packets_received.add();
+                stats.irq_service_latency.record(stored_ns - std::min(packet.timestamp_ns, stored_ns));
+                return true;
+            }
+
+            // Empty packet, drop it so RxDone can fire again
+            writeRegister(REG_IRQ_FLAGS, 0xFF);
+            rx_clear_ns = seen_ns;
+        }
+        else
+        {
+            rx_clear_ns = poll_ns;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            writeRegister(REG_IRQ_FLAGS, 0xFF); // Clear flags
+
+            // Restore normal IQ mode if it was inverted
+            if (invert_iq)
+            {
+                setInvertIQ(false);
+            }
+
+            return false; // Timeout
+        }
+
+        waitForEvent(seen, deadline);
+    }
+}
+
+bool RFM95::setInterruptPin(uint8_t pin)
+{
+    clearInterruptPin();
+
+    // DIO0 is active high: TxDone/RxDone raise it, clearing the flags drops it
+    if (!spi->configureInterrupt(pin, SPIInterface::InterruptEdge::Rising))
+    {
+        return false;
+    }
+
+    // Prefer the backend's edge timestamp, fall back to when the callback runs
+    if (!spi->setInterruptEventCallback([this](const SPIInterface::InterruptEvent &event) {
+            recordEdge(event.timestamp_ns, event.uncertainty_ns);
+        }))
+    {
+        spi->setInterruptCallback([this]() { recordEdge(steadyNowNs(), 0); });
+    }
+
+    if (!spi->enableInterrupt(true))
+    {
+        spi->setInterruptEventCallback(SPIInterface::InterruptEventCallback());
+        spi->setInterruptCallback(SPIInterface::InterruptCallback());
+        spi->configureInterrupt(pin, SPIInterface::InterruptEdge::None);
+        return false;
+    }
+
+    irq_active = true;
+    return true;
+}
+
+void RFM95::clearInterruptPin()
+{
+    if (!irq_active)
+    {
+        return;
+    }
+
+    irq_active = false;
+    spi->enableInterrupt(false);
+    spi->setInterruptEventCallback(SPIInterface::InterruptEventCallback());
+    spi->setInterruptCallback(SPIInterface::InterruptCallback());
+}
+
+void RFM95::recordEdge(uint64_t timestamp_ns, uint32_t uncertainty_ns)
+{
+    stats.interrupts.add();
+
+    std::function<void()> listener;
+    {
+        std::lock_guard<std::mutex> lock(irq_mutex);
+        irq_edge_ns = timestamp_ns;
+        irq_edge_uncertainty_ns = uncertainty_ns;
+        irq_count++;
+        irq_cv.notify_all();
+        listener = irq_listener;
+    }
+    if (listener)
+    {
+        listener();
+    }
+}
+
+void RFM95::setInterruptListener(std::function<void()> listener)
+{
+    std::lock_guard<std::mutex> lock(irq_mutex);
+    irq_listener = std::move(listener);
+}
+
+void RFM95::stampPacket(RxPacket &packet, uint64_t clear_ns, uint64_t seen_ns)
+{
+    if (irq_active)
+    {
+        std::lock_guard<std::mutex> lock(irq_mutex);
+        if (irq_edge_ns > clear_ns && irq_edge_ns <= seen_ns)
+        {
+            packet.timestamp_ns = irq_edge_ns;
+            packet.timestamp_uncertainty_ns = irq_edge_uncertainty_ns;
+            packet.timestamp_from_edge = true;
+            return;
+        }
+    }
+
+    // RxDone rose somewhere between the last clear poll and the end of this one
+    uint64_t half_width = (seen_ns - std::min(clear_ns, seen_ns)) / 2;
+    packet.timestamp_ns = seen_ns - half_width;
+    packet.timestamp_uncertainty_ns = static_cast<uint32_t>(std::min<uint64_t>(half_width, UINT32_MAX));
+    packet.timestamp_from_edge = false;
+}
+
+bool RFM95::getInterruptActive() const
+{
+    return irq_active;
+}
+
+uint64_t RFM95::interruptCount()
+{
+    std::lock_guard<std::mutex> lock(irq_mutex);
+    return irq_count;
+}
+
+void RFM95::waitForEvent(uint64_t &seen, std::chrono::steady_clock::time_point deadline,
+                         std::chrono::microseconds poll)
+{
+    if (!irq_active)
+    {
+        std::this_thread::sleep_until(std::min(deadline, std::chrono::steady_clock::now() + poll));
+        return;
+    }
+
+    // Only the bus is idle while waiting, a missed edge costs at most the timeout
+    std::unique_lock<std::mutex> lock(irq_mutex);
+    irq_cv.wait_until(lock, deadline, [this, seen]() { return irq_count != seen; });
+    seen = irq_count;
+}
+
+bool RFM95::setContinuousReceive()
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    // Reads are resolved before the batch so it stays write-only
+    uint8_t rx_base = readRegister(REG_FIFO_RX_BASE_ADDR);
+    uint8_t dio_mapping = readRegister(REG_DIO_MAPPING_1);
+
+    RegisterBatch setup(*this);
+
+    // Put the module in standby mode first
+    setup.setMode(MODE_STDBY);
+    
+    // Configure FIFO RX
+    setup.write(REG_FIFO_ADDR_PTR, rx_base);
+    
+    // Configure DIO for reception
+    dio_mapping &= 0x3F;  // Clear DIO0 bits (bits 6-7)
+    dio_mapping |= DIO0_RX_DONE;  // DIO0 = 0 (RX_DONE)
+    setup.write(REG_DIO_MAPPING_1, dio_mapping);
+    
+    // Clear interrupt flags
+    setup.write(REG_IRQ_FLAGS, 0xFF);
+    
+    // Change to RX_CONTINUOUS mode
+    setup.setMode(MODE_RX_CONTINUOUS);
+    bool submitted = setup.submit();
+    rx_clear_ns = steadyNowNs();
+    
+    // Verify that the mode was changed correctly
+    uint8_t opmode = readRegister(REG_OP_MODE);
+    if (!submitted || (opmode & 0x07) != MODE_RX_CONTINUOUS)
+    {
+        if (!stats.trace.emit(TraceEvent::RxModeError, opmode, "Could not change to RX_CONTINUOUS mode"))
+        {
+            std::cerr << "Error: Could not change to RX_CONTINUOUS mode" << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool RFM95::startRxEngine(bool background)
+{
+    stopRxEngine();
+
+    rx_ring.clear();
+    rx_dropped = 0;
+    rx_crc_errors = 0;
+    if (!setContinuousReceive())
+    {
+        return false;
+    }
+
+    // Also set without a thread, so TX and CAD return to RX for the caller's engine too
+    rx_running = true;
+    if (background)
+    {
+        rx_thread = std::thread(&RFM95::rxEngineThread, this);
+    }
+    return true;
+}
+
+void RFM95::stopRxEngine()
+{
+    if (!rx_running)
+    {
+        return;
+    }
+
+    rx_running = false;
+    if (!rx_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        // Counts as a spurious edge, which only costs the thread one extra check
+        std::lock_guard<std::mutex> lock(irq_mutex);
+        irq_count++;
+        irq_cv.notify_all();
+    }
+    rx_thread.join();
+}
+
+bool RFM95::getRxEngineRunning() const
+{
+    return rx_running;
+}
+
+bool RFM95::serviceReceiver()
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    // RX_CURRENT_ADDR, IRQ_FLAGS_MASK, IRQ_FLAGS and RX_NB_BYTES in one burst
+    uint8_t status[4] = {0, 0, 0, 0};
+    uint64_t poll_ns = steadyNowNs();
+    if (!readRegisters(REG_FIFO_RX_CURRENT_ADDR, status, sizeof(status)))
+    {
+        return false;
+    }
+    uint64_t seen_ns = steadyNowNs();
+    uint8_t flags = status[REG_IRQ_FLAGS - REG_FIFO_RX_CURRENT_ADDR];
+    if (!(flags & IRQ_RX_DONE_MASK))
+    {
+        rx_clear_ns = poll_ns;
+        return false;
+    }
+
+    uint8_t length = status[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR];
+    bool crc_error = (flags & IRQ_PAYLOAD_CRC_ERROR_MASK) != 0;
+    bool keep = !crc_error || rx_keep_crc_errors;
+    RxPacket *packet = !keep || length == 0 ? nullptr : rx_ring.acquire();
+
+    // Payload, SNR/RSSI, header CRC flag and frequency error in one submission,
+    // then clear only the flags seen so a packet completing meanwhile is not lost
+    uint8_t signal[4] = {0, 0, 0, 0};
+    uint8_t freq_error[3] = {0, 0, 0};
+    RegisterBatch drain(*this);
+    if (packet)
+    {
+        drain.write(REG_FIFO_ADDR_PTR, status[0]);
+        drain.read(REG_FIFO, packet->data, length);
+        drain.read(REG_PKT_SNR_VALUE, signal, sizeof(signal));
+        drain.read(REG_FREQ_ERROR_MSB, freq_error, sizeof(freq_error));
+    }
+    drain.write(REG_IRQ_FLAGS, flags);
+    if (!drain.submit())
+    {
+        return false;
+    }
+    // Flags are clear again, the next RxDone rises after this poll
+    uint64_t clear_ns = rx_clear_ns;
+    rx_clear_ns = seen_ns;
+
+    if (crc_error)
+    {
+        rx_crc_errors++;
+        stats.crc_errors.add();
+        stats.trace.emit(TraceEvent::RxCrcError, 0, "Payload CRC error");
+        if (!keep)
+        {
+            return true;
+        }
+    }
+    if (!packet)
+    {
+        if (length > 0)
+        {
+            rx_dropped++;
+            stats.rx_dropped.add();
+            stats.trace.emit(TraceEvent::RxDropped, length, "RX ring full");
+        }
+        return true;
+    }
+
+    packet->length = length;
+    packet->crc_error = crc_error;
+    decodeSignal(*packet, signal, freq_error);
+    stampPacket(*packet, clear_ns, seen_ns);
+    uint64_t stored_ns = steadyNowNs();
+    uint64_t timestamp_ns = packet->timestamp_ns;
+    rx_ring.publish();
+    if (!crc_error)
+    {
+        stats.packets_received.add();
+    }
+    stats.irq_service_latency.record(stored_ns - std::min(timestamp_ns, stored_ns));
+    return true;
+}
+
+void RFM95::decodeSignal(RxPacket &packet, const uint8_t *signal, const uint8_t *freq_error)
+{
+    // FreqError is 20-bit two's complement, Ferr = v * 2^24 / Fxtal * BW / 500 kHz
+    int32_t raw = (static_cast<int32_t>(freq_error[0] & 0x0F) << 16) |
+                  (static_cast<int32_t>(freq_error[1]) << 8) | freq_error[2];
+    if (raw & 0x80000)
+    {
+        raw -= 0x100000;
+    }
+
+    packet.snr = static_cast<int8_t>(signal[0]) * 0.25f;
+    packet.rssi = packetRssi(signal[1], packet.snr);
+
+    // The header tells whether the sender added a CRC; without one the receiver's setting applies
+    if (readRegister(REG_MODEM_CONFIG_1) & 0x01)
+    {
+        packet.crc_present = (readRegister(REG_MODEM_CONFIG_2) & 0x04) != 0;
+    }
+    else
+    {
+        packet.crc_present = (signal[REG_HOP_CHANNEL - REG_PKT_SNR_VALUE] & 0x40) != 0;
+    }
+    packet.freq_error = static_cast<int32_t>(raw * (16777216.0f / 32e6f) * (getBandwidth() / 500.0f));
+}
+
+bool RFM95::readPacket(RxPacket &packet)
+{
+    return rx_ring.pop(packet);
+}
+
+const RFM95::RxPacket *RFM95::peekPacket()
+{
+    return rx_ring.peek();
+}
+
+void RFM95::releasePacket()
+{
+    rx_ring.release();
+}
+
+size_t RFM95::getRxPending() const
+{
+    return rx_ring.size();
+}
+
+uint32_t RFM95::getRxDropped() const
+{
+    return rx_dropped;
+}
+
+uint32_t RFM95::getRxCrcErrors() const
+{
+    return rx_crc_errors;
+}
+
+void RFM95::setKeepCrcErrors(bool keep)
+{
+    rx_keep_crc_errors = keep;
+}
+
+bool RFM95::getKeepCrcErrors() const
+{
+    return rx_keep_crc_errors;
+}
+
+RadioStats &RFM95::getStats()
+{
+    return stats;
+}
+
+const RadioStats &RFM95::getStats() const
+{
+    return stats;
+}
+
+BusStats &RFM95::getBusStats()
+{
+    return spi->getStats();
+}
+
+void RFM95::rxEngineThread()
+{
+    uint64_t seen = interruptCount();
+    while (rx_running)
+    {
+        // Drain everything pending before sleeping again
+        while (rx_running && serviceReceiver())
+        {
+        }
+
+        // The timeout bounds the latency of an edge missed while the bus was busy
+        waitForEvent(seen, std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+    }
+}
+
+bool RFM95::startTxQueue()
+{
+    if (tx_thread.joinable())
+    {
+        return true;
+    }
+
+    tx_options = TxOptions();
+    tx_running = true;
+    tx_thread = std::thread(&RFM95::txWorkerThread, this);
+    return true;
+}
+
+void RFM95::stopTxQueue()
+{
+    if (!tx_thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tx_mutex);
+        tx_running = false;
+    }
+    tx_cv.notify_all();
+    tx_thread.join();
+}
+
+bool RFM95::enqueue(const uint8_t *data, size_t length, const TxOptions &options, TxCallback callback)
+{
+    if (length > 255)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tx_mutex);
+        if (!tx_running)
+        {
+            return false;
+        }
+
+        TxRequest *request = tx_ring.acquire();
+        if (!request)
+        {
+            return false;
+        }
+        std::memcpy(request->data, data, length);
+        request->length = static_cast<uint8_t>(length);
+        request->options = options;
+        request->callback = std::move(callback);
+        tx_ring.publish();
+    }
+    tx_cv.notify_all();
+    return true;
+}
+
+std::future<bool> RFM95::enqueue(const std::vector<uint8_t> &data, const TxOptions &options)
+{
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = promise->get_future();
+    if (!enqueue(data.data(), data.size(), options, [promise](bool success) { promise->set_value(success); }))
+    {
+        promise->set_value(false);
+    }
+    return result;
+}
+
+size_t RFM95::getTxPending() const
+{
+    return tx_ring.size();
+}
+
+bool RFM95::waitTxIdle(float timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(static_cast<int64_t>(timeout * 1e6f));
+    std::unique_lock<std::mutex> lock(tx_mutex);
+    return tx_cv.wait_until(lock, deadline, [this]() { return tx_ring.empty() && !tx_busy; });
+}
+
+void RFM95::txWorkerThread()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(tx_mutex);
+            tx_cv.wait(lock, [this]() { return !tx_running || !tx_ring.empty(); });
+            if (!tx_running)
+            {
+                break;
+            }
+            tx_busy = true;
+        }
+
+        transmitBurst();
+
+        {
+            std::lock_guard<std::mutex> lock(tx_mutex);
+            tx_busy = false;
+        }
+        tx_cv.notify_all();
+    }
+
+    // Nothing else will send what is left
+    while (!tx_ring.empty())
+    {
+        completeTx(false);
+    }
+    tx_cv.notify_all();
+}
+
+void RFM95::transmitBurst()
+{
+    // The radio cannot receive while transmitting, keep everyone off the bus
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    // The oscillator only needs time to start when leaving sleep
+    uint8_t op_mode = 0;
+    bool from_sleep = !cachedValue(REG_OP_MODE, op_mode) || (op_mode & 0x07) == MODE_SLEEP;
+
+    RegisterBatch setup(*this);
+    queueDIOMapping(setup, 0x40, 0x40); // DIO0=01 (TxDone), once per burst
+    setup.setMode(MODE_STDBY);
+    bool ok = setup.submit();
+    if (from_sleep)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // A failed setup fails the packets queued so far instead of retrying forever
+    TxRequest *request = tx_ring.peek();
+    while (request && tx_running)
+    {
+        if (!ok)
+        {
+            completeTx(false);
+            request = tx_ring.peek();
+            continue;
+        }
+
+        // Settings that did not change since the previous packet cost nothing here
+        applyTxOptions(request->options);
+        if (!checkFrameLength(request->length))
+        {
+            completeTx(false);
+            request = tx_ring.peek();
+            continue;
+        }
+
+        // The module is in standby after TxDone: reload and restart in one submission.
+        // Edges from before the flags were cleared only cause one extra read.
+        uint64_t seen = interruptCount();
+        RegisterBatch load(*this);
+        queueInvertIQ(load, request->options.invert_iq);
+        load.write(REG_IRQ_FLAGS, 0xFF);
+        load.write(REG_FIFO_ADDR_PTR, 0);
+        load.writeBurst(REG_FIFO, request->data, request->length);
+        load.write(REG_PAYLOAD_LENGTH, request->length);
+        load.setMode(MODE_TX);
+        uint32_t time_on_air = getTimeOnAir(request->length);
+        bool sent = load.submit() && waitTxDone(seen, time_on_air);
+
+        if (sent && cachedValue(REG_OP_MODE, op_mode))
+        {
+            // The module fell back to standby by itself
+            storeShadow(REG_OP_MODE, (op_mode & 0xF8) | MODE_STDBY);
+        }
+        else if (!sent)
+        {
+            setMode(MODE_STDBY);
+        }
+
+        completeTx(sent);
+        request = tx_ring.peek();
+    }
+
+    // Leave the module as other users expect it
+    RegisterBatch restore(*this);
+    restore.write(REG_IRQ_FLAGS, 0xFF);
+    queueInvertIQ(restore, false);
+    restore.submit();
+    if (rx_running)
+    {
+        setContinuousReceive();
+    }
+}
+
+void RFM95::applyTxOptions(const TxOptions &options)
+{
+    if (options.use_profile)
+    {
+        // The profile sets power and spreading factor too, forget what was applied before
+        applyProfile(options.profile);
+        tx_options = TxOptions();
+    }
+    if (options.tx_power != 0 && options.tx_power != tx_options.tx_power)
+    {
+        setTxPower(options.tx_power);
+        tx_options.tx_power = options.tx_power;
+    }
+    if (options.spreading_factor != 0 && options.spreading_factor != tx_options.spreading_factor)
+    {
+        setSpreadingFactor(options.spreading_factor);
+        tx_options.spreading_factor = options.spreading_factor;
+    }
+}
+
+void RFM95::completeTx(bool success)
+{
+    TxRequest *request = tx_ring.peek();
+    if (!request)
+    {
+        return;
+    }
+
+    TxCallback callback;
+    callback.swap(request->callback);
+    tx_ring.release();
+    tx_cv.notify_all();
+
+    if (callback)
+    {
+        callback(success);
+    }
+}
+
+void RFM95::standbyMode()
+{
+    setMode(MODE_STDBY);
+}
+
+void RFM95::sleepMode()
+{
+    setMode(MODE_SLEEP);
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
 }
 
-void RFM95::resetPtrRx()
+void RFM95::setMode(uint8_t mode)
+{
+    writeRegister(REG_OP_MODE, modeValue(mode));
+}
+
+uint8_t RFM95::modeValue(uint8_t mode)
+{
+    // Only the upper bits are reused, and those never change on their own
+    uint8_t current = 0;
+    if (!cache_enabled || !shadow_valid[REG_OP_MODE])
+    {
+        current = readRegister(REG_OP_MODE);
+    }
+    else
+    {
+        current = shadow[REG_OP_MODE];
+    }
+    return (current & 0xF8) | (mode & 0x07);
+}
+
+void RFM95::resetPtrRx()
+{
+    writeRegister(REG_FIFO_ADDR_PTR, 0);
+}
+
+uint8_t RFM95::getFifoRxCurrentAddr()
+{
+    return readRegister(REG_FIFO_RX_CURRENT_ADDR);
+}
+
+uint8_t RFM95::getRxNbBytes()
+{
+    return readRegister(REG_RX_NB_BYTES);
+}
+
+std::vector<uint8_t> RFM95::readPayload()
+{
+    std::vector<uint8_t> data(FIFO_SIZE);
+    data.resize(readPayload(data.data(), data.size()));
+    return data;
+}
+
+size_t RFM95::readPayload(uint8_t *buffer, size_t capacity)
+{
+    // RX_CURRENT_ADDR (0x10) through RX_NB_BYTES (0x13) in one burst
+    uint8_t status[4] = {0, 0, 0, 0};
+    if (!readRegisters(REG_FIFO_RX_CURRENT_ADDR, status, sizeof(status)))
+    {
+        return 0;
+    }
+
+    uint8_t current_addr = status[0];
+    uint8_t length = status[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR];
+    if (length == 0 || length > capacity)
+    {
+        return 0;
+    }
+
+    writeRegister(REG_FIFO_ADDR_PTR, current_addr);
+    if (!readFifo(buffer, length))
+    {
+        return 0;
+    }
+    return length;
+}
+
+bool RFM95::getPacketStatus(float &rssi, float &snr)
 {
-    writeRegister(REG_FIFO_ADDR_PTR, 0);
+    // PKT_SNR_VALUE (0x19) and PKT_RSSI_VALUE (0x1A) are adjacent
+    uint8_t status[2] = {0, 0};
+    if (!readRegisters(REG_PKT_SNR_VALUE, status, sizeof(status)))
+    {
+        return false;
+    }
+
+    snr = static_cast<int8_t>(status[0]) * 0.25f;
+    rssi = packetRssi(status[1], snr);
+    return true;
 }
 
-uint8_t RFM95::getFifoRxCurrentAddr()
+float RFM95::getRSSI()
 {
-    return readRegister(REG_FIFO_RX_CURRENT_ADDR);
+    // Below the noise floor the RSSI needs the SNR as well
+    float rssi = 0.0f;
+    float snr = 0.0f;
+    getPacketStatus(rssi, snr);
+    return rssi;
 }
 
-uint8_t RFM95::getRxNbBytes()
+float RFM95::packetRssi(uint8_t value, float snr)
 {
-    return readRegister(REG_RX_NB_BYTES);
+    // The HF port (band 1) and the LF ports have different references (datasheet 5.5.5)
+    float rssi = (getFrequency() >= HF_PORT_MIN_MHZ ? -157.0f : -164.0f) + value;
+
+    // Below 0 dB SNR the packet power is under the noise that RegPktRssiValue measured
+    return snr < 0.0f ? rssi + snr : rssi;
 }
 
-std::vector<uint8_t> RFM95::readPayload()
+float RFM95::getSNR()
+{
+    int8_t snr = static_cast<int8_t>(readRegister(REG_PKT_SNR_VALUE));
+    return snr * 0.25f;
+}
+
+uint8_t RFM95::readRegister(uint8_t address)
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+    uint8_t value = 0;
+    if (cachedValue(address, value))
+    {
+        return value;
+    }
+
+    flushWrites();
+    uint8_t cmd = address & 0x7F;
+    if (!spi->transfer(&cmd, 1, &value, 1))
+    {
+        return 0;
+    }
+    storeShadow(address, value);
+    return value;
+}
+
+bool RFM95::readRegisters(uint8_t address, uint8_t *buffer, size_t length)
 {
-    uint8_t length = readRegister(REG_RX_NB_BYTES);
-    if (length > 0)
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+
+    // Serve the whole range from the cache or none of it
+    bool hit = address != REG_FIFO;
+    for (size_t i = 0; hit && i < length; i++)
+    {
+        hit = cachedValue(static_cast<uint8_t>(address + i), buffer[i]);
+    }
+    if (hit)
+    {
+        return true;
+    }
+
+    flushWrites();
+    uint8_t cmd = address & 0x7F;
+    if (!spi->transfer(&cmd, 1, buffer, length))
     {
-        uint8_t current_addr = readRegister(REG_FIFO_RX_CURRENT_ADDR);
-        writeRegister(REG_FIFO_ADDR_PTR, current_addr);
+        return false;
+    }
 
-        std::vector<uint8_t> data;
-        data.reserve(length);
-        for (int i = 0; i < length; i++)
+    if (address != REG_FIFO)
+    {
+        for (size_t i = 0; i < length; i++)
         {
-            data.push_back(readRegister(REG_FIFO));
+            storeShadow(static_cast<uint8_t>(address + i), buffer[i]);
         }
+    }
+    return true;
+}
+
+void RFM95::writeRegisters(uint8_t address, const uint8_t *data, size_t length)
+{
+    RegisterBatch batch(*this);
+    batch.writeBurst(address, data, length);
+    batch.submit();
+}
+
+bool RFM95::readFifo(uint8_t *buffer, size_t length)
+{
+    return readRegisters(REG_FIFO, buffer, length);
+}
+
+void RFM95::writeFifo(const uint8_t *data, size_t length)
+{
+    writeRegisters(REG_FIFO, data, length);
+}
+
+void RFM95::writeRegister(uint8_t address, uint8_t value)
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+    if (!writeNeeded(address, value))
+    {
+        return; // No effective change
+    }
 
-        return data;
+    // Writes are queued so back-to-back configuration writes can overlap on the bus;
+    // any later read is ordered behind them.
+    uint8_t cmd[2] = {static_cast<uint8_t>(address | 0x80), value};
+    if (!spi->queueWrite(cmd, sizeof(cmd)))
+    {
+        // The chip may or may not hold the new value, and a mode write may have switched pages
+        invalidateRegisterCache();
+        return;
     }
-    return std::vector<uint8_t>();
+
+    writes_queued = true;
+    applyShadowWrite(address, value);
 }
 
-float RFM95::getRSSI()
+bool RFM95::flushWrites()
+{
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
+    if (!writes_queued)
+    {
+        return true;
+    }
+
+    writes_queued = false;
+    if (spi->flush())
+    {
+        return true;
+    }
+
+    // Which queued write failed is unknown, so none of the shadow can be trusted
+    invalidateRegisterCache();
+    return false;
+}
+
+bool RFM95::writeNeeded(uint8_t address, uint8_t value) const
 {
-    return -137 + readRegister(REG_PKT_RSSI_VALUE);
+    uint8_t current = 0;
+    if (!cachedValue(address, current))
+    {
+        return true;
+    }
+
+    if (address == REG_OP_MODE)
+    {
+        // LongRangeMode can only change in sleep mode, compare what the chip will hold
+        uint8_t effective = (current & 0x07) == MODE_SLEEP ? value : ((value & 0x7F) | (current & 0x80));
+        return effective != current;
+    }
+
+    return current != value;
 }
 
-float RFM95::getSNR()
+RFM95::RegisterBatch::RegisterBatch(RFM95 &radio)
+    : radio(radio),
+      lock(radio.bus_mutex),
+      arena_used(0),
+      count(0),
+      ok(true)
 {
-    int8_t snr = static_cast<int8_t>(readRegister(REG_PKT_SNR_VALUE));
-    return snr * 0.25f;
 }
 
-uint8_t RFM95::readRegister(uint8_t address)
+RFM95::RegisterBatch::~RegisterBatch()
+{
+    submit();
+}
+
+SPIInterface::Transaction &RFM95::RegisterBatch::append(size_t tx_len)
 {
-    std::vector<uint8_t> cmd = {static_cast<uint8_t>(address & 0x7F)};
-    std::vector<uint8_t> response = spi->transfer(cmd, 1);
-    if (!response.empty())
+    if (count == MAX_TRANSACTIONS || arena_used + tx_len > ARENA_SIZE)
     {
-        return response[0];
+        ok = submit();
     }
-    return 0;
+
+    SPIInterface::Transaction &t = transactions[count++];
+    t.tx = arena + arena_used;
+    t.tx_len = tx_len;
+    t.rx = nullptr;
+    t.rx_len = 0;
+    arena_used += tx_len;
+    return t;
 }
 
-void RFM95::writeRegister(uint8_t address, uint8_t value)
+void RFM95::RegisterBatch::write(uint8_t address, uint8_t value)
+{
+    if (!radio.writeNeeded(address, value))
+    {
+        return;
+    }
+
+    radio.applyShadowWrite(address, value);
+
+    SPIInterface::Transaction &t = append(2);
+    uint8_t *cmd = const_cast<uint8_t *>(t.tx);
+    cmd[0] = static_cast<uint8_t>(address | 0x80);
+    cmd[1] = value;
+}
+
+void RFM95::RegisterBatch::writeBurst(uint8_t address, const uint8_t *data, size_t length)
+{
+    if (address != REG_FIFO)
+    {
+        // Skip the write entirely when every register already holds its value
+        bool unchanged = true;
+        for (size_t i = 0; unchanged && i < length; i++)
+        {
+            uint8_t current = 0;
+            unchanged = address != REG_OP_MODE && radio.cachedValue(static_cast<uint8_t>(address + i), current) &&
+                        current == data[i];
+        }
+        if (unchanged)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < length; i++)
+        {
+            radio.applyShadowWrite(static_cast<uint8_t>(address + i), data[i]);
+        }
+    }
+
+    // Split anything larger than the FIFO; the register address keeps incrementing
+    // between chunks, except for the FIFO which always stays at REG_FIFO
+    while (length > 0)
+    {
+        size_t chunk = length < FIFO_SIZE ? length : FIFO_SIZE;
+        SPIInterface::Transaction &t = append(chunk + 1);
+        uint8_t *cmd = const_cast<uint8_t *>(t.tx);
+        cmd[0] = static_cast<uint8_t>(address | 0x80);
+        std::copy(data, data + chunk, cmd + 1);
+
+        data += chunk;
+        length -= chunk;
+        if (address != REG_FIFO)
+        {
+            address = static_cast<uint8_t>(address + chunk);
+        }
+    }
+}
+
+void RFM95::RegisterBatch::read(uint8_t address, uint8_t *buffer, size_t length)
+{
+    SPIInterface::Transaction &t = append(1);
+    const_cast<uint8_t *>(t.tx)[0] = address & 0x7F;
+    t.rx = buffer;
+    t.rx_len = length;
+}
+
+void RFM95::RegisterBatch::setMode(uint8_t mode)
+{
+    write(REG_OP_MODE, radio.modeValue(mode));
+}
+
+bool RFM95::RegisterBatch::submit()
+{
+    bool success = ok;
+    if (count > 0 && !radio.spi->transferBatch(transactions, count))
+    {
+        // The writes were shadowed as they were queued, but some may not have reached the chip
+        radio.invalidateRegisterCache();
+        success = false;
+    }
+
+    count = 0;
+    arena_used = 0;
+    ok = true;
+    return success;
+}
+
+void RFM95::setRegisterCache(bool enable)
+{
+    cache_enabled = enable;
+    invalidateRegisterCache();
+}
+
+bool RFM95::getRegisterCache() const
+{
+    return cache_enabled;
+}
+
+bool RFM95::refreshRegisterCache()
+{
+    if (!cache_enabled)
+    {
+        return false;
+    }
+
+    invalidateRegisterCache();
+
+    // One burst over the whole shadowed range; REG_OP_MODE comes first, so the
+    // LoRa/FSK page is known before the paged registers are stored
+    uint8_t values[SHADOW_LAST - SHADOW_FIRST + 1];
+    return readRegisters(SHADOW_FIRST, values, sizeof(values));
+}
+
+void RFM95::invalidateRegisterCache()
+{
+    std::fill(std::begin(shadow_valid), std::end(shadow_valid), false);
+    op_mode_stale = false;
+}
+
+bool RFM95::isCacheable(uint8_t address) const
+{
+    if (!cache_enabled || address < SHADOW_FIRST || address > SHADOW_LAST)
+    {
+        return false;
+    }
+
+    switch (address)
+    {
+    case REG_FIFO_ADDR_PTR:        // Advances on every FIFO access
+    case REG_FIFO_RX_CURRENT_ADDR:
+    case REG_IRQ_FLAGS:
+    case REG_RX_NB_BYTES:
+    case 0x14:                     // RegRxHeaderCntValue MSB/LSB, RegRxPacketCntValue MSB/LSB
+    case 0x15:
+    case 0x16:
+    case 0x17:
+    case 0x18:                     // RegModemStat
+    case REG_PKT_SNR_VALUE:
+    case REG_PKT_RSSI_VALUE:
+    case 0x1B:                     // RegRssiValue
+    case REG_HOP_CHANNEL:
+    case 0x25:                     // RegFifoRxByteAddr
+    case REG_FREQ_ERROR_MSB:
+    case REG_FREQ_ERROR_MID:
+    case REG_FREQ_ERROR_LSB:
+    case REG_RSSI_WIDEBAND:
+        return false;
+    default:
+        break;
+    }
+
+    // 0x0D-0x3F are different registers in FSK mode, only mirror the LoRa page
+    if (address >= REG_FIFO_ADDR_PTR && address <= 0x3F)
+    {
+        return shadow_valid[REG_OP_MODE] && (shadow[REG_OP_MODE] & 0x80) != 0;
+    }
+
+    return true;
+}
+
+bool RFM95::cachedValue(uint8_t address, uint8_t &value) const
+{
+    if (!isCacheable(address) || !shadow_valid[address])
+    {
+        return false;
+    }
+    if (address == REG_OP_MODE && op_mode_stale)
+    {
+        return false;
+    }
+
+    value = shadow[address];
+    return true;
+}
+
+void RFM95::storeShadow(uint8_t address, uint8_t value)
+{
+    if (!cache_enabled || address < SHADOW_FIRST || address > SHADOW_LAST)
+    {
+        return;
+    }
+
+    if (address == REG_OP_MODE)
+    {
+        if (shadow_valid[REG_OP_MODE] && ((shadow[REG_OP_MODE] ^ value) & 0x80))
+        {
+            invalidatePagedRegisters();
+        }
+        shadow[REG_OP_MODE] = value;
+        shadow_valid[REG_OP_MODE] = true;
+        op_mode_stale = false;
+        return;
+    }
+
+    if (isCacheable(address))
+    {
+        shadow[address] = value;
+        shadow_valid[address] = true;
+    }
+}
+
+void RFM95::applyShadowWrite(uint8_t address, uint8_t value)
+{
+    if (!cache_enabled || address < SHADOW_FIRST || address > SHADOW_LAST)
+    {
+        return;
+    }
+
+    if (address == REG_OP_MODE)
+    {
+        if (!shadow_valid[REG_OP_MODE])
+        {
+            // Can't tell whether the LoRa bit took effect, re-read on next use
+            invalidatePagedRegisters();
+            return;
+        }
+
+        uint8_t current = shadow[REG_OP_MODE];
+        if ((current & 0x07) == MODE_SLEEP)
+        {
+            if ((current ^ value) & 0x80)
+            {
+                invalidatePagedRegisters();
+            }
+        }
+        else
+        {
+            // LongRangeMode writes are ignored outside sleep mode
+            value = (value & 0x7F) | (current & 0x80);
+        }
+
+        shadow[REG_OP_MODE] = value;
+
+        // These modes fall back to standby by themselves
+        uint8_t mode = value & 0x07;
+        op_mode_stale = mode == MODE_TX || mode == MODE_RX_SINGLE || mode == 0x07;
+        return;
+    }
+
+    if (isCacheable(address))
+    {
+        shadow[address] = value;
+        shadow_valid[address] = true;
+    }
+}
+
+void RFM95::invalidatePagedRegisters()
 {
-    std::vector<uint8_t> cmd = {static_cast<uint8_t>(address | 0x80), value};
-    spi->transfer(cmd, 0);
+    for (uint8_t address = REG_FIFO_ADDR_PTR; address <= 0x3F; address++)
+    {
+        shadow_valid[address] = false;
+    }
 }
 
 void RFM95::receiveMode()
@@ -639,86 +2203,120 @@ void RFM95::receiveMode()
     writeRegister(REG_DETECTION_THRESHOLD, 0x0A);
 
     // Enter RX continuous mode
-    writeRegister(REG_OP_MODE, MODE_RX_CONTINUOUS);
+    setMode(MODE_RX_CONTINUOUS);
 }
 
 void RFM95::setDIOMapping(uint8_t _dio3, uint8_t _dio4)
+{
+    RegisterBatch batch(*this);
+    queueDIOMapping(batch, _dio3, _dio4);
+    batch.write(REG_IRQ_FLAGS, 0xFF); // Clear flags
+    batch.submit();
+}
+
+void RFM95::queueDIOMapping(RegisterBatch &batch, uint8_t _dio3, uint8_t _dio4)
 {
     // RegDioMapping1 (0x40)
     uint8_t dio_map1 = readRegister(REG_DIO_MAPPING_1);
     dio_map1 = (dio_map1 & 0x3F) | (_dio3 & 0xC0);
-    writeRegister(REG_DIO_MAPPING_1, dio_map1);
+    batch.write(REG_DIO_MAPPING_1, dio_map1);
 
     // RegDioMapping2 (0x41)
     uint8_t dio_map2 = readRegister(REG_DIO_MAPPING_2);
     dio_map2 = (dio_map2 & 0x3F) | (_dio4 & 0xC0);
-    writeRegister(REG_DIO_MAPPING_2, dio_map2);
+    batch.write(REG_DIO_MAPPING_2, dio_map2);
 
     // Enable interrupts
-    writeRegister(REG_IRQ_FLAGS_MASK, 0x00); // IRQ mask
-    writeRegister(REG_IRQ_FLAGS, 0xFF);      // Clear flags
+    batch.write(REG_IRQ_FLAGS_MASK, 0x00); // IRQ mask
 }
 
-bool RFM95::calibrateTemperature(float actual_temp)
+bool RFM95::switchModem(bool lora, uint8_t mode)
 {
-    try
-    {
-        // Save current mode
-        uint8_t current_mode = readRegister(REG_OP_MODE);
-
-        // Set FSK mode
-        writeRegister(REG_OP_MODE, 0x00); // FSK + sleep
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-        // Store calibration value
-        uint8_t cal_value = static_cast<uint8_t>(actual_temp);
-        writeRegister(0x3B, cal_value);
-                //   << static_cast<int>(cal_value) << std::dec << std::endl;
-
-        // Restore mode
-        writeRegister(REG_OP_MODE, current_mode);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
 
-        return true;
+    uint8_t page = (lora ? 0x80 : 0x00) | (readRegister(REG_OP_MODE) & 0x08);
+    setMode(MODE_SLEEP);
+    if (!waitForOpMode(modeValue(MODE_SLEEP), 10))
+    {
+        return false;
     }
-    catch (const std::exception &e)
+    writeRegister(REG_OP_MODE, page | MODE_SLEEP);
+    if (!waitForOpMode(page | MODE_SLEEP, 10))
     {
-        std::cerr << "Error in temperature calibration: " << e.what() << std::endl;
         return false;
     }
+    if (mode == MODE_SLEEP)
+    {
+        return true;
+    }
+    writeRegister(REG_OP_MODE, page | mode);
+    return waitForOpMode(page | mode, 10);
 }
 
-float RFM95::readTemperature()
+bool RFM95::measureTemperature(int &raw)
 {
-    try
-    {
-        // Save current mode
-        uint8_t current_mode = readRegister(REG_OP_MODE);
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
 
-        // Set FSK mode
-        writeRegister(REG_OP_MODE, 0x00);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    uint8_t previous = readRegister(REG_OP_MODE);
+    bool lora = (previous & 0x80) != 0;
 
-        // Read calibration value
-        uint8_t cal_value = readRegister(0x3B);
-
-        // Read current value
-        uint8_t raw_temp = readRegister(0x3C);
+    // The sensor only runs while the synthesizer is on in FSK/OOK mode
+    bool ok = switchModem(false, MODE_FSRX);
+    if (ok)
+    {
+        uint8_t image_cal = readRegister(REG_FSK_IMAGE_CAL);
+        writeRegister(REG_FSK_IMAGE_CAL, image_cal & ~0x01); // TempMonitorOff = 0
+        flushWrites();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        writeRegister(REG_FSK_IMAGE_CAL, image_cal | 0x01);
+        ok = switchModem(false, MODE_SLEEP);
 
-        // Calculate actual temperature using calibration
-        float temp = raw_temp + cal_value;
+        // Sign and magnitude, with the magnitude counting down as it gets warmer
+        uint8_t value = readRegister(REG_FSK_TEMP);
+        raw = (value & 0x80) ? 255 - value : -static_cast<int>(value);
+    }
 
-        // Restore mode
-        writeRegister(REG_OP_MODE, current_mode);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Transient modes end in standby, the receiver gets its FIFO pointers back
+    uint8_t mode = previous & 0x07;
+    bool receiving = mode == MODE_RX_CONTINUOUS;
+    if (!receiving && mode != MODE_SLEEP)
+    {
+        mode = MODE_STDBY;
+    }
+    bool restored = switchModem(lora, receiving ? MODE_STDBY : mode);
+    if (restored && receiving)
+    {
+        if (lora)
+        {
+            restored = setContinuousReceive();
+        }
+        else
+        {
+            setMode(MODE_RX_CONTINUOUS);
+        }
+    }
+    return ok && restored;
+}
 
-        return temp;
+bool RFM95::calibrateTemperature(float actual_temp)
+{
+    int raw = 0;
+    if (!measureTemperature(raw))
+    {
+        return false;
     }
-    catch (const std::exception &e)
+    temperature_offset = actual_temp - static_cast<float>(raw);
+    return true;
+}
+
+float RFM95::readTemperature()
+{
+    int raw = 0;
+    if (!measureTemperature(raw))
     {
-        std::cerr << "Error reading temperature: " << e.what() << std::endl;
         return 0.0f;
     }
+    return static_cast<float>(raw) + temperature_offset;
 }
 
 bool RFM95::setBeaconMode(int interval_ms, const std::vector<uint8_t> &payload)
@@ -735,10 +2333,7 @@ bool RFM95::setBeaconMode(int interval_ms, const std::vector<uint8_t> &payload)
     writeRegister(REG_FIFO_ADDR_PTR, 0);
 
     // Write payload
-    for (uint8_t byte : payload)
-    {
-        writeRegister(REG_FIFO, byte);
-    }
+    writeFifo(payload.data(), payload.size());
     writeRegister(REG_PAYLOAD_LENGTH, payload.size());
 
     // Set beacon interval
@@ -795,26 +2390,50 @@ void RFM95::printRegisters()
 
 bool RFM95::testCommunication()
 {
-    // Write a test value to sync word register
-    uint8_t test_value = 0x42;
-    writeRegister(REG_SYNC_WORD, test_value);
+    std::lock_guard<std::recursive_mutex> lock(bus_mutex);
 
-    // Read it back
-    uint8_t read_value = readRegister(REG_SYNC_WORD);
+    // Bypass the shadow cache both ways, the point is to go over the bus
+    flushWrites();
+    uint8_t read_cmd = REG_SYNC_WORD;
+    uint8_t original = 0;
+    if (!spi->transfer(&read_cmd, 1, &original, 1))
+    {
+        return false;
+    }
 
-    return test_value == read_value;
+    // Write the complement of the sync word, so the readback must differ from what was there
+    uint8_t test_value = static_cast<uint8_t>(~original);
+    uint8_t write_cmd[2] = {static_cast<uint8_t>(REG_SYNC_WORD | 0x80), test_value};
+    uint8_t read_value = 0;
+    bool ok = spi->transfer(write_cmd, sizeof(write_cmd), nullptr, 0) &&
+              spi->transfer(&read_cmd, 1, &read_value, 1) &&
+              read_value == test_value;
+
+    // Restore the original sync word
+    write_cmd[1] = original;
+    if (!spi->transfer(write_cmd, sizeof(write_cmd), nullptr, 0))
+    {
+        ok = false;
+        shadow_valid[REG_SYNC_WORD] = false;
+    }
+    else
+    {
+        storeShadow(REG_SYNC_WORD, original);
+    }
+    return ok;
 }
 
 uint8_t RFM95::readVersionRegister()
 {
     try
     {
-        std::vector<uint8_t> response = spi->transfer({0x42}, 1);
-        if (!response.empty())
+        uint8_t cmd = REG_VERSION;
+        uint8_t version = 0;
+        if (!spi->transfer(&cmd, 1, &version, 1))
         {
-            return response[0];
+            return 0;
         }
-        return 0;
+        return version;
     }
     catch (const std::exception &e)
     {
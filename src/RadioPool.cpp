@@ -0,0 +1,328 @@
+/**
+ * @file RadioPool.cpp
+ * @brief Implementation of the multi-radio gateway front end
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "RadioPool.hpp"
+#include "PacketCapture.hpp"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+constexpr int RadioPool::POLL_INTERVAL_MS;
+constexpr int RadioPool::IDLE_CHECK_MS;
+
+namespace
+{
+// Heap order: the oldest packet on top, the lower radio index first on ties
+bool newerThan(const RadioPool::Packet &a, const RadioPool::Packet &b)
+{
+    if (a.rx.timestamp_ns != b.rx.timestamp_ns)
+    {
+        return a.rx.timestamp_ns > b.rx.timestamp_ns;
+    }
+    return a.radio > b.radio;
+}
+}
+
+RadioPool::RadioPool(size_t worker_count, const std::vector<int> &cpus)
+    : cpus(cpus),
+      reorder_window(std::chrono::milliseconds(20)),
+      max_pending(RFM95::RX_RING_SIZE),
+      capture(nullptr),
+      running(false)
+{
+    worker_count = std::max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(new Worker());
+        workers.back()->wake = false;
+    }
+}
+
+RadioPool::~RadioPool()
+{
+    stop();
+    for (std::unique_ptr<Member> &member : members)
+    {
+        member->radio->setInterruptListener(std::function<void()>());
+        member->radio->stopRxEngine();
+    }
+}
+
+int RadioPool::addRadio(std::unique_ptr<SPIInterface> spi, const RadioProfile &profile, int interrupt_pin)
+{
+    if (running)
+    {
+        return -1;
+    }
+
+    std::unique_ptr<RFM95> radio(new RFM95(std::move(spi)));
+    if (!radio->begin())
+    {
+        std::cerr << "Pool radio " << members.size() << " failed to initialize" << std::endl;
+        return -1;
+    }
+    if (!radio->applyProfile(profile))
+    {
+        std::cerr << "Pool radio " << members.size() << " rejected its profile" << std::endl;
+        return -1;
+    }
+    if (interrupt_pin >= 0 && !radio->setInterruptPin(static_cast<uint8_t>(interrupt_pin)))
+    {
+        std::cerr << "Pool radio " << members.size() << " falls back to polling" << std::endl;
+    }
+    return addRadio(std::move(radio));
+}
+
+int RadioPool::addRadio(std::unique_ptr<RFM95> radio)
+{
+    if (running || !radio)
+    {
+        return -1;
+    }
+
+    std::unique_ptr<Member> member(new Member());
+    member->radio = std::move(radio);
+    member->index = members.size();
+    member->worker = member->index % workers.size();
+    member->queued = 0;
+    member->signalled = false;
+
+    // The listener only flags the radio, the worker does the SPI work
+    Member *flagged = member.get();
+    Worker *worker = workers[member->worker].get();
+    member->radio->setInterruptListener([this, flagged, worker]() {
+        flagged->signalled = true;
+        wakeWorker(*worker);
+    });
+
+    worker->members.push_back(member.get());
+    members.push_back(std::move(member));
+    return static_cast<int>(members.size() - 1);
+}
+
+RFM95 &RadioPool::getRadio(size_t index)
+{
+    return *members.at(index)->radio;
+}
+
+size_t RadioPool::getRadioCount() const
+{
+    return members.size();
+}
+
+void RadioPool::setReorderWindow(std::chrono::microseconds window)
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    reorder_window = window;
+}
+
+void RadioPool::setMaxPendingPerRadio(size_t limit)
+{
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        max_pending = std::max<size_t>(limit, 1);
+        output.reserve(members.size() * max_pending);
+    }
+    for (std::unique_ptr<Worker> &worker : workers)
+    {
+        wakeWorker(*worker);
+    }
+}
+
+void RadioPool::setCapture(PacketCapture *capture)
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    this->capture = capture;
+}
+
+bool RadioPool::start()
+{
+    if (running)
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        if (!members[i]->radio->startRxEngine(false))
+        {
+            std::cerr << "Pool radio " << i << " failed to start receiving" << std::endl;
+            for (size_t j = 0; j < i; j++)
+            {
+                members[j]->radio->stopRxEngine();
+            }
+            return false;
+        }
+        members[i]->profile = members[i]->radio->getProfile();
+        members[i]->signalled = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        output.reserve(members.size() * max_pending);
+    }
+
+    running = true;
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers[i]->thread = std::thread(&RadioPool::run, this, std::ref(*workers[i]), cpu);
+    }
+    return true;
+}
+
+void RadioPool::stop()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    running = false;
+    for (std::unique_ptr<Worker> &worker : workers)
+    {
+        wakeWorker(*worker);
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+    output_cv.notify_all();
+}
+
+bool RadioPool::readPacket(Packet &packet, float timeout)
+{
+    Clock::time_point deadline = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(timeout * 1e6));
+    std::unique_lock<std::mutex> lock(output_mutex);
+    while (true)
+    {
+        Clock::time_point wait_until = deadline;
+        if (!output.empty())
+        {
+            // Timestamps share the steady_clock timeline
+            Clock::time_point ready = Clock::time_point(std::chrono::nanoseconds(output.front().rx.timestamp_ns)) +
+                                      reorder_window;
+            if (Clock::now() >= ready)
+            {
+                std::pop_heap(output.begin(), output.end(), newerThan);
+                packet = output.back();
+                output.pop_back();
+
+                Member &member = *members[packet.radio];
+                bool was_full = member.queued-- >= max_pending;
+                lock.unlock();
+                if (was_full)
+                {
+                    wakeWorker(*workers[member.worker]);
+                }
+                return true;
+            }
+            wait_until = std::min(wait_until, ready);
+        }
+
+        if (Clock::now() >= deadline)
+        {
+            return false;
+        }
+        output_cv.wait_until(lock, wait_until);
+    }
+}
+
+size_t RadioPool::getPending()
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    return output.size();
+}
+
+void RadioPool::wakeWorker(Worker &worker)
+{
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.wake = true;
+    }
+    worker.cv.notify_one();
+}
+
+void RadioPool::drain(Member &member)
+{
+    bool added = false;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        const RFM95::RxPacket *rx;
+        while (member.queued < max_pending && (rx = member.radio->peekPacket()) != nullptr)
+        {
+            if (capture)
+            {
+                capture->capture(*rx, member.profile, static_cast<uint8_t>(member.index));
+            }
+            output.emplace_back();
+            output.back().rx = *rx;
+            member.radio->releasePacket();
+            output.back().radio = member.index;
+            std::push_heap(output.begin(), output.end(), newerThan);
+            member.queued++;
+            added = true;
+        }
+    }
+    if (added)
+    {
+        output_cv.notify_all();
+    }
+}
+
+void RadioPool::run(Worker &worker, int cpu)
+{
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0)
+        {
+            std::cerr << "Failed to pin pool worker to CPU " << cpu << ": " << std::strerror(ret) << std::endl;
+        }
+    }
+#else
+    (void)cpu;
+#endif
+
+    for (Member *member : worker.members)
+    {
+        member->next_check = Clock::now();
+    }
+
+    while (running)
+    {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = now + std::chrono::milliseconds(IDLE_CHECK_MS);
+        for (Member *member : worker.members)
+        {
+            // An edge or the periodic check, whichever comes first
+            if (member->signalled.exchange(false) || now >= member->next_check)
+            {
+                while (running && member->radio->serviceReceiver())
+                {
+                }
+                int interval = member->radio->getInterruptActive() ? IDLE_CHECK_MS : POLL_INTERVAL_MS;
+                member->next_check = now + std::chrono::milliseconds(interval);
+            }
+            drain(*member);
+            next = std::min(next, member->next_check);
+        }
+
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.cv.wait_until(lock, next, [this, &worker]() { return worker.wake || !running; });
+        worker.wake = false;
+    }
+}
@@ -1,10 +1,25 @@
 #include "SPIInterface.hpp"
 #include "CH341SPI.hpp"
 #include "LinuxSPI.hpp"
+#include "SimulatedSX127x.hpp"
+#include "USBManager.hpp"
 #include <memory>
+#include <mutex>
+#include <iostream>
+#include <cctype>
+#include <algorithm>
 
-std::unique_ptr<SPIInterface> SPIFactory::createCH341SPI(int device_index, bool lsb_first) {
-    return std::make_unique<CH341SPI>(device_index, lsb_first);
+namespace {
+    std::mutex usb_manager_mutex;
+    std::shared_ptr<USBManager> usb_manager;
+}
+
+std::unique_ptr<SPIInterface> SPIFactory::createCH341SPI(int device_index, bool lsb_first, uint32_t speed) {
+    return std::make_unique<CH341SPI>(device_index, lsb_first, CH341SPI::speedForFrequency(speed));
+}
+
+std::unique_ptr<SPIInterface> SPIFactory::createCH341SPI(const std::string& device_path, bool lsb_first, uint32_t speed) {
+    return std::make_unique<CH341SPI>(device_path, lsb_first, CH341SPI::speedForFrequency(speed));
 }
 
 std::unique_ptr<SPIInterface> SPIFactory::createLinuxSPI(const std::string& device, 
@@ -12,3 +27,41 @@ std::unique_ptr<SPIInterface> SPIFactory::createLinuxSPI(const std::string& devi
                                                        uint8_t mode) {
     return std::make_unique<LinuxSPI>(device, speed, mode);
 }
+
+std::unique_ptr<SPIInterface> SPIFactory::createSPIInterface(const std::string& device_type, int device_index, bool lsb_first) {
+    std::string type(device_type);
+    std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (type == "ch341") {
+        return createCH341SPI(device_index, lsb_first);
+    }
+    if (type == "linux" || type == "spidev") {
+        // spidev has no LSB-first mode worth emulating here, the index picks the chip select
+        return createLinuxSPI("/dev/spidev0." + std::to_string(device_index));
+    }
+    if (type == "sim") {
+        return std::make_unique<SimulatedSX127x>();
+    }
+    if (type == "sim-ch341") {
+        return std::make_unique<SimulatedSX127x>(SimulatedSX127x::LatencyModel::ch341());
+    }
+    if (type == "sim-spidev") {
+        return std::make_unique<SimulatedSX127x>(SimulatedSX127x::LatencyModel::spidev());
+    }
+
+    std::cerr << "Unsupported SPI device type: " << device_type << std::endl;
+    return nullptr;
+}
+
+std::shared_ptr<USBManager> SPIFactory::getUSBManager() {
+    std::lock_guard<std::mutex> lock(usb_manager_mutex);
+    if (!usb_manager) {
+        usb_manager = std::make_shared<USBManager>();
+    }
+    return usb_manager;
+}
+
+void SPIFactory::cleanupResources() {
+    std::lock_guard<std::mutex> lock(usb_manager_mutex);
+    usb_manager.reset();
+}
@@ -0,0 +1,864 @@
+/**
+ * @file SimulatedSX127x.cpp
+ * @brief Implementation of the simulated SX127x SPI backend
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "SimulatedSX127x.hpp"
+#include "RadioProfile.hpp"
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+// Register addresses and bits, as in the SX1276 datasheet (LoRa page)
+constexpr uint8_t REG_FIFO = 0x00;
+constexpr uint8_t REG_OP_MODE = 0x01;
+constexpr uint8_t REG_FIFO_ADDR_PTR = 0x0D;
+constexpr uint8_t REG_FIFO_TX_BASE_ADDR = 0x0E;
+constexpr uint8_t REG_FIFO_RX_BASE_ADDR = 0x0F;
+constexpr uint8_t REG_FIFO_RX_CURRENT_ADDR = 0x10;
+constexpr uint8_t REG_IRQ_FLAGS_MASK = 0x11;
+constexpr uint8_t REG_IRQ_FLAGS = 0x12;
+constexpr uint8_t REG_RX_NB_BYTES = 0x13;
+constexpr uint8_t REG_RX_HEADER_CNT_MSB = 0x14;
+constexpr uint8_t REG_RX_PACKET_CNT_MSB = 0x16;
+constexpr uint8_t REG_MODEM_STAT = 0x18;
+constexpr uint8_t REG_PKT_SNR_VALUE = 0x19;
+constexpr uint8_t REG_PKT_RSSI_VALUE = 0x1A;
+constexpr uint8_t REG_RSSI_VALUE = 0x1B;
+constexpr uint8_t REG_HOP_CHANNEL = 0x1C;
+constexpr uint8_t REG_MODEM_CONFIG_1 = 0x1D;
+constexpr uint8_t REG_MODEM_CONFIG_2 = 0x1E;
+constexpr uint8_t REG_SYMB_TIMEOUT_LSB = 0x1F;
+constexpr uint8_t REG_PREAMBLE_MSB = 0x20;
+constexpr uint8_t REG_PREAMBLE_LSB = 0x21;
+constexpr uint8_t REG_PAYLOAD_LENGTH = 0x22;
+constexpr uint8_t REG_FIFO_RX_BYTE_ADDR = 0x25;
+constexpr uint8_t REG_MODEM_CONFIG_3 = 0x26;
+constexpr uint8_t REG_FEI_MSB = 0x28;
+constexpr uint8_t REG_FEI_MID = 0x29;
+constexpr uint8_t REG_FEI_LSB = 0x2A;
+constexpr uint8_t REG_RSSI_WIDEBAND = 0x2C;
+constexpr uint8_t REG_INVERTIQ = 0x33;
+constexpr uint8_t REG_DIO_MAPPING_1 = 0x40;
+constexpr uint8_t REG_VERSION = 0x42;
+
+constexpr uint8_t MODE_SLEEP = 0x00;
+constexpr uint8_t MODE_STDBY = 0x01;
+constexpr uint8_t MODE_TX = 0x03;
+constexpr uint8_t MODE_RX_CONTINUOUS = 0x05;
+constexpr uint8_t MODE_RX_SINGLE = 0x06;
+constexpr uint8_t MODE_CAD = 0x07;
+
+constexpr uint8_t IRQ_RX_TIMEOUT = 0x80;
+constexpr uint8_t IRQ_RX_DONE = 0x40;
+constexpr uint8_t IRQ_PAYLOAD_CRC_ERROR = 0x20;
+constexpr uint8_t IRQ_VALID_HEADER = 0x10;
+constexpr uint8_t IRQ_TX_DONE = 0x08;
+constexpr uint8_t IRQ_CAD_DONE = 0x04;
+constexpr uint8_t IRQ_CAD_DETECTED = 0x01;
+
+// Noise floor reported by RegRssiValue on a quiet channel
+constexpr float NOISE_FLOOR_DBM = -125.0f;
+
+// Beyond this, chargeLatency() sleeps instead of spinning for all of it
+constexpr uint64_t SPIN_LIMIT_NS = 2000000;
+
+uint64_t steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint8_t clampByte(float value)
+{
+    return static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, std::round(value))));
+}
+}
+
+SimulatedSX127x::SimulatedSX127x(const LatencyModel &latency)
+    : rx_write(0),
+      mode_event_ns(0),
+      mode_start_ns(0),
+      channel_busy(false),
+      dio0(false),
+      noise(1),
+      airtime_scale(1.0),
+      latency(latency),
+      opened(false),
+      pin_state(0),
+      interrupt_pin(-1),
+      interrupt_edge(InterruptEdge::None),
+      interrupt_running(false)
+{
+    reset();
+}
+
+SimulatedSX127x::~SimulatedSX127x()
+{
+    enableInterrupt(false);
+}
+
+bool SimulatedSX127x::open()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    opened = true;
+    return true;
+}
+
+void SimulatedSX127x::close()
+{
+    enableInterrupt(false);
+    std::lock_guard<std::mutex> lock(mutex);
+    opened = false;
+}
+
+std::vector<uint8_t> SimulatedSX127x::transfer(const std::vector<uint8_t> &write_data, size_t read_length)
+{
+    std::vector<uint8_t> result(read_length);
+    if (!transfer(write_data.data(), write_data.size(), result.data(), read_length))
+    {
+        return std::vector<uint8_t>();
+    }
+    return result;
+}
+
+bool SimulatedSX127x::transfer(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!isActive())
+    {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    chargeLatency(tx_len + rx_len);
+
+    std::vector<Transmission> delivered;
+    std::unique_lock<std::mutex> lock(mutex);
+    execute(tx, tx_len, rx, rx_len, delivered);
+    deliver(lock, delivered);
+    lock.unlock();
+
+    stats.transactions.add();
+    stats.bytes_out.add(tx_len);
+    stats.bytes_in.add(rx_len);
+    stats.transaction_latency.recordSince(start);
+    return true;
+}
+
+bool SimulatedSX127x::transferBatch(const Transaction *transactions, size_t count)
+{
+    if (!isActive())
+    {
+        return false;
+    }
+
+    // One submission, like the CH341 packing a whole batch into one USB transfer
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes_out = 0;
+    size_t bytes_in = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        bytes_out += transactions[i].tx_len;
+        bytes_in += transactions[i].rx_len;
+    }
+    chargeLatency(bytes_out + bytes_in);
+
+    std::vector<Transmission> delivered;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++)
+    {
+        const Transaction &t = transactions[i];
+        execute(t.tx, t.tx_len, t.rx, t.rx_len, delivered);
+    }
+    deliver(lock, delivered);
+    lock.unlock();
+
+    stats.transactions.add(count);
+    stats.bytes_out.add(bytes_out);
+    stats.bytes_in.add(bytes_in);
+    stats.transaction_latency.recordSince(start);
+    return true;
+}
+
+bool SimulatedSX127x::digitalWrite(uint8_t pin, bool value)
+{
+    if (pin > 7)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pin_state = value ? (pin_state | (1 << pin)) : (pin_state & ~(1 << pin));
+    return true;
+}
+
+bool SimulatedSX127x::digitalRead(uint8_t pin)
+{
+    std::vector<Transmission> delivered;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (static_cast<int>(pin) == interrupt_pin)
+    {
+        advance(steadyNowNs(), delivered);
+        bool level = dio0;
+        deliver(lock, delivered);
+        return level;
+    }
+    return pin < 8 && (pin_state & (1 << pin)) != 0;
+}
+
+bool SimulatedSX127x::pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)mode;
+    return pin < 8;
+}
+
+bool SimulatedSX127x::configureInterrupt(uint8_t pin, bool enable)
+{
+    return configureInterrupt(pin, enable ? InterruptEdge::Rising : InterruptEdge::None);
+}
+
+bool SimulatedSX127x::configureInterrupt(uint8_t pin, InterruptEdge edge)
+{
+    if (pin > 7)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    interrupt_pin = edge == InterruptEdge::None ? -1 : pin;
+    interrupt_edge = edge;
+    return true;
+}
+
+bool SimulatedSX127x::setInterruptCallback(InterruptCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    interrupt_callback = std::move(callback);
+    return true;
+}
+
+bool SimulatedSX127x::setInterruptEventCallback(InterruptEventCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    interrupt_event_callback = std::move(callback);
+    return true;
+}
+
+bool SimulatedSX127x::enableInterrupt(bool enable)
+{
+    if (!enable)
+    {
+        if (interrupt_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                interrupt_running = false;
+            }
+            cv.notify_all();
+            interrupt_thread.join();
+        }
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (interrupt_pin < 0)
+        {
+            return false;
+        }
+    }
+    if (!interrupt_thread.joinable())
+    {
+        interrupt_running = true;
+        interrupt_thread = std::thread(&SimulatedSX127x::interruptThread, this);
+    }
+    return true;
+}
+
+bool SimulatedSX127x::isActive() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return opened;
+}
+
+void SimulatedSX127x::setLatencyModel(const LatencyModel &model)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    latency = model;
+}
+
+void SimulatedSX127x::setAirtimeScale(double scale)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    airtime_scale = std::max(0.0, scale);
+}
+
+bool SimulatedSX127x::injectPacket(const uint8_t *data, size_t length, const InjectOptions &options)
+{
+    if (length > 255)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        OnAir packet;
+        packet.data.assign(data, data + length);
+        packet.options = options;
+        packet.start_ns = options.start_ns ? options.start_ns : steadyNowNs() + options.delay.count() * 1000;
+        packet.end_ns = packet.start_ns + scaled(timeOnAirNs(length));
+
+        auto position = std::upper_bound(on_air.begin(), on_air.end(), packet.end_ns,
+                                         [](uint64_t end, const OnAir &other) { return end < other.end_ns; });
+        on_air.insert(position, std::move(packet));
+    }
+    cv.notify_all();
+    return true;
+}
+
+void SimulatedSX127x::setChannelBusy(bool busy)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    channel_busy = busy;
+}
+
+void SimulatedSX127x::setTransmitCallback(TransmitCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    transmit_callback = std::move(callback);
+}
+
+std::vector<SimulatedSX127x::Transmission> SimulatedSX127x::takeTransmissions()
+{
+    std::vector<Transmission> delivered;
+    std::vector<Transmission> result;
+    std::unique_lock<std::mutex> lock(mutex);
+    advance(steadyNowNs(), delivered);
+    result.swap(transmissions);
+    deliver(lock, delivered);
+    return result;
+}
+
+void SimulatedSX127x::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Power-on values of the LoRa register page
+    std::memset(regs, 0, sizeof(regs));
+    regs[REG_OP_MODE] = 0x09;
+    regs[0x06] = 0x6C;
+    regs[0x07] = 0x80;
+    regs[0x09] = 0x4F;
+    regs[0x0A] = 0x09;
+    regs[0x0B] = 0x2B;
+    regs[0x0C] = 0x20;
+    regs[REG_FIFO_TX_BASE_ADDR] = 0x80;
+    regs[REG_MODEM_CONFIG_1] = 0x72;
+    regs[REG_MODEM_CONFIG_2] = 0x70;
+    regs[REG_SYMB_TIMEOUT_LSB] = 0x64;
+    regs[REG_PREAMBLE_LSB] = 0x08;
+    regs[REG_PAYLOAD_LENGTH] = 0x01;
+    regs[0x23] = 0xFF;
+    regs[REG_MODEM_CONFIG_3] = 0x04;
+    regs[0x31] = 0xC3;
+    regs[REG_INVERTIQ] = 0x27;
+    regs[0x37] = 0x0A;
+    regs[0x39] = 0x12;
+    regs[0x3B] = 0x1D;
+    regs[REG_VERSION] = 0x12;
+    regs[0x44] = 0x2D;
+    regs[0x4B] = 0x09;
+    regs[0x4D] = 0x84;
+
+    std::memset(fifo, 0, sizeof(fifo));
+    rx_write = 0;
+    mode_event_ns = 0;
+    mode_start_ns = steadyNowNs();
+    on_air.clear();
+    dio0 = false;
+}
+
+uint8_t SimulatedSX127x::peekRegister(uint8_t address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return regs[address & 0x7F];
+}
+
+uint64_t SimulatedSX127x::getTransferCount() const
+{
+    return stats.transactions.get();
+}
+
+uint64_t SimulatedSX127x::getByteCount() const
+{
+    return stats.bytes_out.get() + stats.bytes_in.get();
+}
+
+void SimulatedSX127x::chargeLatency(size_t bytes)
+{
+    LatencyModel model;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        model = latency;
+    }
+    uint64_t cost = model.transfer_ns + static_cast<uint64_t>(model.byte_ns) * bytes;
+    if (cost == 0)
+    {
+        return;
+    }
+
+    // sleep_for overshoots by tens of microseconds, so only the bulk of long waits sleeps
+    uint64_t deadline = steadyNowNs() + cost;
+    if (cost > SPIN_LIMIT_NS)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(cost - SPIN_LIMIT_NS / 2));
+    }
+    while (steadyNowNs() < deadline)
+    {
+    }
+}
+
+void SimulatedSX127x::execute(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len,
+                              std::vector<Transmission> &delivered)
+{
+    if (tx_len == 0)
+    {
+        return;
+    }
+
+    uint64_t now = steadyNowNs();
+    advance(now, delivered);
+
+    // The address auto-increments on every byte, except on the FIFO
+    uint8_t address = tx[0] & 0x7F;
+    bool write = (tx[0] & 0x80) != 0;
+    for (size_t i = 1; i < tx_len; i++)
+    {
+        if (write)
+        {
+            writeRegister(address, tx[i], now);
+        }
+        if (address != REG_FIFO)
+        {
+            address = (address + 1) & 0x7F;
+        }
+    }
+    for (size_t i = 0; i < rx_len; i++)
+    {
+        rx[i] = write ? 0 : readRegister(address, now);
+        if (address != REG_FIFO)
+        {
+            address = (address + 1) & 0x7F;
+        }
+    }
+
+    // A mode change may already be complete, e.g. with an airtime scale of 0
+    advance(now, delivered);
+    if (write && interrupt_running)
+    {
+        cv.notify_all();
+    }
+}
+
+uint8_t SimulatedSX127x::readRegister(uint8_t address, uint64_t now)
+{
+    switch (address)
+    {
+    case REG_FIFO:
+        return fifo[regs[REG_FIFO_ADDR_PTR]++];
+    case REG_RSSI_VALUE:
+    {
+        const OnAir *packet = activePacket(now);
+        float rssi = channel_busy ? -60.0f : (packet ? packet->options.rssi : NOISE_FLOOR_DBM);
+        return clampByte(rssi + (frequencyHz() >= 779000000 ? 157.0f : 164.0f));
+    }
+    case REG_MODEM_STAT:
+    {
+        uint8_t m = mode();
+        bool receiving = (m == MODE_RX_CONTINUOUS || m == MODE_RX_SINGLE) && activePacket(now) != nullptr;
+        return receiving ? 0x0B : 0x10;
+    }
+    case REG_RSSI_WIDEBAND:
+        return static_cast<uint8_t>(noise());
+    default:
+        return regs[address];
+    }
+}
+
+void SimulatedSX127x::writeRegister(uint8_t address, uint8_t value, uint64_t now)
+{
+    switch (address)
+    {
+    case REG_FIFO:
+        fifo[regs[REG_FIFO_ADDR_PTR]++] = value;
+        return;
+    case REG_OP_MODE:
+        setOpMode(value, now);
+        updateDio0(now);
+        return;
+    case REG_IRQ_FLAGS:
+        // Write one to clear
+        regs[REG_IRQ_FLAGS] &= ~value;
+        updateDio0(now);
+        return;
+    case REG_IRQ_FLAGS_MASK:
+    case REG_DIO_MAPPING_1:
+        regs[address] = value;
+        updateDio0(now);
+        return;
+    case REG_FIFO_RX_CURRENT_ADDR:
+    case REG_RX_NB_BYTES:
+    case REG_RX_HEADER_CNT_MSB:
+    case REG_RX_HEADER_CNT_MSB + 1:
+    case REG_RX_PACKET_CNT_MSB:
+    case REG_RX_PACKET_CNT_MSB + 1:
+    case REG_MODEM_STAT:
+    case REG_PKT_SNR_VALUE:
+    case REG_PKT_RSSI_VALUE:
+    case REG_RSSI_VALUE:
+    case REG_HOP_CHANNEL:
+    case REG_FIFO_RX_BYTE_ADDR:
+    case REG_FEI_MSB:
+    case REG_FEI_MID:
+    case REG_FEI_LSB:
+    case REG_RSSI_WIDEBAND:
+    case REG_VERSION:
+        // Read-only
+        return;
+    default:
+        regs[address] = value;
+        return;
+    }
+}
+
+void SimulatedSX127x::setOpMode(uint8_t value, uint64_t now)
+{
+    uint8_t old = regs[REG_OP_MODE];
+
+    // LongRangeMode can only be changed in sleep mode
+    if ((old & 0x07) != MODE_SLEEP)
+    {
+        value = (value & 0x7F) | (old & 0x80);
+    }
+    regs[REG_OP_MODE] = value;
+    if (value == old)
+    {
+        return;
+    }
+
+    mode_event_ns = 0;
+    mode_start_ns = now;
+    if (!loraMode())
+    {
+        return;
+    }
+
+    switch (value & 0x07)
+    {
+    case MODE_SLEEP:
+        // The FIFO does not survive sleep
+        std::memset(fifo, 0, sizeof(fifo));
+        break;
+    case MODE_TX:
+        mode_event_ns = now + scaled(timeOnAirNs(regs[REG_PAYLOAD_LENGTH]));
+        break;
+    case MODE_RX_CONTINUOUS:
+        rx_write = regs[REG_FIFO_RX_BASE_ADDR];
+        break;
+    case MODE_RX_SINGLE:
+    {
+        rx_write = regs[REG_FIFO_RX_BASE_ADDR];
+        uint64_t symbols = (static_cast<uint64_t>(regs[REG_MODEM_CONFIG_2] & 0x03) << 8) | regs[REG_SYMB_TIMEOUT_LSB];
+        mode_event_ns = now + scaled(symbols * symbolNs());
+        break;
+    }
+    case MODE_CAD:
+    {
+        // About (2^SF + 32) / BW: one symbol plus processing
+        uint8_t sf = (regs[REG_MODEM_CONFIG_2] >> 4) & 0x0F;
+        uint64_t divisor = RadioProfile::bandwidthDivisor((regs[REG_MODEM_CONFIG_1] >> 4) & 0x0F);
+        mode_event_ns = now + scaled((static_cast<uint64_t>(1u << sf) + 32) * divisor * 2000);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void SimulatedSX127x::advance(uint64_t now, std::vector<Transmission> &delivered)
+{
+    while (true)
+    {
+        uint64_t packet_end = on_air.empty() ? std::numeric_limits<uint64_t>::max() : on_air.front().end_ns;
+        uint64_t event = mode_event_ns ? mode_event_ns : std::numeric_limits<uint64_t>::max();
+        if (std::min(packet_end, event) > now)
+        {
+            return;
+        }
+
+        if (event <= packet_end)
+        {
+            mode_event_ns = 0;
+            switch (mode())
+            {
+            case MODE_TX:
+            {
+                Transmission sent;
+                uint8_t length = regs[REG_PAYLOAD_LENGTH];
+                sent.data.resize(length);
+                for (uint8_t i = 0; i < length; i++)
+                {
+                    sent.data[i] = fifo[static_cast<uint8_t>(regs[REG_FIFO_TX_BASE_ADDR] + i)];
+                }
+                sent.frequency_hz = frequencyHz();
+                sent.modem_config[0] = regs[REG_MODEM_CONFIG_1];
+                sent.modem_config[1] = regs[REG_MODEM_CONFIG_2];
+                sent.modem_config[2] = regs[REG_MODEM_CONFIG_3];
+                sent.invert_iq = (regs[REG_INVERTIQ] & 0x01) != 0;
+                sent.start_ns = mode_start_ns;
+                sent.end_ns = event;
+                transmissions.push_back(sent);
+                delivered.push_back(std::move(sent));
+                regs[REG_IRQ_FLAGS] |= IRQ_TX_DONE;
+                break;
+            }
+            case MODE_CAD:
+                regs[REG_IRQ_FLAGS] |= IRQ_CAD_DONE |
+                                       ((channel_busy || activePacket(event)) ? IRQ_CAD_DETECTED : 0);
+                break;
+            case MODE_RX_SINGLE:
+            {
+                // A preamble found within the window keeps the receiver on until the packet ends
+                const OnAir *packet = activePacket(event);
+                if (packet && packet->start_ns >= mode_start_ns)
+                {
+                    continue;
+                }
+                regs[REG_IRQ_FLAGS] |= IRQ_RX_TIMEOUT;
+                break;
+            }
+            default:
+                continue;
+            }
+
+            // TX, CAD and single RX fall back to standby by themselves
+            regs[REG_OP_MODE] = (regs[REG_OP_MODE] & 0xF8) | MODE_STDBY;
+            mode_start_ns = event;
+            updateDio0(event);
+            continue;
+        }
+
+        OnAir packet = std::move(on_air.front());
+        on_air.pop_front();
+
+        uint8_t m = mode();
+        uint32_t tolerance = RadioProfile::bandwidthHz((regs[REG_MODEM_CONFIG_1] >> 4) & 0x0F) / 4;
+        uint32_t hz = frequencyHz();
+        bool on_channel = packet.options.frequency_hz == 0 ||
+                          (packet.options.frequency_hz > hz ? packet.options.frequency_hz - hz
+                                                            : hz - packet.options.frequency_hz) <= tolerance;
+        // SF6 only demodulates in implicit header mode
+        bool sf6_explicit = ((regs[REG_MODEM_CONFIG_2] >> 4) & 0x0F) == 6 && !(regs[REG_MODEM_CONFIG_1] & 0x01);
+        if (!loraMode() || (m != MODE_RX_CONTINUOUS && m != MODE_RX_SINGLE) || !on_channel ||
+            packet.start_ns < mode_start_ns || sf6_explicit)
+        {
+            continue;
+        }
+
+        receivePacket(packet);
+        if (m == MODE_RX_SINGLE)
+        {
+            regs[REG_OP_MODE] = (regs[REG_OP_MODE] & 0xF8) | MODE_STDBY;
+            mode_event_ns = 0;
+            mode_start_ns = packet.end_ns;
+        }
+        updateDio0(packet.end_ns);
+    }
+}
+
+void SimulatedSX127x::receivePacket(const OnAir &packet)
+{
+    // Without a header the modem takes RegPayloadLength bytes, whatever was sent
+    bool implicit_header = (regs[REG_MODEM_CONFIG_1] & 0x01) != 0;
+    uint8_t length = implicit_header ? regs[REG_PAYLOAD_LENGTH] : static_cast<uint8_t>(packet.data.size());
+    regs[REG_FIFO_RX_CURRENT_ADDR] = rx_write;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        fifo[rx_write++] = i < packet.data.size() ? packet.data[i] : 0;
+    }
+    regs[REG_FIFO_RX_BYTE_ADDR] = rx_write;
+    regs[REG_RX_NB_BYTES] = length;
+
+    if (!implicit_header)
+    {
+        uint16_t headers = ((regs[REG_RX_HEADER_CNT_MSB] << 8) | regs[REG_RX_HEADER_CNT_MSB + 1]) + 1;
+        regs[REG_RX_HEADER_CNT_MSB] = headers >> 8;
+        regs[REG_RX_HEADER_CNT_MSB + 1] = headers & 0xFF;
+
+        // CrcOnPayload comes from the received header
+        regs[REG_HOP_CHANNEL] = (regs[REG_HOP_CHANNEL] & ~0x40) | (packet.options.crc_on_payload ? 0x40 : 0);
+    }
+    if (!packet.options.crc_error)
+    {
+        uint16_t packets = ((regs[REG_RX_PACKET_CNT_MSB] << 8) | regs[REG_RX_PACKET_CNT_MSB + 1]) + 1;
+        regs[REG_RX_PACKET_CNT_MSB] = packets >> 8;
+        regs[REG_RX_PACKET_CNT_MSB + 1] = packets & 0xFF;
+    }
+
+    // PacketRssi = offset + PktRssi, with the SNR added when it is negative
+    float snr = std::min(31.75f, std::max(-32.0f, packet.options.snr));
+    regs[REG_PKT_SNR_VALUE] = static_cast<uint8_t>(static_cast<int8_t>(std::round(snr * 4)));
+    float offset = frequencyHz() >= 779000000 ? 157.0f : 164.0f;
+    float reported_snr = static_cast<int8_t>(regs[REG_PKT_SNR_VALUE]) * 0.25f;
+    regs[REG_PKT_RSSI_VALUE] = clampByte(packet.options.rssi + offset - (reported_snr < 0 ? reported_snr : 0.0f));
+
+    // FreqError = Ferr * Fxtal / 2^24 * 500 kHz / BW, 20-bit two's complement
+    uint32_t divisor = RadioProfile::bandwidthDivisor((regs[REG_MODEM_CONFIG_1] >> 4) & 0x0F);
+    int32_t fei = static_cast<int32_t>(std::round(packet.options.freq_error_hz * (32e6 / 16777216.0) * divisor));
+    uint32_t raw = static_cast<uint32_t>(fei) & 0xFFFFF;
+    regs[REG_FEI_MSB] = (raw >> 16) & 0x0F;
+    regs[REG_FEI_MID] = (raw >> 8) & 0xFF;
+    regs[REG_FEI_LSB] = raw & 0xFF;
+
+    regs[REG_IRQ_FLAGS] |= IRQ_RX_DONE | (implicit_header ? 0 : IRQ_VALID_HEADER) |
+                           (packet.options.crc_error ? IRQ_PAYLOAD_CRC_ERROR : 0);
+}
+
+void SimulatedSX127x::updateDio0(uint64_t when)
+{
+    // Mapping 00 RxDone, 01 TxDone, 10 CadDone; masked flags do not reach the pin
+    static const uint8_t sources[4] = {IRQ_RX_DONE, IRQ_TX_DONE, IRQ_CAD_DONE, 0};
+    uint8_t source = sources[regs[REG_DIO_MAPPING_1] >> 6];
+    bool level = (regs[REG_IRQ_FLAGS] & source & ~regs[REG_IRQ_FLAGS_MASK]) != 0;
+    if (level == dio0)
+    {
+        return;
+    }
+    dio0 = level;
+
+    bool wanted = interrupt_edge == InterruptEdge::Both ||
+                  (level ? interrupt_edge == InterruptEdge::Rising : interrupt_edge == InterruptEdge::Falling);
+    if (interrupt_pin >= 0 && wanted && interrupt_running)
+    {
+        edges.push_back(InterruptEvent{static_cast<uint8_t>(interrupt_pin), level, when, 0});
+        cv.notify_all();
+    }
+}
+
+const SimulatedSX127x::OnAir *SimulatedSX127x::activePacket(uint64_t now) const
+{
+    uint32_t hz = frequencyHz();
+    uint32_t tolerance = RadioProfile::bandwidthHz((regs[REG_MODEM_CONFIG_1] >> 4) & 0x0F) / 4;
+    for (const OnAir &packet : on_air)
+    {
+        uint32_t f = packet.options.frequency_hz;
+        bool on_channel = f == 0 || (f > hz ? f - hz : hz - f) <= tolerance;
+        if (on_channel && packet.start_ns <= now && now < packet.end_ns)
+        {
+            return &packet;
+        }
+    }
+    return nullptr;
+}
+
+bool SimulatedSX127x::loraMode() const
+{
+    return (regs[REG_OP_MODE] & 0x80) != 0;
+}
+
+uint8_t SimulatedSX127x::mode() const
+{
+    return regs[REG_OP_MODE] & 0x07;
+}
+
+uint32_t SimulatedSX127x::frequencyHz() const
+{
+    return Frf{{regs[0x06], regs[0x07], regs[0x08]}}.toHz();
+}
+
+uint64_t SimulatedSX127x::scaled(uint64_t duration_ns) const
+{
+    return static_cast<uint64_t>(duration_ns * airtime_scale);
+}
+
+uint64_t SimulatedSX127x::symbolNs() const
+{
+    uint8_t sf = (regs[REG_MODEM_CONFIG_2] >> 4) & 0x0F;
+    return static_cast<uint64_t>(RadioProfile::symbolUs(sf, (regs[REG_MODEM_CONFIG_1] >> 4) & 0x0F)) * 1000;
+}
+
+uint64_t SimulatedSX127x::timeOnAirNs(size_t payload_length) const
+{
+    uint16_t preamble = static_cast<uint16_t>((regs[REG_PREAMBLE_MSB] << 8) | regs[REG_PREAMBLE_LSB]);
+    return static_cast<uint64_t>(RadioProfile::timeOnAirUs(regs[REG_MODEM_CONFIG_1], regs[REG_MODEM_CONFIG_2],
+                                                           regs[REG_MODEM_CONFIG_3], preamble, payload_length)) * 1000;
+}
+
+void SimulatedSX127x::deliver(std::unique_lock<std::mutex> &lock, std::vector<Transmission> &delivered)
+{
+    if (delivered.empty() || !transmit_callback)
+    {
+        return;
+    }
+
+    TransmitCallback callback = transmit_callback;
+    lock.unlock();
+    for (const Transmission &sent : delivered)
+    {
+        callback(sent);
+    }
+    lock.lock();
+}
+
+void SimulatedSX127x::interruptThread()
+{
+    std::vector<Transmission> delivered;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (interrupt_running)
+    {
+        advance(steadyNowNs(), delivered);
+        deliver(lock, delivered);
+        delivered.clear();
+
+        if (!edges.empty())
+        {
+            std::vector<InterruptEvent> pending;
+            pending.swap(edges);
+            InterruptEventCallback event_callback = interrupt_event_callback;
+            InterruptCallback callback = interrupt_callback;
+            lock.unlock();
+            for (const InterruptEvent &event : pending)
+            {
+                if (event_callback)
+                {
+                    event_callback(event);
+                }
+                else if (callback)
+                {
+                    callback();
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        // Sleep until the next mode event or end of packet, or until something changes
+        uint64_t next = mode_event_ns ? mode_event_ns : std::numeric_limits<uint64_t>::max();
+        if (!on_air.empty())
+        {
+            next = std::min(next, on_air.front().end_ns);
+        }
+        uint64_t now = steadyNowNs();
+        uint64_t wait = next > now ? std::min<uint64_t>(next - now, 100000000) : 0;
+        if (wait > 0)
+        {
+            cv.wait_for(lock, std::chrono::nanoseconds(wait));
+        }
+    }
+}
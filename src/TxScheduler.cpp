@@ -0,0 +1,356 @@
+/**
+ * @file TxScheduler.cpp
+ * @brief Implementation of the duty-cycle aware transmission scheduler
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "TxScheduler.hpp"
+#include <cstring>
+#include <iostream>
+
+constexpr size_t TxScheduler::QUEUE_SIZE;
+constexpr size_t TxScheduler::MAX_CHANNELS;
+constexpr uint32_t TxScheduler::ALL_CHANNELS;
+
+TxScheduler::TxScheduler(RFM95 &radio, std::chrono::seconds window)
+    : radio(radio),
+      window(window),
+      preamble_length(8),
+      running(false)
+{
+    pending.reserve(QUEUE_SIZE);
+}
+
+TxScheduler::~TxScheduler()
+{
+    stop();
+}
+
+size_t TxScheduler::addSubBand(uint32_t low_hz, uint32_t high_hz, float duty_cycle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Band band;
+    band.limits = SubBand{low_hz, high_hz, duty_cycle};
+    band.used_us = 0;
+    bands.push_back(band);
+    return bands.size() - 1;
+}
+
+void TxScheduler::addEU868SubBands()
+{
+    addSubBand(863000000, 865000000, 0.001f);
+    addSubBand(865000000, 868000000, 0.01f);
+    addSubBand(868000000, 868600000, 0.01f);
+    addSubBand(868700000, 869200000, 0.001f);
+    addSubBand(869400000, 869650000, 0.1f);
+    addSubBand(869700000, 870000000, 0.01f);
+}
+
+int TxScheduler::addChannel(const RadioProfile &profile)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (channels.size() >= MAX_CHANNELS)
+    {
+        std::cerr << "Too many scheduler channels" << std::endl;
+        return -1;
+    }
+
+    // 865 MHz belongs to both neighbouring ranges, the first match wins
+    uint32_t hz = profile.frf.toHz();
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        if (hz >= bands[i].limits.low_hz && hz <= bands[i].limits.high_hz)
+        {
+            channels.push_back(Channel{profile, i});
+            return static_cast<int>(channels.size() - 1);
+        }
+    }
+
+    std::cerr << "No sub-band contains " << hz << " Hz" << std::endl;
+    return -1;
+}
+
+void TxScheduler::setPreambleLength(uint16_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    preamble_length = length;
+}
+
+bool TxScheduler::start()
+{
+    if (worker.joinable())
+    {
+        return true;
+    }
+
+    if (!radio.startTxQueue())
+    {
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&TxScheduler::run, this);
+    return true;
+}
+
+void TxScheduler::stop()
+{
+    if (!worker.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+    worker.join();
+
+    std::vector<Pending> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dropped.swap(pending);
+        pending.reserve(QUEUE_SIZE);
+    }
+    for (Pending &packet : dropped)
+    {
+        if (packet.callback)
+        {
+            packet.callback(false);
+        }
+    }
+}
+
+bool TxScheduler::schedule(const uint8_t *data, size_t length, RFM95::TxCallback callback,
+                           uint32_t channel_mask, const RFM95::TxOptions &options)
+{
+    if (length > 255)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t known = channels.size() >= 32 ? ALL_CHANNELS : (1u << channels.size()) - 1;
+        if ((channel_mask & known) == 0 || pending.size() >= QUEUE_SIZE)
+        {
+            return false;
+        }
+
+        pending.emplace_back();
+        Pending &packet = pending.back();
+        std::memcpy(packet.data, data, length);
+        packet.length = static_cast<uint8_t>(length);
+        packet.channels = channel_mask & known;
+        packet.options = options;
+        packet.callback = std::move(callback);
+    }
+    cv.notify_all();
+    return true;
+}
+
+TxScheduler::Clock::time_point TxScheduler::nextAvailable(int channel, size_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (channel < 0 || channel >= static_cast<int>(channels.size()))
+    {
+        return Clock::time_point::max();
+    }
+
+    Clock::time_point now = Clock::now();
+    Band &band = bands[channels[channel].band];
+    prune(band, now);
+    return earliest(band, channels[channel].profile.timeOnAirUs(length, preamble_length), now);
+}
+
+float TxScheduler::getUtilization(size_t sub_band)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sub_band >= bands.size())
+    {
+        return 0.0f;
+    }
+
+    Band &band = bands[sub_band];
+    prune(band, Clock::now());
+    uint64_t allowed = budget(band);
+    return allowed ? static_cast<float>(band.used_us) / allowed : 1.0f;
+}
+
+size_t TxScheduler::getPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+void TxScheduler::prune(Band &band, Clock::time_point now)
+{
+    // A transmission leaves the window once its last microsecond does
+    while (!band.usage.empty())
+    {
+        const Usage &usage = band.usage.front();
+        if (usage.start + std::chrono::microseconds(usage.airtime_us) + window > now)
+        {
+            break;
+        }
+        band.used_us -= usage.airtime_us;
+        band.usage.pop_front();
+    }
+}
+
+TxScheduler::Clock::time_point TxScheduler::earliest(const Band &band, uint32_t airtime_us,
+                                                     Clock::time_point now) const
+{
+    uint64_t allowed = budget(band);
+    if (airtime_us > allowed)
+    {
+        return Clock::time_point::max();
+    }
+    if (band.used_us + airtime_us <= allowed)
+    {
+        return now;
+    }
+
+    // Wait for enough of the oldest transmissions to leave the window
+    uint64_t excess = band.used_us + airtime_us - allowed;
+    uint64_t freed = 0;
+    for (const Usage &usage : band.usage)
+    {
+        freed += usage.airtime_us;
+        if (freed >= excess)
+        {
+            return usage.start + std::chrono::microseconds(usage.airtime_us) + window;
+        }
+    }
+    return now;
+}
+
+uint64_t TxScheduler::budget(const Band &band) const
+{
+    return static_cast<uint64_t>(window.count() * static_cast<double>(band.limits.duty_cycle));
+}
+
+void TxScheduler::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        if (pending.empty())
+        {
+            cv.wait(lock, [this]() { return !running || !pending.empty(); });
+            continue;
+        }
+
+        // Usage is accounted from dispatch, so only hand over a packet when it goes on air at once
+        if (radio.getTxPending() != 0)
+        {
+            lock.unlock();
+            radio.waitTxIdle(0.1f);
+            lock.lock();
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        for (Band &band : bands)
+        {
+            prune(band, now);
+        }
+
+        // Earliest packet and channel; on ties the older packet and lower channel win
+        size_t best_packet = 0;
+        size_t best_channel = 0;
+        uint32_t best_airtime = 0;
+        Clock::time_point best_time = Clock::time_point::max();
+        std::vector<RFM95::TxCallback> rejected;
+        for (size_t i = 0; i < pending.size();)
+        {
+            Clock::time_point packet_time = Clock::time_point::max();
+            for (size_t c = 0; c < channels.size(); c++)
+            {
+                if (!(pending[i].channels & (1u << c)))
+                {
+                    continue;
+                }
+                uint32_t airtime = channels[c].profile.timeOnAirUs(pending[i].length, preamble_length);
+                Clock::time_point time = earliest(bands[channels[c].band], airtime, now);
+                if (time < packet_time)
+                {
+                    packet_time = time;
+                }
+                if (time < best_time)
+                {
+                    best_time = time;
+                    best_packet = i;
+                    best_channel = c;
+                    best_airtime = airtime;
+                }
+            }
+
+            // Longer than the whole budget of every allowed channel: it can never be sent
+            if (packet_time == Clock::time_point::max())
+            {
+                rejected.push_back(std::move(pending[i].callback));
+                pending.erase(pending.begin() + i);
+                if (best_time != Clock::time_point::max() && best_packet > i)
+                {
+                    best_packet--;
+                }
+                continue;
+            }
+            i++;
+        }
+
+        if (!rejected.empty())
+        {
+            lock.unlock();
+            for (RFM95::TxCallback &callback : rejected)
+            {
+                if (callback)
+                {
+                    callback(false);
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (best_time > now)
+        {
+            // New packets may fit a channel that is free sooner, so wake for them too
+            size_t queued = pending.size();
+            cv.wait_until(lock, best_time, [this, queued]() { return !running || pending.size() != queued; });
+            continue;
+        }
+
+        Pending packet = std::move(pending[best_packet]);
+        pending.erase(pending.begin() + best_packet);
+
+        Band &band = bands[channels[best_channel].band];
+        band.usage.push_back(Usage{now, best_airtime});
+        band.used_us += best_airtime;
+
+        RFM95::TxOptions options = packet.options;
+        options.use_profile = true;
+        options.profile = channels[best_channel].profile;
+        RFM95::TxCallback callback = packet.callback;
+        lock.unlock();
+        bool queued = radio.enqueue(packet.data, packet.length, options, std::move(packet.callback));
+        lock.lock();
+
+        if (!queued)
+        {
+            // Nothing went on air, give the airtime back (the worker is the only writer of usage)
+            band.usage.pop_back();
+            band.used_us -= best_airtime;
+            lock.unlock();
+            if (callback)
+            {
+                callback(false);
+            }
+            lock.lock();
+        }
+    }
+}
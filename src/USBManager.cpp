@@ -0,0 +1,352 @@
+/**
+ * @file USBManager.cpp
+ * @brief Implementation of the process-wide libusb context and CH341 device cache.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "USBManager.hpp"
+#include "CH341Config.hpp"
+#include <iostream>
+#include <algorithm>
+
+USBManager::USBManager()
+    : context(nullptr),
+      hotplug_handle(),
+      hotplug_registered(false),
+      event_running(false)
+{
+    int ret = libusb_init(&context);
+    if (ret != 0)
+    {
+        std::cerr << "Failed to initialize libusb: " << libusb_error_name(ret) << std::endl;
+        context = nullptr;
+        return;
+    }
+
+    // With ENUMERATE the callback also reports the devices already attached
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+    {
+        ret = libusb_hotplug_register_callback(context,
+                                               LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                               LIBUSB_HOTPLUG_ENUMERATE,
+                                               CH341Config::VENDOR_ID, CH341Config::PRODUCT_ID,
+                                               LIBUSB_HOTPLUG_MATCH_ANY,
+                                               &USBManager::hotplugCallback, this, &hotplug_handle);
+        hotplug_registered = ret == LIBUSB_SUCCESS;
+    }
+    if (!hotplug_registered)
+    {
+        refresh();
+    }
+
+    event_running = true;
+    event_thread = std::thread(&USBManager::eventLoop, this);
+}
+
+USBManager::~USBManager()
+{
+    event_running = false;
+    if (event_thread.joinable())
+    {
+        event_thread.join();
+    }
+
+    if (context)
+    {
+        if (hotplug_registered)
+        {
+            libusb_hotplug_deregister_callback(context, hotplug_handle);
+            hotplug_registered = false;
+        }
+        clearDevices();
+        libusb_exit(context);
+        context = nullptr;
+    }
+}
+
+std::vector<USBManager::DeviceInfo> USBManager::listDevices()
+{
+    if (!hotplug_registered)
+    {
+        refresh();
+    }
+
+    std::vector<DeviceInfo> result;
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (const Entry &entry : devices)
+    {
+        result.push_back(entry.info);
+    }
+    return result;
+}
+
+libusb_device_handle *USBManager::openDevice(int index)
+{
+    if (!context)
+    {
+        std::cerr << "LibUSB not initialized" << std::endl;
+        return nullptr;
+    }
+
+    // Without hotplug events only a miss tells us the cache may be out of date
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        libusb_device *device = nullptr;
+        size_t found = 0;
+        {
+            std::lock_guard<std::mutex> lock(devices_mutex);
+            found = devices.size();
+            if (index >= 0 && index < static_cast<int>(found))
+            {
+                device = libusb_ref_device(devices[index].device);
+            }
+        }
+
+        if (device)
+        {
+            libusb_device_handle *handle = openCached(device);
+            libusb_unref_device(device);
+            return handle;
+        }
+
+        if (attempt == 0 && !hotplug_registered && refresh())
+        {
+            continue;
+        }
+
+        if (found == 0)
+        {
+            std::cerr << "No CH341 devices found" << std::endl;
+        }
+        else
+        {
+            std::cerr << "Device index " << index << " out of range, only "
+                      << found << " devices found" << std::endl;
+        }
+        break;
+    }
+    return nullptr;
+}
+
+libusb_device_handle *USBManager::openDevice(const std::string &id)
+{
+    if (!context)
+    {
+        std::cerr << "LibUSB not initialized" << std::endl;
+        return nullptr;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        libusb_device *device = nullptr;
+        std::vector<libusb_device *> unread;
+        {
+            std::lock_guard<std::mutex> lock(devices_mutex);
+            for (const Entry &entry : devices)
+            {
+                if (entry.info.path == id || (entry.serial_read && entry.info.serial == id))
+                {
+                    device = libusb_ref_device(entry.device);
+                    break;
+                }
+                if (!entry.serial_read)
+                {
+                    unread.push_back(libusb_ref_device(entry.device));
+                }
+            }
+        }
+
+        // Serials need I/O, which must not happen while the hotplug callback could be waiting for the lock
+        for (libusb_device *candidate : unread)
+        {
+            std::string serial;
+            libusb_device_descriptor desc;
+            libusb_device_handle *handle = nullptr;
+            if (!device && libusb_get_device_descriptor(candidate, &desc) == 0 &&
+                libusb_open(candidate, &handle) == 0)
+            {
+                unsigned char text[128];
+                int length = desc.iSerialNumber ?
+                    libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, text, sizeof(text)) : 0;
+                if (length > 0)
+                {
+                    serial.assign(reinterpret_cast<char *>(text), length);
+                }
+                libusb_close(handle);
+
+                std::lock_guard<std::mutex> lock(devices_mutex);
+                for (Entry &entry : devices)
+                {
+                    if (entry.device == candidate)
+                    {
+                        entry.info.serial = serial;
+                        entry.serial_read = true;
+                    }
+                }
+                if (!serial.empty() && serial == id)
+                {
+                    device = libusb_ref_device(candidate);
+                }
+            }
+            libusb_unref_device(candidate);
+        }
+
+        if (device)
+        {
+            libusb_device_handle *handle = openCached(device);
+            libusb_unref_device(device);
+            return handle;
+        }
+
+        if (attempt == 0 && !hotplug_registered && refresh())
+        {
+            continue;
+        }
+        break;
+    }
+
+    std::cerr << "No CH341 device with path or serial " << id << std::endl;
+    return nullptr;
+}
+
+bool USBManager::refresh()
+{
+    if (!context)
+    {
+        return false;
+    }
+
+    libusb_device **device_list;
+    ssize_t count = libusb_get_device_list(context, &device_list);
+    if (count < 0)
+    {
+        std::cerr << "Failed to get device list: " << libusb_error_name(count) << std::endl;
+        return false;
+    }
+
+    clearDevices();
+    for (ssize_t i = 0; i < count; i++)
+    {
+        libusb_device_descriptor desc;
+        if (libusb_get_device_descriptor(device_list[i], &desc) < 0)
+            continue;
+
+        if (desc.idVendor == CH341Config::VENDOR_ID &&
+            desc.idProduct == CH341Config::PRODUCT_ID)
+        {
+            addDevice(device_list[i]);
+        }
+    }
+    libusb_free_device_list(device_list, 1);
+    return true;
+}
+
+void USBManager::addDevice(libusb_device *device)
+{
+    Entry entry;
+    entry.device = device;
+    entry.info.path = devicePath(device);
+    entry.info.bus = libusb_get_bus_number(device);
+    uint8_t ports[8];
+    int depth = libusb_get_port_numbers(device, ports, sizeof(ports));
+    entry.ports.assign(ports, ports + std::max(depth, 0));
+    entry.info.address = libusb_get_device_address(device);
+    entry.serial_read = false;
+
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (const Entry &existing : devices)
+    {
+        if (existing.device == device)
+        {
+            return;
+        }
+    }
+
+    // Keep topology order so an index names the same socket across runs
+    auto position = std::find_if(devices.begin(), devices.end(), [&entry](const Entry &e) {
+        return entry.info.bus < e.info.bus || (entry.info.bus == e.info.bus && entry.ports < e.ports);
+    });
+    libusb_ref_device(device);
+    devices.insert(position, entry);
+}
+
+void USBManager::removeDevice(libusb_device *device)
+{
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (auto it = devices.begin(); it != devices.end(); ++it)
+    {
+        if (it->device == device)
+        {
+            libusb_unref_device(it->device);
+            devices.erase(it);
+            return;
+        }
+    }
+}
+
+void USBManager::clearDevices()
+{
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (Entry &entry : devices)
+    {
+        libusb_unref_device(entry.device);
+    }
+    devices.clear();
+}
+
+libusb_device_handle *USBManager::openCached(libusb_device *device)
+{
+    libusb_device_handle *handle = nullptr;
+    int ret = libusb_open(device, &handle);
+    if (ret != 0)
+    {
+        std::cerr << "Failed to open device: " << libusb_error_name(ret) << std::endl;
+        if (ret == LIBUSB_ERROR_NO_DEVICE)
+        {
+            removeDevice(device);
+        }
+        return nullptr;
+    }
+    return handle;
+}
+
+std::string USBManager::devicePath(libusb_device *device)
+{
+    std::string path = std::to_string(libusb_get_bus_number(device));
+
+    uint8_t ports[8];
+    int depth = libusb_get_port_numbers(device, ports, sizeof(ports));
+    for (int i = 0; i < depth; i++)
+    {
+        path += (i == 0 ? '-' : '.');
+        path += std::to_string(ports[i]);
+    }
+    return path;
+}
+
+void USBManager::eventLoop()
+{
+    while (event_running)
+    {
+        struct timeval tv = {0, static_cast<long>(CH341Config::EVENT_LOOP_TIMEOUT_MS * 1000)};
+        libusb_handle_events_timeout_completed(context, &tv, nullptr);
+    }
+}
+
+int LIBUSB_CALL USBManager::hotplugCallback(libusb_context *ctx, libusb_device *device,
+                                            libusb_hotplug_event event, void *user_data)
+{
+    (void)ctx;
+    USBManager *manager = static_cast<USBManager *>(user_data);
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+    {
+        manager->addDevice(device);
+    }
+    else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT)
+    {
+        manager->removeDevice(device);
+    }
+    return 0; // Stay registered
+}
@@ -0,0 +1,95 @@
+/**
+ * @file adr_test.cpp
+ * @brief Checks the adaptive data rate selection against simulated links
+ *
+ * Packets are injected into the simulated SX127x with a known RSSI and SNR,
+ * drained by the RX engine and observed as RxPackets, so the check covers
+ * the driver's signal decoding as well as the selection. Both links with a
+ * saturated SNR depend on the RSSI estimate: the first one only reaches the
+ * low power profile through it, and the second one would too if the RSSI
+ * were read a few dB high. The exit status is non-zero if a link ends up on
+ * another profile than expected.
+ *
+ * @author Sergio Pérez
+ * @date 2025
+ */
+
+#include "RFM95.hpp"
+#include "SimulatedSX127x.hpp"
+#include "AdaptiveDataRate.hpp"
+#include <iostream>
+#include <memory>
+
+int main()
+{
+    struct Link
+    {
+        float rssi_dbm;
+        float snr_db;
+        int sf;
+        int power_dbm;
+    };
+    const Link links[] = {
+        {-70.0f, 9.5f, 7, 2},
+        {-108.5f, 8.5f, 7, 14},
+        {-110.0f, -5.0f, 9, 14},
+        {-120.0f, -14.0f, 12, 14},
+    };
+
+    SimulatedSX127x *sim = new SimulatedSX127x();
+    RFM95 radio{std::unique_ptr<SPIInterface>(sim)};
+    if (!radio.begin())
+    {
+        std::cerr << "adr: begin() failed" << std::endl;
+        return 1;
+    }
+    radio.setFrequency(868.1);
+    sim->setAirtimeScale(0.0);
+    radio.startRxEngine(false);
+
+    AdaptiveDataRate adr;
+    adr.addLadder(868100000, 125000, 7, 12, 14);
+    adr.addLadder(868100000, 125000, 7, 12, 2);
+    size_t packets = AdaptiveDataRate::Options().window;
+
+    bool passed = true;
+    uint8_t payload[16] = {0};
+    for (uint32_t peer = 0; peer < sizeof(links) / sizeof(links[0]); peer++)
+    {
+        const Link &link = links[peer];
+        SimulatedSX127x::InjectOptions inject;
+        inject.rssi = link.rssi_dbm;
+        inject.snr = link.snr_db;
+
+        for (size_t i = 0; i < packets; i++)
+        {
+            RFM95::RxPacket packet;
+            sim->injectPacket(payload, sizeof(payload), inject);
+            radio.serviceReceiver();
+            if (!radio.readPacket(packet))
+            {
+                std::cerr << "adr: packet " << i << " of link " << peer << " was not received" << std::endl;
+                return 1;
+            }
+
+            // The peer sends with the profile selected for it
+            adr.observe(peer, packet, adr.getProfileIndex(peer));
+        }
+
+        RadioProfile selected = adr.getProfile(peer);
+        int sf = (selected.modem_config_2 >> 4) & 0x0F;
+        if (sf != link.sf || selected.powerDbm() != link.power_dbm)
+        {
+            AdaptiveDataRate::LinkState state = adr.getLinkState(peer);
+            std::cerr << "adr: link " << peer << " (" << link.rssi_dbm << " dBm, " << link.snr_db
+                      << " dB) selected SF" << sf << " at " << selected.powerDbm() << " dBm, expected SF" << link.sf
+                      << " at " << link.power_dbm << " dBm; mean RSSI " << state.rssi_dbm << " dBm, SNR "
+                      << state.snr_db << " dB" << std::endl;
+            passed = false;
+        }
+    }
+
+    radio.stopRxEngine();
+    radio.end();
+    return passed ? 0 : 1;
+}